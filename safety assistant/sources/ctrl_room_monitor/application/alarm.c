@@ -0,0 +1,438 @@
+/******************************************************************************/
+
+/* File - alarm.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Alarm engine of the evaluation thread. See alarm.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "sched.h"
+#include "ipc.h"
+#include "db.h"
+#include "alarm.h"
+
+/******************************************************************************/
+
+/* Topic of the alarm pushes
+*/
+#define ALARM_TOPIC             "alarm"
+
+/* Points kept per rate rule. A point is taken every window / (points / 2),
+*  so the ring always reaches back at least one window.
+*/
+#define ALARM_RATE_POINTS       (32)
+
+/* Events waiting for the database, and the retry interval while it is not
+*  available or busy with a storage cycle. The oldest event is dropped on
+*  overflow.
+*/
+#define ALARM_MAX_PENDING       (64)
+#define ALARM_RETRY_MS          (1000)
+
+#define NSEC_PER_SEC            (1000000000LL)
+
+typedef enum
+{
+    ALARM_KIND_HIGH = 0,
+    ALARM_KIND_LOW,
+    ALARM_KIND_RISE,
+    ALARM_KIND_FALL
+} alarm_kind_t;
+
+typedef struct
+{
+    db_alarm_rule_t rule;
+    alarm_kind_t    kind;
+    uint8_t         is_active;
+    uint32_t        count;                      // Consecutive samples towards a transition
+    double          value;                      // Value (or rate) of the last transition
+    time_t          since;
+    int64_t         t_ns[ALARM_RATE_POINTS];    // Rate rules only
+    int32_t         val[ALARM_RATE_POINTS];
+    uint8_t         head;
+    uint8_t         num_points;
+} alarm_rule_t;
+
+typedef struct
+{
+    uint32_t rule_id;
+    uint16_t sen_id;
+    uint8_t  state;
+    double   value;
+    double   threshold;
+    time_t   alarm_time;
+} alarm_event_t;
+
+/******************************************************************************/
+
+static alarm_rule_t  rules[ALARM_MAX_RULES];
+static uint16_t      num_rules = 0;
+
+static alarm_event_t pending[ALARM_MAX_PENDING];
+static uint16_t      pending_head = 0;
+static uint16_t      pending_count = 0;
+static sched_task_t  retry_task;
+
+/******************************************************************************/
+
+/* Function declaration to (re)load the rules, rules kept with the same ID and
+*  parameters keep their state
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+static uint8_t alarm_load(void);
+
+/* Function declaration to get the rate of change of a rate rule
+*  @param[out] p_rate - Units per minute
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if there is no window of data yet )
+*/
+static uint8_t alarm_rate(alarm_rule_t * p_rule, const sample_t * p_sample, double * p_rate);
+
+/* Function declaration to publish and store a transition
+*/
+static void    alarm_raise(alarm_rule_t * p_rule, uint8_t state, time_t alarm_time);
+
+/* Function declaration to store the pending events until the first failure
+*  @return - uint8_t ( SUCCESS(1) if none is left, FAIL(0) )
+*/
+static uint8_t alarm_flush(void);
+
+static void    retry_task_fn(sched_task_t * p_task);
+
+/* Function declarations of the control commands
+*/
+static uint8_t alarm_cmd_alarms(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t alarm_cmd_reload(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t alarm_init(void)
+{
+    sched_task_init(&retry_task, retry_task_fn, NULL);
+
+    // Commands are added even without rules, so RELOAD can pick them up later
+    ipc_register_cmd("ALARMS", alarm_cmd_alarms, "ALARMS");
+    ipc_register_cmd("RELOAD", alarm_cmd_reload, "RELOAD");
+
+    return alarm_load();
+}
+
+void alarm_eval(const sample_t * p_sample)
+{
+    alarm_rule_t *p_rule;
+    uint16_t      i;
+    double        metric, threshold;
+    uint8_t       is_crossed;
+
+    for (i = 0; i < num_rules; i++)
+    {
+        p_rule = &rules[i];
+        if (p_rule->rule.sen_id != p_sample->sen_id)
+        {
+            continue;
+        }
+
+        // Everything is checked as a "high" condition, low and fall rules
+        // are mirrored (a fall threshold is a positive rate already)
+        if ((ALARM_KIND_RISE == p_rule->kind) || (ALARM_KIND_FALL == p_rule->kind))
+        {
+            if (SUCCESS != alarm_rate(p_rule, p_sample, &metric))
+            {
+                continue;
+            }
+        }
+        else
+        {
+            metric = (double)p_sample->sen_val / SAMPLE_SCALE;
+        }
+
+        threshold = p_rule->rule.threshold;
+        if (ALARM_KIND_LOW == p_rule->kind)
+        {
+            metric = -metric;
+            threshold = -threshold;
+        }
+        else if (ALARM_KIND_FALL == p_rule->kind)
+        {
+            metric = -metric;
+        }
+
+        if (!p_rule->is_active)
+        {
+            is_crossed = (metric >= threshold);
+        }
+        else
+        {
+            is_crossed = (metric < (threshold - p_rule->rule.hysteresis));
+        }
+
+        if (!is_crossed)
+        {
+            p_rule->count = 0;
+            continue;
+        }
+
+        if (++p_rule->count < p_rule->rule.debounce)
+        {
+            continue;
+        }
+        p_rule->count = 0;
+        p_rule->is_active = !p_rule->is_active;
+        p_rule->value = ((ALARM_KIND_LOW == p_rule->kind) ||
+                         (ALARM_KIND_FALL == p_rule->kind)) ? (-metric) : (metric);
+        p_rule->since = (time_t)p_sample->sen_time;
+
+        alarm_raise(p_rule, p_rule->is_active, (time_t)p_sample->sen_time);
+    }
+}
+
+void alarm_close(void)
+{
+    sched_stop(&retry_task);
+
+    if ((SUCCESS != alarm_flush()) && (pending_count > 0))
+    {
+        printf("%u alarm event(s) not stored.\n", pending_count);
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t alarm_load(void)
+{
+    static db_alarm_rule_t loaded[ALARM_MAX_RULES];
+    static alarm_rule_t    old_rules[ALARM_MAX_RULES];
+    uint16_t               num_loaded, num_old, i, j;
+    alarm_kind_t           kind;
+    uint8_t                ret_val;
+
+    ret_val = db_load_alarm_rules(loaded, ALARM_MAX_RULES, &num_loaded);
+    if (SUCCESS != ret_val)
+    {
+        return ret_val;
+    }
+
+    memcpy(old_rules, rules, num_rules * sizeof(alarm_rule_t));
+    num_old = num_rules;
+    num_rules = 0;
+
+    for (i = 0; i < num_loaded; i++)
+    {
+        if (0 == strcmp(loaded[i].kind, "high"))
+        {
+            kind = ALARM_KIND_HIGH;
+        }
+        else if (0 == strcmp(loaded[i].kind, "low"))
+        {
+            kind = ALARM_KIND_LOW;
+        }
+        else if (0 == strcmp(loaded[i].kind, "rise"))
+        {
+            kind = ALARM_KIND_RISE;
+        }
+        else if (0 == strcmp(loaded[i].kind, "fall"))
+        {
+            kind = ALARM_KIND_FALL;
+        }
+        else
+        {
+            printf("Alarm rule %u has unknown kind '%s', ignored.\n", loaded[i].rule_id,
+                                                                        loaded[i].kind);
+            continue;
+        }
+
+        if (((ALARM_KIND_RISE == kind) || (ALARM_KIND_FALL == kind)) && (0 == loaded[i].window_s))
+        {
+            printf("Alarm rule %u has no rate window, ignored.\n", loaded[i].rule_id);
+            continue;
+        }
+        if (0 == loaded[i].debounce)
+        {
+            loaded[i].debounce = 1;
+        }
+
+        for (j = 0; j < num_old; j++)
+        {
+            if (0 == memcmp(&old_rules[j].rule, &loaded[i], sizeof(db_alarm_rule_t)))
+            {
+                break;
+            }
+        }
+
+        if (j < num_old)
+        {
+            rules[num_rules] = old_rules[j];
+        }
+        else
+        {
+            memset(&rules[num_rules], 0, sizeof(alarm_rule_t));
+            rules[num_rules].rule = loaded[i];
+            rules[num_rules].kind = kind;
+        }
+        num_rules++;
+    }
+
+    #if defined(RUN_TIME_LOG)
+        printf("%d alarm rule(s) loaded.\n", num_rules);
+    #endif
+
+    return SUCCESS;
+}
+
+static uint8_t alarm_rate(alarm_rule_t * p_rule, const sample_t * p_sample, double * p_rate)
+{
+    int64_t  window_ns = (int64_t)p_rule->rule.window_s * NSEC_PER_SEC;
+    int64_t  age_ns;
+    uint8_t  i, index, ref;
+    uint8_t  is_ref_found = 0;
+
+    // Points newest first, the reference is the newest one at least a window
+    // old, or the oldest one once the ring is full
+    for (i = 0; i < p_rule->num_points; i++)
+    {
+        index = (uint8_t)((p_rule->head + ALARM_RATE_POINTS - 1 - i) % ALARM_RATE_POINTS);
+        if ((p_sample->t_acq_ns - p_rule->t_ns[index]) >= window_ns)
+        {
+            ref = index;
+            is_ref_found = 1;
+            break;
+        }
+    }
+    if (!is_ref_found && (ALARM_RATE_POINTS == p_rule->num_points))
+    {
+        ref = p_rule->head;
+        is_ref_found = 1;
+    }
+
+    if (is_ref_found)
+    {
+        age_ns = p_sample->t_acq_ns - p_rule->t_ns[ref];
+        *p_rate = (age_ns > 0) ?
+            ((double)(p_sample->sen_val - p_rule->val[ref]) / SAMPLE_SCALE * 60.0 * NSEC_PER_SEC /
+                                                                        age_ns) : (0.0);
+    }
+
+    index = (uint8_t)((p_rule->head + ALARM_RATE_POINTS - 1) % ALARM_RATE_POINTS);
+    if ((0 == p_rule->num_points) ||
+        ((p_sample->t_acq_ns - p_rule->t_ns[index]) >= (window_ns / (ALARM_RATE_POINTS / 2))))
+    {
+        p_rule->t_ns[p_rule->head] = p_sample->t_acq_ns;
+        p_rule->val[p_rule->head] = p_sample->sen_val;
+        p_rule->head = (p_rule->head + 1) % ALARM_RATE_POINTS;
+        if (p_rule->num_points < ALARM_RATE_POINTS)
+        {
+            p_rule->num_points++;
+        }
+    }
+
+    return (is_ref_found) ? (SUCCESS) : (FAIL);
+}
+
+static void alarm_raise(alarm_rule_t * p_rule, uint8_t state, time_t alarm_time)
+{
+    alarm_event_t *p_event;
+
+    ipc_publish(ALARM_TOPIC, p_rule->rule.sen_id, "%u %d %s %0.3f %0.3f %ld",
+                p_rule->rule.rule_id, p_rule->rule.sen_id, (state) ? ("RAISE") : ("CLEAR"),
+                p_rule->value, p_rule->rule.threshold, (long)alarm_time);
+
+    #if defined(RUN_TIME_LOG)
+        printf("Alarm rule %u sensor ID=%d %s, value=%0.3f.\n", p_rule->rule.rule_id,
+                p_rule->rule.sen_id, (state) ? ("raised") : ("cleared"), p_rule->value);
+    #endif
+
+    if (ALARM_MAX_PENDING == pending_count)
+    {
+        printf("Alarm event of rule %u dropped.\n", pending[pending_head].rule_id);
+        pending_head = (pending_head + 1) % ALARM_MAX_PENDING;
+        pending_count--;
+    }
+
+    p_event = &pending[(pending_head + pending_count) % ALARM_MAX_PENDING];
+    p_event->rule_id = p_rule->rule.rule_id;
+    p_event->sen_id = p_rule->rule.sen_id;
+    p_event->state = state;
+    p_event->value = p_rule->value;
+    p_event->threshold = p_rule->rule.threshold;
+    p_event->alarm_time = alarm_time;
+    pending_count++;
+
+    // Events keep their order, nothing is written while older ones wait.
+    // During a storage cycle the event waits for the retry as well.
+    if (!sched_is_pending(&retry_task) && (SUCCESS != alarm_flush()))
+    {
+        sched_after(&retry_task, ALARM_RETRY_MS);
+    }
+}
+
+static uint8_t alarm_flush(void)
+{
+    alarm_event_t *p_event;
+
+    while (pending_count > 0)
+    {
+        p_event = &pending[pending_head];
+        if (SUCCESS != db_store_alarm(p_event->rule_id, p_event->sen_id, p_event->state,
+                                    p_event->value, p_event->threshold, p_event->alarm_time))
+        {
+            return FAIL;
+        }
+        pending_head = (pending_head + 1) % ALARM_MAX_PENDING;
+        pending_count--;
+    }
+
+    return SUCCESS;
+}
+
+static void retry_task_fn(sched_task_t * p_task)
+{
+    if (SUCCESS != alarm_flush())
+    {
+        sched_after(p_task, ALARM_RETRY_MS);
+    }
+}
+
+static uint8_t alarm_cmd_alarms(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    uint16_t i;
+
+    for (i = 0; i < num_rules; i++)
+    {
+        if (rules[i].is_active)
+        {
+            ipc_reply(p_client, "ALM %u %d %s %0.3f %0.3f %ld", rules[i].rule.rule_id,
+                      rules[i].rule.sen_id, rules[i].rule.kind, rules[i].value,
+                      rules[i].rule.threshold, (long)rules[i].since);
+        }
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t alarm_cmd_reload(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    uint8_t ret_val;
+
+    ret_val = alarm_load();
+    if (SUCCESS != ret_val)
+    {
+        *p_err = (DB_BUSY == ret_val) ? ("database busy") : ("database error");
+        return FAIL;
+    }
+
+    ipc_reply(p_client, "RULES %d", num_rules);
+
+    return SUCCESS;
+}
@@ -0,0 +1,65 @@
+/******************************************************************************/
+
+/* File - alarm.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Alarm engine of the evaluation thread. Every sample is checked against the
+*  rules of its sensor from the 'alarm_rules' table as soon as it is acquired,
+*  instead of waiting for the next dashboard poll. Kinds of rules:
+*
+*     high  - value >= threshold
+*     low   - value <= threshold
+*     rise  - rate of change >= threshold (units per minute)
+*     fall  - rate of change <= -threshold (units per minute)
+*
+*  The rate is taken over the last 'window_s' seconds. An alarm is raised
+*  once the condition held for 'debounce' consecutive samples and cleared once
+*  the value is back by 'hysteresis' (e.g. high 27.5 with hysteresis 3.0
+*  clears below 24.5) for as many samples. Transitions are stored in the
+*  'alarms' table and pushed over the control socket (see ipc.h):
+*
+*     SUB alarm [sen_id]    - "PUB alarm <rule_id> <sen_id> RAISE|CLEAR <value>
+*                             <threshold> <time>" per transition
+*     ALARMS                - One "ALM <rule_id> <sen_id> <kind> <value>
+*                             <threshold> <since>" line per active alarm
+*     RELOAD                - Reload the rules from the database
+*/
+
+/******************************************************************************/
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Maximum number of rules in use
+*/
+#define ALARM_MAX_RULES         (64)
+
+/******************************************************************************/
+
+/* Function declaration to load the rules and add the ALARMS and RELOAD
+*  commands to the control socket. Evaluation thread only.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the rules could not be loaded )
+*/
+uint8_t alarm_init(void);
+
+/* Function declaration to check a sample against the rules of its sensor.
+*  Evaluation thread only.
+*  @param[in] p_sample - Sample
+*  @return - None
+*/
+void alarm_eval(const sample_t * p_sample);
+
+/* Function declaration to make a last attempt to store the pending alarm
+*  events
+*  @return - None
+*/
+void alarm_close(void);
+
+#endif /* ALARM_H */
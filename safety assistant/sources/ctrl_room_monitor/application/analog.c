@@ -0,0 +1,97 @@
+/******************************************************************************/
+
+/* File - analog.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Processing of the analog sensors. See analog.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+
+#include "common.h"
+#include "config.h"
+#include "conv.h"
+#include "analog.h"
+
+/******************************************************************************/
+
+// Dust: trimmed mean of the pulses drops the reads hit by an LED edge or an
+// interrupt, then single burst spikes are replaced by the recent median
+static const filter_cfg_t dust_filter_def =
+{
+    .burst_mode = FILTER_MODE_TRIMMED,
+    .mode       = FILTER_MODE_NONE,
+    .trim       = 4,
+    .window     = 9,
+    .mad_k      = 4.0f,
+    .mad_floor  = 4.0f,
+    .ema_alpha  = 0.0f
+};
+
+// Humidity: changes slowly, so the output is smoothed by an EMA as well
+static const filter_cfg_t hsm_filter_def =
+{
+    .burst_mode = FILTER_MODE_MEDIAN,
+    .mode       = FILTER_MODE_NONE,
+    .trim       = 0,
+    .window     = 9,
+    .mad_k      = 4.0f,
+    .mad_floor  = 2.0f,
+    .ema_alpha  = 0.3f
+};
+
+/******************************************************************************/
+
+uint8_t analog_init(analog_t * p_analog, sensor_type_t type, uint16_t sen_id)
+{
+    char prefix[CONFIG_MAX_KEY_LEN];
+
+    p_analog->type = type;
+    p_analog->sen_id = sen_id;
+    snprintf(prefix, sizeof(prefix), "filter.%d", sen_id);
+
+    switch (type)
+    {
+        case SENSOR_TYPE_GP2Y:
+            return filter_init_from_config(&p_analog->filter, &dust_filter_def, prefix);
+
+        case SENSOR_TYPE_HSM:
+            return filter_init_from_config(&p_analog->filter, &hsm_filter_def, prefix);
+
+        default:
+            printf("Sensor ID=%d is not an analog sensor.\n", sen_id);
+            return FAIL;
+    }
+}
+
+int32_t analog_process(analog_t * p_analog, int32_t * p_adc, uint8_t num)
+{
+    float   adc_val;
+    uint8_t is_spike = 0;
+
+    // Burst reduced to one ADC count, then spikes between bursts rejected
+    adc_val = filter_reduce(&p_analog->filter, p_adc, num);
+    adc_val = filter_update(&p_analog->filter, adc_val, &is_spike);
+
+    #if defined(RUN_TIME_LOG)
+        if (is_spike)
+        {
+            printf("Sensor ID=%d spike rejected, %u so far.\n", p_analog->sen_id,
+                                                        p_analog->filter.num_spikes);
+        }
+    #endif
+
+    if (SENSOR_TYPE_GP2Y == p_analog->type)
+    {
+        // Dust density from the sensor output voltage, 0.0 up to 0.6 V, cut
+        // off at 0.6 mg/m3 from 3.5 V on (see conv_ref.h)
+        return conv_gp2y(adc_val);
+    }
+
+    // Humidity from the analog voltage, quadratic fit of the datasheet curve
+    // (see conv_ref.h)
+    return conv_hsm(adc_val);
+}
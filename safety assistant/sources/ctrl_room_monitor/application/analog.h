@@ -0,0 +1,60 @@
+/******************************************************************************/
+
+/* File - analog.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Processing of the analog sensors (GP2Y1010AU dust, HSM-20G humidity): a
+*  burst of ADC counts is reduced and filtered (see filter.h), then converted
+*  to the sample value (see conv.h). The application and the trace replay
+*  (see trace.h) run the same code, so a replay filters as the field did.
+*/
+
+/******************************************************************************/
+
+#ifndef ANALOG_H
+#define ANALOG_H
+
+#include <stdint.h>
+
+#include "filter.h"
+#include "registry.h"
+
+/******************************************************************************/
+
+/* Keys of the analog sensors in the 'sensors' table
+*/
+#define DUST_SENSOR_KEY             "GP2Y-A0"
+#define HUMIDITY_SENSOR_KEY         "HSM-A1"
+
+/* Processing state of an analog sensor
+*/
+typedef struct
+{
+    filter_t      filter;
+    sensor_type_t type;
+    uint16_t      sen_id;
+} analog_t;
+
+/******************************************************************************/
+
+/* Function declaration to set up the processing of an analog sensor. Its
+*  filter takes the defaults of the sensor type, overridden by the
+*  'filter.<sen_id>.*' keys (see app.conf).
+*  @param[out] p_analog - Processing state
+*  @param[in]  type     - SENSOR_TYPE_GP2Y or SENSOR_TYPE_HSM
+*  @param[in]  sen_id   - Sensor ID
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on an unknown type or a bad filter
+*            configuration )
+*/
+uint8_t analog_init(analog_t * p_analog, sensor_type_t type, uint16_t sen_id);
+
+/* Function declaration to turn a burst of ADC counts into a sample value
+*  @param[in]     p_analog - Processing state
+*  @param[in,out] p_adc    - ADC counts, reordered by the reduction
+*  @param[in]     num      - Number of counts (1 ~ FILTER_MAX_WINDOW)
+*  @return - int32_t (dust density in 0.01 mg/m3 or humidity in 0.01 %RH)
+*/
+int32_t analog_process(analog_t * p_analog, int32_t * p_adc, uint8_t num);
+
+#endif /* ANALOG_H */
@@ -5,9 +5,15 @@
 *  Target Hardware: SIEMENS IoT2020
 *  
 *  This module used to acquire data from different sensors (DS18B20, HSG-20G, 
-*  GP2Y1010AU) using Intel low level skeleton mraa library. Acquired data then
+*  GP2Y1010AU) using Intel low level skeleton mraa library (through the HAL in
+*  hal.h, so it also runs on simulated sensors). Acquired data then
 *  store to SQLite database for generation of trend as well as other function
 *  tailored to application of safety assistant for industrial control system.
+*
+*  Every sensor is sampled by its own scheduler task (sched.h) with a period
+*  and phase taken from the configuration file, see app.conf. DS18B20 probes
+*  are sampled by the thread of their 1-wire bus (see owbus.h), the samples
+*  of all buses are merged into the stream of this thread.
 *   
 *  Version - 1.0 (May, 2017)
 */
@@ -17,208 +23,232 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
 #include <assert.h>
-#include <sqlite3.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
 
-#include "mraa.h"
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "sched.h"
+#include "dust.h"
+#include "filter.h"
+#include "analog.h"
+#include "lat.h"
+#include "registry.h"
+#include "db.h"
+#include "sample.h"
+#include "storage.h"
+#include "eval.h"
+#include "alarm.h"
+#include "load.h"
+#include "owbus.h"
+#include "stats.h"
+#include "trace.h"
 
 /******************************************************************************/
 
-/* The predefine symbol below 'RUN_TIME_LOG' used to print runtime data such as
-*  DS18B20 ROM content, temperature value, sqlite data stored successfully 
-*  etc. If you need to print those, then uncomment the below and build again.  
+/* Configuration file loaded at start-up if present, '-c' loads another one
 */
-//#define RUN_TIME_LOG
+#define CONFIG_PATH                 "/home/root/ctrl_room_monitor/application/app.conf"
 
-#define SUCCESS    (1)
-#define FAIL       (0)
+/* Dust sensor pulse engine: pulses per burst ('dust.samples'), SCHED_FIFO
+*  priority of the pulse thread ('dust.rt_priority', 0 for normal scheduling)
+*  and memory locking ('dust.mlockall'). Timing statistics of the sample point
+*  are printed every DUST_JITTER_REPORT bursts ('dust.jitter_report', 0 = off).
+*/
+#define DUST_SAMPLES                (16)
+#define DUST_RT_PRIORITY            (0)
+#define DUST_LOCK_MEMORY            (0)
+#define DUST_JITTER_REPORT          (0)
+
+/* ADC readings of the humidity sensor per sample, reduced to one value by
+*  the 'burst_mode' of its filter ('humidity.samples')
+*/
+#define HUMIDITY_SAMPLES            (8)
 
-/* Define DS18B20 search type in order to issue as new search (new iteration) 
-*  or continue with previous search (required for multiple sensors)
+/* Control socket serving the latest sensor values ('ipc.socket'), see ipc.h
 */
-#define NEW_SEARCH                  (1)
-#define CONTINUE_WITH_PREV_SEARCH   (0)
+#define IPC_SOCKET_PATH             "/var/run/ctrl_room_monitor.sock"
 
-/* Command to to issue read scratchpad and start temperature conversion 
-*  respectively from DS18B20
+/* Acquisition jitter (task run time versus deadline) and sample-to-disk
+*  latency are printed every STATS_REPORT_MS ('stats.report_ms', 0 = off)
+*  and at shutdown
 */
-#define CMD_READ_SCRATCHPAD         (0xBE)
-#define CMD_START_TEMP_CONV         (0x44)
+#define STATS_REPORT_MS             (0)
 
-/* Define the size of address ROM (8 bytes) of DS18B20 family. Define the number
-*  of sensor(s) used in application. For me - 2 sensors used
+/* Capture of the raw sensor readings ('trace.path', empty = off) for the
+*  'replay' tool, up to 'trace.max_mb' MiB, see trace.h
 */
-#define DS18B20_ADDR_LEN            (MRAA_UART_OW_ROMCODE_SIZE)
-#define NUM_OF_SENSORS              (2)
+#define TRACE_PATH                  ""
 
 /* SQLite3 database path to store temperature for future usage
 */
 #define DATABASE_PATH               "/home/root/ctrl_room_monitor/database/ctrl_db.db"
 
+/* Set to (1) in order to switch the database to WAL journal mode. Node-RED
+*  reads the same database, WAL lets it do so without blocking the writer.
+*/
+#define DATABASE_WAL_MODE           (0)
+
 /******************************************************************************/
 
+// GPIO instance and pin number to trigger IR LED of dust 
+// sensor (GP2Y1010AU)
+// AIO instance and pin number to read data from dust sensor
+static hal_gpio_t *  dust_gpio_path;
+static hal_aio_t *   dust_aio_path;
+static const uint8_t dust_ir_led_pin = 4;
+static const uint8_t dust_aio_in = 0;
+
+// AIO instance and pin number to read humidity from hsm-20g sensor
+static hal_aio_t *   hsm_aio_path;
+static const uint8_t hsm_aio_in  = 1;
+
+// Burst in progress on the dust pulse thread, collected by 'dust_collect_task'.
+// Bursts given up on are dropped once they arrive.
+static sched_task_t  dust_collect_task;
+static uint8_t       dust_busy = 0;
+static uint16_t      dust_polls = 0;
+static uint16_t      dust_stale = 0;
+static uint32_t      dust_bursts = 0;
+static dust_jitter_t dust_jitter;
+
+// Task run time versus deadline of the analog sensor tasks
+static lat_t         acq_jitter;
+static sched_task_t  report_task;
+
+// SIGTERM and SIGINT arrive here instead of killing the application
+static int           signal_fd = -1;
+static sched_fd_t    signal_watch;
+static uint8_t       app_stop = 0;
+
+// Set by any task on a fatal error, stops the scheduler loop
+static uint8_t       app_failed = 0;
+
+// Filters and conversion of the analog channels, defaults may be overridden
+// per sensor by 'filter.<sen_id>.*' keys (see analog.h, filter.h)
+static analog_t      dust_analog;
+static analog_t      hsm_analog;
+
 /******************************************************************************/
 
-/* Definition of enumerated type with the keywords, will be used in this application
+/* Function declaration to read humidity as percentage from HSM-20G sensor,
+*  the ADC readings are captured (see trace.h) and filtered by 'hsm_analog'
+*  before conversion
+*  @param[in]  hsm_aio_path - AIO instance returned by hal_aio_init() function
+*  @param[out] p_humidity   - Humidity in 0.01 %RH (see conv.h)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the ADC read failed )
 */
-typedef enum 
-{
-	NONE = 0, 
-	START_CONV,
-	WAIT_TILL_CONV_FINISHED,
-	READ_TEMP,
-	READ_DUST_CONCENTRATION,
-	READ_HUMIDITY,
-	WAIT
-} app_states_t;
+static uint8_t hsm_read_humidity(hal_aio_t * hsm_aio_path, int32_t * p_humidity);
 
-/******************************************************************************/
+/* Scheduler task functions. 'p_task->p_arg' of a sensor task is its sensor_t.
+*/
+static void dust_task(sched_task_t * p_task);
+static void dust_collect_task_fn(sched_task_t * p_task);
+static void humidity_task(sched_task_t * p_task);
+static void report_task_fn(sched_task_t * p_task);
+static void signal_fn(sched_fd_t * p_watch);
 
-/* Function declaration to read temperature data from DS18B20. In this application 
-*  the default resolution (12-bit) is used.
-*  @param[in] uart_path - UART instance returned by  mraa_uart_ow_init() function
-*  @param[in] sen_addr  - 8-byte ROM address of DS18B20
-*  @param[in] p_temp    - a float pointer which contains temperature in degree celsius
-*                         upon a valid read 
-*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+/* Scheduler observer, profiles every acquisition task while the stats
+*  region is open
 */
-static uint8_t ds18b20_read_temp_float(mraa_uart_ow_context uart_path, uint8_t 
-                                        sen_addr[DS18B20_ADDR_LEN], float * p_temp);
+static void app_observer(const sched_task_t * p_task, int64_t run_ns);
 
-/* Function declaration to update i.e. start conversion in this case a specified DS18B20 
-*  with its address. 
-*  @param[in] uart_path - UART instance returned by  mraa_uart_ow_init() function
-*  @param[in] sen_addr  - 8-byte ROM address of DS18B20
+/* Function declaration to schedule the tasks of the analog sensors, the
+*  DS18B20 are scheduled by the threads of their buses
 *  @return - None
 */
-static void ds18b20_update(mraa_uart_ow_context uart_path, 
-                            uint8_t sen_addr[DS18B20_ADDR_LEN]);
-
-/* Function declaration to read analog output voltage corresponding to dust 
-*  concentration in air from GP2Y1010AU sensor 
-*  @param[in] dust_gpio_path - GPIO instance returned by mraa_gpio_init() function 
-*  @param[in] dust_aio_path  - AIO instance returned by mraa_aio_init() function
-*  @return - float (Dust concentration in term of voltage)
-*/
-static float gp2y_read_dust_output_voltage_float(mraa_gpio_context dust_gpio_path, 
-                                                   mraa_aio_context dust_aio_path);
+static void app_schedule_sensors(void);
 
-/* Function declaration to read humidity as percentage from HSM-20G sensor 
-*  @param[in] hsm_aio_path  - AIO instance returned by mraa_aio_init() function
-*  @return - float (Humidity in percentage)
+/* Function declaration to hand a sample over to the storage and evaluation
+*  threads
+*  @param[in] sen_id  - Sensor ID
+*  @param[in] sen_val - Sensor value in 1 / SAMPLE_SCALE units
+*  @return - None
 */
-static float hsm_read_humidity_float(mraa_aio_context hsm_aio_path);
+static void app_store_sample(uint16_t sen_id, int32_t sen_val);
 
-/* Function declaration to store sensor(s) data to sqlite3 database
-*  @param[in] sen_id  - Sensor ID as uint8_t
-*  @param[in] sen_val - Sensor value as float
-*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+/* Function declaration to hand a timestamped sample over to the storage and
+*  evaluation threads, the samples of the 1-wire buses come in here as well
+*  @param[in] p_sample - Sample
+*  @return - None
 */
-static uint8_t store_data_to_db(uint8_t sen_id, float sen_val);
+static void app_submit_sample(const sample_t * p_sample);
 
 /******************************************************************************/
 
 int main(int argc, char** argv) 
 {
-    // UART instance to talk to DS18B20 (1-wire over UART)
-    static mraa_uart_ow_context uart_path;
-    static mraa_result_t 		mraa_ret_val;
-	
-    // GPIO instance and pin number to trigger IR LED of dust 
-    // sensor (GP2Y1010AU)
-    // AIO instance and pin number to read data from dust sensor
-    static mraa_gpio_context dust_gpio_path;
-    static mraa_aio_context  dust_aio_path;
-    static const uint8_t dust_ir_led_pin = 4;
-    static const uint8_t dust_aio_in = 0;
-	
-    // AIO instance and pin number to read humidity from hsm-20g sensor
-    static mraa_aio_context  hsm_aio_path;
-    static const uint8_t     hsm_aio_in  = 1;
-	
-    static app_states_t state_index = NONE;
-	
-    static uint8_t ds18b20_addr[NUM_OF_SENSORS][DS18B20_ADDR_LEN] = {0};
-    static float   temp = 0.0;
-    static uint8_t sen_count = 0;
-    
-    static float humidity = 0.0;
-    
-    static float dust_concentration = 0.0;
-    static float acc_dust_concentration = 0.0;
-    static const uint8_t dust_sensor_max_sample = 16;
-    static uint8_t       dust_sensor_sample_count = 0;
-    static uint8_t       dust_data_coll_err = 0;
-    
-    // We choose '0' as the argument of 'mraa_uart_ow_init()' since we have
-    // only singel UART in IoT2020.
-    uart_path = mraa_uart_ow_init(0);
-    if (NULL == uart_path) 
-    {
-        printf("mraa_uart_ow_init() failed.\n");
-        return 1;
-    }
-    else
+    static hal_result_t  hal_ret_val;
+    static sensor_t *    p_dust_sen;
+    static sensor_t *    p_hum_sen;
+    uint8_t              ret_val;
+    uint32_t             report_ms;
+    sigset_t             sig_mask;
+    const char *         p_stats_path;
+    const char *         p_trace_path;
+
+    // Database path may be overridden with '-d', '-c' loads a config file
+    const char *p_db_path = DATABASE_PATH;
+    const char *p_config_path = CONFIG_PATH;
+    int         opt;
+
+    while (-1 != (opt = getopt(argc, argv, "d:c:")))
     {
-        printf("UART instance created.\n");
+        switch (opt)
+        {
+            case 'd':
+                p_db_path = optarg;
+            break;
+
+            case 'c':
+                p_config_path = optarg;
+            break;
+
+            default:
+                printf("Usage: %s [-d database_path] [-c config_file]\n", argv[0]);
+                return 1;
+        }
     }
-	
-    mraa_ret_val = mraa_uart_ow_reset(uart_path);
-    if (MRAA_SUCCESS == mraa_ret_val) 
-    {
-        printf("Reset succeeded, device(s) found on bus!\n");
-    } 
-    else 
+
+    // Without a config file every sensor uses the default period
+    if ((0 == access(p_config_path, R_OK)) && (SUCCESS != config_load(p_config_path)))
     {
-        printf("Reset failed, returned %d. No devices on bus?\n", mraa_ret_val);
-        
-	    mraa_uart_ow_stop(uart_path);
         return 1;
     }
 
-    printf("Seraching for devices.\n");
-    
-    mraa_ret_val = mraa_uart_ow_rom_search(uart_path, NEW_SEARCH, 
-                                                    ds18b20_addr[sen_count++]);
-    if (MRAA_ERROR_UART_OW_NO_DEVICES == mraa_ret_val) 
+    // Self-profiling region read by 'appstat' ('stats.path', empty to
+    // disable the hooks), the application runs the same without it
+    p_stats_path = config_get_str(STATS_PATH, "stats.path");
+    if (('\0' != p_stats_path[0]) && (SUCCESS != stats_open(p_stats_path)))
     {
-        printf("No devices detected.\n");
-        
-	    mraa_uart_ow_stop(uart_path);
-        return 1;
+        printf("Self-profiling not available.\n");
     }
-	
-    // Search the other sensors if we have multiple sensor connected on 
-    // the same bus.
-    if (NUM_OF_SENSORS > 1) 
-    {
-	    do 
-	    {
-		    mraa_ret_val = mraa_uart_ow_rom_search(uart_path, CONTINUE_WITH_PREV_SEARCH, 
-                                                                 ds18b20_addr[sen_count]);
-		    if (MRAA_ERROR_UART_OW_NO_DEVICES == mraa_ret_val) 
-		    {
-			    printf("Failed to find desired number of sensors on bus.\n");
-                
-			    mraa_uart_ow_stop(uart_path);
-			    return 1;
-		    }
-	    } while (NUM_OF_SENSORS != (++sen_count));
-    }
-    if (MRAA_ERROR_UART_OW_DATA_ERROR == mraa_ret_val) 
-    {
-        printf("Bus or data error.\n");
-        
-	    mraa_uart_ow_stop(uart_path);
+
+    // Signals are taken through 'signal_fd' by the scheduler loop, blocked
+    // before any thread is started so every thread inherits the mask
+    sigemptyset(&sig_mask);
+    sigaddset(&sig_mask, SIGTERM);
+    sigaddset(&sig_mask, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &sig_mask, NULL);
+    signal_fd = signalfd(-1, &sig_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    if (SUCCESS != hal_init())
+    {
+        printf("hal_init() failed.\n");
         return 1;
     }
 	
-    dust_gpio_path = mraa_gpio_init(dust_ir_led_pin);
+    dust_gpio_path = hal_gpio_init(dust_ir_led_pin);
     if (NULL == dust_gpio_path)
     {
 	    printf("Failed to open GPIO instance of pin %d.\n", dust_ir_led_pin);
-        
-	    mraa_uart_ow_stop(uart_path);
 	    return 1;
     }
     else
@@ -226,8 +256,8 @@ int main(int argc, char** argv)
 	    printf("GPIO instance of pin %d created.\n", dust_ir_led_pin);
     }
 	
-    mraa_ret_val = mraa_gpio_dir(dust_gpio_path, MRAA_GPIO_OUT);
-    if (MRAA_SUCCESS == mraa_ret_val) 
+    hal_ret_val = hal_gpio_dir_out(dust_gpio_path);
+    if (HAL_SUCCESS == hal_ret_val) 
     {
 	    printf("Config GPIO pin %d as output.\n", dust_ir_led_pin);
     }
@@ -235,18 +265,16 @@ int main(int argc, char** argv)
     {
 	    printf("Failed to config GPIO pin %d as output.\n", dust_ir_led_pin);
         
-	    mraa_gpio_close(dust_gpio_path);
-        mraa_uart_ow_stop(uart_path);
+	    hal_gpio_close(dust_gpio_path);
 	    return 1;
     }
 	
-    dust_aio_path = mraa_aio_init(dust_aio_in);
+    dust_aio_path = hal_aio_init(dust_aio_in);
     if (NULL == dust_aio_path)
     {
 	    printf("Failed to open AIO instance of pin %d.\n", dust_aio_in);
         
-	    mraa_gpio_close(dust_gpio_path);
-	    mraa_uart_ow_stop(uart_path);
+	    hal_gpio_close(dust_gpio_path);
 	    return 1;
     }
     else
@@ -254,383 +282,389 @@ int main(int argc, char** argv)
 	    printf("AIO instance of pin %d created.\n", dust_aio_in);
     }
     
-    hsm_aio_path = mraa_aio_init(hsm_aio_in);
+    hsm_aio_path = hal_aio_init(hsm_aio_in);
     if (NULL == hsm_aio_path)
     {
 	    printf("Failed to open AIO instance of pin %d.\n", hsm_aio_in);
         
-        mraa_gpio_close(dust_gpio_path);
-        mraa_aio_close(dust_aio_path);
-        mraa_uart_ow_stop(uart_path);
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
         return 1;
     }
     else
     {
         printf("AIO instance of pin %d created.\n", hsm_aio_in);
     }
-	
-    // Set the value of sensor counter to 0 in order start new iteration
-    sen_count = 0;
-    
-    for ( ; ; ) 
+
+    // Database stays open for the whole life time of the application
+    if (SUCCESS != db_open(p_db_path, DATABASE_WAL_MODE))
+    {
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
+        hal_aio_close(hsm_aio_path);
+        return 1;
+    }
+
+    // Database writes and evaluation of the samples run on threads of their
+    // own, the acquisition thread (this one) only hands samples over. Both
+    // run before the 1-wire buses, which start sampling right away.
+    if (SUCCESS != storage_start())
+    {
+        db_close();
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
+        hal_aio_close(hsm_aio_path);
+        return 1;
+    }
+
+    // The loads are driven by commands and rules of the evaluation thread,
+    // sampling goes on without them
+    if (SUCCESS != load_start())
     {
-        switch (state_index) 
+        printf("Load control not available.\n");
+    }
+
+    if (SUCCESS != eval_start(config_get_str(IPC_SOCKET_PATH, "ipc.socket")))
+    {
+        storage_stop();
+        load_stop();
+        db_close();
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
+        hal_aio_close(hsm_aio_path);
+        return 1;
+    }
+
+    // Raw readings are captured from the first one on, the sensors defined
+    // as they get their IDs. Sampling goes on without a capture.
+    p_trace_path = config_get_str(TRACE_PATH, "trace.path");
+    if ('\0' != p_trace_path[0])
+    {
+        trace_open(p_trace_path, (uint64_t)config_get_int(TRACE_MAX_MB, "trace.max_mb") << 20);
+    }
+
+    // Samples of the 1-wire buses arrive through descriptors watched by the
+    // scheduler of this thread
+    sched_init();
+    if (NULL != p_stats)
+    {
+        sched_set_observer(app_observer);
+    }
+
+    // Known sensors keep their IDs from the 'sensors' table. On a fresh
+    // database the DS18B20 get IDs in bus and search order, followed by dust
+    // and humidity sensor, i.e. the same IDs as the former fixed numbering.
+    if (SUCCESS != owbus_start(app_submit_sample))
+    {
+        storage_stop();
+        eval_stop();
+        load_stop();
+        db_close();
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
+        hal_aio_close(hsm_aio_path);
+        return 1;
+    }
+
+    p_dust_sen = registry_add_analog(DUST_SENSOR_KEY, SENSOR_TYPE_GP2Y);
+    p_hum_sen = registry_add_analog(HUMIDITY_SENSOR_KEY, SENSOR_TYPE_HSM);
+    ret_val = (NULL != p_dust_sen) && (NULL != p_hum_sen);
+
+    ret_val = ret_val && analog_init(&dust_analog, SENSOR_TYPE_GP2Y, p_dust_sen->sen_id) &&
+                         analog_init(&hsm_analog, SENSOR_TYPE_HSM, p_hum_sen->sen_id);
+
+    // IR LED pulses of the dust sensor run on their own thread
+    if (!ret_val || (SUCCESS != dust_start(dust_gpio_path, dust_aio_path,
+                                (uint8_t)config_get_int(DUST_SAMPLES, "dust.samples"),
+                                (int)config_get_int(DUST_RT_PRIORITY, "dust.rt_priority"),
+                                (uint8_t)config_get_int(DUST_LOCK_MEMORY, "dust.mlockall"))))
+    {
+        owbus_stop();
+        storage_stop();
+        eval_stop();
+        load_stop();
+        db_close();
+        hal_gpio_close(dust_gpio_path);
+        hal_aio_close(dust_aio_path);
+        hal_aio_close(hsm_aio_path);
+        return 1;
+    }
+    dust_jitter_reset(&dust_jitter);
+    lat_reset(&acq_jitter);
+
+    printf("%d DS18B20 sensor(s) in use on %u 1-wire bus(es).\n",
+                            registry_count_present(SENSOR_TYPE_DS18B20), owbus_count());
+
+    // Every analog sensor gets its own task
+    sched_task_init(&dust_collect_task, dust_collect_task_fn, p_dust_sen);
+    sched_task_init(&p_dust_sen->task, dust_task, p_dust_sen);
+    sched_task_init(&p_hum_sen->task, humidity_task, p_hum_sen);
+    sched_task_init(&report_task, report_task_fn, NULL);
+
+    app_schedule_sensors();
+    report_ms = (uint32_t)config_get_int(STATS_REPORT_MS, "stats.report_ms");
+    if (report_ms)
+    {
+        sched_start(&report_task, report_ms, report_ms);
+    }
+
+    if ((signal_fd < 0) || (SUCCESS != sched_watch(&signal_watch, signal_fd, signal_fn, NULL)))
+    {
+        printf("Signals not watched, SIGTERM ends the application without shutdown.\n");
+    }
+
+    while (!app_failed && !app_stop)
+    {
+        if (sched_run() < 0)
         {
-            // Nothing to do here, just moving forward
-            case NONE:
-                state_index = START_CONV;
-            break;
-			
-            case START_CONV:
-                ds18b20_update(uart_path, ds18b20_addr[sen_count]);
-                state_index = WAIT_TILL_CONV_FINISHED;
-            break;
-			
-            // A delay of 1 sec in order to finish the conversion
-            // Maximum conversion time 750 msecs (12-bit resolution)
-            case WAIT_TILL_CONV_FINISHED:
-                sleep(1);
-                state_index = READ_TEMP;
-            break;
-			
-            case READ_TEMP:
-                if (SUCCESS == ds18b20_read_temp_float(uart_path, ds18b20_addr[sen_count++], &temp)) 
-                {
-                    // NOTE: In database we writing fisrt sensor id starts from 1 instead of 0 here
-                    if (SUCCESS == store_data_to_db(sen_count, temp)) 
-                    {
-                        if (sen_count >= NUM_OF_SENSORS) 
-                        {
-                            // All temperature sensor read, time to collect dust concentration
-                            sen_count = 0;
-                            state_index = READ_DUST_CONCENTRATION;
-                        }
-                        else
-                        {
-                            // Start conversion of next DS18B20 sensor in case of multiple sensors
-                            // on the bus
-                            state_index = START_CONV;
-                        }
-                    }
-                    else
-                    {
-                        // Something bad happened, go to default case 
-                        printf("Failed to store data of sensor ID=%d.\n", sen_count);
-                        state_index = (WAIT + 1);
-                    }
-                }
-                else
-                {
-                    // Something bad happened, go to default case
-                    printf("Error in collecting ds18b20 sensor data.\n");
-                    state_index = (WAIT + 1);
-                }
-            break;
-			
-            case READ_DUST_CONCENTRATION:
-                dust_data_coll_err = 0;
-                acc_dust_concentration = 0.0;
-                
-                // In order to get a stable value from sensor, we are taking reading defined in
-                // 'dust_sensor_max_sample' variable. 
-                for (dust_sensor_sample_count = 0; dust_sensor_sample_count < dust_sensor_max_sample; 
-                                                                            dust_sensor_sample_count++)
-                {
-                    dust_concentration = gp2y_read_dust_output_voltage_float(dust_gpio_path, 
-                                                                                dust_aio_path);
-                                                                             
-                    if (dust_concentration >= 0.0) 
-                    {
-                        acc_dust_concentration += dust_concentration;
-                    }
-                    else
-                    {
-                        // Something bad happened, go to default case
-                        printf("Error in collecting dust sensor data.\n");
-                        
-                        dust_data_coll_err = 1;
-                    }
-                }
-				
-                if (dust_data_coll_err)
-                {
-                    state_index = (WAIT + 1);
-                }
-                else
-                {
-                    acc_dust_concentration = acc_dust_concentration / ((float)dust_sensor_max_sample);
-                    
-                    // Calculate dust density based on sensor output voltage and put the result
-                    // in same variable.
-                    // NOTE: Please check the below link understanding the calculation
-                    // https://github.com/nazmul21/IoT2020/tree/master/safety%20assistant/documents
-                    if (acc_dust_concentration <= 0.6)
-                    {
-                        // GP2Y1010AU can produce a valid dust concentration value after 0.6
-                        // If output voltage is equal or lower than this threshold, then we
-                        // define '0.0' as dust concentration.
-                        acc_dust_concentration = 0.0;
-                    }
-                    else if ((acc_dust_concentration > 0.6) && (acc_dust_concentration <= 3.5))
-                    {
-                        // This equlation is only valid for sensor output voltage in a range of (0 ~ 3.5)
-                        acc_dust_concentration = ( acc_dust_concentration - 0.6 ) / 5.8;
-                    }
-                    else 
-                    {
-                        // It seems from datasheet, the output voltage of GP2Y1010AU is almost constant                         
-                        // i.e. after 3.5V even though the dust concentration is going higher.
-                        // So, we cut off the dust concentration limit to '0.6'.
-                        acc_dust_concentration = 0.6;
-                    }
-				
-                    // NOTE: I choose (NUM_OF_SENSORS+1) as param 'sen_id', since this is my first 
-                    //    	 sensor beyond all the temperature sensor(s). 
-                    if (SUCCESS == store_data_to_db((NUM_OF_SENSORS + 1), acc_dust_concentration))
-                    {
-                        state_index = READ_HUMIDITY;
-                    }
-                    else
-                    {
-                        // Something bad happened, go to default case
-                        printf("Failed to store data of sensor ID=%d.\n", (NUM_OF_SENSORS + 1));
-                        state_index = (WAIT + 1);
-                    }
-                }
-            break;
-			
-            case READ_HUMIDITY:
-                humidity = hsm_read_humidity_float(hsm_aio_path);
-				
-                // NOTE: second sensor beyond all temperature sensors (NUM_OF_SENSORS+2)
-                if (SUCCESS == store_data_to_db((NUM_OF_SENSORS + 2), humidity))
-                {
-                    state_index = WAIT;
-                }
-                else
-                {
-                    // Something bad happened, go to default case
-                    printf("Failed to store data of sensor ID=%d.\n", (NUM_OF_SENSORS + 2));
-                    state_index = (WAIT + 1);
-                }
-            break;
-			
-            case WAIT:
-                sleep(60);
-                state_index = START_CONV;
             break;
-			
-            // Application shouldn't reach here. If there is an exception
-            // then loop forever here.
-            default:
-                printf("Something bad happened.\n");
-                
-                mraa_gpio_close(dust_gpio_path);
-                mraa_aio_close(dust_aio_path);
-                mraa_aio_close(hsm_aio_path);
-                mraa_uart_ow_stop(uart_path);
-                while(1);
-            break; 
         }
     }
-    return 0;
+
+    // A fatal error ends here as well. Samples not stored yet are kept in the
+    // spill file and the exit status lets the service manager restart the
+    // application.
+    if (!app_stop)
+    {
+        printf("Something bad happened.\n");
+    }
+
+    // Producers first, every sample taken so far is stored and evaluated
+    owbus_stop();
+    dust_stop();
+    trace_close();
+    storage_stop();
+    eval_stop();
+    load_stop();
+    lat_print(&acq_jitter, "Acquisition jitter");
+    stats_close();
+
+    db_close();
+    hal_gpio_close(dust_gpio_path);
+    hal_aio_close(dust_aio_path);
+    hal_aio_close(hsm_aio_path);
+
+    return (app_stop) ? (0) : (1);
 }
 
-/* Definition of read temperature data from DS18B20. 
+/* Dust sensor is due, a burst of pulses is requested from the pulse thread
+*  and collected once it is finished
 */
-static uint8_t ds18b20_read_temp_float(mraa_uart_ow_context uart_path, 
-									   uint8_t sen_addr[8], float * p_temp) 
+static void dust_task(sched_task_t * p_task)
 {
-    assert(NULL != uart_path);
-  
-    static const uint8_t ds18b20_scratchpad_len = 9;
-    uint8_t   ds18b20_scratchpad[ds18b20_scratchpad_len];
-     
-    #if defined(RUN_TIME_LOG)
-        printf("Device Family 0x%02x, ID %02x%02x%02x%02x%02x%02x CRC 0x%02x\n", 
-			sen_addr[0], sen_addr[6], sen_addr[5], sen_addr[4], sen_addr[3], 
-			sen_addr[2], sen_addr[1], sen_addr[7]);
-    #endif
-	
-    // Issue a scratchpad read command to the specified device
-    mraa_uart_ow_command(uart_path, CMD_READ_SCRATCHPAD, sen_addr);
-    
-    uint8_t i;
-    for (i = 0; i < ds18b20_scratchpad_len; i++) 
-    {
-        ds18b20_scratchpad[i] = (uint8_t)mraa_uart_ow_read_byte(uart_path);
-    }
-	
-    // Calculate the CRC based on value read from scratchpad
-    //  Check if the calculated CRC match with the device internal's
-    uint8_t crc = mraa_uart_ow_crc8(ds18b20_scratchpad, DS18B20_ADDR_LEN);
-    if (crc != ds18b20_scratchpad[8])
+    lat_add(&acq_jitter, p_task->late_ns);
+
+    if (dust_busy)
     {
-        printf("CRC Error.\n");
-		
-        return FAIL;
+        // Previous burst not collected yet, skip this period
+        return;
     }
-	
-    // Accumulate the high and low temperature data 
-    int16_t temp_adc_val = ( (((int16_t)ds18b20_scratchpad[1]) << 8) | 
-                                    ((int16_t)ds18b20_scratchpad[0]) );
-	
-    // Check if the temperature is negative or not
-    // If negative, then convert the 2's complement (negative) to binary (positive) 
-    // and return the temperature value
-    uint8_t is_temp_negative = (ds18b20_scratchpad[1] & 0x80) ? (1) : (0);
-    if (is_temp_negative) 
+
+    if (SUCCESS != dust_trigger())
     {
-        temp_adc_val = ( (int16_t)(~temp_adc_val) ) + 1;
-        temp_adc_val = -temp_adc_val;
+        printf("Error in collecting dust sensor data.\n");
+        stats_count(STATS_AIO_ERRORS, 1);
+        return;
     }
-    
-    *p_temp = (((float)temp_adc_val) * 0.0625); 
-	
-    return SUCCESS;
-}
 
-static void ds18b20_update(mraa_uart_ow_context uart_path, uint8_t sen_addr[8]) 
-{
-    assert(NULL != uart_path);
-	
-    // Issue a start conversion command to the specified device
-    mraa_uart_ow_command(uart_path, CMD_START_TEMP_CONV, sen_addr);
+    dust_busy = 1;
+    dust_polls = 0;
+    sched_after(&dust_collect_task, dust_burst_ms());
 }
 
-static float gp2y_read_dust_output_voltage_float(mraa_gpio_context dust_gpio_path, 
-                                                    mraa_aio_context dust_aio_path)
+static void dust_collect_task_fn(sched_task_t * p_task)
 {
-    assert(NULL != dust_gpio_path);
-    assert(NULL != dust_aio_path);
-	
-    mraa_result_t mraa_ret_val;
-    static uint16_t dust_adc_val = 0;
-    static float    dust_output_vol = 0.0;
-    
-    // Turn on IR LED and wait until the hold time of 0.28 msecs, which defined in
-    // datasheet
-    mraa_ret_val = mraa_gpio_write(dust_gpio_path, 1);
-    if (MRAA_SUCCESS == mraa_ret_val) 
+    sensor_t *     p_sen = (sensor_t *)p_task->p_arg;
+    dust_result_t  result;
+    int32_t        dust_density;
+    int32_t        adc_buf[DUST_MAX_SAMPLES];
+    uint8_t        i;
+    uint32_t       jitter_report;
+
+    // Bursts given up on earlier come first, their readings are outdated
+    while (dust_stale && (SUCCESS == dust_poll(&result)))
     {
-        #if defined(RUN_TIME_LOG)
-            printf("IR LED turned on.\n");
-        #endif
+        dust_stale--;
     }
-    else 
+
+    if (SUCCESS != dust_poll(&result))
     {
-        printf("Falied to turn on IR LED.\n");
-        return 0.0;
+        // Burst is late, e.g. the pulse thread was starved
+        if ((++dust_polls * DS18B20_CONV_POLL_MS) >= (dust_burst_ms() + DS18B20_CONV_TIMEOUT_MS))
+        {
+            // Sample skipped, the next period requests a new burst
+            printf("Dust sensor burst not finished.\n");
+            stats_count(STATS_AIO_ERRORS, 1);
+            dust_stale++;
+            dust_busy = 0;
+        }
+        else
+        {
+            sched_after(p_task, DS18B20_CONV_POLL_MS);
+        }
+        return;
     }
-    usleep(280);
-	
-    // Read dust concentration and wait until the rest of pulse 
-    // width period of 0.32 ms
-    dust_adc_val = mraa_aio_read(dust_aio_path);
-    usleep(40);
-    
-    // Turn off IR LED and wait until the rest of pulse cycle
-    // of 10 msecs. i.e (10 - 0.32) msecs = 9680 usecs
-    mraa_ret_val = mraa_gpio_write(dust_gpio_path, 0);
-    if (MRAA_SUCCESS == mraa_ret_val) 
+    dust_busy = 0;
+
+    if (result.error)
     {
-        #if defined(RUN_TIME_LOG)
-            printf("IR LED turned off.\n");
-        #endif
+        // Sample skipped, sampling goes on with the next period
+        printf("Error in collecting dust sensor data.\n");
+        stats_count(STATS_AIO_ERRORS, 1);
+        return;
     }
-    else 
+
+    dust_jitter_add(&dust_jitter, &result);
+    jitter_report = (uint32_t)config_get_int(DUST_JITTER_REPORT, "dust.jitter_report");
+    if (jitter_report && (0 == (++dust_bursts % jitter_report)))
     {
-        printf("Falied to turn off IR LED.\n");
-        return 0.0;
+        dust_jitter_print(&dust_jitter);
     }
-    usleep(9680);
-    
-    dust_output_vol = (((float)dust_adc_val/1023.0) * 5.0); 
-	
-    return dust_output_vol;
+
+    // Pulses of the burst reduced to one ADC count, spikes between bursts
+    // rejected, then converted to the dust density
+    for (i = 0; i < result.num_samples; i++)
+    {
+        adc_buf[i] = result.adc[i];
+    }
+    trace_aio(p_sen->sen_id, adc_buf, result.num_samples);
+    dust_density = analog_process(&dust_analog, adc_buf, result.num_samples);
+
+    // NOTE: 'sen_id' of the dust sensor comes from the 'sensors' table
+    app_store_sample(p_sen->sen_id, dust_density);
 }
 
-static float hsm_read_humidity_float(mraa_aio_context hsm_aio_path)
+static void humidity_task(sched_task_t * p_task)
 {
-    assert(NULL != hsm_aio_path);
-    
-    static uint16_t hum_adc_val;
-    static float humidity = 0.0;
-    
-    hum_adc_val = mraa_aio_read(hsm_aio_path);
-    
-    // Calculate the humidity based on analog voltage
-    // NOTE: Please check the below link to get details of equiation
-    // https://github.com/nazmul21/IoT2020/tree/master/safety%20assistant/documents
-    humidity = (((float)hum_adc_val / 1023.0) * 5.0);
-    humidity = ((1.253 * humidity * humidity) + 
-                        (25.931 * humidity) - 7.542);
-    
-    return humidity;
+    sensor_t *p_sen = (sensor_t *)p_task->p_arg;
+    int32_t   humidity;
+
+    lat_add(&acq_jitter, p_task->late_ns);
+
+    if (SUCCESS != hsm_read_humidity(hsm_aio_path, &humidity))
+    {
+        printf("Failed to read humidity sensor output.\n");
+        stats_count(STATS_AIO_ERRORS, 1);
+        return;
+    }
+
+    app_store_sample(p_sen->sen_id, humidity);
 }
 
-static uint8_t store_data_to_db(uint8_t sen_id, float sen_val) 
+static void app_schedule_sensors(void)
 {
-    static sqlite3 *p_db_handle;
-    static char *p_db_err_msg;
-    static char *p_db_query;
-    static uint16_t db_ret_val;
-    
-    db_ret_val = SQLITE_ERROR;
-    
-    db_ret_val = sqlite3_open(DATABASE_PATH, &p_db_handle);
-    if (SQLITE_OK == db_ret_val) 
+    sensor_t *p_sen;
+    uint16_t  index;
+    uint32_t  period_ms, phase_ms;
+
+    for (index = 0; NULL != (p_sen = registry_get(index)); index++)
     {
-        #if defined(RUN_TIME_LOG)
-            printf("Database opened successfully.\n");
-        #endif
+        if ((SENSOR_TYPE_DS18B20 == p_sen->type) || sched_is_pending(&p_sen->task))
+        {
+            continue;
+        }
+
+        period_ms = (uint32_t)config_get_int(config_get_int(SENSOR_PERIOD_MS, "sensor.period_ms"),
+                                                    "sensor.%d.period_ms", p_sen->sen_id);
+        phase_ms = (uint32_t)config_get_int(config_get_int(SENSOR_PHASE_MS, "sensor.phase_ms"),
+                                                    "sensor.%d.phase_ms", p_sen->sen_id);
+
+        printf("Sensor ID=%d sampled every %u ms, phase %u ms.\n", p_sen->sen_id,
+                                                                period_ms, phase_ms);
+        if (SUCCESS != sched_start(&p_sen->task, period_ms, phase_ms))
+        {
+            app_failed = 1;
+        }
     }
-    else 
+}
+
+static void app_store_sample(uint16_t sen_id, int32_t sen_val)
+{
+    sample_t sample;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.sen_id = sen_id;
+    sample.sen_val = sen_val;
+    sample.sen_time = (int64_t)time(NULL);
+    sample.t_acq_ns = lat_now_ns();
+
+    app_submit_sample(&sample);
+}
+
+static void app_submit_sample(const sample_t * p_sample)
+{
+    // Queues only fill up if a thread is stuck, the sample is lost then
+    if (SUCCESS != storage_submit(p_sample))
     {
-        printf("Database open failed: %s\n", sqlite3_errmsg(p_db_handle));
-        sqlite3_close(p_db_handle);
-        
-        return FAIL;
+        printf("Storage queue full, sample of sensor ID=%d dropped.\n", p_sample->sen_id);
+        stats_count(STATS_QUEUE_DROPS, 1);
     }
-	
-    // Try to allocate a 64 bytes of dynamic memory for query buffer
-    p_db_query = (char *) malloc(64);
-    if (NULL == p_db_query) 
+    else
     {
-        printf("malloc() failed to allocate.\n");			
-        sqlite3_close(p_db_handle);
-        return FAIL;
+        stats_count(STATS_SAMPLES, 1);
     }
-    else 
+    if (SUCCESS != eval_submit(p_sample))
     {
-        sprintf(p_db_query, "INSERT INTO sensor_data (sen_id, sen_val) values (%d, %0.2f);", 
-                                                                             sen_id, sen_val);
-		
         #if defined(RUN_TIME_LOG)
-            printf("SQLite3 Query - %s\n", p_db_query);
+            printf("Evaluation queue full.\n");
         #endif
-		
-        db_ret_val = sqlite3_exec(p_db_handle, (const char *)p_db_query, NULL, NULL, 
-                                                                        &p_db_err_msg);
-        if (SQLITE_OK == db_ret_val) 
-        {
-            #if defined(RUN_TIME_LOG)
-                printf("Data stored to SQLite.\n");
-            #endif
-        }
-        else 
+    }
+}
+
+static void report_task_fn(sched_task_t * p_task)
+{
+    lat_print(&acq_jitter, "Acquisition jitter");
+    owbus_report();
+}
+
+static void app_observer(const sched_task_t * p_task, int64_t run_ns)
+{
+    stats_add(STATS_TASK_RUN, run_ns);
+    stats_add(STATS_TASK_DRIFT, p_task->late_ns);
+    stats_count(STATS_ACQ_BUSY_NS, (uint64_t)run_ns);
+}
+
+/* SIGTERM or SIGINT, leave the scheduler loop and shut down cleanly
+*/
+static void signal_fn(sched_fd_t * p_watch)
+{
+    struct signalfd_siginfo info;
+
+    if (sizeof(info) == read(signal_fd, &info, sizeof(info)))
+    {
+        printf("Signal %u received, stopping.\n", info.ssi_signo);
+    }
+    app_stop = 1;
+}
+
+static uint8_t hsm_read_humidity(hal_aio_t * hsm_aio_path, int32_t * p_humidity)
+{
+    assert(NULL != hsm_aio_path);
+    
+    static int32_t adc_buf[FILTER_MAX_WINDOW];
+    int            num_samples;
+    int            i;
+    int64_t        t0;
+
+    num_samples = (int)config_get_int(HUMIDITY_SAMPLES, "humidity.samples");
+    if ((num_samples < 1) || (num_samples > FILTER_MAX_WINDOW))
+    {
+        num_samples = HUMIDITY_SAMPLES;
+    }
+
+    for (i = 0; i < num_samples; i++)
+    {
+        t0 = stats_begin();
+        adc_buf[i] = hal_aio_read(hsm_aio_path);
+        stats_end(STATS_AIO_READ, t0);
+        if (adc_buf[i] < 0)
         {
-            printf("Falied to store data. Err Msg - %s.\n", p_db_err_msg);
-            sqlite3_free(p_db_err_msg);			
-            sqlite3_close(p_db_handle);
             return FAIL;
         }
-        
-        // Set free the allocated memory for the query buffer
-        free(p_db_query);
     }
-	
-    sqlite3_close(p_db_handle);
-	
+
+    trace_aio(hsm_analog.sen_id, adc_buf, (uint8_t)num_samples);
+    *p_humidity = analog_process(&hsm_analog, adc_buf, (uint8_t)num_samples);
+
     return SUCCESS;
 }
@@ -0,0 +1,163 @@
+/******************************************************************************/
+
+/* File - appstat.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Viewer of the self-profiling region of the application (see stats.h).
+*  Maps the region read-only and prints the latency of every stage and the
+*  counters, the application is not disturbed. With '-p' the region is
+*  exported in the Prometheus text format instead ('-' for stdout), with
+*  '-w' the output is repeated every 'interval' seconds.
+*
+*  Usage: appstat [-f region] [-p file|-] [-w interval_s]
+*     e.g. appstat -w 5
+*          appstat -p /var/lib/node_exporter/ctrl_room_monitor.prom -w 15
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "common.h"
+#include "lat.h"
+#include "stats.h"
+
+/******************************************************************************/
+
+/* Function declaration to print a region in human readable form
+*  @param[in] p_region - Region
+*  @return - None
+*/
+static void appstat_print(const stats_region_t * p_region);
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    const stats_region_t *p_region;
+    const char           *p_path = STATS_PATH;
+    const char           *p_prom = NULL;
+    uint32_t              interval_s = 0;
+    uint8_t               is_ok = 1;
+    int                   opt;
+
+    while (-1 != (opt = getopt(argc, argv, "f:p:w:")))
+    {
+        switch (opt)
+        {
+            case 'f':
+                p_path = optarg;
+            break;
+
+            case 'p':
+                p_prom = optarg;
+            break;
+
+            case 'w':
+                interval_s = (uint32_t)atoi(optarg);
+            break;
+
+            default:
+                optind = argc + 1;
+            break;
+        }
+    }
+
+    if (optind != argc)
+    {
+        printf("Usage: %s [-f region] [-p file|-] [-w interval_s]\n", argv[0]);
+        return 1;
+    }
+
+    p_region = stats_map(p_path);
+    if (NULL == p_region)
+    {
+        return 1;
+    }
+
+    for ( ; ; )
+    {
+        if (NULL == p_prom)
+        {
+            appstat_print(p_region);
+        }
+        else if (0 == strcmp(p_prom, "-"))
+        {
+            stats_export(p_region, stdout);
+        }
+        else
+        {
+            is_ok = stats_export_file(p_region, p_prom);
+        }
+        fflush(stdout);
+
+        if (0 == interval_s)
+        {
+            break;
+        }
+        sleep(interval_s);
+    }
+
+    stats_unmap(p_region);
+
+    return (is_ok) ? (0) : (1);
+}
+
+/******************************************************************************/
+
+static void appstat_print(const stats_region_t * p_region)
+{
+    lat_t    lat;
+    uint16_t i;
+    int64_t  up_s;
+    uint8_t  is_running;
+    uint64_t busy_ns;
+
+    up_s = (int64_t)time(NULL) - p_region->start_time;
+    is_running = (0 == kill(p_region->pid, 0)) || (EPERM == errno);
+
+    printf("ctrl_room_monitor pid %d (%s), up %lld s\n", p_region->pid,
+           (is_running) ? ("running") : ("not running"), (long long)up_s);
+
+    printf("%-14s %10s %10s %10s %10s %10s\n", "stage [us]", "count", "mean", "p50",
+                                                                        "p99", "max");
+    for (i = 0; i < STATS_NUM_HISTS; i++)
+    {
+        if (SUCCESS != stats_read_hist(p_region, (stats_hist_id_t)i, &lat))
+        {
+            printf("%-14s (busy)\n", stats_hist_name((stats_hist_id_t)i));
+            continue;
+        }
+        if (0 == lat.count)
+        {
+            printf("%-14s %10d\n", stats_hist_name((stats_hist_id_t)i), 0);
+            continue;
+        }
+        printf("%-14s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+               stats_hist_name((stats_hist_id_t)i), (unsigned long long)lat.count,
+               ((double)lat.sum_ns / lat.count) / 1000.0, lat_percentile(&lat, 50) / 1000.0,
+               lat_percentile(&lat, 99) / 1000.0, lat.max_ns / 1000.0);
+    }
+
+    for (i = 0; i < STATS_NUM_COUNTERS; i++)
+    {
+        if (STATS_ACQ_BUSY_NS == i)
+        {
+            continue;
+        }
+        printf("%-14s %10llu\n", stats_counter_name((stats_counter_id_t)i),
+               (unsigned long long)stats_read_counter(p_region, (stats_counter_id_t)i));
+    }
+
+    // Whatever the acquisition thread does not spend in tasks it sleeps
+    busy_ns = stats_read_counter(p_region, STATS_ACQ_BUSY_NS);
+    printf("%-14s %10.3f s (%0.2f %% of uptime)\n", "acq_busy", busy_ns / 1e9,
+           (up_s > 0) ? ((busy_ns / 1e7) / up_s) : (0.0));
+}
@@ -0,0 +1,359 @@
+/******************************************************************************/
+
+/* File - archive.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Compact binary archive of aged sensor data. See archive.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "archive.h"
+
+/******************************************************************************/
+
+/* Worst case bytes of a point, two 64 bit varints
+*/
+#define ARCHIVE_MAX_POINT_LEN   (20)
+
+#define SEC_PER_DAY             (86400)
+
+/******************************************************************************/
+
+/* Function declarations of the varint coding
+*/
+static uint8_t *archive_put(uint8_t * p_buf, int64_t value);
+static uint8_t  archive_get(archive_seg_t * p_seg, int64_t * p_value);
+
+/* Function declaration to write a file through a temp file and rename, the
+*  old file stays intact until the new one is on disk
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t  archive_replace(const char * p_dir, const char * p_path,
+                                const uint8_t * p_buf, size_t len);
+
+/******************************************************************************/
+
+void archive_path(char * p_path, const char * p_dir, uint16_t sen_id, time_t day)
+{
+    struct tm tm_day;
+
+    gmtime_r(&day, &tm_day);
+    snprintf(p_path, ARCHIVE_PATH_LEN, "%s/sen%d_%04d%02d%02d.seg", p_dir, sen_id,
+                        tm_day.tm_year + 1900, tm_day.tm_mon + 1, tm_day.tm_mday);
+}
+
+uint8_t archive_write(const char * p_dir, uint16_t sen_id, time_t day,
+                      const archive_point_t * p_points, uint32_t num_points)
+{
+    char              path[ARCHIVE_PATH_LEN];
+    archive_seg_t     seg;
+    archive_header_t *p_header;
+    archive_point_t  *p_merged;
+    uint8_t          *p_buf, *p_pos;
+    uint32_t          num_old = 0, num_merged = 0, i = 0, j = 0;
+    int64_t           last_sl = 0, sen_time = 0, value = 0, prev_time, prev_delta, prev_value;
+    uint8_t           ret_val;
+
+    archive_path(path, p_dir, sen_id, day);
+
+    if ((0 != mkdir(p_dir, 0755)) && (EEXIST != errno))
+    {
+        printf("Failed to create %s.\n", p_dir);
+        return FAIL;
+    }
+
+    if (SUCCESS == archive_map(path, &seg))
+    {
+        if ((seg.p_header->sen_id != sen_id) || (seg.p_header->day != (int64_t)day))
+        {
+            printf("Segment %s belongs to another sensor or day.\n", path);
+            archive_unmap(&seg);
+            return FAIL;
+        }
+        num_old = seg.p_header->count;
+        last_sl = seg.p_header->last_sl;
+
+        if (num_old && (SUCCESS != archive_next(&seg, &sen_time, &value)))
+        {
+            printf("Segment %s is corrupt.\n", path);
+            archive_unmap(&seg);
+            return FAIL;
+        }
+    }
+    else if (0 == access(path, F_OK))
+    {
+        // Not overwritten, might be all that is left of that day
+        printf("Segment %s is corrupt.\n", path);
+        return FAIL;
+    }
+
+    p_merged = (archive_point_t *) malloc(((size_t)num_old + num_points) * sizeof(archive_point_t));
+    p_buf = (uint8_t *) malloc(sizeof(archive_header_t) +
+                               (((size_t)num_old + num_points) * ARCHIVE_MAX_POINT_LEN));
+    if ((NULL == p_merged) || (NULL == p_buf))
+    {
+        printf("malloc() failed to allocate.\n");
+        free(p_merged);
+        free(p_buf);
+        archive_unmap(&seg);
+        return FAIL;
+    }
+
+    // Both in time order, at the same time the archived sample goes first
+    while ((i < num_old) || (j < num_points))
+    {
+        if ((j < num_points) && (p_points[j].sl <= last_sl))
+        {
+            j++;
+        }
+        else if ((i < num_old) && ((j >= num_points) || (sen_time <= p_points[j].sen_time)))
+        {
+            p_merged[num_merged].sen_time = sen_time;
+            p_merged[num_merged++].value = (int32_t)value;
+            if ((++i < num_old) && (SUCCESS != archive_next(&seg, &sen_time, &value)))
+            {
+                printf("Segment %s is corrupt.\n", path);
+                break;
+            }
+        }
+        else
+        {
+            p_merged[num_merged++] = p_points[j++];
+        }
+    }
+    archive_unmap(&seg);
+
+    if ((i < num_old) || (num_merged == num_old))
+    {
+        // Corrupt, or nothing new
+        free(p_merged);
+        free(p_buf);
+        return (i < num_old) ? (FAIL) : (SUCCESS);
+    }
+
+    for (j = 0; j < num_points; j++)
+    {
+        if (p_points[j].sl > last_sl)
+        {
+            last_sl = p_points[j].sl;
+        }
+    }
+
+    p_header = (archive_header_t *)p_buf;
+    memset(p_header, 0, sizeof(archive_header_t));
+    p_header->magic = ARCHIVE_MAGIC;
+    p_header->version = ARCHIVE_VERSION;
+    p_header->sen_id = sen_id;
+    p_header->scale = ARCHIVE_SCALE;
+    p_header->count = num_merged;
+    p_header->day = (int64_t)day;
+    p_header->last_sl = last_sl;
+
+    prev_time = (int64_t)day;
+    prev_delta = 0;
+    prev_value = 0;
+    p_pos = p_buf + sizeof(archive_header_t);
+    for (i = 0; i < num_merged; i++)
+    {
+        p_pos = archive_put(p_pos, (p_merged[i].sen_time - prev_time) - prev_delta);
+        p_pos = archive_put(p_pos, p_merged[i].value - prev_value);
+        prev_delta = p_merged[i].sen_time - prev_time;
+        prev_time = p_merged[i].sen_time;
+        prev_value = p_merged[i].value;
+    }
+    p_header->data_len = (uint32_t)(p_pos - (p_buf + sizeof(archive_header_t)));
+
+    ret_val = archive_replace(p_dir, path, p_buf, (size_t)(p_pos - p_buf));
+
+    free(p_merged);
+    free(p_buf);
+
+    return ret_val;
+}
+
+uint8_t archive_map(const char * p_path, archive_seg_t * p_seg)
+{
+    struct stat st;
+    int         fd;
+
+    memset(p_seg, 0, sizeof(archive_seg_t));
+
+    fd = open(p_path, O_RDONLY);
+    if (fd < 0)
+    {
+        return FAIL;
+    }
+    if ((0 != fstat(fd, &st)) || (st.st_size < (off_t)sizeof(archive_header_t)))
+    {
+        close(fd);
+        return FAIL;
+    }
+
+    p_seg->p_map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p_seg->p_map)
+    {
+        p_seg->p_map = NULL;
+        return FAIL;
+    }
+    p_seg->size = (size_t)st.st_size;
+    p_seg->p_header = (const archive_header_t *)p_seg->p_map;
+
+    if ((ARCHIVE_MAGIC != p_seg->p_header->magic) ||
+        (ARCHIVE_VERSION != p_seg->p_header->version) ||
+        ((sizeof(archive_header_t) + p_seg->p_header->data_len) > p_seg->size))
+    {
+        archive_unmap(p_seg);
+        return FAIL;
+    }
+
+    // Scans run front to back, let the kernel read ahead
+    madvise(p_seg->p_map, p_seg->size, MADV_SEQUENTIAL);
+
+    p_seg->p_pos = (const uint8_t *)p_seg->p_map + sizeof(archive_header_t);
+    p_seg->p_end = p_seg->p_pos + p_seg->p_header->data_len;
+    p_seg->sen_time = p_seg->p_header->day;
+
+    return SUCCESS;
+}
+
+uint8_t archive_next(archive_seg_t * p_seg, int64_t * p_sen_time, int64_t * p_value)
+{
+    int64_t dod, delta_value;
+
+    if ((p_seg->index >= p_seg->p_header->count) ||
+        (SUCCESS != archive_get(p_seg, &dod)) || (SUCCESS != archive_get(p_seg, &delta_value)))
+    {
+        return FAIL;
+    }
+
+    p_seg->delta += dod;
+    p_seg->sen_time += p_seg->delta;
+    p_seg->value += delta_value;
+    p_seg->index++;
+
+    *p_sen_time = p_seg->sen_time;
+    *p_value = p_seg->value;
+
+    return SUCCESS;
+}
+
+void archive_unmap(archive_seg_t * p_seg)
+{
+    if (NULL != p_seg->p_map)
+    {
+        munmap(p_seg->p_map, p_seg->size);
+        p_seg->p_map = NULL;
+    }
+}
+
+/******************************************************************************/
+
+/* Zigzag, small negative values get small codes as well, then 7 bits a byte,
+*  least significant first, MSB set on all but the last byte
+*/
+static uint8_t * archive_put(uint8_t * p_buf, int64_t value)
+{
+    uint64_t zz = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+    while (zz >= 0x80)
+    {
+        *p_buf++ = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    *p_buf++ = (uint8_t)zz;
+
+    return p_buf;
+}
+
+static uint8_t archive_get(archive_seg_t * p_seg, int64_t * p_value)
+{
+    uint64_t zz = 0;
+    uint8_t  shift = 0;
+    uint8_t  byte;
+
+    do
+    {
+        if ((p_seg->p_pos >= p_seg->p_end) || (shift > 63))
+        {
+            return FAIL;
+        }
+        byte = *p_seg->p_pos++;
+        zz |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *p_value = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+
+    return SUCCESS;
+}
+
+static uint8_t archive_replace(const char * p_dir, const char * p_path,
+                               const uint8_t * p_buf, size_t len)
+{
+    char    tmp_path[ARCHIVE_PATH_LEN + 4];
+    int     fd;
+    ssize_t ret_val;
+    size_t  done = 0;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", p_path);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        printf("Failed to create %s.\n", tmp_path);
+        return FAIL;
+    }
+
+    while (done < len)
+    {
+        ret_val = write(fd, p_buf + done, len - done);
+        if (ret_val <= 0)
+        {
+            if ((ret_val < 0) && (EINTR == errno))
+            {
+                continue;
+            }
+            break;
+        }
+        done += (size_t)ret_val;
+    }
+
+    if ((done < len) || (0 != fsync(fd)))
+    {
+        printf("Failed to write %s.\n", tmp_path);
+        close(fd);
+        unlink(tmp_path);
+        return FAIL;
+    }
+    close(fd);
+
+    if (0 != rename(tmp_path, p_path))
+    {
+        printf("Failed to rename %s.\n", tmp_path);
+        unlink(tmp_path);
+        return FAIL;
+    }
+
+    // The rename itself is durable once the directory is synced
+    fd = open(p_dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+
+    return SUCCESS;
+}
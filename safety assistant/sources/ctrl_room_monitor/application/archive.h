@@ -0,0 +1,134 @@
+/******************************************************************************/
+
+/* File - archive.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Compact binary archive of aged sensor data. Samples older than a few days
+*  are moved out of 'sensor_data' into one segment file per sensor and UTC
+*  day, '<dir>/sen<sen_id>_<YYYYMMDD>.seg':
+*
+*     header   - archive_header_t (little endian, 40 bytes)
+*     points   - per sample, oldest first:
+*                  time : zigzag varint of the delta-of-delta of the time
+*                  value: zigzag varint of the delta of value * scale
+*
+*  Values are stored as the scaled integers the database rounds them to
+*  (0.01), so a sensor sampled at a fixed period mostly costs 1 byte of time
+*  (delta-of-delta 0) and 1 byte of value, against 30 - 40 bytes a row in
+*  SQLite. Segments are read through mmap(), see archive_map().
+*
+*  A segment is rewritten (temp file and rename) when rows of its day show up
+*  later. 'last_sl' is the highest 'sl' of the rows it holds, so rows which
+*  were archived but not deleted before a crash are not added twice.
+*/
+
+/******************************************************************************/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/******************************************************************************/
+
+#define ARCHIVE_MAGIC           (0x31435241)        // "ARC1"
+#define ARCHIVE_VERSION         (1)
+
+/* Values are stored in 1 / ARCHIVE_SCALE units
+*/
+#define ARCHIVE_SCALE           (100)
+
+#define ARCHIVE_PATH_LEN        (256)
+
+/* Default archive directory ('archive.path'), written by the storage thread
+*  and read by the range queries (see query.h)
+*/
+#define ARCHIVE_PATH            "/home/root/ctrl_room_monitor/database/archive"
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sen_id;
+    uint32_t scale;
+    uint32_t count;                             // Number of samples
+    int64_t  day;                               // Start of the UTC day (unix seconds)
+    int64_t  last_sl;
+    uint32_t data_len;                          // Bytes of points behind the header
+    uint32_t reserved;
+} archive_header_t;
+
+/* A sample to be archived, value in 1 / ARCHIVE_SCALE units
+*/
+typedef struct
+{
+    int64_t  sen_time;
+    int64_t  sl;
+    int32_t  value;
+} archive_point_t;
+
+/* Mapped segment and read position
+*/
+typedef struct
+{
+    void                   *p_map;
+    size_t                  size;
+    const archive_header_t *p_header;
+    const uint8_t          *p_pos;
+    const uint8_t          *p_end;
+    uint32_t                index;
+    int64_t                 sen_time;
+    int64_t                 delta;
+    int64_t                 value;
+} archive_seg_t;
+
+/******************************************************************************/
+
+/* Function declaration to build the path of a segment
+*  @param[out] p_path - Buffer of ARCHIVE_PATH_LEN bytes
+*  @param[in]  p_dir  - Archive directory
+*  @param[in]  sen_id - Sensor ID
+*  @param[in]  day    - Any time of the day (unix seconds)
+*  @return - None
+*/
+void archive_path(char * p_path, const char * p_dir, uint16_t sen_id, time_t day);
+
+/* Function declaration to add samples of one sensor and day to its segment.
+*  The segment is created, or rewritten with the samples merged in time
+*  order. Samples with 'sl' not above the 'last_sl' of the segment are
+*  skipped. Returns once the segment is on disk (fsync).
+*  @param[in] p_dir      - Archive directory, created if missing
+*  @param[in] sen_id     - Sensor ID
+*  @param[in] day        - Start of the UTC day (unix seconds)
+*  @param[in] p_points   - Samples in time order, all of the day
+*  @param[in] num_points - Number of samples
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t archive_write(const char * p_dir, uint16_t sen_id, time_t day,
+                      const archive_point_t * p_points, uint32_t num_points);
+
+/* Function declaration to map a segment for reading
+*  @param[in]  p_path - Path of the segment
+*  @param[out] p_seg  - Segment, read position at the first sample
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if missing or not a valid segment )
+*/
+uint8_t archive_map(const char * p_path, archive_seg_t * p_seg);
+
+/* Function declaration to read the next sample of a mapped segment
+*  @param[in]  p_seg      - Segment
+*  @param[out] p_sen_time - Acquisition time (unix seconds)
+*  @param[out] p_value    - Value in 1 / scale units
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) at the end or on corrupt data )
+*/
+uint8_t archive_next(archive_seg_t * p_seg, int64_t * p_sen_time, int64_t * p_value);
+
+/* Function declaration to unmap a segment
+*  @param[in] p_seg - Segment
+*  @return - None
+*/
+void archive_unmap(archive_seg_t * p_seg);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,212 @@
+/******************************************************************************/
+
+/* File - archive_tool.c
+*
+*  Target Hardware: SIEMENS IoT2020 (or any Linux host)
+*
+*  Reader of the sensor data archive (see archive.h). Exports segments as
+*  CSV ("sen_id,time,sen_val", one line per sample), or with '-i' prints one
+*  line of information per segment. Arguments are segment files or archive
+*  directories, a directory stands for all its segments.
+*
+*  Usage: archive_tool [-i] [-s sen_id] [-f from] [-t to] <segment|dir> ...
+*     e.g. archive_tool -s 3 /home/root/ctrl_room_monitor/database/archive
+*          archive_tool -f 1792022400 -t 1792108800 sen1_20261014.seg
+*  'from' and 'to' are unix seconds, 'to' excluded.
+*/
+
+/******************************************************************************/
+
+// scandir()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "archive.h"
+
+/******************************************************************************/
+
+static uint8_t  is_info = 0;
+static int32_t  sen_filter = -1;
+static int64_t  time_from = 0;
+static int64_t  time_to = INT64_MAX;
+static uint64_t total_samples = 0;
+static uint64_t total_bytes = 0;
+
+/******************************************************************************/
+
+/* Function declaration to export (or describe) one segment
+*  @param[in] p_path - Path of the segment
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t tool_segment(const char * p_path);
+
+/* Function declaration to export (or describe) all segments of a directory
+*  @param[in] p_dir - Archive directory
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t tool_dir(const char * p_dir);
+
+static int     tool_is_segment(const struct dirent * p_entry);
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    struct stat st;
+    int         opt, i;
+    uint8_t     is_ok = 1;
+
+    while (-1 != (opt = getopt(argc, argv, "is:f:t:")))
+    {
+        switch (opt)
+        {
+            case 'i':
+                is_info = 1;
+            break;
+
+            case 's':
+                sen_filter = atoi(optarg);
+            break;
+
+            case 'f':
+                time_from = atoll(optarg);
+            break;
+
+            case 't':
+                time_to = atoll(optarg);
+            break;
+
+            default:
+                optind = argc + 1;
+            break;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        printf("Usage: %s [-i] [-s sen_id] [-f from] [-t to] <segment|dir> ...\n", argv[0]);
+        return 1;
+    }
+
+    if (!is_info)
+    {
+        printf("sen_id,time,sen_val\n");
+    }
+
+    for (i = optind; i < argc; i++)
+    {
+        if ((0 == stat(argv[i], &st)) && S_ISDIR(st.st_mode))
+        {
+            is_ok &= tool_dir(argv[i]);
+        }
+        else
+        {
+            is_ok &= tool_segment(argv[i]);
+        }
+    }
+
+    if (is_info && total_samples)
+    {
+        printf("Total: %llu samples, %llu bytes, %0.2f bytes/sample.\n",
+               (unsigned long long)total_samples, (unsigned long long)total_bytes,
+               (double)total_bytes / total_samples);
+    }
+
+    return (is_ok) ? (0) : (1);
+}
+
+/******************************************************************************/
+
+static uint8_t tool_segment(const char * p_path)
+{
+    archive_seg_t seg;
+    int64_t       sen_time, value;
+    uint32_t      num = 0;
+
+    if (SUCCESS != archive_map(p_path, &seg))
+    {
+        fprintf(stderr, "%s is not a valid segment.\n", p_path);
+        return FAIL;
+    }
+
+    // Whole segment outside the filter, not even decoded
+    if (((sen_filter >= 0) && (seg.p_header->sen_id != sen_filter)) ||
+        (seg.p_header->day >= time_to) || ((seg.p_header->day + 86400) <= time_from))
+    {
+        archive_unmap(&seg);
+        return SUCCESS;
+    }
+
+    if (is_info)
+    {
+        printf("%s: sensor ID=%d, day %lld, %u samples, %zu bytes, %0.2f bytes/sample.\n",
+               p_path, seg.p_header->sen_id, (long long)seg.p_header->day,
+               seg.p_header->count, seg.size,
+               (seg.p_header->count) ? ((double)seg.size / seg.p_header->count) : (0.0));
+        total_samples += seg.p_header->count;
+        total_bytes += seg.size;
+        archive_unmap(&seg);
+        return SUCCESS;
+    }
+
+    while (SUCCESS == archive_next(&seg, &sen_time, &value))
+    {
+        num++;
+        if ((sen_time >= time_from) && (sen_time < time_to))
+        {
+            printf("%d,%lld,%0.2f\n", seg.p_header->sen_id, (long long)sen_time,
+                                                (double)value / seg.p_header->scale);
+        }
+    }
+
+    if (num != seg.p_header->count)
+    {
+        fprintf(stderr, "%s is corrupt after %u of %u samples.\n", p_path, num,
+                                                            seg.p_header->count);
+        archive_unmap(&seg);
+        return FAIL;
+    }
+
+    archive_unmap(&seg);
+
+    return SUCCESS;
+}
+
+static uint8_t tool_dir(const char * p_dir)
+{
+    struct dirent **p_entries;
+    char            path[ARCHIVE_PATH_LEN + 256];
+    int             num, i;
+    uint8_t         is_ok = 1;
+
+    num = scandir(p_dir, &p_entries, tool_is_segment, alphasort);
+    if (num < 0)
+    {
+        fprintf(stderr, "Failed to read %s.\n", p_dir);
+        return FAIL;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", p_dir, p_entries[i]->d_name);
+        is_ok &= tool_segment(path);
+        free(p_entries[i]);
+    }
+    free(p_entries);
+
+    return (is_ok) ? (SUCCESS) : (FAIL);
+}
+
+static int tool_is_segment(const struct dirent * p_entry)
+{
+    size_t len = strlen(p_entry->d_name);
+
+    return (len > 4) && (0 == strcmp(&p_entry->d_name[len - 4], ".seg"));
+}
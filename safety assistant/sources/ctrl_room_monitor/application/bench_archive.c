@@ -0,0 +1,312 @@
+/******************************************************************************/
+
+/* File - bench_archive.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Benchmark of the sensor data archive (see archive.h) against the
+*  'sensor_data' table. A synthetic history (temperature like values rounded
+*  to 0.01 as db_store_sample() stores them, one sample per sensor every
+*  BENCH_PERIOD_S) is loaded into a database with the dashboard index and
+*  written to archive segments. It reports the bytes per sample of both and
+*  the time of a long-range trend scan (daily min / max / mean of every
+*  sensor over the whole history), from a warm page cache.
+*
+*  Usage: bench_archive [dir] [days] [sensors]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "db.h"
+#include "archive.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_DIR       "/tmp/bench_archive"
+#define BENCH_DEFAULT_DAYS      (30)
+#define BENCH_DEFAULT_SENSORS   (4)
+
+#define BENCH_PERIOD_S          (10)
+#define BENCH_SAMPLES_PER_DAY   (86400 / BENCH_PERIOD_S)
+
+#define SQL_CREATE_TABLE        "CREATE TABLE sensor_data (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id INTEGER NOT NULL, sen_val REAL NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now')));"
+#define SQL_TREND               "SELECT sen_id, time / 86400, MIN(sen_val), MAX(sen_val), " \
+                                "AVG(sen_val) FROM sensor_data GROUP BY 1, 2;"
+
+/******************************************************************************/
+
+static sqlite3 *p_db = NULL;
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint8_t bench_exec(const char * p_sql)
+{
+    char *p_err = NULL;
+
+    if (SQLITE_OK != sqlite3_exec(p_db, p_sql, NULL, NULL, &p_err))
+    {
+        printf("Query '%s' failed: %s\n", p_sql, p_err);
+        sqlite3_free(p_err);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+/* Value of a sensor at a sample index, slow daily swing plus noise, rounded
+*  to 0.01 like the stored values
+*/
+static int32_t bench_value(uint32_t sensor, long index)
+{
+    double t = (double)index / BENCH_SAMPLES_PER_DAY;
+
+    return (int32_t)lround((25.0 + sensor * 0.5 + 3.0 * sin(2 * M_PI * t) +
+                            ((rand() % 21) - 10) * 0.01) * ARCHIVE_SCALE);
+}
+
+/* Function declaration to load the history into the database and the
+*  archive at once
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_load(const char * p_dir, time_t start, uint32_t days, uint32_t sensors)
+{
+    static archive_point_t points[BENCH_SAMPLES_PER_DAY];
+    sqlite3_stmt          *p_stmt;
+    uint32_t               d, s, i;
+    int64_t                sl = 0;
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO sensor_data (sen_id, sen_val, time) "
+                                            "VALUES (?1, ?2, ?3);", -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+        return FAIL;
+    }
+
+    for (d = 0; d < days; d++)
+    {
+        bench_exec("BEGIN;");
+        for (s = 1; s <= sensors; s++)
+        {
+            for (i = 0; i < BENCH_SAMPLES_PER_DAY; i++)
+            {
+                points[i].sen_time = (int64_t)start + ((int64_t)d * 86400) + (i * BENCH_PERIOD_S);
+                points[i].sl = ++sl;
+                points[i].value = bench_value(s, ((long)d * BENCH_SAMPLES_PER_DAY) + i);
+
+                sqlite3_bind_int(p_stmt, 1, s);
+                sqlite3_bind_double(p_stmt, 2, (double)points[i].value / ARCHIVE_SCALE);
+                sqlite3_bind_int64(p_stmt, 3, points[i].sen_time);
+                sqlite3_step(p_stmt);
+                sqlite3_reset(p_stmt);
+            }
+
+            if (SUCCESS != archive_write(p_dir, (uint16_t)s, start + ((time_t)d * 86400),
+                                                        points, BENCH_SAMPLES_PER_DAY))
+            {
+                sqlite3_finalize(p_stmt);
+                return FAIL;
+            }
+        }
+        if (SUCCESS != bench_exec("COMMIT;"))
+        {
+            sqlite3_finalize(p_stmt);
+            return FAIL;
+        }
+    }
+    sqlite3_finalize(p_stmt);
+
+    return SUCCESS;
+}
+
+/* Function declaration to run the trend scan on the database
+*  @return - double (seconds, negative on failure)
+*/
+static double bench_scan_db(double * p_check)
+{
+    sqlite3_stmt *p_stmt;
+    double        t_start = now_sec();
+
+    *p_check = 0;
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db, SQL_TREND, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+        return -1.0;
+    }
+    while (SQLITE_ROW == sqlite3_step(p_stmt))
+    {
+        *p_check += sqlite3_column_double(p_stmt, 4);
+    }
+    sqlite3_finalize(p_stmt);
+
+    return now_sec() - t_start;
+}
+
+/* Function declaration to run the trend scan on the archive
+*  @return - double (seconds, negative on failure)
+*/
+static double bench_scan_archive(const char * p_dir, time_t start, uint32_t days,
+                                                    uint32_t sensors, double * p_check)
+{
+    char          path[ARCHIVE_PATH_LEN];
+    archive_seg_t seg;
+    int64_t       sen_time, value, v_min, v_max, v_sum;
+    uint32_t      d, s, num;
+    double        t_start = now_sec();
+
+    *p_check = 0;
+    for (s = 1; s <= sensors; s++)
+    {
+        for (d = 0; d < days; d++)
+        {
+            archive_path(path, p_dir, (uint16_t)s, start + ((time_t)d * 86400));
+            if (SUCCESS != archive_map(path, &seg))
+            {
+                printf("Failed to map %s.\n", path);
+                return -1.0;
+            }
+
+            v_min = INT64_MAX;
+            v_max = INT64_MIN;
+            v_sum = 0;
+            num = 0;
+            while (SUCCESS == archive_next(&seg, &sen_time, &value))
+            {
+                v_min = (value < v_min) ? (value) : (v_min);
+                v_max = (value > v_max) ? (value) : (v_max);
+                v_sum += value;
+                num++;
+            }
+            archive_unmap(&seg);
+
+            if (num)
+            {
+                *p_check += (double)v_sum / num / ARCHIVE_SCALE;
+            }
+        }
+    }
+
+    return now_sec() - t_start;
+}
+
+/* Function declaration to add up the size of all segments of a directory
+*/
+static uint64_t bench_archive_bytes(const char * p_dir, time_t start, uint32_t days,
+                                                                    uint32_t sensors)
+{
+    char        path[ARCHIVE_PATH_LEN];
+    struct stat st;
+    uint64_t    bytes = 0;
+    uint32_t    d, s;
+
+    for (s = 1; s <= sensors; s++)
+    {
+        for (d = 0; d < days; d++)
+        {
+            archive_path(path, p_dir, (uint16_t)s, start + ((time_t)d * 86400));
+            if (0 == stat(path, &st))
+            {
+                bytes += (uint64_t)st.st_size;
+            }
+            unlink(path);
+        }
+    }
+
+    return bytes;
+}
+
+int main(int argc, char** argv)
+{
+    const char *p_dir = (argc > 1) ? (argv[1]) : (BENCH_DEFAULT_DIR);
+    uint32_t    days = (argc > 2) ? ((uint32_t)atoi(argv[2])) : (BENCH_DEFAULT_DAYS);
+    uint32_t    sensors = (argc > 3) ? ((uint32_t)atoi(argv[3])) : (BENCH_DEFAULT_SENSORS);
+    char        db_path[ARCHIVE_PATH_LEN];
+    struct stat st;
+    time_t      start;
+    double      samples, t_db, t_archive, check_db, check_archive, db_bytes, archive_bytes;
+
+    if ((0 == days) || (0 == sensors) || (sensors > 0xFFFF))
+    {
+        printf("Usage: %s [dir] [days] [sensors]\n", argv[0]);
+        return 1;
+    }
+
+    if ((0 != mkdir(p_dir, 0755)) && (0 != access(p_dir, W_OK)))
+    {
+        printf("Failed to create %s.\n", p_dir);
+        return 1;
+    }
+    snprintf(db_path, sizeof(db_path), "%s/bench.db", p_dir);
+    unlink(db_path);
+
+    // Whole days, as the archive has them
+    start = time(NULL) - ((time_t)(days + 1) * 86400);
+    start -= start % 86400;
+    samples = (double)days * sensors * BENCH_SAMPLES_PER_DAY;
+    srand(1);
+
+    printf("%u days of history, %u sensors every %d s, %.0f samples, directory %s\n",
+                                            days, sensors, BENCH_PERIOD_S, samples, p_dir);
+
+    if ((SQLITE_OK != sqlite3_open(db_path, &p_db)) ||
+        (SUCCESS != bench_exec("PRAGMA synchronous=OFF;")) ||
+        (SUCCESS != bench_exec(SQL_CREATE_TABLE)) ||
+        (SUCCESS != bench_exec("CREATE INDEX sensor_data_latest "
+                               "ON sensor_data (sen_id, sl DESC, sen_val);")) ||
+        (SUCCESS != bench_load(p_dir, start, days, sensors)))
+    {
+        printf("Benchmark failed.\n");
+        sqlite3_close(p_db);
+        return 1;
+    }
+
+    // Both scanned once before, so both are measured from the page cache
+    bench_scan_db(&check_db);
+    bench_scan_archive(p_dir, start, days, sensors, &check_archive);
+    t_db = bench_scan_db(&check_db);
+    t_archive = bench_scan_archive(p_dir, start, days, sensors, &check_archive);
+
+    sqlite3_close(p_db);
+
+    stat(db_path, &st);
+    db_bytes = (double)st.st_size;
+    unlink(db_path);
+    archive_bytes = (double)bench_archive_bytes(p_dir, start, days, sensors);
+    rmdir(p_dir);
+
+    if ((t_db < 0) || (t_archive < 0))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    printf("  %-30s %14s %14s\n", "", "sensor_data", "archive");
+    printf("  %-30s %14.0f %14.0f\n", "bytes", db_bytes, archive_bytes);
+    printf("  %-30s %14.2f %14.2f\n", "bytes/sample", db_bytes / samples,
+                                                                archive_bytes / samples);
+    printf("  %-30s %11.1f ms %11.1f ms\n", "trend scan", t_db * 1e3, t_archive * 1e3);
+    printf("  %-30s %14.3f %14.3f\n", "check (sum of daily means)", check_db, check_archive);
+    printf("Archive is %.1fx smaller, trend scan %.1fx faster.\n", db_bytes / archive_bytes,
+                                                                        t_db / t_archive);
+
+    return 0;
+}
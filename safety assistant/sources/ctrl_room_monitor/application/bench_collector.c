@@ -0,0 +1,419 @@
+/******************************************************************************/
+
+/* File - bench_collector.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Throughput benchmark of the multi-node collection path. A collector
+*  daemon (./collector) and several simulated gateway processes run on this
+*  machine, every gateway streams the backlog of its own database through
+*  the uplink (uplink.c) over a Unix socket. The samples per second from
+*  the start of the gateways until the last sample is acknowledged are
+*  reported for a few batch sizes, each run into an empty collector store.
+*
+*  The last run checks resuming as well: the collector is restarted, every
+*  gateway stores more samples and connects again, only the new samples must
+*  be sent and the store must hold every sample of every node exactly once.
+*
+*  Usage: bench_collector [nodes] [samples_per_node]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "config.h"
+#include "db.h"
+#include "lat.h"
+#include "uplink.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_NODES     (8)
+#define BENCH_DEFAULT_SAMPLES   (20000)
+#define BENCH_MAX_NODES         (24)
+#define BENCH_COLLECTOR         "./collector"
+
+/* Sensors of every gateway, samples are stored in cycles of this size
+*/
+#define BENCH_SENSORS           (4)
+#define BENCH_CYCLE             (1000)
+
+/* A gateway not done by then has failed
+*/
+#define BENCH_TIMEOUT_S         (120)
+
+#define SQL_CREATE_TABLES       "CREATE TABLE sensor_data (" \
+                                "sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id INTEGER NOT NULL, " \
+                                "sen_val REAL NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE loads (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "load_type INTEGER NOT NULL, load_status CHAR(3) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE users (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "u_name CHAR(32) NOT NULL, u_pass CHAR(32) NOT NULL, " \
+                                "fl_name CHAR(32) NOT NULL, u_role CHAR(32) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now')));"
+
+/******************************************************************************/
+
+static const uint32_t batch_sizes[] = { 32, 256, 2048 };
+
+static char  bench_dir[64];
+static char  sock_addr[96];
+static char  store_path[96];
+static char  node_paths[BENCH_MAX_NODES][96];
+
+/******************************************************************************/
+
+/* Function declaration to store samples in the database of a gateway
+*  @param[in] p_path   - Database, created if 'is_new'
+*  @param[in] samples  - Samples to append
+*  @param[in] is_new   - Non-zero to create the database
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_fill(const char * p_path, uint32_t samples, uint8_t is_new)
+{
+    sqlite3  *p_db;
+    uint16_t  sen_ids[BENCH_SENSORS];
+    char      key[16];
+    uint32_t  i;
+    uint8_t   ret_val;
+    time_t    now = time(NULL) - samples;
+
+    if (is_new)
+    {
+        ret_val = (SQLITE_OK == sqlite3_open(p_path, &p_db)) &&
+                  (SQLITE_OK == sqlite3_exec(p_db, SQL_CREATE_TABLES, NULL, NULL, NULL));
+        sqlite3_close(p_db);
+        if (!ret_val)
+        {
+            printf("Failed to create %s.\n", p_path);
+            return FAIL;
+        }
+    }
+
+    if (SUCCESS != db_open(p_path, 1))
+    {
+        return FAIL;
+    }
+
+    for (i = 0; i < BENCH_SENSORS; i++)
+    {
+        snprintf(key, sizeof(key), "28BENCH%08X", i);
+        if (SUCCESS != db_map_sensor(key, 1, &sen_ids[i]))
+        {
+            db_close();
+            return FAIL;
+        }
+    }
+
+    for (i = 0, ret_val = SUCCESS; (i < samples) && ret_val; i++)
+    {
+        ret_val = (SUCCESS == db_begin_cycle()) &&
+                  (SUCCESS == db_store_sample(sen_ids[i % BENCH_SENSORS],
+                                              2000 + (int32_t)(i % 1000), now + i));
+        if (ret_val && (((i + 1) % BENCH_CYCLE) == 0))
+        {
+            ret_val = db_commit_cycle();
+        }
+    }
+    ret_val = ret_val && (SUCCESS == db_commit_cycle());
+    db_close();
+
+    return ret_val;
+}
+
+/* Function declaration to run a gateway process, it ends once all samples
+*  of its database are acknowledged
+*  @return - pid_t (process, -1 on failure)
+*/
+static pid_t bench_gateway(uint16_t node, uint32_t batch)
+{
+    char     val[16];
+    char     name[16];
+    int64_t  target, t_end;
+    uint8_t  is_done = 0;
+    pid_t    pid;
+
+    pid = fork();
+    if (0 != pid)
+    {
+        return pid;
+    }
+
+    // Connection messages of the gateways would drown the results
+    freopen("/dev/null", "w", stdout);
+
+    snprintf(name, sizeof(name), "gw%02u", node);
+    snprintf(val, sizeof(val), "%u", batch);
+    config_set("uplink.addr", sock_addr);
+    config_set("uplink.node", name);
+    config_set("uplink.batch", val);
+    config_set("uplink.retry_min_ms", "100");
+
+    if ((SUCCESS != db_open(node_paths[node], 1)) || (SUCCESS != db_read_max_sl(&target)) ||
+        (SUCCESS != uplink_start()))
+    {
+        _exit(1);
+    }
+
+    t_end = lat_now_ns() + ((int64_t)BENCH_TIMEOUT_S * 1000000000LL);
+    while (!is_done && (lat_now_ns() < t_end))
+    {
+        is_done = (uplink_acked() >= target);
+        usleep(1000);
+    }
+
+    uplink_stop();
+    db_close();
+
+    _exit((is_done) ? (0) : (1));
+}
+
+/* Function declaration to start the collector on an empty or existing store
+*  @return - pid_t (process, -1 on failure)
+*/
+static pid_t bench_collector_start(void)
+{
+    char  sock_path[96];
+    pid_t pid;
+    int   fd, i;
+
+    snprintf(sock_path, sizeof(sock_path), "%s", &sock_addr[5]);
+    unlink(sock_path);
+
+    pid = fork();
+    if (0 == pid)
+    {
+        fd = open("/dev/null", O_WRONLY);
+        dup2(fd, STDOUT_FILENO);
+        execl(BENCH_COLLECTOR, BENCH_COLLECTOR, "-l", sock_addr, "-d", store_path, "-r", "0",
+                                                                                (char *)NULL);
+        _exit(127);
+    }
+
+    // Listening once the socket file exists
+    for (i = 0; (pid > 0) && (i < 5000) && (0 != access(sock_path, F_OK)); i++)
+    {
+        usleep(1000);
+    }
+    if ((pid < 0) || (0 != access(sock_path, F_OK)))
+    {
+        printf("Failed to start %s.\n", BENCH_COLLECTOR);
+        return -1;
+    }
+
+    return pid;
+}
+
+static uint8_t bench_collector_stop(pid_t pid)
+{
+    int status;
+
+    kill(pid, SIGTERM);
+
+    return (pid == waitpid(pid, &status, 0)) && WIFEXITED(status) && (0 == WEXITSTATUS(status));
+}
+
+/* Function declaration to run all gateways until every sample is acknowledged
+*  @return - double (seconds, negative on failure)
+*/
+static double bench_run(uint16_t nodes, uint32_t batch)
+{
+    pid_t    pids[BENCH_MAX_NODES];
+    int64_t  t_start, t_end;
+    uint16_t i;
+    int      status;
+    uint8_t  is_ok = 1;
+
+    fflush(stdout);
+
+    t_start = lat_now_ns();
+    for (i = 0; i < nodes; i++)
+    {
+        pids[i] = bench_gateway(i, batch);
+        is_ok = is_ok && (pids[i] > 0);
+    }
+    for (i = 0; i < nodes; i++)
+    {
+        if ((pids[i] <= 0) || (pids[i] != waitpid(pids[i], &status, 0)) ||
+            !WIFEXITED(status) || (0 != WEXITSTATUS(status)))
+        {
+            is_ok = 0;
+        }
+    }
+    t_end = lat_now_ns();
+
+    return (is_ok) ? ((t_end - t_start) / 1e9) : (-1.0);
+}
+
+/* Function declaration to count the samples of the store
+*  @param[out] p_rows       - Samples
+*  @param[out] p_duplicates - Samples stored more than once
+*  @param[out] p_nodes      - Nodes with samples
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_count(int64_t * p_rows, int64_t * p_duplicates, int64_t * p_nodes)
+{
+    sqlite3      *p_db;
+    sqlite3_stmt *p_stmt;
+    uint8_t       ret_val;
+
+    if (SQLITE_OK != sqlite3_open(store_path, &p_db))
+    {
+        sqlite3_close(p_db);
+        return FAIL;
+    }
+
+    ret_val = (SQLITE_OK == sqlite3_prepare_v2(p_db,
+                "SELECT COUNT(*), COUNT(DISTINCT node_id), (SELECT COUNT(*) FROM "
+                "(SELECT 1 FROM node_data GROUP BY node_id, seq HAVING COUNT(*) > 1)) "
+                "FROM node_data;", -1, &p_stmt, NULL));
+    if (ret_val)
+    {
+        ret_val = (SQLITE_ROW == sqlite3_step(p_stmt));
+        *p_rows = (int64_t)sqlite3_column_int64(p_stmt, 0);
+        *p_nodes = (int64_t)sqlite3_column_int64(p_stmt, 1);
+        *p_duplicates = (int64_t)sqlite3_column_int64(p_stmt, 2);
+        sqlite3_finalize(p_stmt);
+    }
+    sqlite3_close(p_db);
+
+    return ret_val;
+}
+
+static void bench_unlink_db(const char * p_path)
+{
+    char path[128];
+
+    unlink(p_path);
+    snprintf(path, sizeof(path), "%s-wal", p_path);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s-shm", p_path);
+    unlink(path);
+}
+
+static void bench_cleanup(uint16_t nodes)
+{
+    uint16_t i;
+
+    for (i = 0; i < nodes; i++)
+    {
+        bench_unlink_db(node_paths[i]);
+    }
+    bench_unlink_db(store_path);
+    rmdir(bench_dir);
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t nodes = (argc > 1) ? ((uint16_t)atoi(argv[1])) : (BENCH_DEFAULT_NODES);
+    uint32_t samples = (argc > 2) ? ((uint32_t)atoi(argv[2])) : (BENCH_DEFAULT_SAMPLES);
+    uint32_t extra = samples / 4;
+    int64_t  rows, duplicates, num_nodes;
+    double   secs;
+    pid_t    collector;
+    uint16_t i, b;
+
+    if ((0 == nodes) || (nodes > BENCH_MAX_NODES) || (0 == samples) || (argc > 3))
+    {
+        printf("Usage: %s [nodes(1..%d)] [samples_per_node]\n", argv[0], BENCH_MAX_NODES);
+        return 1;
+    }
+    if (0 != access(BENCH_COLLECTOR, X_OK))
+    {
+        printf("%s not found, run 'make collector' first.\n", BENCH_COLLECTOR);
+        return 1;
+    }
+
+    snprintf(bench_dir, sizeof(bench_dir), "/tmp/bench_collector.%d", (int)getpid());
+    snprintf(sock_addr, sizeof(sock_addr), "unix:%s/collector.sock", bench_dir);
+    snprintf(store_path, sizeof(store_path), "%s/collector.db", bench_dir);
+    if (0 != mkdir(bench_dir, 0700))
+    {
+        printf("Failed to create %s.\n", bench_dir);
+        return 1;
+    }
+
+    printf("Filling %u gateway database(s) with %u samples each.\n", nodes, samples);
+    for (i = 0; i < nodes; i++)
+    {
+        snprintf(node_paths[i], sizeof(node_paths[i]), "%s/gw%02u.db", bench_dir, i);
+        if (SUCCESS != bench_fill(node_paths[i], samples, 1))
+        {
+            bench_cleanup(nodes);
+            return 1;
+        }
+    }
+
+    printf("%8s %8s %10s %10s %12s\n", "batch", "nodes", "samples", "seconds", "samples/s");
+
+    for (b = 0; b < sizeof(batch_sizes) / sizeof(batch_sizes[0]); b++)
+    {
+        bench_unlink_db(store_path);
+        collector = bench_collector_start();
+        if (collector < 0)
+        {
+            bench_cleanup(nodes);
+            return 1;
+        }
+
+        secs = bench_run(nodes, batch_sizes[b]);
+        if ((secs < 0.0) || !bench_collector_stop(collector) ||
+            (SUCCESS != bench_count(&rows, &duplicates, &num_nodes)) ||
+            (rows != ((int64_t)nodes * samples)) || (0 != duplicates) || (num_nodes != nodes))
+        {
+            printf("Run with batch %u failed.\n", batch_sizes[b]);
+            bench_cleanup(nodes);
+            return 1;
+        }
+
+        printf("%8u %8u %10llu %10.3f %12.0f\n", batch_sizes[b], nodes,
+               (unsigned long long)rows, secs, rows / secs);
+    }
+
+    // Collector restarted on the last store, gateways only send what is new
+    for (i = 0; i < nodes; i++)
+    {
+        if (SUCCESS != bench_fill(node_paths[i], extra, 0))
+        {
+            bench_cleanup(nodes);
+            return 1;
+        }
+    }
+
+    collector = bench_collector_start();
+    if (collector < 0)
+    {
+        bench_cleanup(nodes);
+        return 1;
+    }
+    secs = bench_run(nodes, batch_sizes[b - 1]);
+    if ((secs < 0.0) || !bench_collector_stop(collector) ||
+        (SUCCESS != bench_count(&rows, &duplicates, &num_nodes)))
+    {
+        printf("Resume run failed.\n");
+        bench_cleanup(nodes);
+        return 1;
+    }
+
+    printf("Resume: %u new sample(s) per node in %0.3f s, store holds %lld of %llu, "
+           "%lld duplicate(s).\n", extra, secs, (long long)rows,
+           (unsigned long long)nodes * (samples + extra), (long long)duplicates);
+
+    bench_cleanup(nodes);
+
+    return ((rows == ((int64_t)nodes * (samples + extra))) && (0 == duplicates)) ? (0) : (1);
+}
@@ -0,0 +1,400 @@
+/******************************************************************************/
+
+/* File - bench_compress.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Rows written and reconstruction error of the compression of the raw
+*  samples (see compress.h). Every trace is compressed with 'deadband' and
+*  'swinging' at a few deviations, reconstructed with compress_interpolate()
+*  at the time of every sample taken and compared with it.
+*
+*  Simulated traces (a week each, with the resolution of the sensors):
+*
+*     temp_flat  - control room temperature, slow daily swing, DS18B20 steps
+*     temp_ac    - cabinet temperature cycled by the air conditioner
+*     dust       - dust density, noise and short spikes, every 10 s
+*     humidity   - relative humidity, daily swing and ADC noise
+*     dust_reread - dust, every 25th sample read again within the same
+*                  second, up to half the smallest deviation off
+*
+*  Recorded traces are read from the 'sensor_data' table of a database
+*  (e.g. a copy of ctrl_db.db), one trace per sensor ID.
+*
+*  Usage: bench_compress [-d database] [-b heartbeat_s]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "compress.h"
+
+/******************************************************************************/
+
+#define BENCH_DAYS              (7)
+#define BENCH_HEARTBEAT_S       (900)
+
+/* DS18B20 12-bit step in degree celsius
+*/
+#define BENCH_DS18B20_STEP      (0.0625)
+
+/* Every n-th sample of 'dust_reread' is read again within the same second
+*/
+#define BENCH_REREAD_EVERY      (25)
+
+typedef struct
+{
+    char      name[32];
+    double    dev;                              // Nominal deviation of the trace
+    uint8_t   is_simulated;
+    uint32_t  num;
+    int64_t  *p_time;
+    int32_t  *p_val;                            // 1 / SAMPLE_SCALE units
+} bench_trace_t;
+
+/******************************************************************************/
+
+static const double  dev_factors[] = { 0.5, 1.0, 2.0 };
+static uint64_t      prng = 0x9E3779B97F4A7C15ULL;
+
+/******************************************************************************/
+
+static double bench_rand_unit(void)
+{
+    prng ^= prng >> 12;
+    prng ^= prng << 25;
+    prng ^= prng >> 27;
+
+    return (double)((prng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+/* Gaussian noise (Box-Muller)
+*/
+static double bench_rand_noise(double sigma)
+{
+    double u1 = bench_rand_unit() + 1e-12;
+    double u2 = bench_rand_unit();
+
+    return sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static uint8_t bench_trace_alloc(bench_trace_t * p_trace, const char * p_name, double dev,
+                                                                            uint32_t num)
+{
+    snprintf(p_trace->name, sizeof(p_trace->name), "%s", p_name);
+    p_trace->dev = dev;
+    p_trace->num = num;
+    p_trace->p_time = (int64_t *) malloc(num * sizeof(int64_t));
+    p_trace->p_val = (int32_t *) malloc(num * sizeof(int32_t));
+    if ((NULL == p_trace->p_time) || (NULL == p_trace->p_val))
+    {
+        printf("malloc() failed to allocate.\n");
+        free(p_trace->p_time);
+        free(p_trace->p_val);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+static void bench_trace_free(bench_trace_t * p_trace)
+{
+    free(p_trace->p_time);
+    free(p_trace->p_val);
+}
+
+/* Function declaration to simulate a trace
+*  @param[in] kind - 0 temp_flat, 1 temp_ac, 2 dust, 3 humidity, 4 dust_reread
+*/
+static uint8_t bench_simulate(bench_trace_t * p_trace, uint8_t kind)
+{
+    static const char * const names[] = { "temp_flat", "temp_ac", "dust", "humidity",
+                                          "dust_reread" };
+    static const double       devs[] = { 0.1, 0.1, 0.02, 0.5, 0.02 };
+    uint32_t period_s = ((2 == kind) || (4 == kind)) ? (10) : (60);
+    uint32_t num_taken = (BENCH_DAYS * 86400) / period_s;
+    uint32_t num = num_taken;
+    uint32_t i, n = 0;
+    double   t, val, spike = 0.0, phase;
+
+    if (4 == kind)
+    {
+        num += num_taken / BENCH_REREAD_EVERY;
+    }
+    if (SUCCESS != bench_trace_alloc(p_trace, names[kind], devs[kind], num))
+    {
+        return FAIL;
+    }
+    p_trace->is_simulated = 1;
+
+    for (i = 0; i < num_taken; i++)
+    {
+        t = (double)i * period_s;
+        switch (kind)
+        {
+            case 0:
+                val = 24.0 + 0.4 * sin(2.0 * M_PI * t / 86400.0) + bench_rand_noise(0.015);
+                val = BENCH_DS18B20_STEP * round(val / BENCH_DS18B20_STEP);
+            break;
+
+            case 1:
+                // Heats up from 24.5 to 27.5 in 40 min, cooled down in 10 min
+                phase = fmod(t, 3000.0);
+                val = (phase < 2400.0) ? (24.5 + 3.0 * phase / 2400.0) :
+                                         (27.5 - 3.0 * (phase - 2400.0) / 600.0);
+                val = BENCH_DS18B20_STEP * round((val + bench_rand_noise(0.015)) /
+                                                                    BENCH_DS18B20_STEP);
+            break;
+
+            case 2:
+            case 4:
+                if (bench_rand_unit() < 0.0005)
+                {
+                    spike = 0.4 + 0.4 * bench_rand_unit();
+                }
+                spike *= 0.7;
+                val = 0.12 + 0.02 * sin(2.0 * M_PI * t / 86400.0) + spike +
+                      bench_rand_noise(0.004);
+            break;
+
+            default:
+                val = 42.0 + 4.0 * sin(2.0 * M_PI * (t / 86400.0 + 0.3)) + bench_rand_noise(0.25);
+            break;
+        }
+
+        p_trace->p_time[n] = 1700000000LL + (int64_t)t;
+        p_trace->p_val[n] = (int32_t)lround(val * SAMPLE_SCALE);
+        n++;
+
+        if ((4 == kind) && (0 == ((i + 1) % BENCH_REREAD_EVERY)))
+        {
+            val += (bench_rand_unit() - 0.5) * devs[kind] * dev_factors[0];
+            p_trace->p_time[n] = p_trace->p_time[n - 1];
+            p_trace->p_val[n] = (int32_t)lround(val * SAMPLE_SCALE);
+            n++;
+        }
+    }
+
+    return SUCCESS;
+}
+
+/* Function declaration to read the recorded traces of a database
+*  @param[out] p_traces   - Traces, one per sensor ID
+*  @param[in]  max        - Room in 'p_traces'
+*  @param[out] p_num      - Traces read
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_read_db(const char * p_path, bench_trace_t * p_traces, uint8_t max,
+                                                                            uint8_t * p_num)
+{
+    sqlite3      *p_db;
+    sqlite3_stmt *p_ids = NULL;
+    sqlite3_stmt *p_rows = NULL;
+    char          name[32];
+    uint32_t      i;
+    uint8_t       ret_val;
+
+    *p_num = 0;
+    ret_val = (SQLITE_OK == sqlite3_open_v2(p_path, &p_db, SQLITE_OPEN_READONLY, NULL)) &&
+              (SQLITE_OK == sqlite3_prepare_v2(p_db, "SELECT sen_id, COUNT(*) FROM sensor_data "
+                                        "WHERE time IS NOT NULL GROUP BY sen_id HAVING COUNT(*) > 1 "
+                                        "ORDER BY sen_id;", -1, &p_ids, NULL)) &&
+              (SQLITE_OK == sqlite3_prepare_v2(p_db, "SELECT time, sen_val FROM sensor_data "
+                                        "WHERE sen_id = ?1 AND time IS NOT NULL ORDER BY time, sl;",
+                                        -1, &p_rows, NULL));
+    if (!ret_val)
+    {
+        printf("Failed to read %s: %s\n", p_path, sqlite3_errmsg(p_db));
+    }
+
+    while (ret_val && (*p_num < max) && (SQLITE_ROW == sqlite3_step(p_ids)))
+    {
+        snprintf(name, sizeof(name), "sensor %d", sqlite3_column_int(p_ids, 0));
+        ret_val = bench_trace_alloc(&p_traces[*p_num], name, 0.1,
+                                    (uint32_t)sqlite3_column_int64(p_ids, 1));
+        if (!ret_val)
+        {
+            break;
+        }
+
+        sqlite3_bind_int(p_rows, 1, sqlite3_column_int(p_ids, 0));
+        for (i = 0; (i < p_traces[*p_num].num) && (SQLITE_ROW == sqlite3_step(p_rows)); i++)
+        {
+            p_traces[*p_num].p_time[i] = (int64_t)sqlite3_column_int64(p_rows, 0);
+            p_traces[*p_num].p_val[i] = (int32_t)lround(sqlite3_column_double(p_rows, 1) *
+                                                                            SAMPLE_SCALE);
+        }
+        sqlite3_reset(p_rows);
+        p_traces[*p_num].num = i;
+        p_traces[*p_num].is_simulated = 0;
+        (*p_num)++;
+    }
+
+    sqlite3_finalize(p_ids);
+    sqlite3_finalize(p_rows);
+    sqlite3_close(p_db);
+
+    return ret_val;
+}
+
+/* Function declaration to compress and reconstruct a trace
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the error exceeds the deviation )
+*/
+static uint8_t bench_run(const bench_trace_t * p_trace, compress_mode_t mode, double dev,
+                                                                    uint32_t heartbeat_s)
+{
+    static const char * const mode_names[] = { "none", "deadband", "swinging" };
+    compress_t comp;
+    sample_t   sample, out[2];
+    int64_t   *p_time;
+    double    *p_val;
+    double     val, err, max_err = 0.0, sum_sq = 0.0;
+    uint32_t   num_rows = 0, i;
+    uint8_t    num_out, j;
+
+    p_time = (int64_t *) malloc(p_trace->num * sizeof(int64_t));
+    p_val = (double *) malloc(p_trace->num * sizeof(double));
+    if ((NULL == p_time) || (NULL == p_val))
+    {
+        printf("malloc() failed to allocate.\n");
+        free(p_time);
+        free(p_val);
+        return FAIL;
+    }
+
+    // What the storage thread would write to 'sensor_data'
+    compress_init(&comp, mode, dev, heartbeat_s);
+    memset(&sample, 0, sizeof(sample));
+    for (i = 0; i <= p_trace->num; i++)
+    {
+        if (i < p_trace->num)
+        {
+            sample.sen_time = p_trace->p_time[i];
+            sample.sen_val = p_trace->p_val[i];
+            num_out = compress_push(&comp, &sample, out);
+        }
+        else
+        {
+            num_out = compress_flush(&comp, out);
+        }
+
+        for (j = 0; j < num_out; j++)
+        {
+            if (!(out[j].flags & SAMPLE_NO_RAW))
+            {
+                p_time[num_rows] = out[j].sen_time;
+                p_val[num_rows] = (double)out[j].sen_val / SAMPLE_SCALE;
+                num_rows++;
+            }
+        }
+    }
+
+    // What a reader makes of it at the time of every sample taken
+    for (i = 0; i < p_trace->num; i++)
+    {
+        if (SUCCESS != compress_interpolate(mode, p_time, p_val, num_rows, p_trace->p_time[i], &val))
+        {
+            val = p_val[num_rows - 1];
+        }
+        err = fabs(val - ((double)p_trace->p_val[i] / SAMPLE_SCALE));
+        sum_sq += err * err;
+        if (err > max_err)
+        {
+            max_err = err;
+        }
+    }
+
+    printf("%-12s %-9s %6.3f %9u %9u %7.2f %9.4f %9.4f%s\n", p_trace->name, mode_names[mode],
+           dev, p_trace->num, num_rows, 100.0 * num_rows / p_trace->num, max_err,
+           sqrt(sum_sq / p_trace->num), (max_err > (dev + 1e-9)) ? (" !") : (""));
+
+    free(p_time);
+    free(p_val);
+
+    return (max_err <= (dev + 1e-9)) ? (SUCCESS) : (FAIL);
+}
+
+int main(int argc, char** argv)
+{
+    bench_trace_t traces[16];
+    const char   *p_db_path = NULL;
+    uint32_t      heartbeat_s = BENCH_HEARTBEAT_S;
+    uint8_t       num_traces = 0, num_read, t, f;
+    uint8_t       is_ok = 1;
+    int           opt;
+
+    while (-1 != (opt = getopt(argc, argv, "d:b:")))
+    {
+        switch (opt)
+        {
+            case 'd':
+                p_db_path = optarg;
+            break;
+
+            case 'b':
+                heartbeat_s = (uint32_t)atoi(optarg);
+            break;
+
+            default:
+                printf("Usage: %s [-d database] [-b heartbeat_s]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    for (t = 0; t < 5; t++)
+    {
+        if (SUCCESS != bench_simulate(&traces[num_traces], t))
+        {
+            return 1;
+        }
+        num_traces++;
+    }
+
+    if (NULL != p_db_path)
+    {
+        if (SUCCESS != bench_read_db(p_db_path, &traces[num_traces],
+                                     (uint8_t)(sizeof(traces) / sizeof(traces[0]) - num_traces),
+                                     &num_read))
+        {
+            return 1;
+        }
+        num_traces += num_read;
+        printf("Samples of a recorded trace within the same second (times are stored in\n"
+               "seconds) can not be told apart, they may be off by more than the deviation.\n");
+    }
+    else
+    {
+        printf("No recorded database given (-d), simulated traces only.\n");
+    }
+
+    printf("Heartbeat %u s, errors in sensor units, '!' = error above the deviation\n",
+                                                                            heartbeat_s);
+    printf("%-12s %-9s %6s %9s %9s %7s %9s %9s\n", "trace", "mode", "dev", "samples", "rows",
+                                                    "rows %", "max err", "rms err");
+
+    for (t = 0; t < num_traces; t++)
+    {
+        for (f = 0; f < (sizeof(dev_factors) / sizeof(dev_factors[0])); f++)
+        {
+            // A recorded trace may have samples of the same second further
+            // apart than the deviation, a reader gets one value per second
+            if (((SUCCESS != bench_run(&traces[t], COMPRESS_DEADBAND, traces[t].dev * dev_factors[f],
+                                       heartbeat_s)) && traces[t].is_simulated) ||
+                ((SUCCESS != bench_run(&traces[t], COMPRESS_SWINGING, traces[t].dev * dev_factors[f],
+                                       heartbeat_s)) && traces[t].is_simulated))
+            {
+                is_ok = 0;
+            }
+        }
+        bench_trace_free(&traces[t]);
+    }
+
+    return (is_ok) ? (0) : (1);
+}
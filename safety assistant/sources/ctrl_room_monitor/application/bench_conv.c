@@ -0,0 +1,180 @@
+/******************************************************************************/
+
+/* File - bench_conv.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Check and micro benchmark of the fixed-point sensor conversions (conv.c)
+*  against the former floating point formulas (conv_ref.h):
+*
+*     - every DS18B20 raw value and every integer ADC count has to give the
+*       same 0.01 value, the benchmark fails otherwise
+*     - fractional (filtered) ADC counts are interpolated, the largest
+*       difference over a sweep in 1/256 steps is reported
+*     - mean time per conversion of both, the figures of interest are the
+*       ones on the target, a host FPU hides the difference
+*
+*  Usage: bench_conv [iterations]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common.h"
+#include "conv.h"
+#include "conv_ref.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_ITERATIONS    (2000000)
+
+/******************************************************************************/
+
+// Keeps the compiler from dropping the timed loops
+static volatile int32_t bench_sink;
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* Function declaration to compare a table conversion with its reference
+*  @return - uint32_t (number of integer ADC counts not matching)
+*/
+static uint32_t bench_check_adc(const char * p_name, int32_t (*conv_fn)(float),
+                                                            float (*ref_fn)(float))
+{
+    uint32_t num_diff = 0, max_diff = 0, diff;
+    int32_t  i;
+    float    max_adc = 0.0f;
+    float    adc;
+
+    for (i = 0; i < CONV_ADC_LEVELS; i++)
+    {
+        if (conv_fn((float)i) != conv_ref_centi(ref_fn((float)i)))
+        {
+            printf("  %s: ADC %d gives %d, expected %d\n", p_name, i, conv_fn((float)i),
+                                                conv_ref_centi(ref_fn((float)i)));
+            num_diff++;
+        }
+    }
+
+    for (i = 0; i < ((CONV_ADC_LEVELS - 1) << CONV_FRAC_BITS); i++)
+    {
+        adc = (float)i / (1 << CONV_FRAC_BITS);
+        diff = (uint32_t)abs(conv_fn(adc) - conv_ref_centi(ref_fn(adc)));
+        if (diff > max_diff)
+        {
+            max_diff = diff;
+            max_adc = adc;
+        }
+    }
+
+    // The largest differences are at steps of the former formula within a
+    // count, e.g. the GP2Y1010 cut-off at 3.5 V
+    printf("  %-10s integer counts %s, fractional counts within %u x 0.01 (ADC %.2f)\n",
+                        p_name, (num_diff) ? ("DIFFER") : ("exact"), max_diff, max_adc);
+
+    return num_diff;
+}
+
+/* Function declaration to time a conversion, float and fixed-point
+*/
+static void bench_time(const char * p_name, int32_t (*conv_fn)(float),
+                                        float (*ref_fn)(float), uint32_t iterations)
+{
+    double   t_start, t_ref, t_conv;
+    uint32_t i;
+    int32_t  sum = 0;
+
+    t_start = now_sec();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += conv_ref_centi(ref_fn((float)(i & 1023) + 0.25f));
+    }
+    t_ref = now_sec() - t_start;
+
+    t_start = now_sec();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += conv_fn((float)(i & 1023) + 0.25f);
+    }
+    t_conv = now_sec() - t_start;
+    bench_sink = sum;
+
+    printf("  %-10s float %7.1f ns, fixed-point %7.1f ns\n", p_name,
+                                    t_ref * 1e9 / iterations, t_conv * 1e9 / iterations);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t iterations = (argc > 1) ? ((uint32_t)atol(argv[1])) : (BENCH_DEFAULT_ITERATIONS);
+    uint32_t num_diff = 0, i;
+    double   t_start, t_ref, t_conv;
+    int32_t  sum = 0;
+    int16_t  raw;
+
+    if (0 == iterations)
+    {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Conversion check against the former formulas:\n");
+    for (i = 0; i <= 0xFFFF; i++)
+    {
+        raw = (int16_t)i;
+        if (conv_ds18b20(raw) != conv_ref_centi(conv_ref_ds18b20((uint8_t)i, (uint8_t)(i >> 8))))
+        {
+            if (num_diff < 10)
+            {
+                printf("  DS18B20: raw 0x%04x gives %d, expected %d\n", i, conv_ds18b20(raw),
+                        conv_ref_centi(conv_ref_ds18b20((uint8_t)i, (uint8_t)(i >> 8))));
+            }
+            num_diff++;
+        }
+    }
+    printf("  %-10s all raw values %s\n", "DS18B20", (num_diff) ? ("DIFFER") : ("exact"));
+
+    num_diff += bench_check_adc("HSM-20G", conv_hsm, conv_ref_hsm);
+    num_diff += bench_check_adc("GP2Y1010", conv_gp2y, conv_ref_gp2y);
+
+    printf("\nMean time per conversion, %u iterations:\n", iterations);
+
+    t_start = now_sec();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += conv_ref_centi(conv_ref_ds18b20((uint8_t)i, (uint8_t)((i >> 8) & 0x07)));
+    }
+    t_ref = now_sec() - t_start;
+
+    t_start = now_sec();
+    for (i = 0; i < iterations; i++)
+    {
+        sum += conv_ds18b20((int16_t)(i & 0x07FF));
+    }
+    t_conv = now_sec() - t_start;
+    bench_sink = sum;
+
+    printf("  %-10s float %7.1f ns, fixed-point %7.1f ns\n", "DS18B20",
+                                    t_ref * 1e9 / iterations, t_conv * 1e9 / iterations);
+
+    bench_time("HSM-20G", conv_hsm, conv_ref_hsm, iterations);
+    bench_time("GP2Y1010", conv_gp2y, conv_ref_gp2y, iterations);
+
+    if (num_diff)
+    {
+        printf("Benchmark failed, %u conversion(s) differ.\n", num_diff);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,213 @@
+/******************************************************************************/
+
+/* File - bench_db.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Benchmark of the sensor data storage path. It compares the former
+*  open/sprintf/exec/close per sample path against the long-lived writer in
+*  db.c (prepared INSERT, one transaction per acquisition cycle) with and
+*  without WAL journal mode. Reports inserts/sec and fsyncs per cycle, the
+*  syncs are counted by a pass-through SQLite VFS (bench_vfs.c).
+*
+*  Usage: bench_db [db_path] [cycles] [samples_per_cycle]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "db.h"
+#include "bench_vfs.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_PATH      "/tmp/bench_ctrl_db.db"
+#define BENCH_DEFAULT_CYCLES    (200)
+#define BENCH_DEFAULT_SAMPLES   (4)
+
+#define SQL_CREATE_TABLES       "CREATE TABLE sensor_data (" \
+                                "sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id INTEGER NOT NULL, " \
+                                "sen_val REAL NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE loads (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "load_type INTEGER NOT NULL, load_status CHAR(3) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE users (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "u_name CHAR(32) NOT NULL, u_pass CHAR(32) NOT NULL, " \
+                                "fl_name CHAR(32) NOT NULL, u_role CHAR(32) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now')));"
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* Function declaration to (re)create an empty benchmark database
+*  @param[in] p_path - Path of the database file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_create_db(const char * p_path)
+{
+    sqlite3 *p_db;
+    char     aux_path[256];
+    uint8_t  ret_val;
+
+    unlink(p_path);
+    snprintf(aux_path, sizeof(aux_path), "%s-wal", p_path);
+    unlink(aux_path);
+    snprintf(aux_path, sizeof(aux_path), "%s-shm", p_path);
+    unlink(aux_path);
+    snprintf(aux_path, sizeof(aux_path), "%s-journal", p_path);
+    unlink(aux_path);
+
+    if (SQLITE_OK != sqlite3_open(p_path, &p_db))
+    {
+        sqlite3_close(p_db);
+        return FAIL;
+    }
+    ret_val = (SQLITE_OK == sqlite3_exec(p_db, SQL_CREATE_TABLES, NULL, NULL, NULL)) ?
+                                                                    (SUCCESS) : (FAIL);
+    sqlite3_close(p_db);
+
+    return ret_val;
+}
+
+/* Former storage path, one open/exec/close per sample
+*/
+static uint8_t legacy_store(const char * p_path, uint8_t sen_id, float sen_val)
+{
+    sqlite3 *p_db;
+    char     query[64];
+    uint8_t  ret_val;
+
+    if (SQLITE_OK != sqlite3_open(p_path, &p_db))
+    {
+        sqlite3_close(p_db);
+        return FAIL;
+    }
+    sprintf(query, "INSERT INTO sensor_data (sen_id, sen_val) values (%d, %0.2f);",
+                                                                   sen_id, sen_val);
+    ret_val = (SQLITE_OK == sqlite3_exec(p_db, query, NULL, NULL, NULL)) ? (SUCCESS) : (FAIL);
+    sqlite3_close(p_db);
+
+    return ret_val;
+}
+
+static void bench_report(const char * p_name, uint32_t cycles, uint32_t samples,
+                                                        double elapsed, unsigned long syncs)
+{
+    printf("%-22s %10.0f inserts/s %8.2f fsyncs/cycle %8.3f ms/cycle\n", p_name,
+           (cycles * samples) / elapsed, (double)syncs / cycles, (elapsed * 1e3) / cycles);
+}
+
+static uint8_t bench_legacy(const char * p_path, uint32_t cycles, uint32_t samples)
+{
+    uint32_t c, s;
+    double   start;
+
+    if (SUCCESS != bench_create_db(p_path))
+    {
+        return FAIL;
+    }
+
+    bench_vfs_reset();
+    start = now_sec();
+    for (c = 0; c < cycles; c++)
+    {
+        for (s = 0; s < samples; s++)
+        {
+            if (SUCCESS != legacy_store(p_path, s + 1, 25.0 + (c % 16) * 0.0625))
+            {
+                return FAIL;
+            }
+        }
+    }
+    bench_report("open/exec/close", cycles, samples, now_sec() - start, bench_vfs_syncs());
+
+    return SUCCESS;
+}
+
+static uint8_t bench_batched(const char * p_path, uint32_t cycles, uint32_t samples,
+                                                                    uint8_t use_wal)
+{
+    uint32_t c, s;
+    double   start;
+
+    if ((SUCCESS != bench_create_db(p_path)) || (SUCCESS != db_open(p_path, use_wal)))
+    {
+        return FAIL;
+    }
+
+    bench_vfs_reset();
+    start = now_sec();
+    for (c = 0; c < cycles; c++)
+    {
+        if (SUCCESS != db_begin_cycle())
+        {
+            db_close();
+            return FAIL;
+        }
+        for (s = 0; s < samples; s++)
+        {
+            if (SUCCESS != db_store_sample(s + 1, 2500 + (c % 16) * 6, time(NULL)))
+            {
+                db_close();
+                return FAIL;
+            }
+        }
+        if (SUCCESS != db_commit_cycle())
+        {
+            db_close();
+            return FAIL;
+        }
+    }
+    bench_report((use_wal) ? ("prepared+txn (WAL)") : ("prepared+txn"), cycles, samples,
+                                                            now_sec() - start, bench_vfs_syncs());
+    db_close();
+
+    return SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    const char *p_path  = (argc > 1) ? (argv[1]) : (BENCH_DEFAULT_PATH);
+    uint32_t    cycles  = (argc > 2) ? ((uint32_t)atoi(argv[2])) : (BENCH_DEFAULT_CYCLES);
+    uint32_t    samples = (argc > 3) ? ((uint32_t)atoi(argv[3])) : (BENCH_DEFAULT_SAMPLES);
+
+    if ((0 == cycles) || (0 == samples))
+    {
+        printf("Usage: %s [db_path] [cycles] [samples_per_cycle]\n", argv[0]);
+        return 1;
+    }
+
+    if (SUCCESS != bench_vfs_register())
+    {
+        printf("Failed to register sync counting VFS.\n");
+        return 1;
+    }
+
+    printf("%u cycles x %u samples, database %s\n", cycles, samples, p_path);
+
+    if ((SUCCESS != bench_legacy(p_path, cycles, samples)) ||
+        (SUCCESS != bench_batched(p_path, cycles, samples, 0)) ||
+        (SUCCESS != bench_batched(p_path, cycles, samples, 1)))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,161 @@
+/******************************************************************************/
+
+/* File - bench_dust.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Timing benchmark of the dust sensor pulse engine (dust.c). Runs bursts of
+*  pulses first on an idle system, then with CPU hog threads, and reports
+*  the offset of the ADC sample point from the 280 us target (min, mean,
+*  p99, max). Built against the simulated HAL, on the target it may be built
+*  with hal_mraa.c instead to include the real GPIO/ADC latency.
+*
+*  Usage: bench_dust [bursts] [load_threads] [rt_priority] [mlockall]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "hal.h"
+#include "dust.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_BURSTS    (50)
+#define BENCH_DEFAULT_SAMPLES   (16)
+
+/******************************************************************************/
+
+static atomic_int load_stop;
+
+/******************************************************************************/
+
+/* CPU hog, mixes computation with system calls like a busy host would
+*/
+static void * load_thread_fn(void * p_arg)
+{
+    volatile uint64_t x = 1;
+    uint32_t          i;
+
+    while (!atomic_load(&load_stop))
+    {
+        for (i = 0; i < 100000; i++)
+        {
+            x = (x * 6364136223846793005ULL) + 1442695040888963407ULL;
+        }
+        getppid();
+    }
+
+    return NULL;
+}
+
+static uint8_t bench_run(const char * p_name, hal_gpio_t * p_gpio, hal_aio_t * p_aio,
+                            uint32_t bursts, uint32_t load_threads, int rt_priority,
+                                                                    uint8_t lock_memory)
+{
+    pthread_t     *p_load;
+    dust_jitter_t  jitter;
+    dust_result_t  result;
+    uint32_t       i;
+
+    p_load = (pthread_t *) calloc(load_threads + 1, sizeof(pthread_t));
+    if (NULL == p_load)
+    {
+        return FAIL;
+    }
+
+    atomic_store(&load_stop, 0);
+    for (i = 0; i < load_threads; i++)
+    {
+        pthread_create(&p_load[i], NULL, load_thread_fn, NULL);
+    }
+
+    if (SUCCESS != dust_start(p_gpio, p_aio, BENCH_DEFAULT_SAMPLES, rt_priority, lock_memory))
+    {
+        free(p_load);
+        return FAIL;
+    }
+
+    dust_jitter_reset(&jitter);
+    for (i = 0; i < bursts; i++)
+    {
+        dust_trigger();
+        while (SUCCESS != dust_poll(&result))
+        {
+            usleep(1000);
+        }
+        dust_jitter_add(&jitter, &result);
+    }
+
+    dust_stop();
+
+    atomic_store(&load_stop, 1);
+    for (i = 0; i < load_threads; i++)
+    {
+        pthread_join(p_load[i], NULL);
+    }
+    free(p_load);
+
+    printf("%-22s ", p_name);
+    dust_jitter_print(&jitter);
+
+    return SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t    bursts = (argc > 1) ? ((uint32_t)atoi(argv[1])) : (BENCH_DEFAULT_BURSTS);
+    uint32_t    load_threads = (argc > 2) ? ((uint32_t)atoi(argv[2])) :
+                                            (2 * (uint32_t)sysconf(_SC_NPROCESSORS_ONLN));
+    int         rt_priority = (argc > 3) ? (atoi(argv[3])) : (0);
+    uint8_t     lock_memory = (argc > 4) ? ((uint8_t)atoi(argv[4])) : (0);
+    hal_gpio_t *p_gpio;
+    hal_aio_t  *p_aio;
+    char        name[32];
+
+    if (0 == bursts)
+    {
+        printf("Usage: %s [bursts] [load_threads] [rt_priority] [mlockall]\n", argv[0]);
+        return 1;
+    }
+
+    if (SUCCESS != hal_init())
+    {
+        return 1;
+    }
+    p_gpio = hal_gpio_init(4);
+    p_aio = hal_aio_init(0);
+    if ((NULL == p_gpio) || (NULL == p_aio) || (HAL_SUCCESS != hal_gpio_dir_out(p_gpio)))
+    {
+        printf("Failed to open dust sensor pins.\n");
+        return 1;
+    }
+
+    printf("%u bursts x %d pulses, SCHED_FIFO priority %d, mlockall %d\n", bursts,
+                                    BENCH_DEFAULT_SAMPLES, rt_priority, lock_memory);
+
+    snprintf(name, sizeof(name), "idle:");
+    if (SUCCESS != bench_run(name, p_gpio, p_aio, bursts, 0, rt_priority, lock_memory))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    snprintf(name, sizeof(name), "%u load threads:", load_threads);
+    if (SUCCESS != bench_run(name, p_gpio, p_aio, bursts, load_threads, rt_priority, lock_memory))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    hal_aio_close(p_aio);
+    hal_gpio_close(p_gpio);
+
+    return 0;
+}
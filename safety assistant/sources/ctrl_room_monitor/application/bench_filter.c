@@ -0,0 +1,553 @@
+/******************************************************************************/
+
+/* File - bench_filter.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Check and benchmark of the filter stage of the analog channels (see
+*  filter.h). ADC streams are run through filter_reduce() and
+*  filter_update() and every result is compared with a straightforward
+*  reference (sorting in double precision):
+*
+*     simulated - dust and humidity like bursts (BENCH_VALUES per
+*                 configuration) with noise, pulses hit by an LED edge and a
+*                 step, for the filters of analog.c and variants of them
+*                 covering every window mode
+*     recorded  - the ADC bursts of a trace file (see trace.h), e.g. a
+*                 capture of the application or the synthetic day of
+*                 'replay -g', with the filter of the sensor type
+*
+*  Spikes are added to the reduced values of both every BENCH_SPIKE_EVERY
+*  values, and pulses of a burst are hit up to the number its reduction
+*  drops.
+*
+*  Checked: median, trimmed mean, mean, MAD spike test and EMA as the
+*  reference, every added spike rejected and kept out of the output, no
+*  burst moved by its hit pulses beyond the noise, and a step followed
+*  within BENCH_STEP_SAMPLES values.
+*
+*  Usage: bench_filter [trace_file]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "registry.h"
+#include "trace.h"
+#include "filter.h"
+
+/******************************************************************************/
+
+#define BENCH_VALUES            (20000)
+#define BENCH_MAX_RECORDED      (200000)
+
+/* Added spikes: spacing, first one after the window filled, and size in
+*  ADC counts
+*/
+#define BENCH_SPIKE_EVERY       (50)
+#define BENCH_SPIKE_FIRST       (20)
+#define BENCH_SPIKE_COUNTS      (600.0)
+
+/* Values after a step until the output is within 10 noise deviations of the
+*  new level
+*/
+#define BENCH_STEP_SAMPLES      (16)
+
+/* Difference allowed between the float filter and the double reference, in
+*  ADC counts
+*/
+#define BENCH_TOL               (0.01)
+
+/* MAD of normally distributed noise times this factor is its standard
+*  deviation, as in filter.c
+*/
+#define BENCH_MAD_SCALE         (1.4826)
+
+/* Stream of bursts of an analog sensor
+*/
+typedef struct
+{
+    const char   *p_name;
+    filter_cfg_t  cfg;
+    double        level;                        // ADC counts
+    double        noise;
+    uint8_t       pulses;
+} bench_stream_t;
+
+/* Straightforward streaming stage, see filter.h
+*/
+typedef struct
+{
+    double   hist[FILTER_MAX_WINDOW];
+    uint8_t  count;
+    uint8_t  pos;
+    double   ema;
+    uint8_t  is_ema_valid;
+} bench_ref_t;
+
+typedef struct
+{
+    uint32_t values;
+    uint32_t mismatches;
+    uint32_t borderline;
+    uint32_t spikes;
+    uint32_t spikes_passed;
+    uint32_t bursts_moved;
+    double   update_ns;
+} bench_result_t;
+
+/******************************************************************************/
+
+// Filters of analog.c
+static const bench_stream_t streams[] =
+{
+    { "dust",      { FILTER_MODE_TRIMMED, FILTER_MODE_NONE, 4, 9, 4.0f, 4.0f, 0.0f }, 150.0, 4.0, 16 },
+    { "humidity",  { FILTER_MODE_MEDIAN, FILTER_MODE_NONE, 0, 9, 4.0f, 2.0f, 0.3f }, 290.0, 2.0, 8 },
+    { "median 5",  { FILTER_MODE_MEDIAN, FILTER_MODE_MEDIAN, 0, 5, 3.0f, 2.0f, 0.0f }, 290.0, 2.0, 7 },
+    { "trimmed 7", { FILTER_MODE_MEAN, FILTER_MODE_TRIMMED, 1, 7, 4.0f, 2.0f, 0.5f }, 150.0, 4.0, 16 },
+    { "mean 4",    { FILTER_MODE_TRIMMED, FILTER_MODE_MEAN, 2, 4, 0.0f, 0.0f, 0.0f }, 150.0, 4.0, 16 }
+};
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* Standard normal, xorshift64 and Box-Muller
+*/
+static double bench_uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double bench_normal(void)
+{
+    return sqrt(-2.0 * log(bench_uniform())) * cos(2.0 * M_PI * bench_uniform());
+}
+
+static int cmp_double(const void * p_a, const void * p_b)
+{
+    double a = *(const double *)p_a;
+    double b = *(const double *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+static double ref_median(const double * p_sorted, uint8_t num)
+{
+    return (num & 1) ? (p_sorted[num / 2]) : ((p_sorted[(num / 2) - 1] + p_sorted[num / 2]) / 2.0);
+}
+
+/* Reduction of sorted values by a mode, FILTER_MODE_NONE as mean
+*/
+static double ref_reduce(filter_mode_t mode, uint8_t trim, const double * p_sorted, uint8_t num)
+{
+    double  sum = 0.0;
+    uint8_t i;
+
+    if ((FILTER_MODE_MEDIAN == mode) || ((FILTER_MODE_TRIMMED == mode) && ((2 * trim) >= num)))
+    {
+        return ref_median(p_sorted, num);
+    }
+    if (FILTER_MODE_TRIMMED != mode)
+    {
+        trim = 0;
+    }
+
+    for (i = trim; i < (num - trim); i++)
+    {
+        sum += p_sorted[i];
+    }
+
+    return sum / (num - (2 * trim));
+}
+
+/* Function declaration of the reference of filter_update()
+*  @param[in]  p_cfg        - Configuration
+*  @param[in]  p_ref        - Reference state
+*  @param[in]  value        - New value
+*  @param[out] p_is_spike   - Spike decision
+*  @param[out] p_borderline - Set to 1 if the value is within BENCH_TOL of
+*                             the spike threshold, where float and double
+*                             may decide differently
+*  @return - double (filtered value)
+*/
+static double ref_update(const filter_cfg_t * p_cfg, bench_ref_t * p_ref, double value,
+                                                uint8_t * p_is_spike, uint8_t * p_borderline)
+{
+    double  sorted[FILTER_MAX_WINDOW];
+    double  median, mad;
+    double  result = value;
+    uint8_t i;
+
+    *p_is_spike = 0;
+    *p_borderline = 0;
+
+    if (p_cfg->window > 0)
+    {
+        if ((p_cfg->mad_k > 0.0f) && (p_ref->count >= ((p_cfg->window + 1) / 2)))
+        {
+            memcpy(sorted, p_ref->hist, p_ref->count * sizeof(double));
+            qsort(sorted, p_ref->count, sizeof(double), cmp_double);
+            median = ref_median(sorted, p_ref->count);
+            for (i = 0; i < p_ref->count; i++)
+            {
+                sorted[i] = fabs(p_ref->hist[i] - median);
+            }
+            qsort(sorted, p_ref->count, sizeof(double), cmp_double);
+            mad = fmax(BENCH_MAD_SCALE * ref_median(sorted, p_ref->count), p_cfg->mad_floor);
+
+            *p_is_spike = (fabs(value - median) > (p_cfg->mad_k * mad));
+            *p_borderline = (fabs(fabs(value - median) - (p_cfg->mad_k * mad)) < BENCH_TOL);
+            if (*p_is_spike)
+            {
+                result = median;
+            }
+        }
+
+        p_ref->hist[p_ref->pos] = value;
+        p_ref->pos = (p_ref->pos + 1) % p_cfg->window;
+        if (p_ref->count < p_cfg->window)
+        {
+            p_ref->count++;
+        }
+
+        if (!*p_is_spike && (FILTER_MODE_NONE != p_cfg->mode))
+        {
+            memcpy(sorted, p_ref->hist, p_ref->count * sizeof(double));
+            qsort(sorted, p_ref->count, sizeof(double), cmp_double);
+            result = ref_reduce(p_cfg->mode, p_cfg->trim, sorted, p_ref->count);
+        }
+    }
+
+    if (p_cfg->ema_alpha > 0.0f)
+    {
+        p_ref->ema = (p_ref->is_ema_valid) ? (p_ref->ema + p_cfg->ema_alpha * (result - p_ref->ema))
+                                           : (result);
+        p_ref->is_ema_valid = 1;
+        result = p_ref->ema;
+    }
+
+    return result;
+}
+
+/* Function declaration to reduce a burst and check it against the reference
+*  @param[in]     p_filter - Filter
+*  @param[in]     p_adc    - ADC counts (left unchanged)
+*  @param[in]     num      - Number of counts
+*  @param[in,out] p_result - Counts of mismatches
+*  @return - double (reduced value of the filter)
+*/
+static double bench_reduce(const filter_t * p_filter, const int32_t * p_adc, uint8_t num,
+                                                                bench_result_t * p_result)
+{
+    int32_t buf[FILTER_MAX_WINDOW];
+    double  sorted[FILTER_MAX_WINDOW];
+    double  value, ref;
+    uint8_t i;
+
+    for (i = 0; i < num; i++)
+    {
+        buf[i] = p_adc[i];
+        sorted[i] = p_adc[i];
+    }
+    qsort(sorted, num, sizeof(double), cmp_double);
+
+    value = filter_reduce(p_filter, buf, num);
+    ref = ref_reduce(p_filter->cfg.burst_mode, p_filter->cfg.trim, sorted, num);
+    if (fabs(value - ref) > BENCH_TOL)
+    {
+        if (p_result->mismatches++ < 5)
+        {
+            printf("    burst reduced to %.3f, reference %.3f\n", value, ref);
+        }
+    }
+
+    return value;
+}
+
+/* Function declaration to run a reduced value through the streaming stage
+*  and check it against the reference
+*  @param[in]     p_filter   - Filter
+*  @param[in]     p_ref      - Reference state
+*  @param[in]     value      - Reduced value
+*  @param[out]    p_is_spike - Spike decision of the filter
+*  @param[in,out] p_result   - Counts of mismatches
+*  @return - double (filtered value)
+*/
+static double bench_update(filter_t * p_filter, bench_ref_t * p_ref, double value,
+                                        uint8_t * p_is_spike, bench_result_t * p_result)
+{
+    double  t_run, out, ref;
+    uint8_t is_ref_spike, is_borderline;
+
+    t_run = now_sec();
+    out = filter_update(p_filter, (float)value, p_is_spike);
+    p_result->update_ns += (now_sec() - t_run) * 1e9;
+    p_result->values++;
+
+    ref = ref_update(&p_filter->cfg, p_ref, value, &is_ref_spike, &is_borderline);
+
+    // At the threshold float and double may decide either way, the
+    // reference follows the filter then
+    if (is_borderline && (*p_is_spike != is_ref_spike))
+    {
+        p_result->borderline++;
+        p_ref->ema = p_filter->ema;
+        return out;
+    }
+
+    if ((*p_is_spike != is_ref_spike) || (fabs(out - ref) > BENCH_TOL + (1e-6 * fabs(ref))))
+    {
+        if (p_result->mismatches++ < 5)
+        {
+            printf("    value %.3f filtered to %.3f%s, reference %.3f%s\n", value, out,
+                   (*p_is_spike) ? (" (spike)") : (""), ref, (is_ref_spike) ? (" (spike)") : (""));
+        }
+    }
+
+    return out;
+}
+
+/* Function declaration to add a spike to a reduced value and check it is
+*  kept out
+*  @param[in]     p_filter - Filter
+*  @param[in]     p_ref    - Reference state
+*  @param[in]     value    - Reduced value
+*  @param[in]     sign     - Direction of the spike, 1 or -1
+*  @param[in,out] p_result - Counts of spikes
+*  @return - None
+*/
+static void bench_spike(filter_t * p_filter, bench_ref_t * p_ref, double value, double sign,
+                                                                bench_result_t * p_result)
+{
+    double  spike = value + (sign * BENCH_SPIKE_COUNTS);
+    double  out;
+    uint8_t is_spike;
+
+    out = bench_update(p_filter, p_ref, spike, &is_spike, p_result);
+    p_result->spikes++;
+    if (!is_spike || (fabs(out - spike) < (BENCH_SPIKE_COUNTS / 2)))
+    {
+        if (p_result->spikes_passed++ < 5)
+        {
+            printf("    spike %.1f passed as %.3f\n", spike, out);
+        }
+    }
+}
+
+static void bench_report(const char * p_name, const bench_result_t * p_result)
+{
+    printf("  %-22s %7u values %5.0f ns/update  %u mismatches  %u/%u spikes passed  "
+           "%u bursts moved  %u at the threshold\n", p_name, p_result->values,
+           (p_result->values) ? (p_result->update_ns / p_result->values) : (0.0),
+           p_result->mismatches, p_result->spikes_passed, p_result->spikes,
+           p_result->bursts_moved, p_result->borderline);
+}
+
+/* Function declaration to run a simulated stream: a level with noise, a step
+*  of 250 counts half way and pulses hit by an LED edge
+*  @param[in] p_stream - Stream
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a failed check )
+*/
+static uint8_t bench_simulated(const bench_stream_t * p_stream)
+{
+    filter_t        filter;
+    bench_ref_t     ref;
+    bench_result_t  result;
+    int32_t         adc[FILTER_MAX_WINDOW];
+    double          level, clean, value, out;
+    uint32_t        n, step_at = BENCH_VALUES / 2, followed = 0;
+    uint8_t         i, hits, max_hits, is_spike;
+    uint8_t         is_ok = 1;
+
+    memset(&ref, 0, sizeof(ref));
+    memset(&result, 0, sizeof(result));
+    if (SUCCESS != filter_init(&filter, &p_stream->cfg))
+    {
+        return FAIL;
+    }
+
+    // Hits a reduction drops for sure: the trimmed pulses, fewer than half
+    // for the median
+    max_hits = (FILTER_MODE_TRIMMED == p_stream->cfg.burst_mode) ? (p_stream->cfg.trim) :
+               ((FILTER_MODE_MEDIAN == p_stream->cfg.burst_mode) ? ((p_stream->pulses - 1) / 2) : (0));
+
+    for (n = 0; n < BENCH_VALUES; n++)
+    {
+        level = p_stream->level + ((n >= step_at) ? (250.0) : (0.0));
+
+        clean = 0.0;
+        for (i = 0; i < p_stream->pulses; i++)
+        {
+            adc[i] = (int32_t)lrint(level + (p_stream->noise * bench_normal()));
+            clean += adc[i];
+        }
+        clean /= p_stream->pulses;
+
+        hits = (max_hits) ? ((uint8_t)(n % (max_hits + 1))) : (0);
+        for (i = 0; i < hits; i++)
+        {
+            adc[(n + (5 * i)) % p_stream->pulses] += (i & 1) ? (-300) : (300);
+        }
+
+        value = bench_reduce(&filter, adc, p_stream->pulses, &result);
+        if (fabs(value - clean) > (4.0 * p_stream->noise))
+        {
+            if (result.bursts_moved++ < 5)
+            {
+                printf("    burst with %u hit pulses reduced to %.3f, %.3f without\n",
+                                                                    hits, value, clean);
+            }
+        }
+
+        if ((p_stream->cfg.mad_k > 0.0f) && (n >= BENCH_SPIKE_FIRST) && (n < step_at - FILTER_MAX_WINDOW) &&
+            (0 == (n % BENCH_SPIKE_EVERY)))
+        {
+            bench_spike(&filter, &ref, value, (n & 1) ? (-1.0) : (1.0), &result);
+            continue;
+        }
+
+        out = bench_update(&filter, &ref, value, &is_spike, &result);
+        if ((n >= step_at) && !followed && (fabs(out - level) < (10.0 * p_stream->noise)))
+        {
+            followed = n - step_at + 1;
+        }
+    }
+
+    bench_report(p_stream->p_name, &result);
+    printf("  %-22s step followed after %u values\n", "", followed);
+
+    if (result.mismatches || result.spikes_passed || result.bursts_moved || !followed ||
+        (followed > BENCH_STEP_SAMPLES))
+    {
+        is_ok = 0;
+    }
+
+    return (is_ok) ? (SUCCESS) : (FAIL);
+}
+
+/* Function declaration to run the ADC bursts of a trace through the filter
+*  of their sensor type
+*  @param[in] p_path - Trace file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a failed check or bad trace )
+*/
+static uint8_t bench_recorded(const char * p_path)
+{
+    static uint8_t  types[0x10000];
+    static filter_t filters[TRACE_MAX_SENSORS];
+    static uint16_t ids[TRACE_MAX_SENSORS];
+    static bench_ref_t refs[TRACE_MAX_SENSORS];
+    static uint32_t counts[TRACE_MAX_SENSORS];
+    trace_reader_t  reader;
+    trace_rec_t     rec;
+    bench_result_t  result;
+    double          value;
+    uint8_t         num = 0, i, is_spike;
+    int             ret;
+    char            name[32];
+
+    if (SUCCESS != trace_reader_open(&reader, p_path))
+    {
+        printf("  %s is not a trace file.\n", p_path);
+        return FAIL;
+    }
+    memset(&result, 0, sizeof(result));
+
+    while ((1 == (ret = trace_read(&reader, &rec))) && (result.values < BENCH_MAX_RECORDED))
+    {
+        if (TRACE_REC_SENSOR == rec.kind)
+        {
+            types[rec.sen_id] = rec.type;
+            continue;
+        }
+        if ((TRACE_REC_AIO != rec.kind) || (0 == rec.num_adc) || (rec.num_adc > FILTER_MAX_WINDOW))
+        {
+            continue;
+        }
+
+        for (i = 0; (i < num) && (ids[i] != rec.sen_id); i++)
+        {
+        }
+        if (i == num)
+        {
+            if ((TRACE_MAX_SENSORS == num) ||
+                ((SENSOR_TYPE_GP2Y != types[rec.sen_id]) && (SENSOR_TYPE_HSM != types[rec.sen_id])))
+            {
+                continue;
+            }
+            filter_init(&filters[i], &streams[(SENSOR_TYPE_GP2Y == types[rec.sen_id]) ? (0) : (1)].cfg);
+            ids[i] = rec.sen_id;
+            num++;
+        }
+
+        value = bench_reduce(&filters[i], rec.adc, rec.num_adc, &result);
+        if ((counts[i] >= BENCH_SPIKE_FIRST) && (0 == (counts[i] % BENCH_SPIKE_EVERY)))
+        {
+            bench_spike(&filters[i], &refs[i], value, (counts[i] & 1) ? (-1.0) : (1.0), &result);
+        }
+        else
+        {
+            bench_update(&filters[i], &refs[i], value, &is_spike, &result);
+        }
+        counts[i]++;
+    }
+    trace_reader_close(&reader);
+
+    if (ret < 0)
+    {
+        printf("  %s is corrupted.\n", p_path);
+        return FAIL;
+    }
+
+    snprintf(name, sizeof(name), "recorded, %u sensors", num);
+    bench_report(name, &result);
+
+    return ((0 == result.mismatches) && (0 == result.spikes_passed) && result.values) ?
+                                                                        (SUCCESS) : (FAIL);
+}
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    uint8_t i;
+    uint8_t is_ok = 1;
+
+    printf("Filter against the reference, %d simulated values per stream\n", BENCH_VALUES);
+
+    for (i = 0; i < (sizeof(streams) / sizeof(streams[0])); i++)
+    {
+        is_ok &= (SUCCESS == bench_simulated(&streams[i]));
+    }
+
+    if (argc > 1)
+    {
+        is_ok &= (SUCCESS == bench_recorded(argv[1]));
+    }
+
+    if (!is_ok)
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
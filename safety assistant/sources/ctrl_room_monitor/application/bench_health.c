@@ -0,0 +1,361 @@
+/******************************************************************************/
+
+/* File - bench_health.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Benchmark of the streaming statistics of the sensors (see health.h) with
+*  the default configuration. Synthetic series of BENCH_SAMPLES samples, in
+*  1 / SAMPLE_SCALE units as acquired:
+*
+*     temperature - 25 degree celsius with gaussian noise, quantized to the
+*                   0.0625 steps of a DS18B20
+*     dust        - skewed, a baseline of 0.3 plus exponential bursts
+*
+*  For each it reports the update time per sample and the error of the
+*  statistics against exact computation over the whole series: Welford
+*  against a two-pass mean and standard deviation, P-square quantiles as
+*  the ranks they fall between, min/max against a scan of the window after
+*  every sample. Then the CUSUM: drifts raised on stationary noise after the
+*  baseline, and samples from the start of a step or ramp away from the
+*  baseline until drift is raised.
+*
+*  Checked: min/max exact, mean and standard deviation within 1e-9
+*  (relative), quantiles within BENCH_MAX_RANK_ERR of their rank, no drift
+*  on stationary noise and every shift detected.
+*
+*  Usage: bench_health [samples]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "sample.h"
+#include "health.h"
+
+/******************************************************************************/
+
+#define BENCH_SAMPLES           (1000000)
+
+/* Largest error of the rank of a quantile estimate, e.g. the p95 estimate
+*  must be between the samples at 94.5 % and at 95.5 %, give or take half
+*  the resolution of the values. Readings are quantized, a value may span
+*  several percent of the samples.
+*/
+#define BENCH_MAX_RANK_ERR      (0.005)
+
+/* Noise of the temperature series, in degree celsius
+*/
+#define BENCH_SIGMA             (0.1)
+
+/******************************************************************************/
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static int32_t *p_vals = NULL;
+static int32_t *p_sorted = NULL;
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* Uniform in (0, 1), xorshift64
+*/
+static double bench_uniform(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* Standard normal, Box-Muller
+*/
+static double bench_normal(void)
+{
+    return sqrt(-2.0 * log(bench_uniform())) * cos(2.0 * M_PI * bench_uniform());
+}
+
+/* Temperature reading of a DS18B20 in 1 / SAMPLE_SCALE units
+*/
+static int32_t bench_temp(double mean)
+{
+    double t = round((mean + BENCH_SIGMA * bench_normal()) * 16.0) / 16.0;
+
+    return (int32_t)lround(t * SAMPLE_SCALE);
+}
+
+static int32_t bench_dust(void)
+{
+    double d = 0.3 + 0.02 * bench_normal();
+
+    if (bench_uniform() < 0.05)
+    {
+        d += -0.2 * log(bench_uniform());
+    }
+
+    return (int32_t)lround(d * SAMPLE_SCALE);
+}
+
+static int cmp_int32(const void * p_a, const void * p_b)
+{
+    int32_t a = *(const int32_t *)p_a;
+    int32_t b = *(const int32_t *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+/* Sorted sample at a rank, clamped to the series
+*/
+static double bench_at(uint32_t num, double rank)
+{
+    rank = (rank < 0.0) ? (0.0) : ((rank > 1.0) ? (1.0) : (rank));
+
+    return (double)p_sorted[(uint32_t)(rank * (num - 1))] / SAMPLE_SCALE;
+}
+
+/* Function declaration to run a series through the statistics and check
+*  them against exact computation
+*  @param[in] p_name - Name of the series
+*  @param[in] p_cfg  - Configuration
+*  @param[in] num    - Number of samples in 'p_vals'
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a failed check )
+*/
+static uint8_t bench_series(const char * p_name, const health_cfg_t * p_cfg, uint32_t num)
+{
+    static health_t health;
+    db_health_t     row;
+    double          t_run, sum = 0.0, sq = 0.0, mean, stddev;
+    double          est[3], lo_q, hi_q;
+    const double    p[3] = { 0.50, 0.95, 0.99 };
+    int32_t         lo, hi;
+    uint32_t        i, j, bad_window = 0;
+    uint8_t         is_ok = 1;
+
+    // Time the updates alone first
+    memset(&health, 0, sizeof(health));
+    t_run = now_sec();
+    for (i = 0; i < num; i++)
+    {
+        health_update(&health, p_cfg, p_vals[i]);
+    }
+    t_run = now_sec() - t_run;
+    health_snapshot(&health, p_cfg, &row);
+
+    // Window against a scan, after every sample
+    memset(&health, 0, sizeof(health));
+    for (i = 0; i < num; i++)
+    {
+        health_update(&health, p_cfg, p_vals[i]);
+
+        lo = hi = p_vals[i];
+        for (j = (i + 1 > p_cfg->window) ? (i + 1 - p_cfg->window) : (0); j < i; j++)
+        {
+            lo = (p_vals[j] < lo) ? (p_vals[j]) : (lo);
+            hi = (p_vals[j] > hi) ? (p_vals[j]) : (hi);
+        }
+        if ((health.min.val[health.min.head] != lo) || (health.max.val[health.max.head] != hi))
+        {
+            bad_window++;
+        }
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        sum += (double)p_vals[i] / SAMPLE_SCALE;
+    }
+    mean = sum / num;
+    for (i = 0; i < num; i++)
+    {
+        sq += ((double)p_vals[i] / SAMPLE_SCALE - mean) * ((double)p_vals[i] / SAMPLE_SCALE - mean);
+    }
+    stddev = sqrt(sq / (num - 1));
+
+    memcpy(p_sorted, p_vals, num * sizeof(int32_t));
+    qsort(p_sorted, num, sizeof(int32_t), cmp_int32);
+    est[0] = row.p50;
+    est[1] = row.p95;
+    est[2] = row.p99;
+
+    printf("  %-12s %6.1f ns/sample  mean %.4f (err %.1e)  stddev %.4f (err %.1e)  "
+           "window errors %u\n", p_name, t_run * 1e9 / num, row.mean, fabs(row.mean - mean) / fabs(mean),
+           row.stddev, fabs(row.stddev - stddev) / stddev, bad_window);
+
+    for (i = 0; i < 3; i++)
+    {
+        lo_q = bench_at(num, p[i] - BENCH_MAX_RANK_ERR);
+        hi_q = bench_at(num, p[i] + BENCH_MAX_RANK_ERR);
+        printf("  %-12s p%-2.0f %8.4f, exact %8.4f, %8.4f to %8.4f within the rank error\n", "",
+                                            p[i] * 100, est[i], bench_at(num, p[i]), lo_q, hi_q);
+        if ((est[i] < lo_q - 0.5 / SAMPLE_SCALE) || (est[i] > hi_q + 0.5 / SAMPLE_SCALE))
+        {
+            printf("  %s p%.0f estimate out of range.\n", p_name, p[i] * 100);
+            is_ok = 0;
+        }
+    }
+
+    if (bad_window || (fabs(row.mean - mean) > 1e-9 * fabs(mean)) ||
+        (fabs(row.stddev - stddev) > 1e-9 * stddev))
+    {
+        printf("  %s statistics differ from exact computation.\n", p_name);
+        is_ok = 0;
+    }
+
+    return (is_ok) ? (SUCCESS) : (FAIL);
+}
+
+/* Function declaration to count the drifts raised on a series
+*  @param[in]  p_cfg   - Configuration
+*  @param[in]  num     - Number of samples in 'p_vals'
+*  @param[in]  shift   - First sample of the shift, samples before it must not
+*                        raise drift
+*  @param[out] p_delay - Samples from 'shift' to the first drift, -1 if none
+*  @return - uint32_t (drifts raised before 'shift')
+*/
+static uint32_t bench_drift(const health_cfg_t * p_cfg, uint32_t num, uint32_t shift,
+                                                                        long * p_delay)
+{
+    static health_t health;
+    uint32_t        i, num_false = 0;
+
+    memset(&health, 0, sizeof(health));
+    *p_delay = -1;
+    for (i = 0; i < num; i++)
+    {
+        if (health_update(&health, p_cfg, p_vals[i]) && (0 != health.drift))
+        {
+            if (i < shift)
+            {
+                num_false++;
+            }
+            else if (*p_delay < 0)
+            {
+                *p_delay = i - shift;
+            }
+        }
+    }
+
+    return num_false;
+}
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    uint32_t     num = (argc > 1) ? ((uint32_t)atoi(argv[1])) : (BENCH_SAMPLES);
+    uint32_t     shift, i, num_false;
+    health_cfg_t cfg;
+    long         delay;
+    uint8_t      is_ok = 1;
+    double       ramp;
+
+    if (num < 2 * HEALTH_BASELINE)
+    {
+        printf("Usage: %s [samples >= %d]\n", argv[0], 2 * HEALTH_BASELINE);
+        return 1;
+    }
+
+    p_vals = (int32_t *) malloc(num * sizeof(int32_t));
+    p_sorted = (int32_t *) malloc(num * sizeof(int32_t));
+    if ((NULL == p_vals) || (NULL == p_sorted))
+    {
+        printf("malloc() failed to allocate.\n");
+        return 1;
+    }
+
+    health_get_cfg(&cfg);
+    printf("%u samples, window %u, baseline %u, CUSUM k %.2f h %.2f, %u bytes per sensor\n",
+           num, cfg.window, cfg.baseline, cfg.cusum_k, cfg.cusum_h, (unsigned)sizeof(health_t));
+
+    for (i = 0; i < num; i++)
+    {
+        p_vals[i] = bench_temp(25.0);
+    }
+    is_ok &= (SUCCESS == bench_series("temperature", &cfg, num));
+
+    for (i = 0; i < num; i++)
+    {
+        p_vals[i] = bench_dust();
+    }
+    is_ok &= (SUCCESS == bench_series("dust", &cfg, num));
+
+    // Stationary noise, no drift expected
+    for (i = 0; i < num; i++)
+    {
+        p_vals[i] = bench_temp(25.0);
+    }
+    num_false = bench_drift(&cfg, num, num, &delay);
+    printf("  %-28s %u drifts raised\n", "stationary temperature", num_false);
+    is_ok &= (0 == num_false);
+
+    for (i = 0; i < num; i++)
+    {
+        p_vals[i] = bench_dust();
+    }
+    num_false = bench_drift(&cfg, num, num, &delay);
+    printf("  %-28s %u drifts raised\n", "stationary dust", num_false);
+    is_ok &= (0 == num_false);
+
+    // Steps and ramps up and down from the middle of the series, in noise
+    // standard deviations
+    shift = num / 2;
+    for (ramp = -1; ramp <= 1; ramp += 2)
+    {
+        const double steps[] = { 2.0, 3.0, 5.0 };
+        const double ramps[] = { 1.0 / 1000, 1.0 / 10000 };
+        char         name[32];
+
+        for (i = 0; i < 3; i++)
+        {
+            uint32_t j;
+
+            for (j = 0; j < num; j++)
+            {
+                p_vals[j] = bench_temp(25.0 + ((j >= shift) ? (ramp * steps[i] * BENCH_SIGMA) : (0)));
+            }
+            num_false = bench_drift(&cfg, num, shift, &delay);
+            snprintf(name, sizeof(name), "step %+.0f sigma", ramp * steps[i]);
+            printf("  %-28s %u false, detected after %ld samples\n", name, num_false, delay);
+            is_ok &= (0 == num_false) && (delay >= 0);
+        }
+
+        for (i = 0; i < 2; i++)
+        {
+            uint32_t j;
+
+            for (j = 0; j < num; j++)
+            {
+                p_vals[j] = bench_temp(25.0 + ((j >= shift) ?
+                                       (ramp * ramps[i] * (j - shift) * BENCH_SIGMA) : (0)));
+            }
+            num_false = bench_drift(&cfg, num, shift, &delay);
+            snprintf(name, sizeof(name), "ramp %+.0f sigma / %.0f", ramp, 1.0 / ramps[i]);
+            printf("  %-28s %u false, detected after %ld samples\n", name, num_false, delay);
+            is_ok &= (0 == num_false) && (delay >= 0);
+        }
+    }
+
+    free(p_vals);
+    free(p_sorted);
+
+    if (!is_ok)
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
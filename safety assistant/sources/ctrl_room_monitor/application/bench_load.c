@@ -0,0 +1,456 @@
+/******************************************************************************/
+
+/* File - bench_load.c
+*
+*  Target Hardware: Any Linux host
+*
+*  End-to-end latency of the load command path (see load.h) on the
+*  simulated application (./app_sim). The application samples every sensor
+*  every 100 ms with the fan on a proportional rule, this benchmark switches
+*  the light over the control socket and measures, per command, the time
+*  from sending the request until
+*
+*     reply    - "OK" is received
+*     actuated - the simulated GPIO write of the output returned, i.e. the
+*                'applied_ns' of LOADS (CLOCK_MONOTONIC of the same host)
+*
+*  The second run holds the database locked all along, the outputs must not
+*  wait for it. Every transition must be in the 'loads' table in the end.
+*
+*  Usage: bench_load [commands_per_run]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "ipc.h"
+#include "lat.h"
+
+/******************************************************************************/
+
+#define BENCH_APP               "./app_sim"
+#define BENCH_SCHEMA            "../database/create_tables.sql"
+#define BENCH_DEFAULT_COMMANDS  (500)
+
+/* Target of the actuation latency
+*/
+#define BENCH_LIMIT_NS          (100000000LL)
+
+/* Simulated GPIO write, about a sysfs write on the target
+*/
+#define BENCH_GPIO_LATENCY_US   "100"
+
+/******************************************************************************/
+
+static char    bench_dir[64];
+static char    db_path[96];
+static char    conf_path[96];
+static char    sock_path[96];
+static char    log_path[96];
+
+static char    in_buf[16 * IPC_LINE_LEN];
+static size_t  in_len = 0;
+
+/******************************************************************************/
+
+/* Function declaration to read the next line from the socket
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the connection is closed )
+*/
+static uint8_t bench_read_line(int fd, char * p_line, size_t size)
+{
+    char   *p_nl;
+    ssize_t len;
+    size_t  line_len;
+
+    while (NULL == (p_nl = memchr(in_buf, '\n', in_len)))
+    {
+        if (in_len >= sizeof(in_buf))
+        {
+            return FAIL;
+        }
+        len = read(fd, &in_buf[in_len], sizeof(in_buf) - in_len);
+        if (len <= 0)
+        {
+            return FAIL;
+        }
+        in_len += (size_t)len;
+    }
+
+    line_len = (size_t)(p_nl - in_buf);
+    if (line_len >= size)
+    {
+        line_len = size - 1;
+    }
+    memcpy(p_line, in_buf, line_len);
+    p_line[line_len] = '\0';
+
+    in_len -= (size_t)(p_nl - in_buf) + 1;
+    memmove(in_buf, p_nl + 1, in_len);
+
+    return SUCCESS;
+}
+
+/* Function declaration to create the database and the configuration
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_setup(void)
+{
+    sqlite3 *p_db;
+    FILE    *p_file;
+    char    *p_sql;
+    long     size;
+    uint8_t  ret_val;
+
+    p_file = fopen(BENCH_SCHEMA, "r");
+    if (NULL == p_file)
+    {
+        printf("%s not found.\n", BENCH_SCHEMA);
+        return FAIL;
+    }
+    fseek(p_file, 0, SEEK_END);
+    size = ftell(p_file);
+    rewind(p_file);
+    p_sql = (char *) calloc(1, (size_t)size + 1);
+    ret_val = (NULL != p_sql) && (fread(p_sql, 1, (size_t)size, p_file) == (size_t)size);
+    fclose(p_file);
+
+    ret_val = ret_val && (SQLITE_OK == sqlite3_open(db_path, &p_db)) &&
+              (SQLITE_OK == sqlite3_exec(p_db, p_sql, NULL, NULL, NULL));
+    sqlite3_close(p_db);
+    free(p_sql);
+    if (!ret_val)
+    {
+        printf("Failed to create %s.\n", db_path);
+        return FAIL;
+    }
+
+    // Light switched by the benchmark, fan driven by the temperature of the
+    // first DS18B20 (about 25 degree celsius in the simulation)
+    p_file = fopen(conf_path, "w");
+    if (NULL == p_file)
+    {
+        return FAIL;
+    }
+    fprintf(p_file, "sensor.period_ms = 100\n"
+                    "sensor.resolution = 9\n"
+                    "sim.gpio.write_latency_us = %s\n"
+                    "ipc.socket = %s\n"
+                    "stats.path =\n"
+                    "spool.spill_path =\n"
+                    "archive.path =\n"
+                    "load.1.name = light\n"
+                    "load.1.pin = 9\n"
+                    "load.1.initial = 0\n"
+                    "load.5.name = fan\n"
+                    "load.5.pin = 5\n"
+                    "load.5.output = pwm\n"
+                    "load.5.rule = proportional\n"
+                    "load.5.sensors = 1\n"
+                    "load.5.low = 24.0\n"
+                    "load.5.high = 26.0\n"
+                    "load.5.step = 1\n",
+                    BENCH_GPIO_LATENCY_US, sock_path);
+    fclose(p_file);
+
+    return SUCCESS;
+}
+
+/* Function declaration to start the application and connect to its control
+*  socket
+*  @param[out] p_fd - Socket
+*  @return - pid_t (process, -1 on failure)
+*/
+static pid_t bench_app_start(int * p_fd)
+{
+    struct sockaddr_un addr;
+    pid_t              pid;
+    int                fd, i;
+
+    pid = fork();
+    if (0 == pid)
+    {
+        fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDOUT_FILENO);
+        execl(BENCH_APP, BENCH_APP, "-c", conf_path, "-d", db_path, (char *)NULL);
+        _exit(127);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+
+    *p_fd = -1;
+    for (i = 0; (pid > 0) && (i < 5000) && (*p_fd < 0); i++)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ((fd >= 0) && (0 == connect(fd, (struct sockaddr *)&addr, sizeof(addr))))
+        {
+            *p_fd = fd;
+            break;
+        }
+        close(fd);
+        usleep(1000);
+    }
+    if (*p_fd < 0)
+    {
+        printf("Failed to start %s, see %s.\n", BENCH_APP, log_path);
+        if (pid > 0)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        return -1;
+    }
+
+    return pid;
+}
+
+/* Function declaration to get the state of a load from LOADS
+*  @param[in]  p_name       - Load name
+*  @param[out] p_seq        - Last sequence number applied
+*  @param[out] p_applied_ns - Time it was applied
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_loads(int fd, const char * p_name, uint32_t * p_seq, int64_t * p_applied_ns)
+{
+    char          line[IPC_LINE_LEN];
+    char          name[IPC_LINE_LEN];
+    unsigned int  type, seq;
+    int           pin;
+    long long     applied_ns, latency_us;
+    uint8_t       is_found = 0;
+
+    if (6 != write(fd, "LOADS\n", 6))
+    {
+        return FAIL;
+    }
+
+    while (SUCCESS == bench_read_line(fd, line, sizeof(line)))
+    {
+        if (0 == strcmp(line, "OK"))
+        {
+            return (is_found) ? (SUCCESS) : (FAIL);
+        }
+        if ((6 == sscanf(line, "LOAD %u %s %d %*s %*s %*s %u %lld %lld", &type, name, &pin,
+                         &seq, &applied_ns, &latency_us)) && (0 == strcmp(name, p_name)))
+        {
+            *p_seq = seq;
+            *p_applied_ns = applied_ns;
+            is_found = 1;
+        }
+    }
+
+    return FAIL;
+}
+
+/* Function declaration to switch the light 'commands' times
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_run(int fd, uint32_t commands, lat_t * p_reply, lat_t * p_actuated)
+{
+    char      request[32];
+    char      line[IPC_LINE_LEN];
+    uint32_t  i, seq, applied_seq;
+    int64_t   t_start, t_reply, applied_ns;
+    int       len;
+
+    lat_reset(p_reply);
+    lat_reset(p_actuated);
+
+    for (i = 0; i < commands; i++)
+    {
+        len = snprintf(request, sizeof(request), "LOAD light %s\n", (i & 1) ? ("off") : ("on"));
+
+        t_start = lat_now_ns();
+        if (len != write(fd, request, (size_t)len))
+        {
+            return FAIL;
+        }
+        seq = 0;
+        do
+        {
+            if (SUCCESS != bench_read_line(fd, line, sizeof(line)))
+            {
+                return FAIL;
+            }
+            sscanf(line, "SEQ %u", &seq);
+        } while ((0 != strcmp(line, "OK")) && (0 != strncmp(line, "ERR", 3)));
+        t_reply = lat_now_ns();
+        if ((0 != strcmp(line, "OK")) || (0 == seq))
+        {
+            printf("LOAD failed: %s\n", line);
+            return FAIL;
+        }
+
+        // The time the output was set is taken from the application, the
+        // polling itself adds nothing
+        do
+        {
+            if (SUCCESS != bench_loads(fd, "light", &applied_seq, &applied_ns))
+            {
+                return FAIL;
+            }
+        } while (applied_seq < seq);
+
+        lat_add(p_reply, t_reply - t_start);
+        lat_add(p_actuated, applied_ns - t_start);
+    }
+
+    return SUCCESS;
+}
+
+/* Function declaration to count the stored states of a load type
+*  @return - int64_t (rows, -1 on failure)
+*/
+static int64_t bench_count_loads(uint8_t load_type)
+{
+    sqlite3      *p_db;
+    sqlite3_stmt *p_stmt;
+    int64_t       rows = -1;
+
+    if ((SQLITE_OK == sqlite3_open(db_path, &p_db)) &&
+        (SQLITE_OK == sqlite3_prepare_v2(p_db, "SELECT COUNT(*) FROM loads WHERE load_type = ?1;",
+                                         -1, &p_stmt, NULL)))
+    {
+        sqlite3_bind_int(p_stmt, 1, load_type);
+        if (SQLITE_ROW == sqlite3_step(p_stmt))
+        {
+            rows = (int64_t)sqlite3_column_int64(p_stmt, 0);
+        }
+        sqlite3_finalize(p_stmt);
+    }
+    sqlite3_close(p_db);
+
+    return rows;
+}
+
+static void bench_print(const char * p_name, const lat_t * p_lat)
+{
+    printf("%-22s %10.1f %10.1f %10.1f %10.1f\n", p_name,
+           lat_percentile(p_lat, 50) / 1000.0, lat_percentile(p_lat, 99) / 1000.0,
+           p_lat->max_ns / 1000.0, (p_lat->count) ? (p_lat->sum_ns / 1000.0 / p_lat->count) : (0.0));
+}
+
+static void bench_cleanup(void)
+{
+    char path[128];
+
+    unlink(db_path);
+    snprintf(path, sizeof(path), "%s-journal", db_path);
+    unlink(path);
+    unlink(conf_path);
+    unlink(log_path);
+    unlink(sock_path);
+    rmdir(bench_dir);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t  commands = (argc > 1) ? ((uint32_t)atoi(argv[1])) : (BENCH_DEFAULT_COMMANDS);
+    lat_t     reply, actuated, reply_locked, actuated_locked;
+    sqlite3  *p_lock_db = NULL;
+    int64_t   rows;
+    pid_t     pid;
+    int       fd, status;
+    uint8_t   ret_val;
+
+    if ((0 == commands) || (argc > 2))
+    {
+        printf("Usage: %s [commands_per_run]\n", argv[0]);
+        return 1;
+    }
+    if (0 != access(BENCH_APP, X_OK))
+    {
+        printf("%s not found, run 'make sim' first.\n", BENCH_APP);
+        return 1;
+    }
+
+    snprintf(bench_dir, sizeof(bench_dir), "/tmp/bench_load.%d", (int)getpid());
+    snprintf(db_path, sizeof(db_path), "%s/ctrl_db.db", bench_dir);
+    snprintf(conf_path, sizeof(conf_path), "%s/app.conf", bench_dir);
+    snprintf(sock_path, sizeof(sock_path), "%s/ctrl.sock", bench_dir);
+    snprintf(log_path, sizeof(log_path), "%s/app.log", bench_dir);
+    if (0 != mkdir(bench_dir, 0700))
+    {
+        printf("Failed to create %s.\n", bench_dir);
+        return 1;
+    }
+    if (SUCCESS != bench_setup())
+    {
+        bench_cleanup();
+        return 1;
+    }
+
+    pid = bench_app_start(&fd);
+    if (pid < 0)
+    {
+        bench_cleanup();
+        return 1;
+    }
+
+    // Samples flowing before the first command
+    usleep(500000);
+    ret_val = bench_run(fd, commands, &reply, &actuated);
+
+    // Second run with the database locked by another connection
+    if (ret_val)
+    {
+        ret_val = (SQLITE_OK == sqlite3_open(db_path, &p_lock_db)) &&
+                  (SQLITE_OK == sqlite3_exec(p_lock_db, "BEGIN EXCLUSIVE;", NULL, NULL, NULL));
+        ret_val = ret_val && bench_run(fd, commands, &reply_locked, &actuated_locked);
+        sqlite3_exec(p_lock_db, "COMMIT;", NULL, NULL, NULL);
+        sqlite3_close(p_lock_db);
+    }
+
+    close(fd);
+    kill(pid, SIGTERM);
+    if ((pid != waitpid(pid, &status, 0)) || !WIFEXITED(status) || (0 != WEXITSTATUS(status)))
+    {
+        printf("%s did not end cleanly, see %s.\n", BENCH_APP, log_path);
+        ret_val = 0;
+    }
+    if (!ret_val)
+    {
+        return 1;
+    }
+
+    printf("%u command(s) per run, simulated GPIO write %s us\n", commands, BENCH_GPIO_LATENCY_US);
+    printf("%-22s %10s %10s %10s %10s\n", "usec", "p50", "p99", "max", "mean");
+    bench_print("reply", &reply);
+    bench_print("actuated", &actuated);
+    bench_print("reply (db locked)", &reply_locked);
+    bench_print("actuated (db locked)", &actuated_locked);
+
+    // The state at start and every switch of both runs
+    rows = bench_count_loads(1);
+    printf("Stored light states: %lld of %llu.\n", (long long)rows, 2ULL * commands + 1);
+
+    ret_val = (actuated.max_ns < BENCH_LIMIT_NS) && (actuated_locked.max_ns < BENCH_LIMIT_NS) &&
+              (rows == (int64_t)(2 * commands + 1));
+    printf("%s (actuation limit %lld ms)\n", (ret_val) ? ("PASS") : ("FAIL"),
+                                              BENCH_LIMIT_NS / 1000000);
+
+    // Kept for a look at the log of the application
+    if (ret_val)
+    {
+        bench_cleanup();
+    }
+    else
+    {
+        printf("See %s.\n", bench_dir);
+    }
+
+    return (ret_val) ? (0) : (1);
+}
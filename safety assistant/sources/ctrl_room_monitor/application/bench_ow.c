@@ -0,0 +1,139 @@
+/******************************************************************************/
+
+/* File - bench_ow.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Fault injection benchmark of the DS18B20 read path (ds18b20.c) on the
+*  simulated 1-wire bus. Scratchpad reads are corrupted at increasing rates
+*  and each rate is run without retries and with bus reset and retries. For
+*  every run the samples read and lost, the bus reads per sample and the
+*  throughput relative to an error free bus are reported. Reading goes on at
+*  any error rate, the throughput only degrades.
+*
+*  Bus latencies are a tenth of the real 1-wire over UART bus by default, so
+*  the benchmark runs in seconds; relative numbers are the same.
+*
+*  Usage: bench_ow [samples] [retries] [byte_latency_us]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "lat.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_SAMPLES   (200)
+#define BENCH_DEFAULT_RETRIES   (2)
+#define BENCH_DEFAULT_BYTE_US   "70"
+
+/******************************************************************************/
+
+static const double error_rates[] = { 0.0, 0.01, 0.05, 0.1, 0.2, 0.3, 0.5, 0.8 };
+
+/******************************************************************************/
+
+/* Read 'samples' times from the first probe of a fresh bus
+*  @param[in] ref_rate - Good samples per second of the error free bus, 0 if
+*                        this is the error free run
+*  @return - double (good samples per second, negative on failure)
+*/
+static double bench_run(double error_rate, uint32_t samples, uint8_t retries, double ref_rate)
+{
+    hal_ow_t *p_ow;
+    uint8_t   rom[DS18B20_ADDR_LEN];
+    uint32_t  i, num_good = 0, num_reads = 0;
+    uint8_t   num_failed;
+    int32_t   temp;
+    int64_t   t_start, t_end;
+    double    rate;
+    char      val[16];
+
+    snprintf(val, sizeof(val), "%0.3f", error_rate);
+    config_set("sim.ow.0.crc_error_rate", val);
+
+    p_ow = hal_ow_init(0, NULL);
+    if ((NULL == p_ow) || (HAL_SUCCESS != hal_ow_rom_search(p_ow, NEW_SEARCH, rom)))
+    {
+        printf("No simulated DS18B20 found.\n");
+        return -1.0;
+    }
+
+    t_start = lat_now_ns();
+    for (i = 0; i < samples; i++)
+    {
+        if (SUCCESS == ds18b20_read_temp_retry(p_ow, rom, retries, &temp, NULL, &num_failed))
+        {
+            num_good++;
+            num_reads++;
+        }
+        num_reads += num_failed;
+    }
+    t_end = lat_now_ns();
+
+    hal_ow_stop(p_ow);
+
+    rate = num_good / ((t_end - t_start) / 1e9);
+    printf("%8.2f %8u %8u %8u %10.2f %10.1f %9.0f %%\n", error_rate * 100.0, retries,
+           num_good, samples - num_good, (double)num_reads / samples, rate,
+           (ref_rate > 0.0) ? ((100.0 * rate) / ref_rate) : (100.0));
+
+    return rate;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t samples = (argc > 1) ? ((uint32_t)atoi(argv[1])) : (BENCH_DEFAULT_SAMPLES);
+    uint8_t  retries = (argc > 2) ? ((uint8_t)atoi(argv[2])) : (BENCH_DEFAULT_RETRIES);
+    char     byte_us[16];
+    double   ref_rate = 0.0;
+    double   rate;
+    uint16_t i;
+
+    snprintf(byte_us, sizeof(byte_us), "%s", (argc > 3) ? (argv[3]) : (BENCH_DEFAULT_BYTE_US));
+    if ((0 == samples) || (argc > 4))
+    {
+        printf("Usage: %s [samples] [retries] [byte_latency_us]\n", argv[0]);
+        return 1;
+    }
+
+    // One probe, bus timing of the simulation scaled down
+    config_set("sim.ow.0.sensors", "1");
+    config_set("sim.ow.0.byte_latency_us", byte_us);
+    config_set("sim.ow.0.reset_latency_us", byte_us);
+
+    if (SUCCESS != hal_init())
+    {
+        return 1;
+    }
+
+    printf("%u samples per run, %s us per byte\n", samples, byte_us);
+    printf("%8s %8s %8s %8s %10s %10s %10s\n", "error %", "retries", "good", "lost",
+                                                    "reads/smp", "samples/s", "relative");
+
+    for (i = 0; i < sizeof(error_rates) / sizeof(error_rates[0]); i++)
+    {
+        rate = bench_run(error_rates[i], samples, 0, ref_rate);
+        if (rate < 0.0)
+        {
+            return 1;
+        }
+        if (0 == i)
+        {
+            ref_rate = rate;
+        }
+        if (retries)
+        {
+            bench_run(error_rates[i], samples, retries, ref_rate);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+/******************************************************************************/
+
+/* File - bench_owbus.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Sweep time of the DS18B20 acquisition (see owbus.h) on several simulated
+*  1-wire buses. The same number of probes is spread over 1, 2 and 4 buses,
+*  sampled every second at 9-bit for a few seconds, and the sweep time of
+*  every bus (conversion start until its last probe is read) is reported,
+*  together with the samples merged into the stream of the acquisition
+*  thread. A reference run has a single bus with the probes of the busiest
+*  bus of the 4 bus run:
+*
+*     - the sweep time of the 4 bus run must be within BENCH_SCALE_PCT of the
+*       reference, i.e. scale with the busiest bus and not with all buses
+*     - every probe must deliver a sample per sweep
+*
+*  Bus latencies are those of the real 1-wire over UART bus (about 0.7 ms a
+*  byte). Every run is a process of its own with a fresh database.
+*
+*  Usage: bench_owbus [probes] [seconds]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "sched.h"
+#include "lat.h"
+#include "db.h"
+#include "registry.h"
+#include "owbus.h"
+
+/******************************************************************************/
+
+#define BENCH_SCHEMA            "../database/create_tables.sql"
+#define BENCH_DEFAULT_PROBES    (16)
+#define BENCH_DEFAULT_SECONDS   (5)
+#define BENCH_PERIOD_MS         (1000)
+
+/* Allowed sweep time of the multi bus run over the single bus reference
+*/
+#define BENCH_SCALE_PCT         (125)
+
+typedef struct
+{
+    uint8_t  is_ok;
+    uint8_t  num_buses;
+    uint16_t probes_per_bus;
+    uint32_t num_samples;
+    uint32_t num_expected;                      // A sample a probe and sweep
+    uint32_t num_sweeps;                        // Of the busiest bus
+    int64_t  sweep_p50_ns;                      // Of the busiest bus
+    int64_t  sweep_max_ns;
+} bench_result_t;
+
+/******************************************************************************/
+
+static uint32_t num_samples = 0;
+static uint8_t  bench_stop = 0;
+
+/******************************************************************************/
+
+/* Sample handler on the acquisition thread (main thread of the run)
+*/
+static void bench_sample_fn(const sample_t * p_sample)
+{
+    num_samples++;
+}
+
+static void bench_stop_fn(sched_task_t * p_task)
+{
+    bench_stop = 1;
+}
+
+/* Function declaration to create the database of a run
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_create_db(const char * p_path)
+{
+    sqlite3 *p_db;
+    FILE    *p_file;
+    char    *p_sql;
+    long     size;
+    uint8_t  ret_val;
+
+    p_file = fopen(BENCH_SCHEMA, "r");
+    if (NULL == p_file)
+    {
+        printf("%s not found.\n", BENCH_SCHEMA);
+        return FAIL;
+    }
+    fseek(p_file, 0, SEEK_END);
+    size = ftell(p_file);
+    rewind(p_file);
+    p_sql = (char *) calloc(1, (size_t)size + 1);
+    ret_val = (NULL != p_sql) && (fread(p_sql, 1, (size_t)size, p_file) == (size_t)size);
+    fclose(p_file);
+
+    unlink(p_path);
+    ret_val = ret_val && (SQLITE_OK == sqlite3_open(p_path, &p_db)) &&
+              (SQLITE_OK == sqlite3_exec(p_db, p_sql, NULL, NULL, NULL));
+    sqlite3_close(p_db);
+    free(p_sql);
+    if (!ret_val)
+    {
+        printf("Failed to create %s.\n", p_path);
+    }
+
+    return ret_val;
+}
+
+/* Function declaration of a run, in a child process
+*  @param[in]  num_buses      - Buses
+*  @param[in]  probes_per_bus - DS18B20 on every bus
+*  @param[in]  seconds        - Duration
+*  @param[out] p_result       - Result
+*  @return - None
+*/
+static void bench_run(uint8_t num_buses, uint16_t probes_per_bus, uint32_t seconds,
+                                                        bench_result_t * p_result)
+{
+    sched_task_t stop_task;
+    lat_t        sweep;
+    char         db_path[64];
+    char         key[CONFIG_MAX_KEY_LEN];
+    char         val[16];
+    uint8_t      bus;
+
+    memset(p_result, 0, sizeof(bench_result_t));
+    p_result->num_buses = num_buses;
+    p_result->probes_per_bus = probes_per_bus;
+
+    snprintf(val, sizeof(val), "%u", num_buses);
+    config_set("ow.buses", val);
+    snprintf(val, sizeof(val), "%u", BENCH_PERIOD_MS);
+    config_set("sensor.period_ms", val);
+    config_set("sensor.resolution", "9");
+    config_set("registry.rescan_ms", "3600000");
+    for (bus = 0; bus < num_buses; bus++)
+    {
+        snprintf(key, sizeof(key), "sim.ow.%u.sensors", bus);
+        snprintf(val, sizeof(val), "%u", probes_per_bus);
+        config_set(key, val);
+        snprintf(key, sizeof(key), "sim.ow.%u.byte_latency_us", bus);
+        config_set(key, "700");
+        snprintf(key, sizeof(key), "sim.ow.%u.reset_latency_us", bus);
+        config_set(key, "1000");
+        snprintf(key, sizeof(key), "sim.ow.%u.conv_time_ms", bus);
+        config_set(key, "750");
+    }
+
+    snprintf(db_path, sizeof(db_path), "/tmp/bench_owbus_%d.db", (int)getpid());
+    if ((SUCCESS != hal_init()) || (SUCCESS != bench_create_db(db_path)) ||
+        (SUCCESS != db_open(db_path, 0)))
+    {
+        return;
+    }
+
+    sched_init();
+    if (SUCCESS != owbus_start(bench_sample_fn))
+    {
+        db_close();
+        unlink(db_path);
+        return;
+    }
+
+    sched_task_init(&stop_task, bench_stop_fn, NULL);
+    sched_after(&stop_task, seconds * 1000);
+    while (!bench_stop && (sched_run() >= 0))
+    {
+    }
+    owbus_stop();
+
+    // Busiest bus is the slowest one
+    for (bus = 0; bus < num_buses; bus++)
+    {
+        if (SUCCESS != owbus_sweep_lat(bus, &sweep))
+        {
+            continue;
+        }
+        p_result->num_expected += (uint32_t)sweep.count * probes_per_bus;
+        if (sweep.max_ns > p_result->sweep_max_ns)
+        {
+            p_result->sweep_max_ns = sweep.max_ns;
+            p_result->sweep_p50_ns = lat_percentile(&sweep, 50);
+            p_result->num_sweeps = (uint32_t)sweep.count;
+        }
+    }
+    p_result->num_samples = num_samples;
+    p_result->is_ok = 1;
+
+    db_close();
+    unlink(db_path);
+}
+
+/* Function declaration to run in a child process, its output goes to
+*  /dev/null, the result comes back through a pipe
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_fork_run(uint8_t num_buses, uint16_t probes_per_bus, uint32_t seconds,
+                                                            bench_result_t * p_result)
+{
+    int    fds[2];
+    pid_t  pid;
+    int    status;
+
+    if (0 != pipe(fds))
+    {
+        return FAIL;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        return FAIL;
+    }
+    if (0 == pid)
+    {
+        close(fds[0]);
+        if (NULL == freopen("/dev/null", "w", stdout))
+        {
+            _exit(1);
+        }
+        bench_run(num_buses, probes_per_bus, seconds, p_result);
+        _exit((sizeof(bench_result_t) == write(fds[1], p_result, sizeof(bench_result_t))) ?
+                                                                                (0) : (1));
+    }
+
+    close(fds[1]);
+    status = (sizeof(bench_result_t) == read(fds[0], p_result, sizeof(bench_result_t)));
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+
+    return (status && p_result->is_ok) ? (SUCCESS) : (FAIL);
+}
+
+static void bench_print(const bench_result_t * p_result, uint32_t seconds)
+{
+    printf("%5u %6u %7u %8u %10.1f %10.1f %9.1f\n", p_result->num_buses,
+           p_result->probes_per_bus, p_result->num_sweeps, p_result->num_samples,
+           p_result->sweep_p50_ns / 1e6, p_result->sweep_max_ns / 1e6,
+           (double)p_result->num_samples / seconds);
+}
+
+int main(int argc, char** argv)
+{
+    static const uint8_t bus_counts[] = { 1, 2, 4 };
+    bench_result_t results[sizeof(bus_counts) / sizeof(bus_counts[0])];
+    bench_result_t reference;
+    uint32_t       probes = BENCH_DEFAULT_PROBES;
+    uint32_t       seconds = BENCH_DEFAULT_SECONDS;
+    uint8_t        is_ok = 1;
+    uint8_t        i;
+
+    if (argc > 1)
+    {
+        probes = (uint32_t)atoi(argv[1]);
+    }
+    if (argc > 2)
+    {
+        seconds = (uint32_t)atoi(argv[2]);
+    }
+    if ((probes < 4) || (probes > 64) || (0 != (probes % 4)) || (seconds < 2))
+    {
+        printf("Usage: %s [probes, multiple of 4 up to 64] [seconds, at least 2]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%u DS18B20 at 9-bit sampled every %u ms for %u s\n", probes, BENCH_PERIOD_MS,
+                                                                            seconds);
+    printf("%5s %6s %7s %8s %10s %10s %9s\n", "buses", "probes", "sweeps", "samples",
+                                            "p50 ms", "max ms", "samples/s");
+    printf("                  (per bus, sweeps and sweep time of the busiest bus)\n");
+
+    for (i = 0; i < (sizeof(bus_counts) / sizeof(bus_counts[0])); i++)
+    {
+        if (SUCCESS != bench_fork_run(bus_counts[i], (uint16_t)(probes / bus_counts[i]), seconds,
+                                                                            &results[i]))
+        {
+            printf("Run with %u bus(es) failed.\n", bus_counts[i]);
+            return 1;
+        }
+        bench_print(&results[i], seconds);
+
+        // A sample of every probe per sweep, merged from all buses
+        if (results[i].num_samples < results[i].num_expected)
+        {
+            printf("  %u samples missing.\n", results[i].num_expected - results[i].num_samples);
+            is_ok = 0;
+        }
+    }
+
+    if (SUCCESS != bench_fork_run(1, (uint16_t)(probes / 4), seconds, &reference))
+    {
+        printf("Reference run failed.\n");
+        return 1;
+    }
+    printf("Reference, the busiest bus alone:\n");
+    bench_print(&reference, seconds);
+
+    i = (sizeof(bus_counts) / sizeof(bus_counts[0])) - 1;
+    printf("Sweep with %u buses %0.0f %% of the busiest bus alone, %0.0f %% of a single bus.\n",
+           bus_counts[i], (100.0 * results[i].sweep_max_ns) / reference.sweep_max_ns,
+           (100.0 * results[i].sweep_max_ns) / results[0].sweep_max_ns);
+    if ((100 * results[i].sweep_max_ns) > (BENCH_SCALE_PCT * reference.sweep_max_ns))
+    {
+        printf("Sweep time does not scale with the busiest bus (limit %u %%).\n",
+                                                                        BENCH_SCALE_PCT);
+        is_ok = 0;
+    }
+
+    return (is_ok) ? (0) : (1);
+}
@@ -0,0 +1,428 @@
+/******************************************************************************/
+
+/* File - bench_query.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Benchmark of the queries the Node-RED dashboard runs against the database
+*  (see safety_assistant_flow.txt), with and without the indexes of
+*  DB_SQL_CREATE_INDEXES. A synthetic history of 1 minute samples is loaded
+*  in stages up to the given number of years. For each stage it reports the
+*  mean latency of every query and the write amplification of an insert
+*  (bytes and writes per inserted row, counted by bench_vfs.c). Indexed query
+*  cost should stay flat while the history grows. The query plans are
+*  printed once at the end.
+*
+*  A probe removed after the first day of the history ("stale sensor") is the
+*  worst case without an index, the latest row has to be searched through the
+*  whole table.
+*
+*  Usage: bench_query [db_path] [years] [sensors]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "db.h"
+#include "bench_vfs.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_PATH      "/tmp/bench_query.db"
+#define BENCH_DEFAULT_YEARS     (2)
+#define BENCH_DEFAULT_SENSORS   (4)
+
+/* Sample period of the synthetic history
+*/
+#define BENCH_PERIOD_S          (60)
+#define BENCH_MIN_PER_YEAR      (365L * 24 * 60)
+
+/* Each query runs until BENCH_QUERY_RUNS runs or BENCH_QUERY_TIME_S are
+*  reached, whichever comes first (but at least 3 times)
+*/
+#define BENCH_QUERY_RUNS        (2000)
+#define BENCH_QUERY_TIME_S      (1.0)
+
+/* Cycles (one transaction of 'sensors' inserts each) per write measurement
+*/
+#define BENCH_WRITE_CYCLES      (100)
+
+#define BENCH_NUM_STAGES        (3)
+#define BENCH_NUM_QUERIES       (5)
+
+#define SQL_CREATE_TABLES       "CREATE TABLE access_log (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "fl_name CHAR(32) NOT NULL, u_role CHAR(32) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE loads (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "load_type INTEGER NOT NULL, load_status CHAR(3) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE sensor_data (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id INTEGER NOT NULL, sen_val REAL NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE users (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "u_name CHAR(32) NOT NULL, u_pass CHAR(32) NOT NULL, " \
+                                "fl_name CHAR(32) NOT NULL, u_role CHAR(32) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now')));"
+
+/******************************************************************************/
+
+typedef struct
+{
+    const char *p_name;
+    char        sql[160];
+} bench_query_t;
+
+typedef struct
+{
+    double us[BENCH_NUM_QUERIES];
+    double bytes_per_row;
+    double writes_per_row;
+} bench_result_t;
+
+/******************************************************************************/
+
+static sqlite3       *p_db = NULL;
+static bench_query_t  queries[BENCH_NUM_QUERIES];
+static uint32_t       num_sensors;
+static time_t         history_start;
+static long           loaded_min = 0;
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint8_t bench_exec(const char * p_sql)
+{
+    char *p_err = NULL;
+
+    if (SQLITE_OK != sqlite3_exec(p_db, p_sql, NULL, NULL, &p_err))
+    {
+        printf("Query '%s' failed: %s\n", p_sql, p_err);
+        sqlite3_free(p_err);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+/* Function declaration to (re)create the benchmark database with a few users
+*  @param[in] p_path - Path of the database file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_create_db(const char * p_path)
+{
+    char    sql[160];
+    char    aux_path[256];
+    int     i;
+
+    unlink(p_path);
+    snprintf(aux_path, sizeof(aux_path), "%s-journal", p_path);
+    unlink(aux_path);
+
+    if (SQLITE_OK != sqlite3_open(p_path, &p_db))
+    {
+        printf("Failed to open %s.\n", p_path);
+        return FAIL;
+    }
+
+    if (SUCCESS != bench_exec(SQL_CREATE_TABLES))
+    {
+        return FAIL;
+    }
+
+    bench_exec("BEGIN;");
+    for (i = 0; i < 200; i++)
+    {
+        snprintf(sql, sizeof(sql), "INSERT INTO users (u_name, u_pass, fl_name, u_role) "
+                            "VALUES ('user%03d', 'pass%03d', 'User %d', 'Guest');", i, i, i);
+        bench_exec(sql);
+    }
+    bench_exec("INSERT INTO users (u_name, u_pass, fl_name, u_role) "
+               "VALUES ('admin', 'admin', 'S. John', 'Sr. Engineer');");
+
+    return bench_exec("COMMIT;");
+}
+
+/* Function declaration to extend the history up to 'end_min' minutes. Every
+*  sensor has a sample per minute, the stale sensor only during the first
+*  day, loads toggle every 6 hours and there is one login per day.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_load(long end_min)
+{
+    sqlite3_stmt *p_sample, *p_load, *p_access;
+    sqlite3_int64 t;
+    uint32_t      s;
+    long          m;
+
+    if ((SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO sensor_data (sen_id, sen_val, time) "
+                                            "VALUES (?1, ?2, ?3);", -1, &p_sample, NULL)) ||
+        (SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO loads (load_type, load_status, "
+                                        "time) VALUES (?1, ?2, ?3);", -1, &p_load, NULL)) ||
+        (SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO access_log (fl_name, u_role, "
+                                "time) VALUES ('S. John', 'Sr. Engineer', ?1);", -1, &p_access, NULL)))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+        return FAIL;
+    }
+
+    bench_exec("PRAGMA synchronous=OFF;");
+    bench_exec("BEGIN;");
+
+    for (m = loaded_min; m < end_min; m++)
+    {
+        t = (sqlite3_int64)history_start + (m * BENCH_PERIOD_S);
+
+        for (s = 1; s <= num_sensors + 1; s++)
+        {
+            if ((s > num_sensors) && (m >= (24 * 60)))
+            {
+                break;
+            }
+            sqlite3_bind_int(p_sample, 1, s);
+            sqlite3_bind_double(p_sample, 2, 25.0 + ((m + s) % 64) * 0.0625);
+            sqlite3_bind_int64(p_sample, 3, t);
+            sqlite3_step(p_sample);
+            sqlite3_reset(p_sample);
+        }
+
+        if (0 == (m % (6 * 60)))
+        {
+            for (s = 1; s <= 2; s++)
+            {
+                sqlite3_bind_int(p_load, 1, s);
+                sqlite3_bind_text(p_load, 2, ((m / (6 * 60)) % 2) ? ("ON") : ("OFF"), -1,
+                                                                            SQLITE_STATIC);
+                sqlite3_bind_int64(p_load, 3, t);
+                sqlite3_step(p_load);
+                sqlite3_reset(p_load);
+            }
+        }
+
+        if (0 == (m % (24 * 60)))
+        {
+            sqlite3_bind_int64(p_access, 1, t);
+            sqlite3_step(p_access);
+            sqlite3_reset(p_access);
+        }
+    }
+
+    sqlite3_finalize(p_sample);
+    sqlite3_finalize(p_load);
+    sqlite3_finalize(p_access);
+
+    loaded_min = end_min;
+
+    return (SUCCESS == bench_exec("COMMIT;")) && (SUCCESS == bench_exec("PRAGMA synchronous=FULL;"));
+}
+
+/* Function declaration to measure the mean latency of a query, including
+*  prepare and finalize as the dashboard does it
+*  @return - double (microseconds, negative on failure)
+*/
+static double bench_query(const char * p_sql)
+{
+    sqlite3_stmt *p_stmt;
+    double        start, elapsed;
+    long          runs = 0;
+
+    start = now_sec();
+    do
+    {
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db, p_sql, -1, &p_stmt, NULL))
+        {
+            printf("Failed to prepare '%s': %s\n", p_sql, sqlite3_errmsg(p_db));
+            return -1.0;
+        }
+        while (SQLITE_ROW == sqlite3_step(p_stmt))
+        {
+        }
+        sqlite3_finalize(p_stmt);
+
+        runs++;
+        elapsed = now_sec() - start;
+    } while (((runs < BENCH_QUERY_RUNS) && (elapsed < BENCH_QUERY_TIME_S)) || (runs < 3));
+
+    return (elapsed * 1e6) / runs;
+}
+
+/* Function declaration to measure the bytes and writes of storing samples,
+*  one transaction per cycle like the application does
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_write(bench_result_t * p_result)
+{
+    sqlite3_stmt *p_stmt;
+    uint32_t      c, s;
+    sqlite3_int64 t = (sqlite3_int64)history_start + (loaded_min * BENCH_PERIOD_S);
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO sensor_data (sen_id, sen_val, time) "
+                                            "VALUES (?1, ?2, ?3);", -1, &p_stmt, NULL))
+    {
+        return FAIL;
+    }
+
+    bench_vfs_reset();
+    for (c = 0; c < BENCH_WRITE_CYCLES; c++)
+    {
+        bench_exec("BEGIN;");
+        for (s = 1; s <= num_sensors; s++)
+        {
+            sqlite3_bind_int(p_stmt, 1, s);
+            sqlite3_bind_double(p_stmt, 2, 25.0 + (c % 16) * 0.0625);
+            sqlite3_bind_int64(p_stmt, 3, t + c);
+            sqlite3_step(p_stmt);
+            sqlite3_reset(p_stmt);
+        }
+        if (SUCCESS != bench_exec("COMMIT;"))
+        {
+            sqlite3_finalize(p_stmt);
+            return FAIL;
+        }
+    }
+    sqlite3_finalize(p_stmt);
+
+    p_result->bytes_per_row = (double)bench_vfs_write_bytes() / (BENCH_WRITE_CYCLES * num_sensors);
+    p_result->writes_per_row = (double)bench_vfs_writes() / (BENCH_WRITE_CYCLES * num_sensors);
+
+    return SUCCESS;
+}
+
+static uint8_t bench_run(bench_result_t * p_result)
+{
+    uint8_t i;
+
+    for (i = 0; i < BENCH_NUM_QUERIES; i++)
+    {
+        p_result->us[i] = bench_query(queries[i].sql);
+        if (p_result->us[i] < 0.0)
+        {
+            return FAIL;
+        }
+    }
+
+    return bench_write(p_result);
+}
+
+static void bench_print_plans(void)
+{
+    sqlite3_stmt *p_stmt;
+    char          sql[200];
+    uint8_t       i;
+
+    for (i = 0; i < BENCH_NUM_QUERIES; i++)
+    {
+        printf("  %-30s", queries[i].p_name);
+        snprintf(sql, sizeof(sql), "EXPLAIN QUERY PLAN %s", queries[i].sql);
+        if (SQLITE_OK == sqlite3_prepare_v2(p_db, sql, -1, &p_stmt, NULL))
+        {
+            while (SQLITE_ROW == sqlite3_step(p_stmt))
+            {
+                printf(" %s;", (const char *)sqlite3_column_text(p_stmt, 3));
+            }
+            sqlite3_finalize(p_stmt);
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char     *p_path = (argc > 1) ? (argv[1]) : (BENCH_DEFAULT_PATH);
+    double          years = (argc > 2) ? (atof(argv[2])) : (BENCH_DEFAULT_YEARS);
+    bench_result_t  before, after;
+    long            total_min, stage_min;
+    uint8_t         stage, i;
+
+    num_sensors = (argc > 3) ? ((uint32_t)atoi(argv[3])) : (BENCH_DEFAULT_SENSORS);
+    total_min = (long)(years * BENCH_MIN_PER_YEAR);
+
+    if ((total_min < (24 * 60)) || (0 == num_sensors))
+    {
+        printf("Usage: %s [db_path] [years] [sensors]\n", argv[0]);
+        return 1;
+    }
+
+    if ((SUCCESS != bench_vfs_register()) || (SUCCESS != bench_create_db(p_path)))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    // Queries exactly as the flow sends them
+    queries[0].p_name = "latest sen_val";
+    snprintf(queries[0].sql, sizeof(queries[0].sql),
+             "select sen_val from sensor_data where sen_id=1 order by sl desc limit 1;");
+    queries[1].p_name = "latest sen_val (stale sensor)";
+    snprintf(queries[1].sql, sizeof(queries[1].sql),
+             "select sen_val from sensor_data where sen_id=%u order by sl desc limit 1;",
+                                                                            num_sensors + 1);
+    queries[2].p_name = "latest load_status";
+    snprintf(queries[2].sql, sizeof(queries[2].sql),
+             "select load_status from loads where load_type=2 order by sl desc limit 1;");
+    queries[3].p_name = "latest access_log";
+    snprintf(queries[3].sql, sizeof(queries[3].sql),
+             "select fl_name, u_role, time from access_log order by sl desc limit 1;");
+    queries[4].p_name = "login by u_name";
+    snprintf(queries[4].sql, sizeof(queries[4].sql),
+             "select fl_name, u_role from users where u_name='admin' and u_pass='admin';");
+
+    history_start = time(NULL) - (total_min * BENCH_PERIOD_S);
+
+    printf("%.2f years of history, %u sensors every %d s, database %s\n", years,
+                                                    num_sensors, BENCH_PERIOD_S, p_path);
+
+    for (stage = 1; stage <= BENCH_NUM_STAGES; stage++)
+    {
+        // History grows 4 times per stage, up to the full length
+        stage_min = total_min >> (2 * (BENCH_NUM_STAGES - stage));
+        if (stage_min < (24 * 60))
+        {
+            stage_min = 24 * 60;
+        }
+
+        if ((SUCCESS != bench_exec(DB_SQL_DROP_INDEXES)) || (SUCCESS != bench_load(stage_min)) ||
+            (SUCCESS != bench_run(&before)) ||
+            (SUCCESS != bench_exec(DB_SQL_CREATE_INDEXES)) || (SUCCESS != bench_run(&after)))
+        {
+            printf("Benchmark failed.\n");
+            sqlite3_close(p_db);
+            return 1;
+        }
+
+        printf("\nHistory of %ld days, %ld samples\n", stage_min / (24 * 60),
+                                                        stage_min * (long)num_sensors);
+        printf("  %-30s %14s %14s\n", "", "no index", "indexed");
+        for (i = 0; i < BENCH_NUM_QUERIES; i++)
+        {
+            printf("  %-30s %11.1f us %11.1f us\n", queries[i].p_name, before.us[i], after.us[i]);
+        }
+        printf("  %-30s %11.0f B  %11.0f B\n", "insert, bytes written/row",
+                                                    before.bytes_per_row, after.bytes_per_row);
+        printf("  %-30s %14.2f %14.2f\n", "insert, writes/row",
+                                                    before.writes_per_row, after.writes_per_row);
+    }
+
+    printf("\nQuery plans, indexed:\n");
+    bench_print_plans();
+    bench_exec(DB_SQL_DROP_INDEXES);
+    printf("Query plans, no index:\n");
+    bench_print_plans();
+
+    sqlite3_close(p_db);
+
+    return 0;
+}
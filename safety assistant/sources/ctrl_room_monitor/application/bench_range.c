@@ -0,0 +1,445 @@
+/******************************************************************************/
+
+/* File - bench_range.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Benchmark of the time range queries of the control socket (see query.h).
+*  A synthetic history (one sample per sensor every BENCH_PERIOD_S, a daily
+*  swing plus noise) is loaded as the daemon keeps it: the last
+*  BENCH_DB_DAYS in 'sensor_data', the days before in archive segments. For
+*  a week and for the whole history of one sensor it pages through all
+*  samples (CSV and binary chunks) and through a downsampled series, with a
+*  new query per chunk resumed from the cursor, as a client of the socket
+*  does. It reports samples/s, requests and the resident memory after each
+*  run, which must not grow with the window. Samples/s counts the samples
+*  of the window, also when downsampled.
+*
+*  Checked: all samples of the window are returned exactly once in time
+*  order, a downsampled series has at most its point count and starts and
+*  ends with the first and last sample. A query of a thread not waiting for
+*  the database (see db_set_nowait()) reports DB_BUSY while another thread
+*  holds a cycle transaction open and succeeds once it is committed.
+*
+*  Usage: bench_range [dir] [days] [sensors]
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "config.h"
+#include "db.h"
+#include "archive.h"
+#include "sample.h"
+#include "query.h"
+
+/******************************************************************************/
+
+#define BENCH_DEFAULT_DIR       "/tmp/bench_range"
+#define BENCH_DEFAULT_DAYS      (365)
+#define BENCH_DEFAULT_SENSORS   (4)
+
+#define BENCH_PERIOD_S          (60)
+#define BENCH_SAMPLES_PER_DAY   (86400 / BENCH_PERIOD_S)
+
+/* Days kept in the database, as with the default 'archive.after_days'
+*/
+#define BENCH_DB_DAYS           (7)
+
+/* Points of the downsampled series, about the width of a chart
+*/
+#define BENCH_POINTS            (1000)
+
+/* Tables db_open() expects, it adds the rest
+*/
+#define SQL_CREATE_TABLES       "CREATE TABLE sensor_data (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id INTEGER NOT NULL, sen_val REAL NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE loads (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "load_type INTEGER NOT NULL, load_status CHAR(3) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now'))); " \
+                                "CREATE TABLE users (sl INTEGER PRIMARY KEY AUTOINCREMENT, " \
+                                "u_name CHAR(32) NOT NULL, u_pass CHAR(32) NOT NULL, " \
+                                "fl_name CHAR(32) NOT NULL, u_role CHAR(32) NOT NULL, " \
+                                "time timestamp default (strftime('%s', 'now')));"
+
+/******************************************************************************/
+
+static sqlite3 *p_db = NULL;
+
+// Cycle transaction of the busy check: opened, then committed
+static pthread_barrier_t cycle_barrier;
+
+static query_t       query;
+static query_point_t points[QUERY_MAX_CHUNK];
+static char          buf[QUERY_MAX_CHUNK * QUERY_CSV_LEN];
+
+/******************************************************************************/
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/* Resident memory of the process in KiB
+*/
+static long rss_kib(void)
+{
+    FILE *p_file = fopen("/proc/self/statm", "r");
+    long  size = 0, resident = 0;
+
+    if (NULL != p_file)
+    {
+        if (2 != fscanf(p_file, "%ld %ld", &size, &resident))
+        {
+            resident = 0;
+        }
+        fclose(p_file);
+    }
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static uint8_t bench_exec(const char * p_sql)
+{
+    char *p_err = NULL;
+
+    if (SQLITE_OK != sqlite3_exec(p_db, p_sql, NULL, NULL, &p_err))
+    {
+        printf("Query '%s' failed: %s\n", p_sql, p_err);
+        sqlite3_free(p_err);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+/* Value of a sensor at a sample index, slow daily swing plus noise, rounded
+*  to 0.01 like the stored values
+*/
+static int32_t bench_value(uint32_t sensor, long index)
+{
+    double t = (double)index / BENCH_SAMPLES_PER_DAY;
+
+    return (int32_t)lround((25.0 + sensor * 0.5 + 3.0 * sin(2 * M_PI * t) +
+                            ((rand() % 21) - 10) * 0.01) * SAMPLE_SCALE);
+}
+
+/* Function declaration to load the history, old days into the archive and
+*  the last BENCH_DB_DAYS into the database
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t bench_load(const char * p_dir, time_t start, uint32_t days, uint32_t sensors)
+{
+    static archive_point_t day_points[BENCH_SAMPLES_PER_DAY];
+    sqlite3_stmt          *p_stmt;
+    uint32_t               d, s, i;
+    int64_t                sl = 0;
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db, "INSERT INTO sensor_data (sen_id, sen_val, time) "
+                                            "VALUES (?1, ?2, ?3);", -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+        return FAIL;
+    }
+
+    for (d = 0; d < days; d++)
+    {
+        if (d < (days - BENCH_DB_DAYS))
+        {
+            for (s = 1; s <= sensors; s++)
+            {
+                for (i = 0; i < BENCH_SAMPLES_PER_DAY; i++)
+                {
+                    day_points[i].sen_time = (int64_t)start + ((int64_t)d * 86400) +
+                                                                    (i * BENCH_PERIOD_S);
+                    day_points[i].sl = ++sl;
+                    day_points[i].value = bench_value(s, ((long)d * BENCH_SAMPLES_PER_DAY) + i);
+                }
+                if (SUCCESS != archive_write(p_dir, (uint16_t)s, start + ((time_t)d * 86400),
+                                                        day_points, BENCH_SAMPLES_PER_DAY))
+                {
+                    sqlite3_finalize(p_stmt);
+                    return FAIL;
+                }
+            }
+            continue;
+        }
+
+        // Rows of all sensors interleaved, as one cycle stores them
+        bench_exec("BEGIN;");
+        for (i = 0; i < BENCH_SAMPLES_PER_DAY; i++)
+        {
+            for (s = 1; s <= sensors; s++)
+            {
+                sqlite3_bind_int(p_stmt, 1, s);
+                sqlite3_bind_double(p_stmt, 2,
+                    (double)bench_value(s, ((long)d * BENCH_SAMPLES_PER_DAY) + i) / SAMPLE_SCALE);
+                sqlite3_bind_int64(p_stmt, 3, (int64_t)start + ((int64_t)d * 86400) +
+                                                                    (i * BENCH_PERIOD_S));
+                sqlite3_step(p_stmt);
+                sqlite3_reset(p_stmt);
+            }
+        }
+        if (SUCCESS != bench_exec("COMMIT;"))
+        {
+            sqlite3_finalize(p_stmt);
+            return FAIL;
+        }
+    }
+    sqlite3_finalize(p_stmt);
+
+    return SUCCESS;
+}
+
+/* Function declaration to page through a range, one query per chunk
+*  @param[in] p_name     - Name of the run
+*  @param[in] from       - Start of the range
+*  @param[in] to         - End of the range
+*  @param[in] max_points - Points of the downsampling, 0 for all samples
+*  @param[in] is_bin     - Non-zero for binary chunks
+*  @param[in] expected   - Samples within the range
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a failed check )
+*/
+static uint8_t bench_run(const char * p_name, int64_t from, int64_t to, uint32_t max_points,
+                         uint8_t is_bin, uint64_t expected)
+{
+    char          cursor[QUERY_CURSOR_LEN];
+    uint8_t       has_cursor = 0;
+    uint64_t      num_samples = 0, num_bytes = 0;
+    uint32_t      num_requests = 0, num, i;
+    query_point_t first, last = { 0, 0 };
+    int64_t       prev_time = from;
+    double        t_start = now_sec(), t_run;
+
+    first.sen_time = -1;
+
+    do
+    {
+        if (SUCCESS != query_open(&query, 1, from, to, max_points, (has_cursor) ? (cursor) : (NULL)))
+        {
+            printf("%s: query rejected.\n", p_name);
+            return FAIL;
+        }
+        if (SUCCESS != query_read(&query, points, QUERY_CHUNK, QUERY_MAX_SCAN, &num))
+        {
+            printf("%s: query failed.\n", p_name);
+            query_close(&query);
+            return FAIL;
+        }
+        num_bytes += query_encode(points, num, is_bin, buf);
+        has_cursor = (SUCCESS == query_cursor(&query, cursor));
+        query_close(&query);
+        num_requests++;
+
+        for (i = 0; i < num; i++)
+        {
+            if ((points[i].sen_time < prev_time) || (points[i].sen_time >= to))
+            {
+                printf("%s: sample out of order at %lld.\n", p_name, (long long)points[i].sen_time);
+                return FAIL;
+            }
+            prev_time = points[i].sen_time;
+            if (first.sen_time < 0)
+            {
+                first = points[i];
+            }
+            last = points[i];
+        }
+        num_samples += num;
+    } while (has_cursor);
+
+    t_run = now_sec() - t_start;
+
+    printf("  %-28s %9llu %8u %9.1f ms %11.0f %9.1f MB/s %8ld KiB\n", p_name,
+           (unsigned long long)num_samples, num_requests, t_run * 1e3,
+           ((max_points) ? (expected) : (num_samples)) / t_run,
+           num_bytes / t_run / 1e6, rss_kib());
+
+    if (!max_points && (num_samples != expected))
+    {
+        printf("%s: %llu samples returned, %llu expected.\n", p_name,
+                            (unsigned long long)num_samples, (unsigned long long)expected);
+        return FAIL;
+    }
+    if (max_points &&
+        ((num_samples > max_points) || (first.sen_time != from) ||
+         (last.sen_time != (to - BENCH_PERIOD_S))))
+    {
+        printf("%s: %llu points from %lld to %lld.\n", p_name, (unsigned long long)num_samples,
+                                        (long long)first.sen_time, (long long)last.sen_time);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+/* Function declaration of the thread holding a cycle transaction open
+*  between two barrier waits
+*/
+static void * bench_cycle_fn(void * p_arg)
+{
+    uint8_t is_open = (SUCCESS == db_begin_cycle());
+
+    pthread_barrier_wait(&cycle_barrier);
+    pthread_barrier_wait(&cycle_barrier);
+    if (is_open)
+    {
+        db_commit_cycle();
+    }
+
+    return NULL;
+}
+
+/* Function declaration to check a query against a cycle transaction of
+*  another thread, the calling thread not waiting for it
+*  @param[in] from - Start of the range
+*  @param[in] to   - End of the range
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a failed check )
+*/
+static uint8_t bench_busy(int64_t from, int64_t to)
+{
+    pthread_t thread;
+    uint32_t  num;
+    uint8_t   busy_ret, ret;
+
+    pthread_barrier_init(&cycle_barrier, NULL, 2);
+    if (0 != pthread_create(&thread, NULL, bench_cycle_fn, NULL))
+    {
+        pthread_barrier_destroy(&cycle_barrier);
+        return FAIL;
+    }
+    db_set_nowait(1);
+
+    pthread_barrier_wait(&cycle_barrier);
+    query_open(&query, 1, from, to, 0, NULL);
+    busy_ret = query_read(&query, points, QUERY_CHUNK, QUERY_MAX_SCAN, &num);
+    query_close(&query);
+    pthread_barrier_wait(&cycle_barrier);
+    pthread_join(thread, NULL);
+    pthread_barrier_destroy(&cycle_barrier);
+
+    query_open(&query, 1, from, to, 0, NULL);
+    ret = query_read(&query, points, QUERY_CHUNK, QUERY_MAX_SCAN, &num);
+    query_close(&query);
+    db_set_nowait(0);
+
+    printf("  %-28s %s while committing, %s after\n", "week, busy database",
+                (DB_BUSY == busy_ret) ? ("busy") : ("not busy"),
+                (SUCCESS == ret) ? ("read") : ("failed"));
+
+    return ((DB_BUSY == busy_ret) && (SUCCESS == ret) && (QUERY_CHUNK == num)) ? (SUCCESS) : (FAIL);
+}
+
+int main(int argc, char** argv)
+{
+    const char *p_dir = (argc > 1) ? (argv[1]) : (BENCH_DEFAULT_DIR);
+    uint32_t    days = (argc > 2) ? ((uint32_t)atoi(argv[2])) : (BENCH_DEFAULT_DAYS);
+    uint32_t    sensors = (argc > 3) ? ((uint32_t)atoi(argv[3])) : (BENCH_DEFAULT_SENSORS);
+    char        db_path[ARCHIVE_PATH_LEN];
+    time_t      start, end, week;
+    uint32_t    d, s;
+    uint8_t     is_ok;
+    double      t_load;
+
+    if ((days <= BENCH_DB_DAYS) || (0 == sensors) || (sensors > 0xFFFF))
+    {
+        printf("Usage: %s [dir] [days > %d] [sensors]\n", argv[0], BENCH_DB_DAYS);
+        return 1;
+    }
+
+    if ((0 != mkdir(p_dir, 0755)) && (0 != access(p_dir, W_OK)))
+    {
+        printf("Failed to create %s.\n", p_dir);
+        return 1;
+    }
+    snprintf(db_path, sizeof(db_path), "%s/bench.db", p_dir);
+    unlink(db_path);
+
+    // Whole days, as the archive has them
+    start = time(NULL) - ((time_t)(days + 1) * 86400);
+    start -= start % 86400;
+    end = start + ((time_t)days * 86400);
+    week = end - (7 * 86400);
+    srand(1);
+
+    printf("%u days of history (last %d in the database), %u sensors every %d s, directory %s\n",
+                                            days, BENCH_DB_DAYS, sensors, BENCH_PERIOD_S, p_dir);
+
+    t_load = now_sec();
+    if ((SQLITE_OK != sqlite3_open(db_path, &p_db)) ||
+        (SUCCESS != bench_exec("PRAGMA synchronous=OFF;")) ||
+        (SUCCESS != bench_exec(SQL_CREATE_TABLES)) ||
+        (SUCCESS != bench_load(p_dir, start, days, sensors)))
+    {
+        printf("Benchmark failed.\n");
+        sqlite3_close(p_db);
+        return 1;
+    }
+    sqlite3_close(p_db);
+
+    // The daemon opens the database with its indexes and reads the archive
+    // from 'archive.path'
+    config_set("archive.path", p_dir);
+    if (SUCCESS != db_open(db_path, 1))
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+    printf("Loaded in %.1f s, query state %u bytes, chunk %d samples.\n",
+                        now_sec() - t_load, (unsigned)sizeof(query_t), QUERY_CHUNK);
+
+    printf("  %-28s %9s %8s %12s %11s %14s %12s\n", "", "samples", "requests", "time",
+                                                        "samples/s", "output", "RSS");
+
+    is_ok = (SUCCESS == bench_run("week, all, csv", week, end, 0, 0,
+                                        7UL * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_run("week, all, bin", week, end, 0, 1,
+                                        7UL * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_run("week, 1000 points", week, end, BENCH_POINTS, 1,
+                                        7UL * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_run("history, all, csv", start, end, 0, 0,
+                                        (uint64_t)days * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_run("history, all, bin", start, end, 0, 1,
+                                        (uint64_t)days * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_run("history, 1000 points", start, end, BENCH_POINTS, 1,
+                                        (uint64_t)days * BENCH_SAMPLES_PER_DAY)) &&
+            (SUCCESS == bench_busy(week, end));
+
+    db_close();
+    unlink(db_path);
+    snprintf(db_path, sizeof(db_path), "%s/bench.db-wal", p_dir);
+    unlink(db_path);
+    snprintf(db_path, sizeof(db_path), "%s/bench.db-shm", p_dir);
+    unlink(db_path);
+    for (s = 1; s <= sensors; s++)
+    {
+        for (d = 0; d < days; d++)
+        {
+            archive_path(db_path, p_dir, (uint16_t)s, start + ((time_t)d * 86400));
+            unlink(db_path);
+        }
+    }
+    rmdir(p_dir);
+
+    if (!is_ok)
+    {
+        printf("Benchmark failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
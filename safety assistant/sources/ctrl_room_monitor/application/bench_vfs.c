@@ -0,0 +1,135 @@
+/******************************************************************************/
+
+/* File - bench_vfs.c
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Pass-through SQLite VFS counting syncs and writes. See bench_vfs.h.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "bench_vfs.h"
+
+/******************************************************************************/
+
+/* Pass-through VFS file, the real file object follows right behind it
+*/
+typedef struct
+{
+    sqlite3_file        base;
+    sqlite3_file       *p_real;
+} count_file_t;
+
+static sqlite3_vfs     *p_root_vfs;
+static sqlite3_vfs      count_vfs;
+static unsigned long    sync_count = 0;
+static unsigned long    write_count = 0;
+static uint64_t         write_bytes = 0;
+
+/******************************************************************************/
+
+#define REAL(f)         (((count_file_t *)(f))->p_real)
+
+static int cf_close(sqlite3_file *f)
+    { return REAL(f)->pMethods->xClose(REAL(f)); }
+static int cf_read(sqlite3_file *f, void *p, int n, sqlite3_int64 o)
+    { return REAL(f)->pMethods->xRead(REAL(f), p, n, o); }
+static int cf_write(sqlite3_file *f, const void *p, int n, sqlite3_int64 o)
+    { write_count++; write_bytes += n; return REAL(f)->pMethods->xWrite(REAL(f), p, n, o); }
+static int cf_truncate(sqlite3_file *f, sqlite3_int64 n)
+    { return REAL(f)->pMethods->xTruncate(REAL(f), n); }
+static int cf_sync(sqlite3_file *f, int flags)
+    { sync_count++; return REAL(f)->pMethods->xSync(REAL(f), flags); }
+static int cf_file_size(sqlite3_file *f, sqlite3_int64 *p)
+    { return REAL(f)->pMethods->xFileSize(REAL(f), p); }
+static int cf_lock(sqlite3_file *f, int l)
+    { return REAL(f)->pMethods->xLock(REAL(f), l); }
+static int cf_unlock(sqlite3_file *f, int l)
+    { return REAL(f)->pMethods->xUnlock(REAL(f), l); }
+static int cf_check_lock(sqlite3_file *f, int *p)
+    { return REAL(f)->pMethods->xCheckReservedLock(REAL(f), p); }
+static int cf_file_control(sqlite3_file *f, int op, void *p)
+    { return REAL(f)->pMethods->xFileControl(REAL(f), op, p); }
+static int cf_sector_size(sqlite3_file *f)
+    { return REAL(f)->pMethods->xSectorSize(REAL(f)); }
+static int cf_device_char(sqlite3_file *f)
+    { return REAL(f)->pMethods->xDeviceCharacteristics(REAL(f)); }
+static int cf_shm_map(sqlite3_file *f, int i, int sz, int ext, void volatile **pp)
+    { return REAL(f)->pMethods->xShmMap(REAL(f), i, sz, ext, pp); }
+static int cf_shm_lock(sqlite3_file *f, int o, int n, int fl)
+    { return REAL(f)->pMethods->xShmLock(REAL(f), o, n, fl); }
+static void cf_shm_barrier(sqlite3_file *f)
+    { REAL(f)->pMethods->xShmBarrier(REAL(f)); }
+static int cf_shm_unmap(sqlite3_file *f, int del)
+    { return REAL(f)->pMethods->xShmUnmap(REAL(f), del); }
+
+static const sqlite3_io_methods count_io_methods =
+{
+    2, cf_close, cf_read, cf_write, cf_truncate, cf_sync, cf_file_size,
+    cf_lock, cf_unlock, cf_check_lock, cf_file_control, cf_sector_size,
+    cf_device_char, cf_shm_map, cf_shm_lock, cf_shm_barrier, cf_shm_unmap,
+    NULL, NULL
+};
+
+static int cv_open(sqlite3_vfs *p_vfs, const char *p_name, sqlite3_file *f,
+                                                    int flags, int *p_out_flags)
+{
+    count_file_t *p_file = (count_file_t *)f;
+    int ret_val;
+
+    p_file->p_real = (sqlite3_file *)&p_file[1];
+    ret_val = p_root_vfs->xOpen(p_root_vfs, p_name, p_file->p_real, flags, p_out_flags);
+
+    // Only hook up the methods if the real open succeeded, SQLite will not
+    // call xClose otherwise.
+    p_file->base.pMethods = (NULL != p_file->p_real->pMethods) ?
+                                                    (&count_io_methods) : (NULL);
+
+    return ret_val;
+}
+
+uint8_t bench_vfs_register(void)
+{
+    p_root_vfs = sqlite3_vfs_find(NULL);
+    if (NULL == p_root_vfs)
+    {
+        return FAIL;
+    }
+
+    count_vfs = *p_root_vfs;
+    count_vfs.zName = "count_vfs";
+    count_vfs.szOsFile = sizeof(count_file_t) + p_root_vfs->szOsFile;
+    count_vfs.xOpen = cv_open;
+
+    return (SQLITE_OK == sqlite3_vfs_register(&count_vfs, 1)) ? (SUCCESS) : (FAIL);
+}
+
+/******************************************************************************/
+
+void bench_vfs_reset(void)
+{
+    sync_count = 0;
+    write_count = 0;
+    write_bytes = 0;
+}
+
+unsigned long bench_vfs_syncs(void)
+{
+    return sync_count;
+}
+
+unsigned long bench_vfs_writes(void)
+{
+    return write_count;
+}
+
+uint64_t bench_vfs_write_bytes(void)
+{
+    return write_bytes;
+}
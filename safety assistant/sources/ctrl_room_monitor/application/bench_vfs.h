@@ -0,0 +1,32 @@
+/******************************************************************************/
+
+/* File - bench_vfs.h
+*
+*  Target Hardware: Any Linux host (or SIEMENS IoT2020)
+*
+*  Pass-through SQLite VFS for the benchmarks. It is registered as default
+*  VFS and counts syncs (fsync) and writes of all database, journal and WAL
+*  files, i.e. the I/O cost of a storage path independent of the disk.
+*/
+
+/******************************************************************************/
+
+#ifndef BENCH_VFS_H
+#define BENCH_VFS_H
+
+#include <stdint.h>
+
+/* Function declaration to register the counting VFS as default VFS, must be
+*  called before any database is opened
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t bench_vfs_register(void);
+
+/* Function declarations to reset and read the counters
+*/
+void          bench_vfs_reset(void);
+unsigned long bench_vfs_syncs(void);
+unsigned long bench_vfs_writes(void);
+uint64_t      bench_vfs_write_bytes(void);
+
+#endif /* BENCH_VFS_H */
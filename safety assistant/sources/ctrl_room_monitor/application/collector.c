@@ -0,0 +1,806 @@
+/******************************************************************************/
+
+/* File - collector.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Collector daemon, merges the sample streams of many gateways (see
+*  uplink.h) into one SQLite3 store. Every gateway is a node, its samples
+*  are stored with its node ID, so the sensor IDs of different gateways do
+*  not clash ('node_sensors' maps them to the sensor keys of the gateway).
+*
+*  The last sequence number taken from a node is stored with its samples in
+*  the same transaction, a reconnecting gateway resumes right after it.
+*  Batches of all nodes that arrived in one scheduler round are committed
+*  together and acknowledged after the commit. A gateway sends only a few
+*  batches ahead of the acknowledgement, so a collector slowed down by its
+*  disk slows the gateways down, their backlog stays in their databases.
+*
+*  Usage: collector [-l address] [-d database_path] [-r report_s]
+*     e.g. collector -l :5020 -d /tmp/collector.db
+*          collector -l unix:/tmp/collector.sock
+*/
+
+/******************************************************************************/
+
+// accept4()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "sched.h"
+#include "sample.h"
+#include "wire.h"
+#include "lat.h"
+
+/******************************************************************************/
+
+#define COLLECTOR_ADDR              ":" WIRE_PORT
+#define COLLECTOR_DB_PATH           "/home/root/ctrl_room_monitor/database/collector.db"
+
+/* Connected gateways at most, the scheduler also watches the listening
+*  socket and the signals
+*/
+#define COLLECTOR_MAX_NODES         (SCHED_MAX_FDS - 2)
+
+/* Samples of one transaction, a larger round is committed in parts
+*/
+#define COLLECTOR_COMMIT_ROWS       (16384)
+
+/* Statistics are printed every COLLECTOR_REPORT_S seconds ('-r', 0 = off)
+*/
+#define COLLECTOR_REPORT_S          (60)
+
+#define DB_BUSY_TIMEOUT_MS          (5000)
+
+/* Store, created on open
+*/
+#define SQL_CREATE_TABLES       "CREATE TABLE IF NOT EXISTS nodes (" \
+                                "node_id  INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "name     CHAR(32)  NOT NULL UNIQUE, " \
+                                "last_seq INTEGER   NOT NULL DEFAULT 0, " \
+                                "time     timestamp default (strftime('%s', 'now')));" \
+                                "CREATE TABLE IF NOT EXISTS node_sensors (" \
+                                "sl       INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "node_id  INTEGER   NOT NULL, " \
+                                "sen_id   INTEGER   NOT NULL, " \
+                                "rom_code CHAR(16)  NOT NULL, " \
+                                "sen_type INTEGER   NOT NULL, " \
+                                "UNIQUE (node_id, sen_id));" \
+                                "CREATE TABLE IF NOT EXISTS node_data (" \
+                                "sl       INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "node_id  INTEGER   NOT NULL, " \
+                                "sen_id   INTEGER   NOT NULL, " \
+                                "sen_val  REAL      NOT NULL, " \
+                                "time     timestamp, " \
+                                "seq      INTEGER   NOT NULL);" \
+                                "CREATE INDEX IF NOT EXISTS node_data_sensor " \
+                                "ON node_data (node_id, sen_id, time);"
+
+#define SQL_SELECT_NODE         "SELECT node_id, last_seq FROM nodes WHERE name = ?1;"
+#define SQL_INSERT_NODE         "INSERT INTO nodes (name) VALUES (?1);"
+#define SQL_UPDATE_NODE         "UPDATE nodes SET last_seq = ?2 WHERE node_id = ?1;"
+#define SQL_INSERT_SENSOR       "INSERT OR REPLACE INTO node_sensors (node_id, sen_id, " \
+                                "rom_code, sen_type) VALUES (?1, ?2, ?3, ?4);"
+#define SQL_INSERT_DATA         "INSERT INTO node_data (node_id, sen_id, sen_val, time, seq) " \
+                                "VALUES (?1, ?2, ?3, ?4, ?5);"
+
+/******************************************************************************/
+
+/* Connection of a gateway, free if 'fd' is negative
+*/
+typedef struct
+{
+    int         fd;
+    sched_fd_t  watch;
+    uint8_t    *p_buf;                          // One frame at most
+    uint32_t    buf_len;
+    int64_t     node_id;                        // 0 until HELLO
+    char        name[WIRE_NAME_LEN + 1];
+    int64_t     last_seq;                       // Last sample taken
+    uint8_t     is_ack_due;                     // Samples in the open transaction
+} collector_node_t;
+
+/******************************************************************************/
+
+static sqlite3          *p_db = NULL;
+static sqlite3_stmt     *p_insert_stmt = NULL;
+static sqlite3_stmt     *p_update_stmt = NULL;
+static sqlite3_stmt     *p_sensor_stmt = NULL;
+static uint8_t           is_in_transaction = 0;
+static uint32_t          rows_in_transaction = 0;
+
+static int               listen_fd = -1;
+static sched_fd_t        listen_watch;
+static int               signal_fd = -1;
+static sched_fd_t        signal_watch;
+static uint8_t           is_stop = 0;
+
+static collector_node_t  nodes[COLLECTOR_MAX_NODES];
+
+// Commits the batches of a scheduler round
+static sched_task_t      commit_task;
+static sched_task_t      report_task;
+static uint32_t          report_s;
+
+// Totals since start-up and since the last report
+static uint64_t          num_samples = 0;
+static uint64_t          num_duplicates = 0;
+static uint64_t          num_commits = 0;
+static uint64_t          report_samples = 0;
+static int64_t           report_ns;
+static lat_t             commit_lat;
+
+/******************************************************************************/
+
+/* Function declarations of the watcher and task functions
+*/
+static void    collector_accept(sched_fd_t * p_watch);
+static void    collector_read(sched_fd_t * p_watch);
+static void    signal_fn(sched_fd_t * p_watch);
+static void    commit_task_fn(sched_task_t * p_task);
+static void    report_task_fn(sched_task_t * p_task);
+
+/* Function declarations of the message handlers
+*  @param[in] p_node    - Connection
+*  @param[in] p_payload - Payload of the frame
+*  @param[in] len       - Payload length
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) drops the connection )
+*/
+static uint8_t collector_hello(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len);
+static uint8_t collector_sensors(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len);
+static uint8_t collector_batch(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len);
+
+/* Function declaration to commit the open transaction and acknowledge the
+*  samples in it. On failure the nodes with samples in it are dropped, they
+*  resume from the last commit.
+*  @return - None
+*/
+static void    collector_commit(void);
+
+/* Function declaration to send a frame with a sequence number (RESUME, ACK)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t collector_send_seq(collector_node_t * p_node, wire_type_t type, int64_t seq);
+
+/* Function declaration to close a connection and free its slot
+*  @return - None
+*/
+static void    collector_drop(collector_node_t * p_node, const char * p_reason);
+
+/* Function declarations of the store
+*/
+static uint8_t store_open(const char * p_path);
+static uint8_t store_exec(const char * p_sql);
+static uint8_t store_begin(void);
+static void    store_close(void);
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    const char *p_addr = COLLECTOR_ADDR;
+    const char *p_db_path = COLLECTOR_DB_PATH;
+    sigset_t    sig_mask;
+    uint16_t    i;
+    int         opt;
+
+    report_s = COLLECTOR_REPORT_S;
+
+    while (-1 != (opt = getopt(argc, argv, "l:d:r:")))
+    {
+        switch (opt)
+        {
+            case 'l':
+                p_addr = optarg;
+            break;
+
+            case 'd':
+                p_db_path = optarg;
+            break;
+
+            case 'r':
+                report_s = (uint32_t)atoi(optarg);
+            break;
+
+            default:
+                printf("Usage: %s [-l address] [-d database_path] [-r report_s]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    for (i = 0; i < COLLECTOR_MAX_NODES; i++)
+    {
+        nodes[i].fd = -1;
+    }
+
+    sigemptyset(&sig_mask);
+    sigaddset(&sig_mask, SIGTERM);
+    sigaddset(&sig_mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &sig_mask, NULL);
+    signal_fd = signalfd(-1, &sig_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    if (SUCCESS != store_open(p_db_path))
+    {
+        return 1;
+    }
+
+    listen_fd = wire_listen(p_addr);
+    if (listen_fd < 0)
+    {
+        store_close();
+        return 1;
+    }
+
+    sched_init();
+    sched_task_init(&commit_task, commit_task_fn, NULL);
+    sched_task_init(&report_task, report_task_fn, NULL);
+    lat_reset(&commit_lat);
+    report_ns = lat_now_ns();
+
+    if ((signal_fd < 0) || (SUCCESS != sched_watch(&signal_watch, signal_fd, signal_fn, NULL)) ||
+        (SUCCESS != sched_watch(&listen_watch, listen_fd, collector_accept, NULL)))
+    {
+        close(listen_fd);
+        store_close();
+        return 1;
+    }
+    if (report_s)
+    {
+        sched_start(&report_task, report_s * 1000, report_s * 1000);
+    }
+
+    printf("Collector listening on %s, store %s.\n", p_addr, p_db_path);
+
+    while (!is_stop)
+    {
+        if (sched_run() < 0)
+        {
+            break;
+        }
+    }
+
+    // Whatever is taken is committed and acknowledged
+    collector_commit();
+    for (i = 0; i < COLLECTOR_MAX_NODES; i++)
+    {
+        collector_drop(&nodes[i], NULL);
+        free(nodes[i].p_buf);
+    }
+    close(listen_fd);
+    if (0 == strncmp(p_addr, "unix:", 5))
+    {
+        unlink(&p_addr[5]);
+    }
+
+    printf("%llu sample(s) stored, %llu duplicate(s) skipped, %llu commit(s).\n",
+           (unsigned long long)num_samples, (unsigned long long)num_duplicates,
+           (unsigned long long)num_commits);
+    lat_print(&commit_lat, "Commit latency");
+
+    store_close();
+
+    return 0;
+}
+
+/******************************************************************************/
+
+static void collector_accept(sched_fd_t * p_watch)
+{
+    collector_node_t *p_node;
+    int               fd;
+    uint16_t          i;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    for (i = 0; (i < COLLECTOR_MAX_NODES) && (nodes[i].fd >= 0); i++)
+    {
+    }
+    if (i >= COLLECTOR_MAX_NODES)
+    {
+        printf("Too many nodes, connection refused.\n");
+        close(fd);
+        return;
+    }
+
+    p_node = &nodes[i];
+    if (NULL == p_node->p_buf)
+    {
+        p_node->p_buf = (uint8_t *) malloc(WIRE_HDR_LEN + WIRE_MAX_PAYLOAD);
+    }
+    if ((NULL == p_node->p_buf) ||
+        (SUCCESS != sched_watch(&p_node->watch, fd, collector_read, p_node)))
+    {
+        close(fd);
+        return;
+    }
+    p_node->fd = fd;
+    p_node->buf_len = 0;
+    p_node->node_id = 0;
+    p_node->name[0] = '\0';
+    p_node->is_ack_due = 0;
+}
+
+static void collector_read(sched_fd_t * p_watch)
+{
+    collector_node_t *p_node = (collector_node_t *)p_watch->p_arg;
+    ssize_t           len;
+    int32_t           frame_len;
+    uint32_t          offset = 0;
+    uint8_t           is_ok = 1;
+    uint8_t          *p_frame;
+
+    len = recv(p_node->fd, &p_node->p_buf[p_node->buf_len],
+               (WIRE_HDR_LEN + WIRE_MAX_PAYLOAD) - p_node->buf_len, 0);
+    if ((len < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+    {
+        return;
+    }
+    if (len <= 0)
+    {
+        collector_drop(p_node, "connection closed");
+        return;
+    }
+    p_node->buf_len += (uint32_t)len;
+
+    // A commit run by a handler may drop the node itself
+    while (is_ok && (p_node->fd >= 0) && ((frame_len = wire_frame_len(&p_node->p_buf[offset],
+                                                p_node->buf_len - offset)) > 0))
+    {
+        p_frame = &p_node->p_buf[offset];
+        offset += (uint32_t)frame_len;
+
+        // Nothing but HELLO before the node is known
+        if ((0 == p_node->node_id) && (WIRE_HELLO != p_frame[4]))
+        {
+            collector_drop(p_node, "no hello");
+            return;
+        }
+
+        switch (p_frame[4])
+        {
+            case WIRE_HELLO:
+                is_ok = (0 == p_node->node_id) &&
+                        collector_hello(p_node, &p_frame[WIRE_HDR_LEN], frame_len - WIRE_HDR_LEN);
+            break;
+
+            case WIRE_SENSORS:
+                is_ok = collector_sensors(p_node, &p_frame[WIRE_HDR_LEN], frame_len - WIRE_HDR_LEN);
+            break;
+
+            case WIRE_BATCH:
+                is_ok = collector_batch(p_node, &p_frame[WIRE_HDR_LEN], frame_len - WIRE_HDR_LEN);
+            break;
+
+            default:
+                is_ok = FAIL;
+            break;
+        }
+    }
+
+    if (p_node->fd < 0)
+    {
+        return;
+    }
+    if (!is_ok || (frame_len < 0))
+    {
+        collector_drop(p_node, "invalid message");
+        return;
+    }
+
+    // A partial frame waits for the rest
+    p_node->buf_len -= offset;
+    memmove(p_node->p_buf, &p_node->p_buf[offset], p_node->buf_len);
+}
+
+static uint8_t collector_hello(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len)
+{
+    sqlite3_stmt *p_stmt;
+    int64_t       gw_seq;
+    uint8_t       name_len;
+    uint16_t      i;
+    int           db_ret_val;
+
+    if (len < (WIRE_SEQ_LEN + 1))
+    {
+        return FAIL;
+    }
+    gw_seq = (int64_t)wire_get_u64(p_payload);
+    name_len = p_payload[WIRE_SEQ_LEN];
+    if ((0 == name_len) || (name_len > WIRE_NAME_LEN) || (len != (WIRE_SEQ_LEN + 1u + name_len)))
+    {
+        return FAIL;
+    }
+    memcpy(p_node->name, &p_payload[WIRE_SEQ_LEN + 1], name_len);
+    p_node->name[name_len] = '\0';
+
+    for (i = 0; i < COLLECTOR_MAX_NODES; i++)
+    {
+        if ((&nodes[i] != p_node) && (nodes[i].fd >= 0) && (nodes[i].node_id) &&
+            (0 == strcmp(nodes[i].name, p_node->name)))
+        {
+            printf("Node %s already connected.\n", p_node->name);
+            return FAIL;
+        }
+    }
+
+    // The resume point must be durable, a rollback would leave a gap
+    collector_commit();
+
+    for (i = 0; i < 2; i++)
+    {
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db, (0 == i) ? (SQL_SELECT_NODE) : (SQL_INSERT_NODE),
+                                                                        -1, &p_stmt, NULL))
+        {
+            printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+            return FAIL;
+        }
+        sqlite3_bind_text(p_stmt, 1, p_node->name, -1, SQLITE_STATIC);
+
+        db_ret_val = sqlite3_step(p_stmt);
+        if (SQLITE_ROW == db_ret_val)
+        {
+            p_node->node_id = (int64_t)sqlite3_column_int64(p_stmt, 0);
+            p_node->last_seq = (int64_t)sqlite3_column_int64(p_stmt, 1);
+        }
+        else if (SQLITE_DONE == db_ret_val)
+        {
+            p_node->node_id = (int64_t)sqlite3_last_insert_rowid(p_db);
+            p_node->last_seq = 0;
+        }
+        sqlite3_finalize(p_stmt);
+
+        if ((SQLITE_ROW == db_ret_val) || ((1 == i) && (SQLITE_DONE == db_ret_val)))
+        {
+            break;
+        }
+        if (SQLITE_DONE != db_ret_val)
+        {
+            printf("Failed to look up node %s. Err Msg - %s.\n", p_node->name, sqlite3_errmsg(p_db));
+            p_node->node_id = 0;
+            return FAIL;
+        }
+    }
+
+    // Database of the gateway replaced, its sequence starts over
+    if (gw_seq < p_node->last_seq)
+    {
+        printf("Node %s restarted its sequence at %lld (was %lld).\n", p_node->name,
+               (long long)gw_seq, (long long)p_node->last_seq);
+        p_node->last_seq = 0;
+    }
+
+    printf("Node %s (%lld) connected, resuming after %lld.\n", p_node->name,
+           (long long)p_node->node_id, (long long)p_node->last_seq);
+
+    return collector_send_seq(p_node, WIRE_RESUME, p_node->last_seq);
+}
+
+static uint8_t collector_sensors(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len)
+{
+    uint32_t offset = 2;
+    uint16_t count, i;
+    uint8_t  key_len;
+
+    if ((len < 2) || (SUCCESS != store_begin()))
+    {
+        return FAIL;
+    }
+    count = wire_get_u16(p_payload);
+
+    for (i = 0; i < count; i++)
+    {
+        if ((offset + 4) > len)
+        {
+            return FAIL;
+        }
+        key_len = p_payload[offset + 3];
+        if ((offset + 4 + key_len) > len)
+        {
+            return FAIL;
+        }
+
+        sqlite3_bind_int64(p_sensor_stmt, 1, (sqlite3_int64)p_node->node_id);
+        sqlite3_bind_int(p_sensor_stmt, 2, wire_get_u16(&p_payload[offset]));
+        sqlite3_bind_text(p_sensor_stmt, 3, (const char *)&p_payload[offset + 4], key_len,
+                                                                        SQLITE_TRANSIENT);
+        sqlite3_bind_int(p_sensor_stmt, 4, p_payload[offset + 2]);
+        if (SQLITE_DONE != sqlite3_step(p_sensor_stmt))
+        {
+            printf("Failed to store sensor of node %s. Err Msg - %s.\n", p_node->name,
+                                                                    sqlite3_errmsg(p_db));
+        }
+        sqlite3_reset(p_sensor_stmt);
+
+        offset += 4 + key_len;
+    }
+
+    if (!sched_is_pending(&commit_task))
+    {
+        sched_after(&commit_task, 0);
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t collector_batch(collector_node_t * p_node, const uint8_t * p_payload, uint32_t len)
+{
+    const uint8_t *p_rec;
+    uint16_t       count, i;
+    int64_t        seq;
+    int            db_ret_val;
+
+    if (len < WIRE_BATCH_HDR_LEN)
+    {
+        return FAIL;
+    }
+    seq = (int64_t)wire_get_u64(p_payload);
+    count = wire_get_u16(&p_payload[WIRE_SEQ_LEN]);
+    if ((len != (WIRE_BATCH_HDR_LEN + ((uint32_t)count * WIRE_SAMPLE_LEN))) ||
+        (SUCCESS != store_begin()))
+    {
+        return FAIL;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        p_rec = &p_payload[WIRE_BATCH_HDR_LEN + (i * WIRE_SAMPLE_LEN)];
+        seq += wire_get_u32(p_rec);
+
+        // Sent again after a lost acknowledgement
+        if (seq <= p_node->last_seq)
+        {
+            num_duplicates++;
+            continue;
+        }
+
+        sqlite3_bind_int64(p_insert_stmt, 1, (sqlite3_int64)p_node->node_id);
+        sqlite3_bind_int(p_insert_stmt, 2, wire_get_u16(&p_rec[4]));
+        sqlite3_bind_double(p_insert_stmt, 3,
+                            (double)(int32_t)wire_get_u32(&p_rec[6]) / SAMPLE_SCALE);
+        sqlite3_bind_int64(p_insert_stmt, 4, (sqlite3_int64)wire_get_u32(&p_rec[10]));
+        sqlite3_bind_int64(p_insert_stmt, 5, (sqlite3_int64)seq);
+
+        db_ret_val = sqlite3_step(p_insert_stmt);
+        sqlite3_reset(p_insert_stmt);
+        if (SQLITE_DONE != db_ret_val)
+        {
+            printf("Failed to store sample of node %s. Err Msg - %s.\n", p_node->name,
+                                                                    sqlite3_errmsg(p_db));
+            return FAIL;
+        }
+
+        p_node->last_seq = seq;
+        rows_in_transaction++;
+        num_samples++;
+        report_samples++;
+    }
+
+    sqlite3_bind_int64(p_update_stmt, 1, (sqlite3_int64)p_node->node_id);
+    sqlite3_bind_int64(p_update_stmt, 2, (sqlite3_int64)p_node->last_seq);
+    db_ret_val = sqlite3_step(p_update_stmt);
+    sqlite3_reset(p_update_stmt);
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to update node %s. Err Msg - %s.\n", p_node->name, sqlite3_errmsg(p_db));
+        return FAIL;
+    }
+    p_node->is_ack_due = 1;
+
+    // Acknowledged with the batches of the other nodes of this round
+    if (rows_in_transaction >= COLLECTOR_COMMIT_ROWS)
+    {
+        collector_commit();
+    }
+    else if (!sched_is_pending(&commit_task))
+    {
+        sched_after(&commit_task, 0);
+    }
+
+    return SUCCESS;
+}
+
+static void commit_task_fn(sched_task_t * p_task)
+{
+    collector_commit();
+}
+
+static void collector_commit(void)
+{
+    uint8_t  is_ok;
+    uint16_t i;
+    int64_t  t0;
+
+    if (!is_in_transaction)
+    {
+        return;
+    }
+
+    t0 = lat_now_ns();
+    is_ok = store_exec("COMMIT;");
+    if (!is_ok)
+    {
+        store_exec("ROLLBACK;");
+    }
+    lat_add(&commit_lat, lat_now_ns() - t0);
+    is_in_transaction = 0;
+    rows_in_transaction = 0;
+    num_commits++;
+    sched_stop(&commit_task);
+
+    for (i = 0; i < COLLECTOR_MAX_NODES; i++)
+    {
+        if ((nodes[i].fd < 0) || !nodes[i].is_ack_due)
+        {
+            continue;
+        }
+        nodes[i].is_ack_due = 0;
+
+        if (!is_ok)
+        {
+            collector_drop(&nodes[i], "store failed");
+        }
+        else if (SUCCESS != collector_send_seq(&nodes[i], WIRE_ACK, nodes[i].last_seq))
+        {
+            collector_drop(&nodes[i], "too slow or gone");
+        }
+    }
+}
+
+static void report_task_fn(sched_task_t * p_task)
+{
+    int64_t  now_ns = lat_now_ns();
+    uint16_t i, num_connected = 0;
+
+    for (i = 0; i < COLLECTOR_MAX_NODES; i++)
+    {
+        num_connected += ((nodes[i].fd >= 0) && (nodes[i].node_id));
+    }
+
+    printf("%u node(s) connected, %0.1f samples/s, %llu sample(s) stored.\n", num_connected,
+           report_samples / ((now_ns - report_ns) / 1e9), (unsigned long long)num_samples);
+
+    report_samples = 0;
+    report_ns = now_ns;
+}
+
+/* SIGTERM or SIGINT, leave the scheduler loop and shut down cleanly
+*/
+static void signal_fn(sched_fd_t * p_watch)
+{
+    struct signalfd_siginfo info;
+
+    if (sizeof(info) == read(signal_fd, &info, sizeof(info)))
+    {
+        printf("Signal %u received, stopping.\n", info.ssi_signo);
+    }
+    is_stop = 1;
+}
+
+static uint8_t collector_send_seq(collector_node_t * p_node, wire_type_t type, int64_t seq)
+{
+    uint8_t frame[WIRE_HDR_LEN + WIRE_SEQ_LEN];
+
+    wire_put_hdr(frame, type, WIRE_SEQ_LEN);
+    wire_put_u64(&frame[WIRE_HDR_LEN], (uint64_t)seq);
+
+    // A gateway not reading its socket must not stall the others
+    return (sizeof(frame) == send(p_node->fd, frame, sizeof(frame), MSG_DONTWAIT | MSG_NOSIGNAL));
+}
+
+static void collector_drop(collector_node_t * p_node, const char * p_reason)
+{
+    if (p_node->fd < 0)
+    {
+        return;
+    }
+
+    if ((NULL != p_reason) && (p_node->node_id))
+    {
+        printf("Node %s disconnected (%s).\n", p_node->name, p_reason);
+    }
+
+    // Samples in the open transaction are committed, just not acknowledged,
+    // the node skips them when it resumes
+    sched_unwatch(&p_node->watch);
+    close(p_node->fd);
+    p_node->fd = -1;
+    p_node->node_id = 0;
+    p_node->is_ack_due = 0;
+}
+
+/******************************************************************************/
+
+static uint8_t store_open(const char * p_path)
+{
+    if (SQLITE_OK != sqlite3_open(p_path, &p_db))
+    {
+        printf("Database open failed: %s\n", sqlite3_errmsg(p_db));
+        sqlite3_close(p_db);
+        p_db = NULL;
+        return FAIL;
+    }
+    sqlite3_busy_timeout(p_db, DB_BUSY_TIMEOUT_MS);
+
+    // Only the last commit may be lost on power cut, its nodes send it again
+    if ((SUCCESS != store_exec("PRAGMA journal_mode=WAL;")) ||
+        (SUCCESS != store_exec("PRAGMA synchronous=NORMAL;")) ||
+        (SUCCESS != store_exec(SQL_CREATE_TABLES)))
+    {
+        store_close();
+        return FAIL;
+    }
+
+    if ((SQLITE_OK != sqlite3_prepare_v2(p_db, SQL_INSERT_DATA, -1, &p_insert_stmt, NULL)) ||
+        (SQLITE_OK != sqlite3_prepare_v2(p_db, SQL_UPDATE_NODE, -1, &p_update_stmt, NULL)) ||
+        (SQLITE_OK != sqlite3_prepare_v2(p_db, SQL_INSERT_SENSOR, -1, &p_sensor_stmt, NULL)))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db));
+        store_close();
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t store_exec(const char * p_sql)
+{
+    char *p_db_err_msg = NULL;
+
+    if (SQLITE_OK != sqlite3_exec(p_db, p_sql, NULL, NULL, &p_db_err_msg))
+    {
+        printf("SQLite3 query '%s' failed. Err Msg - %s.\n", p_sql, p_db_err_msg);
+        sqlite3_free(p_db_err_msg);
+
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t store_begin(void)
+{
+    if (is_in_transaction)
+    {
+        return SUCCESS;
+    }
+    if (SUCCESS != store_exec("BEGIN TRANSACTION;"))
+    {
+        return FAIL;
+    }
+    is_in_transaction = 1;
+
+    return SUCCESS;
+}
+
+static void store_close(void)
+{
+    if (is_in_transaction)
+    {
+        store_exec("ROLLBACK;");
+        is_in_transaction = 0;
+    }
+
+    sqlite3_finalize(p_insert_stmt);
+    sqlite3_finalize(p_update_stmt);
+    sqlite3_finalize(p_sensor_stmt);
+    p_insert_stmt = NULL;
+    p_update_stmt = NULL;
+    p_sensor_stmt = NULL;
+
+    sqlite3_close(p_db);
+    p_db = NULL;
+}
@@ -0,0 +1,24 @@
+/******************************************************************************/
+
+/* File - common.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Definitions shared by all modules of the control room monitor application.
+*/
+
+/******************************************************************************/
+
+#ifndef COMMON_H
+#define COMMON_H
+
+/* The predefine symbol below 'RUN_TIME_LOG' used to print runtime data such as
+*  DS18B20 ROM content, temperature value, sqlite data stored successfully
+*  etc. If you need to print those, then uncomment the below and build again.
+*/
+//#define RUN_TIME_LOG
+
+#define SUCCESS    (1)
+#define FAIL       (0)
+
+#endif /* COMMON_H */
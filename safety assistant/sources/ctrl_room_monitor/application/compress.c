@@ -0,0 +1,293 @@
+/******************************************************************************/
+
+/* File - compress.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Report-by-exception compression. See compress.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "config.h"
+#include "compress.h"
+
+/******************************************************************************/
+
+/* Defaults of the 'compress.*' keys: mode, deviation in sensor units and
+*  longest time between stored samples
+*/
+#define COMPRESS_MODE           "none"
+#define COMPRESS_DEV            (0.1)
+#define COMPRESS_HEARTBEAT_S    (900)
+
+/******************************************************************************/
+
+/* Function declaration to make a sample the last stored one
+*/
+static void compress_store(compress_t * p_comp, const sample_t * p_sample);
+
+/* Function declaration to open the door at the last stored sample
+*/
+static void compress_open_door(compress_t * p_comp, const sample_t * p_sample);
+
+/* Function declaration to narrow the door to the lines passing within 'dev'
+*  of a sample 'dt' seconds after the last stored one
+*/
+static void compress_narrow_door(compress_t * p_comp, const sample_t * p_sample, double dt);
+
+/******************************************************************************/
+
+void compress_init(compress_t * p_comp, compress_mode_t mode, double dev, uint32_t heartbeat_s)
+{
+    memset(p_comp, 0, sizeof(compress_t));
+    p_comp->mode = mode;
+    p_comp->dev = (int32_t)lround(dev * SAMPLE_SCALE);
+    p_comp->heartbeat_s = heartbeat_s;
+}
+
+void compress_config(compress_t * p_comp, uint16_t sen_id)
+{
+    compress_mode_t mode;
+    const char     *p_name;
+
+    p_name = config_get_str(config_get_str(COMPRESS_MODE, "compress.mode"),
+                                                    "compress.%u.mode", sen_id);
+    if (SUCCESS != compress_mode_from_name(p_name, &mode))
+    {
+        printf("Unknown compression '%s' of sensor ID=%u, samples stored as taken.\n",
+                                                                        p_name, sen_id);
+        mode = COMPRESS_NONE;
+    }
+
+    compress_init(p_comp, mode,
+                  config_get_double(config_get_double(COMPRESS_DEV, "compress.dev"),
+                                                        "compress.%u.dev", sen_id),
+                  (uint32_t)config_get_int(config_get_int(COMPRESS_HEARTBEAT_S,
+                                    "compress.heartbeat_s"), "compress.%u.heartbeat_s", sen_id));
+}
+
+uint8_t compress_push(compress_t * p_comp, const sample_t * p_sample, sample_t * p_out)
+{
+    double  dt;
+    double  slope;
+    uint8_t num_out = 0;
+
+    p_out[0] = *p_sample;
+    p_out[0].flags = 0;
+
+    if ((COMPRESS_NONE == p_comp->mode) || !p_comp->has_stored)
+    {
+        compress_store(p_comp, p_sample);
+        return 1;
+    }
+
+    if (COMPRESS_DEADBAND == p_comp->mode)
+    {
+        if ((abs(p_sample->sen_val - p_comp->stored_val) > p_comp->dev) ||
+            (p_comp->heartbeat_s && ((p_sample->sen_time - p_comp->stored_time) >= p_comp->heartbeat_s)))
+        {
+            compress_store(p_comp, p_sample);
+        }
+        else
+        {
+            p_out[0].flags = SAMPLE_NO_RAW;
+        }
+        return 1;
+    }
+
+    // Swinging door. A sample within the same second as the held one has no
+    // slope of its own, it narrows the door if the line to the held sample
+    // passes within 'dev' of it. Otherwise the held sample is stored and the
+    // door opens at this one.
+    if (p_comp->has_held && (p_sample->sen_time == p_comp->held.sen_time))
+    {
+        if (abs(p_sample->sen_val - p_comp->held.sen_val) <= p_comp->dev)
+        {
+            dt = (double)(p_sample->sen_time - p_comp->stored_time);
+            compress_narrow_door(p_comp, p_sample, dt);
+            p_out[0].flags = SAMPLE_NO_RAW;
+            return 1;
+        }
+
+        p_out[0] = p_comp->held;
+        p_out[0].flags = SAMPLE_NO_ROLLUP;
+        p_out[1] = *p_sample;
+        p_out[1].flags = 0;
+        compress_store(p_comp, p_sample);
+        return 2;
+    }
+
+    // Same for the second of the stored sample, readers get the value of the
+    // last row of a second. A sample before it (the clock stepped back)
+    // starts the series over.
+    if (p_sample->sen_time <= ((p_comp->has_held) ? (p_comp->held.sen_time) : (p_comp->stored_time)))
+    {
+        if (!p_comp->has_held && (p_sample->sen_time == p_comp->stored_time) &&
+            (abs(p_sample->sen_val - p_comp->stored_val) <= p_comp->dev))
+        {
+            p_out[0].flags = SAMPLE_NO_RAW;
+            return 1;
+        }
+
+        if (p_comp->has_held)
+        {
+            p_out[num_out] = p_comp->held;
+            p_out[num_out].flags = SAMPLE_NO_ROLLUP;
+            num_out++;
+        }
+        p_out[num_out] = *p_sample;
+        p_out[num_out].flags = 0;
+        compress_store(p_comp, p_sample);
+        return num_out + 1;
+    }
+    dt = (double)(p_sample->sen_time - p_comp->stored_time);
+
+    if (!p_comp->has_held)
+    {
+        compress_open_door(p_comp, p_sample);
+    }
+    else
+    {
+        // The door is the range of lines from the last stored sample passing
+        // within 'dev' of every sample since. It is closed once the line to
+        // this sample is out of it, the line to the sample before is stored.
+        slope = (p_sample->sen_val - p_comp->stored_val) / dt;
+        if ((slope > p_comp->slope_max) || (slope < p_comp->slope_min))
+        {
+            p_out[num_out] = p_comp->held;
+            p_out[num_out].flags = SAMPLE_NO_ROLLUP;
+            num_out++;
+            compress_store(p_comp, &p_comp->held);
+            compress_open_door(p_comp, p_sample);
+        }
+        else
+        {
+            compress_narrow_door(p_comp, p_sample, dt);
+        }
+    }
+    p_comp->held = *p_sample;
+    p_comp->has_held = 1;
+
+    p_out[num_out] = *p_sample;
+    p_out[num_out].flags = SAMPLE_NO_RAW;
+    if (p_comp->heartbeat_s && ((p_sample->sen_time - p_comp->stored_time) >= p_comp->heartbeat_s))
+    {
+        p_out[num_out].flags = 0;
+        compress_store(p_comp, p_sample);
+    }
+
+    return num_out + 1;
+}
+
+uint8_t compress_flush(compress_t * p_comp, sample_t * p_out)
+{
+    if (!p_comp->has_held)
+    {
+        return 0;
+    }
+
+    *p_out = p_comp->held;
+    p_out->flags = SAMPLE_NO_ROLLUP;
+    compress_store(p_comp, &p_comp->held);
+
+    return 1;
+}
+
+uint8_t compress_interpolate(compress_mode_t mode, const int64_t * p_time, const double * p_val,
+                             uint32_t num, int64_t t, double * p_result)
+{
+    uint32_t low = 0;
+    uint32_t high;
+    uint32_t mid;
+
+    // A deadband series holds its last value past the end as well
+    if ((0 == num) || (t < p_time[0]) || ((t > p_time[num - 1]) && (COMPRESS_DEADBAND != mode)))
+    {
+        return FAIL;
+    }
+
+    // Last stored sample at or before 't'
+    high = num - 1;
+    while (low < high)
+    {
+        mid = (low + high + 1) / 2;
+        if (p_time[mid] <= t)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    if ((COMPRESS_DEADBAND == mode) || (p_time[low] == t) || (low == (num - 1)))
+    {
+        *p_result = p_val[low];
+    }
+    else
+    {
+        *p_result = p_val[low] + (p_val[low + 1] - p_val[low]) *
+                    ((double)(t - p_time[low]) / (double)(p_time[low + 1] - p_time[low]));
+    }
+
+    return SUCCESS;
+}
+
+uint8_t compress_mode_from_name(const char * p_name, compress_mode_t * p_mode)
+{
+    static const char * const names[] = { "none", "deadband", "swinging" };
+    uint8_t i;
+
+    for (i = 0; i < (sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (0 == strcmp(p_name, names[i]))
+        {
+            *p_mode = (compress_mode_t)i;
+            return SUCCESS;
+        }
+    }
+
+    return FAIL;
+}
+
+/******************************************************************************/
+
+static void compress_store(compress_t * p_comp, const sample_t * p_sample)
+{
+    p_comp->stored_time = p_sample->sen_time;
+    p_comp->stored_val = p_sample->sen_val;
+    p_comp->has_stored = 1;
+    p_comp->has_held = 0;
+}
+
+static void compress_open_door(compress_t * p_comp, const sample_t * p_sample)
+{
+    double dt = (double)(p_sample->sen_time - p_comp->stored_time);
+
+    p_comp->slope_max = (p_sample->sen_val + p_comp->dev - p_comp->stored_val) / dt;
+    p_comp->slope_min = (p_sample->sen_val - p_comp->dev - p_comp->stored_val) / dt;
+}
+
+static void compress_narrow_door(compress_t * p_comp, const sample_t * p_sample, double dt)
+{
+    double slope;
+
+    slope = (p_sample->sen_val + p_comp->dev - p_comp->stored_val) / dt;
+    if (slope < p_comp->slope_max)
+    {
+        p_comp->slope_max = slope;
+    }
+    slope = (p_sample->sen_val - p_comp->dev - p_comp->stored_val) / dt;
+    if (slope > p_comp->slope_min)
+    {
+        p_comp->slope_min = slope;
+    }
+}
@@ -0,0 +1,125 @@
+/******************************************************************************/
+
+/* File - compress.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Report-by-exception compression of the raw samples ('sensor_data'). The
+*  control room is flat for hours, so most samples repeat the stored value.
+*  Per sensor ('compress.<sen_id>.*', defaults 'compress.*'):
+*
+*     none      - every sample is stored
+*     deadband  - a sample is stored once it is more than 'dev' off the last
+*                 stored one. Readers hold the last stored value.
+*     swinging  - swinging door: the line from the last stored sample to
+*                 the latest one is extended as long as it passes within
+*                 'dev' of every sample since, otherwise the sample before is
+*                 stored. Readers interpolate linearly.
+*
+*  In both modes a sample is stored at the latest 'heartbeat_s' after the
+*  last stored one, so a reader can tell a flat series from a stopped one.
+*  Reconstructed values are within 'dev' of every sample taken, see
+*  compress_interpolate(). Times are in seconds, a reader gets the last row
+*  of a second: samples of the same second more than 'dev' apart are all
+*  stored and only the last of them is guaranteed. After the clock stepped
+*  back the series starts over at the sample.
+*
+*  Every sample still counts in the rollups, i.e. min, max and mean of the
+*  rollup tables are exact. With 'swinging' the last sample of a sensor is
+*  held back until the next one decides whether it is stored.
+*/
+
+/******************************************************************************/
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+typedef enum
+{
+    COMPRESS_NONE = 0,
+    COMPRESS_DEADBAND,
+    COMPRESS_SWINGING
+} compress_mode_t;
+
+/* State of the compression of one sensor
+*/
+typedef struct
+{
+    compress_mode_t mode;
+    int32_t         dev;                        // 1 / SAMPLE_SCALE units
+    int64_t         heartbeat_s;
+    uint8_t         has_stored;
+    uint8_t         has_held;
+    int64_t         stored_time;                // Last stored sample
+    int32_t         stored_val;
+    sample_t        held;                       // Last sample, swinging door
+    double          slope_max;                  // Upper side of the door
+    double          slope_min;                  // Lower side of the door
+} compress_t;
+
+/******************************************************************************/
+
+/* Function declaration to set up the compression of a sensor
+*  @param[out] p_comp      - State
+*  @param[in]  mode        - Mode
+*  @param[in]  dev         - Allowed deviation in sensor units
+*  @param[in]  heartbeat_s - Longest time between stored samples, 0 = none
+*  @return - None
+*/
+void compress_init(compress_t * p_comp, compress_mode_t mode, double dev, uint32_t heartbeat_s);
+
+/* Function declaration to set up the compression of a sensor from the
+*  configuration ('compress.<sen_id>.mode', '.dev', '.heartbeat_s')
+*  @param[out] p_comp - State
+*  @param[in]  sen_id - Sensor ID
+*  @return - None
+*/
+void compress_config(compress_t * p_comp, uint16_t sen_id);
+
+/* Function declaration to pass the next sample of a sensor, in time order.
+*  Out come the samples for the database, oldest first: the sample itself
+*  (with SAMPLE_NO_RAW unless stored) and, for 'swinging', a former sample to
+*  be stored (with SAMPLE_NO_ROLLUP, it counted in the rollups already).
+*  @param[in]  p_comp   - State
+*  @param[in]  p_sample - Sample
+*  @param[out] p_out    - Samples for the database, room for 2
+*  @return - uint8_t (number of samples in 'p_out')
+*/
+uint8_t compress_push(compress_t * p_comp, const sample_t * p_sample, sample_t * p_out);
+
+/* Function declaration to get a sample held back, e.g. at shutdown
+*  @param[in]  p_comp - State
+*  @param[out] p_out  - Sample to store (SAMPLE_NO_ROLLUP)
+*  @return - uint8_t (1 if there was one, 0 otherwise)
+*/
+uint8_t compress_flush(compress_t * p_comp, sample_t * p_out);
+
+/* Function declaration to reconstruct a compressed series, reader side. The
+*  value at a time is held from the stored sample before it ('deadband') or
+*  interpolated between the stored samples around it ('swinging', 'none').
+*  @param[in]  mode     - Mode the series was stored with
+*  @param[in]  p_time   - Times of the stored samples, ascending
+*  @param[in]  p_val    - Values of the stored samples
+*  @param[in]  num      - Number of stored samples
+*  @param[in]  t        - Time to reconstruct the value at
+*  @param[out] p_result - Value
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if 't' is outside the stored span,
+*                      a 'deadband' series is held past its end as well )
+*/
+uint8_t compress_interpolate(compress_mode_t mode, const int64_t * p_time, const double * p_val,
+                             uint32_t num, int64_t t, double * p_result);
+
+/* Function declaration to get a mode by name
+*  @param[in]  p_name - "none", "deadband" or "swinging"
+*  @param[out] p_mode - Mode
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if unknown )
+*/
+uint8_t compress_mode_from_name(const char * p_name, compress_mode_t * p_mode);
+
+#endif /* COMPRESS_H */
@@ -0,0 +1,196 @@
+/******************************************************************************/
+
+/* File - config.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Minimal "key = value" configuration store. See config.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "common.h"
+#include "config.h"
+
+/******************************************************************************/
+
+typedef struct
+{
+    char key[CONFIG_MAX_KEY_LEN];
+    char val[CONFIG_MAX_VAL_LEN];
+} config_entry_t;
+
+static config_entry_t config_entries[CONFIG_MAX_ENTRIES];
+static uint16_t       config_num_entries = 0;
+
+/******************************************************************************/
+
+/* Function declaration to strip leading and trailing white spaces in place
+*  @param[in] p_str - String to be stripped
+*  @return - char * (pointer to first non white space character)
+*/
+static char * config_strip(char * p_str);
+
+/* Function declaration to look up the value of a key built from a format
+*  @return - const char * (value, NULL if not present)
+*/
+static const char * config_lookup(const char * p_key_fmt, va_list args);
+
+/******************************************************************************/
+
+uint8_t config_load(const char * p_path)
+{
+    FILE    *p_file;
+    char     line[CONFIG_MAX_KEY_LEN + CONFIG_MAX_VAL_LEN + 8];
+    char    *p_key, *p_val, *p_sep;
+    uint16_t line_num = 0;
+
+    p_file = fopen(p_path, "r");
+    if (NULL == p_file)
+    {
+        printf("Failed to open config file %s.\n", p_path);
+        return FAIL;
+    }
+
+    while (NULL != fgets(line, sizeof(line), p_file))
+    {
+        line_num++;
+
+        p_key = config_strip(line);
+        if (('\0' == *p_key) || ('#' == *p_key))
+        {
+            continue;
+        }
+
+        p_sep = strchr(p_key, '=');
+        if (NULL == p_sep)
+        {
+            printf("%s:%d: missing '='.\n", p_path, line_num);
+            continue;
+        }
+        *p_sep = '\0';
+        p_val = config_strip(p_sep + 1);
+        p_key = config_strip(p_key);
+
+        if (SUCCESS != config_set(p_key, p_val))
+        {
+            fclose(p_file);
+            return FAIL;
+        }
+    }
+
+    fclose(p_file);
+
+    return SUCCESS;
+}
+
+uint8_t config_set(const char * p_key, const char * p_val)
+{
+    uint16_t i;
+
+    if ((strlen(p_key) >= CONFIG_MAX_KEY_LEN) || (strlen(p_val) >= CONFIG_MAX_VAL_LEN))
+    {
+        printf("Config entry '%s' too long.\n", p_key);
+        return FAIL;
+    }
+
+    for (i = 0; i < config_num_entries; i++)
+    {
+        if (0 == strcmp(config_entries[i].key, p_key))
+        {
+            strcpy(config_entries[i].val, p_val);
+            return SUCCESS;
+        }
+    }
+
+    if (config_num_entries >= CONFIG_MAX_ENTRIES)
+    {
+        printf("Too many config entries.\n");
+        return FAIL;
+    }
+
+    strcpy(config_entries[config_num_entries].key, p_key);
+    strcpy(config_entries[config_num_entries].val, p_val);
+    config_num_entries++;
+
+    return SUCCESS;
+}
+
+const char * config_get_str(const char * p_def, const char * p_key_fmt, ...)
+{
+    const char *p_val;
+    va_list     args;
+
+    va_start(args, p_key_fmt);
+    p_val = config_lookup(p_key_fmt, args);
+    va_end(args);
+
+    return (NULL != p_val) ? (p_val) : (p_def);
+}
+
+long config_get_int(long def, const char * p_key_fmt, ...)
+{
+    const char *p_val;
+    va_list     args;
+
+    va_start(args, p_key_fmt);
+    p_val = config_lookup(p_key_fmt, args);
+    va_end(args);
+
+    return (NULL != p_val) ? (strtol(p_val, NULL, 0)) : (def);
+}
+
+double config_get_double(double def, const char * p_key_fmt, ...)
+{
+    const char *p_val;
+    va_list     args;
+
+    va_start(args, p_key_fmt);
+    p_val = config_lookup(p_key_fmt, args);
+    va_end(args);
+
+    return (NULL != p_val) ? (strtod(p_val, NULL)) : (def);
+}
+
+static char * config_strip(char * p_str)
+{
+    char *p_end;
+
+    while (isspace((unsigned char)*p_str))
+    {
+        p_str++;
+    }
+
+    p_end = p_str + strlen(p_str);
+    while ((p_end > p_str) && isspace((unsigned char)p_end[-1]))
+    {
+        p_end--;
+    }
+    *p_end = '\0';
+
+    return p_str;
+}
+
+static const char * config_lookup(const char * p_key_fmt, va_list args)
+{
+    char     key[CONFIG_MAX_KEY_LEN];
+    uint16_t i;
+
+    vsnprintf(key, sizeof(key), p_key_fmt, args);
+
+    for (i = 0; i < config_num_entries; i++)
+    {
+        if (0 == strcmp(config_entries[i].key, key))
+        {
+            return config_entries[i].val;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,45 @@
+/******************************************************************************/
+
+/* File - config.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Minimal "key = value" configuration store. Lines starting with '#' are
+*  comments. Several files can be loaded, a key loaded later overrides the
+*  same key loaded before.
+*/
+
+/******************************************************************************/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+/* Maximum number of entries and length of key/value strings
+*/
+#define CONFIG_MAX_ENTRIES      (256)
+#define CONFIG_MAX_KEY_LEN      (48)
+#define CONFIG_MAX_VAL_LEN      (80)
+
+/* Function declaration to load a configuration file into the store
+*  @param[in] p_path - Path of the configuration file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t config_load(const char * p_path);
+
+/* Function declaration to set (or override) a single entry
+*  @param[in] p_key - Key string
+*  @param[in] p_val - Value string
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t config_set(const char * p_key, const char * p_val);
+
+/* Function declarations to look up a value. The key is built printf-style
+*  from 'p_key_fmt', the default is returned if the key is not present.
+*/
+const char * config_get_str(const char * p_def, const char * p_key_fmt, ...);
+long         config_get_int(long def, const char * p_key_fmt, ...);
+double       config_get_double(double def, const char * p_key_fmt, ...);
+
+#endif /* CONFIG_H */
@@ -0,0 +1,81 @@
+/******************************************************************************/
+
+/* File - conv.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Fixed-point conversion of raw sensor readings. See conv.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdint.h>
+
+#include "common.h"
+#include "conv.h"
+
+/******************************************************************************/
+
+/* Function declaration to look up a fractional ADC count in a table
+*  @param[in] p_table - Table of CONV_ADC_LEVELS entries
+*  @param[in] adc     - ADC count, clamped to the table
+*  @return - int32_t (interpolated entry)
+*/
+static int32_t conv_lookup(const int16_t * p_table, float adc);
+
+/******************************************************************************/
+
+int32_t conv_ds18b20(int16_t raw)
+{
+    // 1/16 degree is 6.25 hundredths, i.e. 25 quarters of 0.01. Quarters are
+    // rounded half to even like rint() did on the float value.
+    int32_t quarters = (int32_t)raw * 25;
+    int32_t rem = quarters & 3;
+    int32_t centi = (quarters - rem) / 4;
+
+    if ((rem > 2) || ((2 == rem) && (centi & 1)))
+    {
+        centi++;
+    }
+
+    return centi;
+}
+
+int32_t conv_hsm(float adc)
+{
+    return conv_lookup(conv_hsm_table, adc);
+}
+
+int32_t conv_gp2y(float adc)
+{
+    return conv_lookup(conv_gp2y_table, adc);
+}
+
+/******************************************************************************/
+
+static int32_t conv_lookup(const int16_t * p_table, float adc)
+{
+    int32_t fixed, index, frac;
+
+    // The only floating point operation, the filters hand over a float
+    fixed = (int32_t)(adc * (1 << CONV_FRAC_BITS) + 0.5f);
+    if (fixed <= 0)
+    {
+        return p_table[0];
+    }
+
+    index = fixed >> CONV_FRAC_BITS;
+    if (index >= (CONV_ADC_LEVELS - 1))
+    {
+        return p_table[CONV_ADC_LEVELS - 1];
+    }
+
+    frac = fixed & ((1 << CONV_FRAC_BITS) - 1);
+    if (0 == frac)
+    {
+        return p_table[index];
+    }
+
+    return p_table[index] + (((p_table[index + 1] - p_table[index]) * frac +
+                            (1 << (CONV_FRAC_BITS - 1))) >> CONV_FRAC_BITS);
+}
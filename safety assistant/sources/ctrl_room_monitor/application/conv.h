@@ -0,0 +1,66 @@
+/******************************************************************************/
+
+/* File - conv.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Fixed-point conversion of raw sensor readings to sample values in
+*  1 / SAMPLE_SCALE units (0.01), the resolution values are stored with.
+*  The Quark X1000 has slow floating point, so no conversion uses it beyond
+*  taking the filtered ADC count:
+*
+*     DS18B20  - raw scratchpad value (1/16 degree) scaled in integers
+*     HSM-20G  - ADC count to %RH by table
+*     GP2Y1010 - ADC count to mg/m3 by table
+*
+*  The tables have an entry per ADC count, generated at build time by
+*  gen_conv.c from the former floating point formulas (see conv_ref.h).
+*  A fractional (filtered) count is interpolated linearly between entries
+*  in CONV_FRAC_BITS bits. Results equal the former formulas, rounded half
+*  to even to 0.01, for every raw value and integer ADC count, bench_conv
+*  checks this.
+*/
+
+/******************************************************************************/
+
+#ifndef CONV_H
+#define CONV_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+/* Entries of the ADC tables, 10-bit ADC
+*/
+#define CONV_ADC_LEVELS         (1024)
+
+/* Fraction bits of an interpolated ADC count
+*/
+#define CONV_FRAC_BITS          (8)
+
+/* Tables in 1 / SAMPLE_SCALE units, generated (conv_tables.c)
+*/
+extern const int16_t conv_hsm_table[CONV_ADC_LEVELS];
+extern const int16_t conv_gp2y_table[CONV_ADC_LEVELS];
+
+/******************************************************************************/
+
+/* Function declaration to convert a DS18B20 temperature register
+*  @param[in] raw - Temperature register, LSB first byte of the scratchpad
+*  @return - int32_t (temperature in 0.01 degree celsius)
+*/
+int32_t conv_ds18b20(int16_t raw);
+
+/* Function declaration to convert an HSM-20G output
+*  @param[in] adc - Filtered ADC count (0 - 1023)
+*  @return - int32_t (humidity in 0.01 %RH)
+*/
+int32_t conv_hsm(float adc);
+
+/* Function declaration to convert a GP2Y1010AU0F output
+*  @param[in] adc - Filtered ADC count (0 - 1023)
+*  @return - int32_t (dust density in 0.01 mg/m3)
+*/
+int32_t conv_gp2y(float adc);
+
+#endif /* CONV_H */
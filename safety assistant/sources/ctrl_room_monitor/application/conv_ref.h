@@ -0,0 +1,84 @@
+/******************************************************************************/
+
+/* File - conv_ref.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Former floating point conversions of the sensor readings, kept as the
+*  reference of the fixed-point ones (see conv.h). Used by gen_conv.c to
+*  build the tables and by bench_conv.c, not by the application.
+*  NOTE: Please check the below link for details of the equations
+*  https://github.com/nazmul21/IoT2020/tree/master/safety%20assistant/documents
+*/
+
+/******************************************************************************/
+
+#ifndef CONV_REF_H
+#define CONV_REF_H
+
+#include <stdint.h>
+#include <math.h>
+
+/******************************************************************************/
+
+/* DS18B20 temperature in degree celsius
+*/
+static inline float conv_ref_ds18b20(uint8_t lsb, uint8_t msb)
+{
+    int16_t temp_adc_val = ( (((int16_t)msb) << 8) | ((int16_t)lsb) );
+
+    if (msb & 0x80)
+    {
+        temp_adc_val = ( (int16_t)(~temp_adc_val) ) + 1;
+        temp_adc_val = -temp_adc_val;
+    }
+
+    return (((float)temp_adc_val) * 0.0625);
+}
+
+/* HSM-20G humidity in %RH from the ADC count
+*/
+static inline float conv_ref_hsm(float hum_adc_val)
+{
+    float humidity;
+
+    humidity = ((hum_adc_val / 1023.0) * 5.0);
+    humidity = ((1.253 * humidity * humidity) + (25.931 * humidity) - 7.542);
+
+    return humidity;
+}
+
+/* GP2Y1010AU0F dust density in mg/m3 from the ADC count
+*/
+static inline float conv_ref_gp2y(float adc_val)
+{
+    float acc_dust_concentration = ((adc_val / 1023.0) * 5.0);
+
+    if (acc_dust_concentration <= 0.6)
+    {
+        // GP2Y1010AU can produce a valid dust concentration value after 0.6
+        acc_dust_concentration = 0.0;
+    }
+    else if ((acc_dust_concentration > 0.6) && (acc_dust_concentration <= 3.5))
+    {
+        // This equation is only valid for sensor output voltage in a range of (0 ~ 3.5)
+        acc_dust_concentration = ( acc_dust_concentration - 0.6 ) / 5.8;
+    }
+    else
+    {
+        // The output voltage is almost constant after 3.5V, the dust
+        // concentration is cut off at '0.6'
+        acc_dust_concentration = 0.6;
+    }
+
+    return acc_dust_concentration;
+}
+
+/* Rounding of a value to 0.01 as db_store_sample() did it
+*/
+static inline int32_t conv_ref_centi(float value)
+{
+    return (int32_t)rint((double)value * 100.0);
+}
+
+#endif /* CONV_REF_H */
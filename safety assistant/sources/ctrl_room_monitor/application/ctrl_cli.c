@@ -0,0 +1,337 @@
+/******************************************************************************/
+
+/* File - ctrl_cli.c
+*
+*  Target Hardware: SIEMENS IoT2020 (or any Linux host with app_sim)
+*
+*  Command line client of the control socket (see ipc.h). Sends one request,
+*  prints the reply and exits with 0 on "OK", 1 otherwise. After a SUB
+*  request it keeps printing the pushed messages until interrupted.
+*  With '-n' the request is repeated and the mean round trip time printed.
+*  With '-p' a RANGE request (see query.h) is repeated with the cursor of
+*  every "NEXT" line until the range is complete, binary chunks are printed
+*  as CSV. A chunk answered with a busy database is requested again every
+*  CLI_BUSY_RETRY_MS, up to CLI_BUSY_RETRIES times.
+*
+*  Usage: ctrl_cli [-s socket_path] [-n repeat] [-p] <command> [arg ...]
+*     e.g. ctrl_cli GET 1
+*          ctrl_cli SUB val
+*          ctrl_cli -p RANGE 1 1792022400 1792627200 1000 bin
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "ipc.h"
+#include "sample.h"
+#include "query.h"
+
+/******************************************************************************/
+
+#define IPC_SOCKET_PATH         "/var/run/ctrl_room_monitor.sock"
+
+#define CLI_BUSY_RETRY_MS       (200)
+#define CLI_BUSY_RETRIES        (50)
+
+/******************************************************************************/
+
+static char    in_buf[4 * IPC_LINE_LEN];
+static size_t  in_len = 0;
+
+// Cursor of the last "NEXT" line, empty after "END"
+static char    next_cursor[QUERY_CURSOR_LEN];
+static uint8_t is_paging = 0;
+
+// The last reply was the busy error of a paged request
+static uint8_t is_busy = 0;
+
+/******************************************************************************/
+
+/* Function declaration to read the next line from the socket
+*  @param[in]  fd     - Socket
+*  @param[out] p_line - Line without newline
+*  @param[in]  size   - Size of the line buffer
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the connection is closed )
+*/
+static uint8_t cli_read_line(int fd, char * p_line, size_t size)
+{
+    char   *p_nl;
+    ssize_t len;
+    size_t  line_len;
+
+    while (NULL == (p_nl = memchr(in_buf, '\n', in_len)))
+    {
+        if (in_len >= sizeof(in_buf))
+        {
+            return FAIL;
+        }
+        len = read(fd, &in_buf[in_len], sizeof(in_buf) - in_len);
+        if (len <= 0)
+        {
+            return FAIL;
+        }
+        in_len += (size_t)len;
+    }
+
+    line_len = (size_t)(p_nl - in_buf);
+    if (line_len >= size)
+    {
+        line_len = size - 1;
+    }
+    memcpy(p_line, in_buf, line_len);
+    p_line[line_len] = '\0';
+
+    in_len -= (size_t)(p_nl - in_buf) + 1;
+    memmove(in_buf, p_nl + 1, in_len);
+
+    return SUCCESS;
+}
+
+/* Function declaration to read binary data following a line
+*  @param[in]  fd    - Socket
+*  @param[out] p_buf - Data
+*  @param[in]  len   - Number of bytes
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the connection is closed )
+*/
+static uint8_t cli_read_bytes(int fd, uint8_t * p_buf, size_t len)
+{
+    size_t  num;
+    ssize_t ret;
+
+    num = (len < in_len) ? (len) : (in_len);
+    memcpy(p_buf, in_buf, num);
+    in_len -= num;
+    memmove(in_buf, &in_buf[num], in_len);
+
+    while (num < len)
+    {
+        ret = read(fd, &p_buf[num], len - num);
+        if (ret <= 0)
+        {
+            return FAIL;
+        }
+        num += (size_t)ret;
+    }
+
+    return SUCCESS;
+}
+
+/* Function declaration to read the reply of a request up to its status line
+*  @param[in] fd       - Socket
+*  @param[in] is_quiet - Non-zero to print nothing but errors
+*  @return - uint8_t ( SUCCESS(1) on "OK", FAIL(0) otherwise )
+*/
+static uint8_t cli_read_reply(int fd, uint8_t is_quiet)
+{
+    char     line[IPC_LINE_LEN];
+    uint8_t  rec[QUERY_BIN_LEN];
+    uint32_t sen_time;
+    int32_t  sen_val;
+    long     num;
+
+    next_cursor[0] = '\0';
+    is_busy = 0;
+
+    while (SUCCESS == cli_read_line(fd, line, sizeof(line)))
+    {
+        if (0 == strcmp(line, "OK"))
+        {
+            return SUCCESS;
+        }
+        if (is_paging && (0 == strcmp(line, "ERR " QUERY_ERR_BUSY)))
+        {
+            is_busy = 1;
+            return FAIL;
+        }
+        if (0 == strncmp(line, "ERR", 3))
+        {
+            printf("%s\n", line);
+            return FAIL;
+        }
+
+        // Binary chunk of a RANGE request, printed as CSV
+        if (0 == strncmp(line, "BIN ", 4))
+        {
+            for (num = atol(&line[4]); num > 0; num--)
+            {
+                if (SUCCESS != cli_read_bytes(fd, rec, sizeof(rec)))
+                {
+                    break;
+                }
+                sen_time = (uint32_t)rec[0] | ((uint32_t)rec[1] << 8) |
+                           ((uint32_t)rec[2] << 16) | ((uint32_t)rec[3] << 24);
+                sen_val = (int32_t)((uint32_t)rec[4] | ((uint32_t)rec[5] << 8) |
+                                    ((uint32_t)rec[6] << 16) | ((uint32_t)rec[7] << 24));
+                if (!is_quiet)
+                {
+                    printf("%u,%0.2f\n", sen_time, (double)sen_val / SAMPLE_SCALE);
+                }
+            }
+            continue;
+        }
+
+        if (0 == strncmp(line, "NEXT ", 5))
+        {
+            snprintf(next_cursor, sizeof(next_cursor), "%.*s", QUERY_CURSOR_LEN - 1, &line[5]);
+        }
+        if (!is_quiet && (!is_paging || ((0 != strncmp(line, "NEXT ", 5)) && (0 != strcmp(line, "END")))))
+        {
+            printf("%s\n", line);
+        }
+    }
+
+    printf("Connection closed.\n");
+
+    return FAIL;
+}
+
+/* Function declaration to send a request and read its reply, a paged
+*  request is repeated while the database is busy
+*  @param[in] fd        - Socket
+*  @param[in] p_request - Request line with newline
+*  @param[in] is_quiet  - Non-zero to print nothing but errors
+*  @return - uint8_t ( SUCCESS(1) on "OK", FAIL(0) otherwise )
+*/
+static uint8_t cli_request(int fd, const char * p_request, uint8_t is_quiet)
+{
+    uint32_t attempt;
+
+    for (attempt = 0; ; attempt++)
+    {
+        if (write(fd, p_request, strlen(p_request)) != (ssize_t)strlen(p_request))
+        {
+            return FAIL;
+        }
+        if (SUCCESS == cli_read_reply(fd, is_quiet))
+        {
+            return SUCCESS;
+        }
+        if (!is_busy)
+        {
+            return FAIL;
+        }
+        if (attempt >= CLI_BUSY_RETRIES)
+        {
+            printf("ERR %s\n", QUERY_ERR_BUSY);
+            return FAIL;
+        }
+        usleep(CLI_BUSY_RETRY_MS * 1000);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char        *p_path = IPC_SOCKET_PATH;
+    long               repeat = 1;
+    long               i;
+    int                opt, fd;
+    char               request[IPC_LINE_LEN] = "";
+    char               paged[IPC_LINE_LEN];
+    char               line[IPC_LINE_LEN];
+    struct sockaddr_un addr;
+    struct timespec    start, end;
+
+    while (-1 != (opt = getopt(argc, argv, "s:n:p")))
+    {
+        switch (opt)
+        {
+            case 's':
+                p_path = optarg;
+            break;
+
+            case 'n':
+                repeat = atol(optarg);
+            break;
+
+            case 'p':
+                is_paging = 1;
+            break;
+
+            default:
+                optind = argc;
+            break;
+        }
+    }
+
+    if ((optind >= argc) || (repeat < 1))
+    {
+        printf("Usage: %s [-s socket_path] [-n repeat] [-p] <command> [arg ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++)
+    {
+        strncat(request, argv[i], sizeof(request) - strlen(request) - 2);
+        strcat(request, (i + 1 < argc) ? (" ") : ("\n"));
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, p_path, sizeof(addr.sun_path) - 1);
+
+    if ((fd < 0) || (0 != connect(fd, (struct sockaddr *)&addr, sizeof(addr))))
+    {
+        printf("Failed to connect to %s.\n", p_path);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < repeat; i++)
+    {
+        if (SUCCESS != cli_request(fd, request, (i + 1) < repeat))
+        {
+            close(fd);
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (repeat > 1)
+    {
+        printf("%ld requests, mean round trip %.1f us.\n", repeat,
+                    (((end.tv_sec - start.tv_sec) * 1e9) + (end.tv_nsec - start.tv_nsec)) /
+                                                                    (repeat * 1000.0));
+    }
+
+    // Rest of the range, the cursor goes behind points and format
+    while (is_paging && ('\0' != next_cursor[0]))
+    {
+        if ((argc - optind) < 6)
+        {
+            printf("Paging needs RANGE <sen_id> <from> <to> <points> <csv|bin>.\n");
+            close(fd);
+            return 1;
+        }
+        snprintf(paged, sizeof(paged), "%s %s %s %s %s %s %s\n", argv[optind], argv[optind + 1],
+                 argv[optind + 2], argv[optind + 3], argv[optind + 4], argv[optind + 5], next_cursor);
+        if (SUCCESS != cli_request(fd, paged, 0))
+        {
+            close(fd);
+            return 1;
+        }
+    }
+
+    // Subscribed, print the pushed messages
+    if (0 == strncasecmp(request, "SUB ", 4))
+    {
+        while (SUCCESS == cli_read_line(fd, line, sizeof(line)))
+        {
+            printf("%s\n", line);
+            fflush(stdout);
+        }
+    }
+
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,1075 @@
+/******************************************************************************/
+
+/* File - db.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Long-lived SQLite3 writer for sensor data. See db.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "db.h"
+
+/******************************************************************************/
+
+/* Query used to store a single sensor value, parameters bound per sample
+*/
+#define SQL_INSERT_SENSOR_DATA  "INSERT INTO sensor_data (sen_id, sen_val, time) VALUES (?1, ?2, ?3);"
+
+/* Tables added after the first release, created on open for databases made
+*  by an older create_tables.sql
+*/
+#define SQL_CREATE_SENSORS      "CREATE TABLE IF NOT EXISTS sensors (" \
+                                "sl       INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id   INTEGER   NOT NULL UNIQUE, " \
+                                "rom_code CHAR(16)  NOT NULL UNIQUE, " \
+                                "sen_type INTEGER   NOT NULL, " \
+                                "time     timestamp default (strftime('%s', 'now')));"
+
+#define SQL_CREATE_ALARM_RULES  "CREATE TABLE IF NOT EXISTS alarm_rules (" \
+                                "sl         INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id     INTEGER   NOT NULL, " \
+                                "kind       CHAR(8)   NOT NULL, " \
+                                "threshold  REAL      NOT NULL, " \
+                                "hysteresis REAL      NOT NULL DEFAULT 0, " \
+                                "debounce   INTEGER   NOT NULL DEFAULT 1, " \
+                                "window_s   INTEGER   NOT NULL DEFAULT 60, " \
+                                "enabled    INTEGER   NOT NULL DEFAULT 1, " \
+                                "name       CHAR(32));"
+#define SQL_CREATE_ALARMS       "CREATE TABLE IF NOT EXISTS alarms (" \
+                                "sl         INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "rule_id    INTEGER   NOT NULL, " \
+                                "sen_id     INTEGER   NOT NULL, " \
+                                "state      INTEGER   NOT NULL, " \
+                                "value      REAL      NOT NULL, " \
+                                "threshold  REAL      NOT NULL, " \
+                                "time       timestamp default (strftime('%s', 'now')));"
+
+#define SQL_CREATE_HEALTH       "CREATE TABLE IF NOT EXISTS sensor_health (" \
+                                "sl         INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id     INTEGER   NOT NULL, " \
+                                "time       INTEGER   NOT NULL, " \
+                                "count      INTEGER   NOT NULL, " \
+                                "mean       REAL      NOT NULL, " \
+                                "stddev     REAL      NOT NULL, " \
+                                "win_min    REAL      NOT NULL, " \
+                                "win_max    REAL      NOT NULL, " \
+                                "p50        REAL      NOT NULL, " \
+                                "p95        REAL      NOT NULL, " \
+                                "p99        REAL      NOT NULL, " \
+                                "baseline   REAL, " \
+                                "cusum_pos  REAL      NOT NULL, " \
+                                "cusum_neg  REAL      NOT NULL, " \
+                                "drift      INTEGER   NOT NULL);"
+
+/* Alarm rules and events
+*/
+#define SQL_SELECT_ALARM_RULES  "SELECT sl, sen_id, kind, threshold, hysteresis, debounce, " \
+                                "window_s FROM alarm_rules WHERE enabled != 0 ORDER BY sl;"
+#define SQL_INSERT_ALARM        "INSERT INTO alarms (rule_id, sen_id, state, value, " \
+                                "threshold, time) VALUES (?1, ?2, ?3, ?4, ?5, ?6);"
+
+/* Statistics snapshots of the sensors (see health.h)
+*/
+#define SQL_INSERT_HEALTH       "INSERT INTO sensor_health (sen_id, time, count, mean, stddev, " \
+                                "win_min, win_max, p50, p95, p99, baseline, cusum_pos, cusum_neg, " \
+                                "drift) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, " \
+                                "?12, ?13, ?14);"
+
+/* Load state transitions (see load.h), same rows as written by the dashboard
+*/
+#define SQL_INSERT_LOAD         "INSERT INTO loads (load_type, load_status, time) " \
+                                "VALUES (?1, ?2, ?3);"
+
+/* Rollup tables, '%s' is the table name. A sample is folded into its bucket
+*  with INSERT OR IGNORE + UPDATE instead of an UPSERT, which needs SQLite3
+*  3.24 or newer. Rows are appended in time order, so the oldest buckets
+*  always have the lowest 'sl' (see SQL_PRUNE).
+*/
+#define SQL_CREATE_ROLLUP       "CREATE TABLE IF NOT EXISTS %s (" \
+                                "sl        INTEGER   PRIMARY KEY AUTOINCREMENT, " \
+                                "sen_id    INTEGER   NOT NULL, " \
+                                "bucket    INTEGER   NOT NULL, " \
+                                "val_min   REAL      NOT NULL, " \
+                                "val_max   REAL      NOT NULL, " \
+                                "val_sum   REAL      NOT NULL, " \
+                                "val_count INTEGER   NOT NULL, " \
+                                "UNIQUE (sen_id, bucket));"
+#define SQL_INSERT_ROLLUP       "INSERT OR IGNORE INTO %s " \
+                                "(sen_id, bucket, val_min, val_max, val_sum, val_count) " \
+                                "VALUES (?1, ?2, ?3, ?3, 0, 0);"
+#define SQL_UPDATE_ROLLUP       "UPDATE %s SET val_min = MIN(val_min, ?3), " \
+                                "val_max = MAX(val_max, ?3), val_sum = val_sum + ?3, " \
+                                "val_count = val_count + 1 WHERE sen_id = ?1 AND bucket = ?2;"
+
+/* Rollup of the raw data already stored, run once when a rollup table is
+*  created, '%d' is the bucket width in seconds
+*/
+#define SQL_BACKFILL_ROLLUP     "INSERT INTO %s (sen_id, bucket, val_min, val_max, val_sum, " \
+                                "val_count) SELECT sen_id, time - (time %% %d), MIN(sen_val), " \
+                                "MAX(sen_val), SUM(sen_val), COUNT(*) FROM sensor_data " \
+                                "WHERE time IS NOT NULL GROUP BY 1, 2 ORDER BY 2, 1;"
+
+/* Retention, deletes all rows in front of the first one not older than the
+*  cut-off. Walks the table in 'sl' order from the start, i.e. costs the
+*  number of pruned rows instead of a full scan of the table.
+*  Arguments are table, table, time column, table.
+*/
+#define SQL_PRUNE               "DELETE FROM %s WHERE sl < IFNULL(" \
+                                "(SELECT sl FROM %s WHERE %s >= ?1 ORDER BY sl LIMIT 1), " \
+                                "(SELECT IFNULL(MAX(sl), 0) + 1 FROM %s));"
+
+/* Archive, moves the rows in front of the first one not older than the
+*  cut-off, at most ?2 rows a time (see archive.h). Same walk as SQL_PRUNE.
+*/
+#define SQL_ARCHIVE_END         "SELECT MIN(IFNULL(" \
+                                "(SELECT sl FROM sensor_data WHERE time >= ?1 ORDER BY sl LIMIT 1), " \
+                                "(SELECT IFNULL(MAX(sl), 0) + 1 FROM sensor_data)), " \
+                                "(SELECT IFNULL(MIN(sl), 0) FROM sensor_data) + ?2);"
+#define SQL_SELECT_ARCHIVE      "SELECT sl, sen_id, sen_val, IFNULL(time, 0) FROM sensor_data " \
+                                "WHERE sl < ?1 ORDER BY sen_id, time, sl;"
+#define SQL_DELETE_ARCHIVE      "DELETE FROM sensor_data WHERE sl < ?1;"
+
+/* Uplink, rows are streamed in 'sl' order, the 'sl' is the sequence number
+*  a collector resumes from (see uplink.h)
+*/
+#define SQL_SELECT_SINCE        "SELECT sl, sen_id, sen_val, IFNULL(time, 0) FROM sensor_data " \
+                                "WHERE sl > ?1 ORDER BY sl LIMIT ?2;"
+
+/* Time range of a sensor (see query.h), resumed after the row (?2, ?3) in
+*  (time, sl) order, the order of the index 'sensor_data_range'
+*/
+#define SQL_SELECT_RANGE        "SELECT sl, sen_id, sen_val, time FROM sensor_data " \
+                                "WHERE sen_id = ?1 AND time >= ?2 AND time < ?4 AND " \
+                                "(time > ?2 OR sl > ?3) ORDER BY time, sl LIMIT ?5;"
+#define SQL_SELECT_MAX_SL       "SELECT IFNULL(MAX(sl), 0) FROM sensor_data;"
+#define SQL_SELECT_SENSORS      "SELECT sen_id, rom_code, sen_type FROM sensors ORDER BY sen_id;"
+
+/* Queries used to map sensor keys to sensor IDs
+*/
+#define SQL_SELECT_SENSOR_ID    "SELECT sen_id FROM sensors WHERE rom_code = ?1;"
+#define SQL_INSERT_SENSOR       "INSERT INTO sensors (sen_id, rom_code, sen_type) " \
+                                "SELECT IFNULL(MAX(sen_id), 0) + 1, ?1, ?2 FROM sensors;"
+
+#define SQL_MAX_LEN             (512)
+
+/******************************************************************************/
+
+/* Rollup levels maintained while samples are stored
+*/
+typedef struct
+{
+    const char   *p_table;
+    int           width_s;
+    sqlite3_stmt *p_insert_stmt;
+    sqlite3_stmt *p_update_stmt;
+} db_rollup_t;
+
+static db_rollup_t   rollups[DB_NUM_ROLLUPS] =
+{
+    { "sensor_data_1m", 60,    NULL, NULL },
+    { "sensor_data_1h", 3600,  NULL, NULL },
+    { "sensor_data_1d", 86400, NULL, NULL }
+};
+
+static sqlite3      *p_db_handle = NULL;
+static sqlite3_stmt *p_insert_stmt = NULL;
+static uint8_t       is_in_transaction = 0;
+
+// Held for the whole cycle transaction, the functions called by another
+// thread wait for its end instead of joining it, or return DB_BUSY on a
+// thread not waiting (see db_set_nowait())
+static pthread_mutex_t db_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint8_t is_nowait = 0;
+
+/******************************************************************************/
+
+/* Function declaration to execute a statement without result rows
+*  @param[in] p_sql - SQL statement
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t db_exec(const char * p_sql);
+
+/* Function declaration to take 'db_lock', without waiting on a thread set
+*  by db_set_nowait()
+*  @return - uint8_t ( SUCCESS(1), DB_BUSY(2) if held by another thread )
+*/
+static uint8_t db_lock_take(void);
+
+/* Function declaration of db_map_sensor() without locking
+*/
+static uint8_t db_map_sensor_key(const char * p_key, uint8_t sen_type, uint16_t * p_sen_id);
+
+/* Function declaration to create the rollup tables and prepare their
+*  statements, a newly created table is filled from the raw data
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t db_open_rollups(void);
+
+/* Function declaration to delete rows older than a cut-off
+*  @param[in] p_table  - Table name
+*  @param[in] p_column - Time column of the table
+*  @param[in] cut_off  - Oldest time to keep
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t db_prune_table(const char * p_table, const char * p_column, time_t cut_off);
+
+/******************************************************************************/
+
+uint8_t db_open(const char * p_path, uint8_t use_wal)
+{
+    int db_ret_val;
+
+    db_ret_val = sqlite3_open(p_path, &p_db_handle);
+    if (SQLITE_OK == db_ret_val)
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("Database opened successfully.\n");
+        #endif
+    }
+    else
+    {
+        printf("Database open failed: %s\n", sqlite3_errmsg(p_db_handle));
+        sqlite3_close(p_db_handle);
+        p_db_handle = NULL;
+
+        return FAIL;
+    }
+
+    sqlite3_busy_timeout(p_db_handle, DB_BUSY_TIMEOUT_MS);
+
+    // In WAL mode a commit only appends to the log file, the database file
+    // itself is synced at checkpoint time. NORMAL synchronous level is safe
+    // (no corruption) with WAL, only the last commit may be lost on power cut.
+    if (use_wal)
+    {
+        if ((SUCCESS != db_exec("PRAGMA journal_mode=WAL;")) ||
+            (SUCCESS != db_exec("PRAGMA synchronous=NORMAL;")))
+        {
+            db_close();
+            return FAIL;
+        }
+    }
+
+    if ((SUCCESS != db_exec(SQL_CREATE_SENSORS)) || (SUCCESS != db_exec(SQL_CREATE_ALARM_RULES)) ||
+        (SUCCESS != db_exec(SQL_CREATE_ALARMS)) || (SUCCESS != db_exec(SQL_CREATE_HEALTH)) ||
+        (SUCCESS != db_open_rollups()) ||
+        (SUCCESS != db_exec(DB_SQL_CREATE_INDEXES)))
+    {
+        db_close();
+        return FAIL;
+    }
+
+    db_ret_val = sqlite3_prepare_v2(p_db_handle, SQL_INSERT_SENSOR_DATA, -1,
+                                                        &p_insert_stmt, NULL);
+    if (SQLITE_OK != db_ret_val)
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        db_close();
+
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_begin_cycle(void)
+{
+    if (is_in_transaction)
+    {
+        return SUCCESS;
+    }
+
+    pthread_mutex_lock(&db_lock);
+    if (SUCCESS != db_exec("BEGIN TRANSACTION;"))
+    {
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+    is_in_transaction = 1;
+
+    return SUCCESS;
+}
+
+uint8_t db_store_sample(uint16_t sen_id, int32_t sen_val, time_t sen_time)
+{
+    if ((SUCCESS != db_store_raw(sen_id, sen_val, sen_time)) ||
+        (SUCCESS != db_store_rollups(sen_id, sen_val, sen_time)))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_store_raw(uint16_t sen_id, int32_t sen_val, time_t sen_time)
+{
+    int db_ret_val;
+
+    // Same REAL as the former "%0.2f" query stored
+    double rounded_val = (double)sen_val / 100.0;
+
+    #if defined(RUN_TIME_LOG)
+        printf("SQLite3 Insert - sen_id=%d, sen_val=%0.2f\n", sen_id, rounded_val);
+    #endif
+
+    sqlite3_bind_int(p_insert_stmt, 1, sen_id);
+    sqlite3_bind_double(p_insert_stmt, 2, rounded_val);
+    sqlite3_bind_int64(p_insert_stmt, 3, (sqlite3_int64)sen_time);
+
+    db_ret_val = sqlite3_step(p_insert_stmt);
+    sqlite3_reset(p_insert_stmt);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Falied to store data. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_store_rollups(uint16_t sen_id, int32_t sen_val, time_t sen_time)
+{
+    double  rounded_val = (double)sen_val / 100.0;
+    int     db_ret_val = SQLITE_DONE;
+    uint8_t i;
+
+    // Fold the sample into the bucket of every rollup level, two index
+    // lookups per level within the same transaction
+    for (i = 0; (SQLITE_DONE == db_ret_val) && (i < DB_NUM_ROLLUPS); i++)
+    {
+        sqlite3_bind_int(rollups[i].p_insert_stmt, 1, sen_id);
+        sqlite3_bind_int64(rollups[i].p_insert_stmt, 2,
+                            (sqlite3_int64)(sen_time - (sen_time % rollups[i].width_s)));
+        sqlite3_bind_double(rollups[i].p_insert_stmt, 3, rounded_val);
+
+        db_ret_val = sqlite3_step(rollups[i].p_insert_stmt);
+        sqlite3_reset(rollups[i].p_insert_stmt);
+        if (SQLITE_DONE != db_ret_val)
+        {
+            break;
+        }
+
+        sqlite3_bind_int(rollups[i].p_update_stmt, 1, sen_id);
+        sqlite3_bind_int64(rollups[i].p_update_stmt, 2,
+                            (sqlite3_int64)(sen_time - (sen_time % rollups[i].width_s)));
+        sqlite3_bind_double(rollups[i].p_update_stmt, 3, rounded_val);
+
+        db_ret_val = sqlite3_step(rollups[i].p_update_stmt);
+        sqlite3_reset(rollups[i].p_update_stmt);
+    }
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Falied to store data. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_prune(time_t now, uint32_t raw_days, uint32_t minute_days)
+{
+    if (raw_days &&
+        (SUCCESS != db_prune_table("sensor_data", "time", now - ((time_t)raw_days * 86400))))
+    {
+        return FAIL;
+    }
+
+    if (minute_days &&
+        ((SUCCESS != db_prune_table(rollups[0].p_table, "bucket",
+                                                now - ((time_t)minute_days * 86400))) ||
+         (SUCCESS != db_prune_table("sensor_health", "time",
+                                                now - ((time_t)minute_days * 86400)))))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_delete_archived(int64_t end_sl)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_DELETE_ARCHIVE, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+    sqlite3_bind_int64(p_stmt, 1, (sqlite3_int64)end_sl);
+
+    db_ret_val = sqlite3_step(p_stmt);
+    sqlite3_finalize(p_stmt);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to delete archived rows. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_commit_cycle(void)
+{
+    if (!is_in_transaction)
+    {
+        return SUCCESS;
+    }
+
+    // A failed commit leaves the transaction open, to be rolled back
+    if (SUCCESS != db_exec("COMMIT;"))
+    {
+        return FAIL;
+    }
+    is_in_transaction = 0;
+    pthread_mutex_unlock(&db_lock);
+
+    #if defined(RUN_TIME_LOG)
+        printf("Data stored to SQLite.\n");
+    #endif
+
+    return SUCCESS;
+}
+
+void db_rollback_cycle(void)
+{
+    if (is_in_transaction)
+    {
+        db_exec("ROLLBACK;");
+        is_in_transaction = 0;
+        pthread_mutex_unlock(&db_lock);
+    }
+}
+
+uint8_t db_map_sensor(const char * p_key, uint8_t sen_type, uint16_t * p_sen_id)
+{
+    uint8_t ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+    ret_val = db_map_sensor_key(p_key, sen_type, p_sen_id);
+    pthread_mutex_unlock(&db_lock);
+
+    return ret_val;
+}
+
+uint8_t db_read_archive(time_t cut_off, uint32_t max_rows, db_sample_fn_t fn, void * p_arg,
+                                                                    int64_t * p_end_sl)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_ARCHIVE_END, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+    sqlite3_bind_int64(p_stmt, 1, (sqlite3_int64)cut_off);
+    sqlite3_bind_int64(p_stmt, 2, (sqlite3_int64)max_rows);
+
+    db_ret_val = sqlite3_step(p_stmt);
+    if (SQLITE_ROW == db_ret_val)
+    {
+        *p_end_sl = (int64_t)sqlite3_column_int64(p_stmt, 0);
+    }
+    sqlite3_finalize(p_stmt);
+
+    if ((SQLITE_ROW != db_ret_val) ||
+        (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_ARCHIVE, -1, &p_stmt, NULL)))
+    {
+        printf("Failed to find rows to archive. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+    sqlite3_bind_int64(p_stmt, 1, (sqlite3_int64)*p_end_sl);
+
+    while (SQLITE_ROW == (db_ret_val = sqlite3_step(p_stmt)))
+    {
+        fn((int64_t)sqlite3_column_int64(p_stmt, 0), (uint16_t)sqlite3_column_int(p_stmt, 1),
+           sqlite3_column_double(p_stmt, 2), (time_t)sqlite3_column_int64(p_stmt, 3), p_arg);
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to read rows to archive. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_load_alarm_rules(db_alarm_rule_t * p_rules, uint16_t max, uint16_t * p_num)
+{
+    sqlite3_stmt *p_stmt;
+    const char   *p_kind;
+    int           db_ret_val;
+
+    *p_num = 0;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_ALARM_RULES, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    while (SQLITE_ROW == (db_ret_val = sqlite3_step(p_stmt)))
+    {
+        if (*p_num >= max)
+        {
+            printf("Too many alarm rules, only %d used.\n", max);
+            db_ret_val = SQLITE_DONE;
+            break;
+        }
+
+        p_kind = (const char *)sqlite3_column_text(p_stmt, 2);
+
+        p_rules[*p_num].rule_id = (uint32_t)sqlite3_column_int(p_stmt, 0);
+        p_rules[*p_num].sen_id = (uint16_t)sqlite3_column_int(p_stmt, 1);
+        snprintf(p_rules[*p_num].kind, sizeof(p_rules[*p_num].kind), "%s",
+                                                    (NULL != p_kind) ? (p_kind) : (""));
+        p_rules[*p_num].threshold = sqlite3_column_double(p_stmt, 3);
+        p_rules[*p_num].hysteresis = sqlite3_column_double(p_stmt, 4);
+        p_rules[*p_num].debounce = (uint32_t)sqlite3_column_int(p_stmt, 5);
+        p_rules[*p_num].window_s = (uint32_t)sqlite3_column_int(p_stmt, 6);
+        (*p_num)++;
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to load alarm rules. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_store_alarm(uint32_t rule_id, uint16_t sen_id, uint8_t state, double value,
+                                                        double threshold, time_t alarm_time)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_INSERT_ALARM, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    sqlite3_bind_int(p_stmt, 1, (int)rule_id);
+    sqlite3_bind_int(p_stmt, 2, sen_id);
+    sqlite3_bind_int(p_stmt, 3, state);
+    sqlite3_bind_double(p_stmt, 4, value);
+    sqlite3_bind_double(p_stmt, 5, threshold);
+    sqlite3_bind_int64(p_stmt, 6, (sqlite3_int64)alarm_time);
+
+    db_ret_val = sqlite3_step(p_stmt);
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to store alarm. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_store_loads(const db_load_event_t * p_events, uint16_t num)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val = SQLITE_DONE;
+    uint16_t      i;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_INSERT_LOAD, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    if (SUCCESS != db_exec("BEGIN TRANSACTION;"))
+    {
+        sqlite3_finalize(p_stmt);
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    for (i = 0; (i < num) && (SQLITE_DONE == db_ret_val); i++)
+    {
+        sqlite3_bind_int(p_stmt, 1, p_events[i].load_type);
+        sqlite3_bind_text(p_stmt, 2, p_events[i].status, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(p_stmt, 3, (sqlite3_int64)p_events[i].load_time);
+
+        db_ret_val = sqlite3_step(p_stmt);
+        sqlite3_reset(p_stmt);
+    }
+    sqlite3_finalize(p_stmt);
+
+    if ((SQLITE_DONE != db_ret_val) || (SUCCESS != db_exec("COMMIT;")))
+    {
+        printf("Failed to store load states. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        db_exec("ROLLBACK;");
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    pthread_mutex_unlock(&db_lock);
+
+    return SUCCESS;
+}
+
+uint8_t db_store_health(const db_health_t * p_rows, uint16_t num)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val = SQLITE_DONE;
+    uint16_t      i;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_INSERT_HEALTH, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    if (SUCCESS != db_exec("BEGIN TRANSACTION;"))
+    {
+        sqlite3_finalize(p_stmt);
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    for (i = 0; (i < num) && (SQLITE_DONE == db_ret_val); i++)
+    {
+        sqlite3_bind_int(p_stmt, 1, p_rows[i].sen_id);
+        sqlite3_bind_int64(p_stmt, 2, (sqlite3_int64)p_rows[i].health_time);
+        sqlite3_bind_int64(p_stmt, 3, (sqlite3_int64)p_rows[i].count);
+        sqlite3_bind_double(p_stmt, 4, p_rows[i].mean);
+        sqlite3_bind_double(p_stmt, 5, p_rows[i].stddev);
+        sqlite3_bind_double(p_stmt, 6, p_rows[i].win_min);
+        sqlite3_bind_double(p_stmt, 7, p_rows[i].win_max);
+        sqlite3_bind_double(p_stmt, 8, p_rows[i].p50);
+        sqlite3_bind_double(p_stmt, 9, p_rows[i].p95);
+        sqlite3_bind_double(p_stmt, 10, p_rows[i].p99);
+        if (p_rows[i].has_baseline)
+        {
+            sqlite3_bind_double(p_stmt, 11, p_rows[i].baseline);
+        }
+        else
+        {
+            sqlite3_bind_null(p_stmt, 11);
+        }
+        sqlite3_bind_double(p_stmt, 12, p_rows[i].cusum_pos);
+        sqlite3_bind_double(p_stmt, 13, p_rows[i].cusum_neg);
+        sqlite3_bind_int(p_stmt, 14, p_rows[i].drift);
+
+        db_ret_val = sqlite3_step(p_stmt);
+        sqlite3_reset(p_stmt);
+    }
+    sqlite3_finalize(p_stmt);
+
+    if ((SQLITE_DONE != db_ret_val) || (SUCCESS != db_exec("COMMIT;")))
+    {
+        printf("Failed to store sensor health. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        db_exec("ROLLBACK;");
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    pthread_mutex_unlock(&db_lock);
+
+    return SUCCESS;
+}
+
+uint8_t db_read_since(int64_t after_sl, uint32_t max_rows, db_sample_fn_t fn, void * p_arg)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_SINCE, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+    sqlite3_bind_int64(p_stmt, 1, (sqlite3_int64)after_sl);
+    sqlite3_bind_int64(p_stmt, 2, (sqlite3_int64)max_rows);
+
+    while (SQLITE_ROW == (db_ret_val = sqlite3_step(p_stmt)))
+    {
+        fn((int64_t)sqlite3_column_int64(p_stmt, 0), (uint16_t)sqlite3_column_int(p_stmt, 1),
+           sqlite3_column_double(p_stmt, 2), (time_t)sqlite3_column_int64(p_stmt, 3), p_arg);
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to read sensor data. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_read_range(uint16_t sen_id, time_t after_time, int64_t after_sl, time_t to_time,
+                      uint32_t max_rows, db_sample_fn_t fn, void * p_arg)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_RANGE, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+    sqlite3_bind_int(p_stmt, 1, sen_id);
+    sqlite3_bind_int64(p_stmt, 2, (sqlite3_int64)after_time);
+    sqlite3_bind_int64(p_stmt, 3, (sqlite3_int64)after_sl);
+    sqlite3_bind_int64(p_stmt, 4, (sqlite3_int64)to_time);
+    sqlite3_bind_int64(p_stmt, 5, (sqlite3_int64)max_rows);
+
+    while (SQLITE_ROW == (db_ret_val = sqlite3_step(p_stmt)))
+    {
+        fn((int64_t)sqlite3_column_int64(p_stmt, 0), (uint16_t)sqlite3_column_int(p_stmt, 1),
+           sqlite3_column_double(p_stmt, 2), (time_t)sqlite3_column_int64(p_stmt, 3), p_arg);
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to read sensor data. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_read_max_sl(int64_t * p_sl)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_MAX_SL, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    db_ret_val = sqlite3_step(p_stmt);
+    if (SQLITE_ROW == db_ret_val)
+    {
+        *p_sl = (int64_t)sqlite3_column_int64(p_stmt, 0);
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_ROW != db_ret_val)
+    {
+        printf("Failed to read last sample. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t db_read_sensors(db_sensor_fn_t fn, void * p_arg)
+{
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    if (SUCCESS != db_lock_take())
+    {
+        return DB_BUSY;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_SENSORS, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        pthread_mutex_unlock(&db_lock);
+        return FAIL;
+    }
+
+    while (SQLITE_ROW == (db_ret_val = sqlite3_step(p_stmt)))
+    {
+        fn((uint16_t)sqlite3_column_int(p_stmt, 0), (const char *)sqlite3_column_text(p_stmt, 1),
+           (uint8_t)sqlite3_column_int(p_stmt, 2), p_arg);
+    }
+    sqlite3_finalize(p_stmt);
+
+    pthread_mutex_unlock(&db_lock);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to read sensors. Err Msg - %s.\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+void db_close(void)
+{
+    uint8_t i;
+
+    db_rollback_cycle();
+
+    for (i = 0; i < DB_NUM_ROLLUPS; i++)
+    {
+        sqlite3_finalize(rollups[i].p_insert_stmt);
+        sqlite3_finalize(rollups[i].p_update_stmt);
+        rollups[i].p_insert_stmt = NULL;
+        rollups[i].p_update_stmt = NULL;
+    }
+
+    // Finalizing a NULL statement pointer is a harmless no-op
+    sqlite3_finalize(p_insert_stmt);
+    p_insert_stmt = NULL;
+
+    sqlite3_close(p_db_handle);
+    p_db_handle = NULL;
+}
+
+void db_set_nowait(uint8_t set_nowait)
+{
+    is_nowait = set_nowait ? 1 : 0;
+}
+
+static uint8_t db_lock_take(void)
+{
+    if (!is_nowait)
+    {
+        pthread_mutex_lock(&db_lock);
+    }
+    else if (0 != pthread_mutex_trylock(&db_lock))
+    {
+        return DB_BUSY;
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t db_map_sensor_key(const char * p_key, uint8_t sen_type, uint16_t * p_sen_id)
+{
+    sqlite3_stmt *p_stmt;
+    uint8_t       attempt;
+    int           db_ret_val;
+
+    // First attempt looks the key up, second one runs after inserting it
+    for (attempt = 0; attempt < 2; attempt++)
+    {
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_SELECT_SENSOR_ID, -1,
+                                                                        &p_stmt, NULL))
+        {
+            printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+            return FAIL;
+        }
+        sqlite3_bind_text(p_stmt, 1, p_key, -1, SQLITE_STATIC);
+
+        db_ret_val = sqlite3_step(p_stmt);
+        if (SQLITE_ROW == db_ret_val)
+        {
+            *p_sen_id = (uint16_t)sqlite3_column_int(p_stmt, 0);
+        }
+        sqlite3_finalize(p_stmt);
+
+        if (SQLITE_ROW == db_ret_val)
+        {
+            return SUCCESS;
+        }
+        else if ((SQLITE_DONE != db_ret_val) || (0 != attempt))
+        {
+            break;
+        }
+
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, SQL_INSERT_SENSOR, -1,
+                                                                        &p_stmt, NULL))
+        {
+            break;
+        }
+        sqlite3_bind_text(p_stmt, 1, p_key, -1, SQLITE_STATIC);
+        sqlite3_bind_int(p_stmt, 2, sen_type);
+
+        db_ret_val = sqlite3_step(p_stmt);
+        sqlite3_finalize(p_stmt);
+        if (SQLITE_DONE != db_ret_val)
+        {
+            break;
+        }
+    }
+
+    printf("Failed to map sensor %s. Err Msg - %s.\n", p_key, sqlite3_errmsg(p_db_handle));
+
+    return FAIL;
+}
+
+static uint8_t db_exec(const char * p_sql)
+{
+    char *p_db_err_msg = NULL;
+
+    if (SQLITE_OK != sqlite3_exec(p_db_handle, p_sql, NULL, NULL, &p_db_err_msg))
+    {
+        printf("SQLite3 query '%s' failed. Err Msg - %s.\n", p_sql, p_db_err_msg);
+        sqlite3_free(p_db_err_msg);
+
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t db_open_rollups(void)
+{
+    char          sql[SQL_MAX_LEN];
+    sqlite3_stmt *p_stmt;
+    uint8_t       is_new;
+    uint8_t       i;
+
+    for (i = 0; i < DB_NUM_ROLLUPS; i++)
+    {
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle,
+                "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = ?1;",
+                                                                        -1, &p_stmt, NULL))
+        {
+            printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+            return FAIL;
+        }
+        sqlite3_bind_text(p_stmt, 1, rollups[i].p_table, -1, SQLITE_STATIC);
+        is_new = (SQLITE_ROW == sqlite3_step(p_stmt)) && (0 == sqlite3_column_int(p_stmt, 0));
+        sqlite3_finalize(p_stmt);
+
+        snprintf(sql, sizeof(sql), SQL_CREATE_ROLLUP, rollups[i].p_table);
+        if (SUCCESS != db_exec(sql))
+        {
+            return FAIL;
+        }
+
+        // Database of an older release, roll up the raw data once
+        if (is_new)
+        {
+            snprintf(sql, sizeof(sql), SQL_BACKFILL_ROLLUP, rollups[i].p_table,
+                                                                rollups[i].width_s);
+            if (SUCCESS != db_exec(sql))
+            {
+                return FAIL;
+            }
+        }
+
+        snprintf(sql, sizeof(sql), SQL_INSERT_ROLLUP, rollups[i].p_table);
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, sql, -1,
+                                                &rollups[i].p_insert_stmt, NULL))
+        {
+            printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+            return FAIL;
+        }
+
+        snprintf(sql, sizeof(sql), SQL_UPDATE_ROLLUP, rollups[i].p_table);
+        if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, sql, -1,
+                                                &rollups[i].p_update_stmt, NULL))
+        {
+            printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+            return FAIL;
+        }
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t db_prune_table(const char * p_table, const char * p_column, time_t cut_off)
+{
+    char          sql[SQL_MAX_LEN];
+    sqlite3_stmt *p_stmt;
+    int           db_ret_val;
+
+    snprintf(sql, sizeof(sql), SQL_PRUNE, p_table, p_table, p_column, p_table);
+    if (SQLITE_OK != sqlite3_prepare_v2(p_db_handle, sql, -1, &p_stmt, NULL))
+    {
+        printf("Failed to prepare statement: %s\n", sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+    sqlite3_bind_int64(p_stmt, 1, (sqlite3_int64)cut_off);
+
+    db_ret_val = sqlite3_step(p_stmt);
+    sqlite3_finalize(p_stmt);
+
+    if (SQLITE_DONE != db_ret_val)
+    {
+        printf("Failed to prune %s. Err Msg - %s.\n", p_table, sqlite3_errmsg(p_db_handle));
+        return FAIL;
+    }
+
+    #if defined(RUN_TIME_LOG)
+        printf("%d rows pruned from %s.\n", sqlite3_changes(p_db_handle), p_table);
+    #endif
+
+    return SUCCESS;
+}
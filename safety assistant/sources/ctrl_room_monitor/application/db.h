@@ -0,0 +1,301 @@
+/******************************************************************************/
+
+/* File - db.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Long-lived SQLite3 writer for sensor data. The database is opened once at
+*  start-up, the INSERT statement is prepared once and all samples of one
+*  acquisition cycle are committed as a single transaction, i.e. one journal
+*  sync per cycle instead of one per sample.
+*
+*  Every sample is also folded into min/max/sum/count rollup tables with 1
+*  minute, 1 hour and 1 day buckets (sensor_data_1m/_1h/_1d), so charts over
+*  long windows read a few hundred rows instead of the raw data. Bucket start
+*  'bucket' is in unix seconds (UTC), the average is val_sum / val_count.
+*  db_prune() drops raw rows (and 1 minute buckets) past their retention.
+*
+*  Statistics snapshots of the sensors (see health.h) go to 'sensor_health'.
+*/
+
+/******************************************************************************/
+
+#ifndef DB_H
+#define DB_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Number of rollup levels (1 minute, 1 hour, 1 day)
+*/
+#define DB_NUM_ROLLUPS          (3)
+
+/* A locked database (e.g. Node-RED writing) is retried for this long before
+*  a statement fails with SQLITE_BUSY
+*/
+#define DB_BUSY_TIMEOUT_MS      (100)
+
+/* Returned instead of FAIL while the cycle transaction of another thread
+*  holds the database and the calling thread does not wait for it (see
+*  db_set_nowait()). Nothing was done, the call may be repeated later.
+*/
+#define DB_BUSY                 (2)
+
+/* Covering indexes of the dashboard queries, created on open for databases
+*  made by an older create_tables.sql. Latest value per sensor and latest
+*  load status are then a single index seek, independent of the history:
+*     select sen_val from sensor_data where sen_id=N order by sl desc limit 1
+*     select load_status from loads where load_type=N order by sl desc limit 1
+*     select fl_name, u_role from users where u_name='...' and u_pass='...'
+*  The latest access_log row is found through the rowid ('sl') anyway.
+*  Time range reads of a sensor (see query.h) walk 'sensor_data_range' in
+*  (time, sl) order without touching the table.
+*/
+#define DB_SQL_CREATE_INDEXES   "CREATE INDEX IF NOT EXISTS sensor_data_latest " \
+                                "ON sensor_data (sen_id, sl DESC, sen_val); " \
+                                "CREATE INDEX IF NOT EXISTS sensor_data_range " \
+                                "ON sensor_data (sen_id, time, sen_val); " \
+                                "CREATE INDEX IF NOT EXISTS loads_latest " \
+                                "ON loads (load_type, sl DESC, load_status); " \
+                                "CREATE INDEX IF NOT EXISTS users_login ON users (u_name);"
+#define DB_SQL_DROP_INDEXES     "DROP INDEX IF EXISTS sensor_data_latest; " \
+                                "DROP INDEX IF EXISTS sensor_data_range; " \
+                                "DROP INDEX IF EXISTS loads_latest; " \
+                                "DROP INDEX IF EXISTS users_login;"
+
+/* An alarm rule as stored in the 'alarm_rules' table, see alarm.h
+*/
+typedef struct
+{
+    uint32_t rule_id;
+    uint16_t sen_id;
+    char     kind[8];
+    double   threshold;
+    double   hysteresis;
+    uint32_t debounce;
+    uint32_t window_s;
+} db_alarm_rule_t;
+
+/* State transition of a load for the 'loads' table
+*/
+typedef struct
+{
+    uint8_t  load_type;
+    char     status[4];                         // "ON", "OFF" or duty in percent
+    time_t   load_time;
+} db_load_event_t;
+
+/* Statistics snapshot of a sensor for the 'sensor_health' table, values in
+*  sensor units, CUSUM sums in baseline standard deviations
+*/
+typedef struct
+{
+    uint16_t sen_id;
+    time_t   health_time;
+    uint32_t count;                             // Samples since the previous snapshot
+    double   mean;
+    double   stddev;
+    double   win_min;                           // Over the sliding window
+    double   win_max;
+    double   p50;
+    double   p95;
+    double   p99;
+    double   baseline;
+    uint8_t  has_baseline;
+    double   cusum_pos;
+    double   cusum_neg;
+    int8_t   drift;                             // 1 up, -1 down, 0 none
+} db_health_t;
+
+/* Called for every row read by db_read_archive(), db_read_since() and
+*  db_read_range()
+*/
+typedef void (*db_sample_fn_t)(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg);
+
+/* Called for every sensor read by db_read_sensors()
+*/
+typedef void (*db_sensor_fn_t)(uint16_t sen_id, const char * p_key, uint8_t sen_type,
+                                                                            void * p_arg);
+
+/* Function declaration to open the database and prepare the sensor data INSERT
+*  statement. Must be called once before any other db_*() function.
+*  @param[in] p_path   - Path of the SQLite3 database file
+*  @param[in] use_wal  - Non-zero to switch the database to WAL journal mode
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_open(const char * p_path, uint8_t use_wal);
+
+/* Function declaration to open a transaction for the samples of one cycle.
+*  The cycle functions must all be called from the same thread.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_begin_cycle(void);
+
+/* Function declaration to store a sensor value within the open transaction
+*  and update its rollup buckets. Value has the 0.01 resolution the former
+*  "%0.2f" query stored.
+*  @param[in] sen_id   - Sensor ID as uint16_t
+*  @param[in] sen_val  - Sensor value in 0.01 units
+*  @param[in] sen_time - Acquisition time (unix seconds)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_store_sample(uint16_t sen_id, int32_t sen_val, time_t sen_time);
+
+/* Function declarations to store only the raw row ('sensor_data') or only
+*  the rollup buckets of a sample, same parameters as db_store_sample(). A
+*  sample left out of 'sensor_data' by the compression (see compress.h) still
+*  counts in the rollups.
+*/
+uint8_t db_store_raw(uint16_t sen_id, int32_t sen_val, time_t sen_time);
+uint8_t db_store_rollups(uint16_t sen_id, int32_t sen_val, time_t sen_time);
+
+/* Function declaration to delete data past its retention, within the open
+*  transaction. Hourly and daily rollups are kept forever.
+*  @param[in] now         - Current time (unix seconds)
+*  @param[in] raw_days    - Days of raw samples to keep, 0 keeps all
+*  @param[in] minute_days - Days of 1 minute rollups and health snapshots to
+*                           keep, 0 keeps all
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_prune(time_t now, uint32_t raw_days, uint32_t minute_days);
+
+/* Function declaration to delete the rows read by db_read_archive(), within
+*  the open transaction
+*  @param[in] end_sl - End returned by db_read_archive()
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_delete_archived(int64_t end_sl);
+
+/* Function declaration to commit the samples of the current cycle
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t db_commit_cycle(void);
+
+/* Function declaration to discard the samples of the current cycle
+*  @return - None
+*/
+void db_rollback_cycle(void);
+
+/* Function declaration to look up the 'sen_id' of a sensor by its key in the
+*  'sensors' table. An unknown key is inserted with the next free 'sen_id'.
+*  Must not be called by the thread holding a cycle transaction open, on any
+*  other thread it waits for the end of that transaction (see
+*  db_set_nowait()).
+*  @param[in]  p_key    - Sensor key (hex ROM code or analog sensor name)
+*  @param[in]  sen_type - Sensor type stored with a new key
+*  @param[out] p_sen_id - Sensor ID of the key
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_map_sensor(const char * p_key, uint8_t sen_type, uint16_t * p_sen_id);
+
+/* Function declaration to read the next rows to archive: the rows in front
+*  of the first one not older than the cut-off ('sl' order), at most
+*  'max_rows'. They are passed to 'fn' ordered by sensor and time. Must not
+*  be called within a cycle transaction.
+*  @param[in]  cut_off  - Rows from this time on stay (unix seconds)
+*  @param[in]  max_rows - Upper bound of rows read
+*  @param[in]  fn       - Called for every row
+*  @param[in]  p_arg    - User argument of 'fn'
+*  @param[out] p_end_sl - All rows read have a lower 'sl'
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_read_archive(time_t cut_off, uint32_t max_rows, db_sample_fn_t fn, void * p_arg,
+                                                                    int64_t * p_end_sl);
+
+/* Function declaration to read the enabled alarm rules. Must not be called by
+*  the thread holding a cycle transaction open.
+*  @param[out] p_rules - Rules in 'sl' order
+*  @param[in]  max     - Size of 'p_rules'
+*  @param[out] p_num   - Number of rules read
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_load_alarm_rules(db_alarm_rule_t * p_rules, uint16_t max, uint16_t * p_num);
+
+/* Function declaration to store an alarm event in the 'alarms' table, in a
+*  transaction of its own. Must not be called by the thread holding a cycle
+*  transaction open.
+*  @param[in] rule_id    - Rule raising or clearing the alarm
+*  @param[in] sen_id     - Sensor ID
+*  @param[in] state      - 1 raised, 0 cleared
+*  @param[in] value      - Value (or rate per minute) at the transition
+*  @param[in] threshold  - Threshold of the rule
+*  @param[in] alarm_time - Time of the transition (unix seconds)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_store_alarm(uint32_t rule_id, uint16_t sen_id, uint8_t state, double value,
+                                                        double threshold, time_t alarm_time);
+
+/* Function declaration to store load state transitions in the 'loads'
+*  table, all in one transaction. Must not be called by the thread holding a
+*  cycle transaction open.
+*  @param[in] p_events - Transitions, oldest first
+*  @param[in] num      - Number of transitions
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) or DB_BUSY(2) nothing is stored )
+*/
+uint8_t db_store_loads(const db_load_event_t * p_events, uint16_t num);
+
+/* Function declaration to store statistics snapshots in the 'sensor_health'
+*  table, all in one transaction. Must not be called by the thread holding a
+*  cycle transaction open.
+*  @param[in] p_rows - Snapshots
+*  @param[in] num    - Number of snapshots
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) or DB_BUSY(2) nothing is stored )
+*/
+uint8_t db_store_health(const db_health_t * p_rows, uint16_t num);
+
+/* Function declaration to read the rows stored after a given one, in 'sl'
+*  order. Must not be called by the thread holding a cycle transaction open.
+*  @param[in] after_sl - Rows with a higher 'sl' are read
+*  @param[in] max_rows - Upper bound of rows read
+*  @param[in] fn       - Called for every row
+*  @param[in] p_arg    - User argument of 'fn'
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_read_since(int64_t after_sl, uint32_t max_rows, db_sample_fn_t fn, void * p_arg);
+
+/* Function declaration to read the rows of a sensor within a time range, in
+*  (time, sl) order, starting after a given row. Must not be called by the
+*  thread holding a cycle transaction open.
+*  @param[in] sen_id     - Sensor ID
+*  @param[in] after_time - Rows from this time on are read (unix seconds) ...
+*  @param[in] after_sl   - ... of this time only those with a higher 'sl'
+*  @param[in] to_time    - Rows from this time on are not read
+*  @param[in] max_rows   - Upper bound of rows read
+*  @param[in] fn         - Called for every row
+*  @param[in] p_arg      - User argument of 'fn'
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_read_range(uint16_t sen_id, time_t after_time, int64_t after_sl, time_t to_time,
+                      uint32_t max_rows, db_sample_fn_t fn, void * p_arg);
+
+/* Function declaration to read the 'sl' of the last row stored. Must not be
+*  called by the thread holding a cycle transaction open.
+*  @param[out] p_sl - Last 'sl', 0 if there are no rows
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_read_max_sl(int64_t * p_sl);
+
+/* Function declaration to read the 'sensors' table in 'sen_id' order. Must
+*  not be called by the thread holding a cycle transaction open.
+*  @param[in] fn    - Called for every sensor
+*  @param[in] p_arg - User argument of 'fn'
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+uint8_t db_read_sensors(db_sensor_fn_t fn, void * p_arg);
+
+/* Function declaration to choose whether the calling thread waits for the
+*  cycle transaction of another thread, e.g. the evaluation thread must not
+*  stall behind a whole storage cycle. Applies to the functions returning
+*  DB_BUSY, the setting is per thread and off by default.
+*  @param[in] set_nowait - Non-zero to return DB_BUSY instead of waiting
+*  @return - None
+*/
+void db_set_nowait(uint8_t set_nowait);
+
+/* Function declaration to finalize the prepared statement and close database
+*  @return - None
+*/
+void db_close(void);
+
+#endif /* DB_H */
@@ -0,0 +1,321 @@
+/******************************************************************************/
+
+/* File - ds18b20.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Driver of DS18B20 temperature sensors on a 1-wire bus (over UART).
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <time.h>
+
+#include "common.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "conv.h"
+#include "stats.h"
+#include "trace.h"
+
+/******************************************************************************/
+
+/* Function declaration to read the scratchpad of a DS18B20, unchecked
+*  @param[in]  uart_path - UART instance returned by  hal_ow_init() function
+*  @param[in]  sen_addr  - 8-byte ROM address of DS18B20
+*  @param[out] p_pad     - DS18B20_SCRATCHPAD_LEN bytes of scratchpad, all
+*                          ones (an open bus) without presence pulse
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) without presence pulse )
+*/
+static uint8_t ds18b20_read_scratchpad(hal_ow_t * uart_path, 
+                        uint8_t sen_addr[DS18B20_ADDR_LEN], uint8_t * p_pad);
+
+/* Function declaration to check the CRC of a scratchpad
+*  @param[in] p_pad - DS18B20_SCRATCHPAD_LEN bytes of scratchpad
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on CRC error )
+*/
+static uint8_t ds18b20_check_scratchpad(const uint8_t * p_pad);
+
+/******************************************************************************/
+
+/* Definition of read temperature data from DS18B20. 
+*/
+uint8_t ds18b20_read_temp(hal_ow_t * uart_path, 
+                    uint8_t sen_addr[8], int32_t * p_temp, uint8_t * p_resolution) 
+{
+    assert(NULL != uart_path);
+  
+    uint8_t   ds18b20_scratchpad[DS18B20_SCRATCHPAD_LEN];
+    uint8_t   ret_val;
+     
+    #if defined(RUN_TIME_LOG)
+        printf("Device Family 0x%02x, ID %02x%02x%02x%02x%02x%02x CRC 0x%02x\n", 
+			sen_addr[0], sen_addr[6], sen_addr[5], sen_addr[4], sen_addr[3], 
+			sen_addr[2], sen_addr[1], sen_addr[7]);
+    #endif
+	
+    // Captured as read, a failed read as well (see trace.h)
+    ret_val = ds18b20_read_scratchpad(uart_path, sen_addr, ds18b20_scratchpad);
+    trace_ow(sen_addr, ds18b20_scratchpad);
+    if (SUCCESS != ret_val)
+    {
+        return FAIL;
+    }
+
+    return ds18b20_decode(ds18b20_scratchpad, p_temp, p_resolution);
+}
+
+uint8_t ds18b20_decode(const uint8_t * p_pad, int32_t * p_temp, uint8_t * p_resolution)
+{
+    uint8_t   resolution;
+    uint16_t  raw;
+
+    if (SUCCESS != ds18b20_check_scratchpad(p_pad))
+    {
+        return FAIL;
+    }
+
+    // Temperature register is a 16-bit two's complement value, LSB first.
+    // Below 12-bit the low bits are undefined and cleared here.
+    resolution = DS18B20_CFG_RESOLUTION(p_pad[DS18B20_PAD_CONFIG]);
+    raw = ((uint16_t)p_pad[1] << 8) | p_pad[0];
+    raw &= (uint16_t)(0xFFFF << (DS18B20_RES_MAX - resolution));
+
+    *p_temp = conv_ds18b20((int16_t)raw);
+    if (NULL != p_resolution)
+    {
+        *p_resolution = resolution;
+    }
+	
+    return SUCCESS;
+}
+
+uint8_t ds18b20_read_temp_retry(hal_ow_t * uart_path, uint8_t sen_addr[8], uint8_t retries,
+                        int32_t * p_temp, uint8_t * p_resolution, uint8_t * p_failed)
+{
+    assert(NULL != uart_path);
+
+    uint8_t attempt;
+
+    *p_failed = 0;
+
+    for (attempt = 0; ; attempt++)
+    {
+        // The scratchpad keeps the last conversion, so it is just read again
+        if (SUCCESS == ds18b20_read_temp(uart_path, sen_addr, p_temp, p_resolution))
+        {
+            return SUCCESS;
+        }
+        (*p_failed)++;
+
+        if (attempt >= retries)
+        {
+            return FAIL;
+        }
+
+        // A reset brings every device back to a known state, e.g. after a
+        // glitch in the middle of a read. Without presence pulse the bus is
+        // down and retries are pointless.
+        if (HAL_SUCCESS != hal_ow_reset(uart_path))
+        {
+            return FAIL;
+        }
+        stats_count(STATS_OW_RETRIES, 1);
+    }
+}
+
+uint8_t ds18b20_set_resolution(hal_ow_t * uart_path, uint8_t sen_addr[8],
+                                                uint8_t resolution, uint8_t is_persist)
+{
+    assert(NULL != uart_path);
+
+    uint8_t ds18b20_scratchpad[DS18B20_SCRATCHPAD_LEN];
+    uint8_t cfg;
+
+    if ((resolution < DS18B20_RES_MIN) || (resolution > DS18B20_RES_MAX))
+    {
+        printf("DS18B20 resolution of %u bit not supported.\n", resolution);
+        return FAIL;
+    }
+    cfg = DS18B20_CFG(resolution);
+
+    // Alarm registers TH and TL are written along, they keep their values
+    if ((SUCCESS != ds18b20_read_scratchpad(uart_path, sen_addr, ds18b20_scratchpad)) ||
+        (SUCCESS != ds18b20_check_scratchpad(ds18b20_scratchpad)))
+    {
+        return FAIL;
+    }
+    if (cfg == ds18b20_scratchpad[DS18B20_PAD_CONFIG])
+    {
+        return SUCCESS;
+    }
+
+    hal_ow_command(uart_path, CMD_WRITE_SCRATCHPAD, sen_addr);
+    hal_ow_write_byte(uart_path, ds18b20_scratchpad[DS18B20_PAD_TH]);
+    hal_ow_write_byte(uart_path, ds18b20_scratchpad[DS18B20_PAD_TL]);
+    hal_ow_write_byte(uart_path, cfg);
+
+    // Read back, a write disturbed on the bus is not copied to EEPROM
+    if ((SUCCESS != ds18b20_read_scratchpad(uart_path, sen_addr, ds18b20_scratchpad)) ||
+        (SUCCESS != ds18b20_check_scratchpad(ds18b20_scratchpad)) ||
+        (cfg != ds18b20_scratchpad[DS18B20_PAD_CONFIG]))
+    {
+        printf("DS18B20 resolution not written.\n");
+        return FAIL;
+    }
+
+    if (is_persist)
+    {
+        // EEPROM write takes up to 10 ms, a parasite powered device needs
+        // the bus kept high meanwhile
+        hal_ow_command(uart_path, CMD_COPY_SCRATCHPAD, sen_addr);
+        usleep(DS18B20_COPY_TIME_MS * 1000);
+    }
+
+    return SUCCESS;
+}
+
+uint32_t ds18b20_conv_time_ms(uint8_t resolution)
+{
+    uint8_t shift;
+
+    if ((resolution < DS18B20_RES_MIN) || (resolution > DS18B20_RES_MAX))
+    {
+        resolution = DS18B20_RES_MAX;
+    }
+    shift = DS18B20_RES_MAX - resolution;
+
+    // Halved per bit less, rounded up: 94, 188, 375 and 750 ms
+    return (DS18B20_CONV_TIME_MS + (1U << shift) - 1) >> shift;
+}
+
+void ds18b20_update(hal_ow_t * uart_path, uint8_t sen_addr[8]) 
+{
+    assert(NULL != uart_path);
+
+    int64_t t0 = stats_begin();
+	
+    // Issue a start conversion command to the specified device
+    hal_ow_command(uart_path, CMD_START_TEMP_CONV, sen_addr);
+    stats_end(STATS_OW_COMMAND, t0);
+}
+
+void ds18b20_update_all(hal_ow_t * uart_path)
+{
+    assert(NULL != uart_path);
+
+    int64_t t0 = stats_begin();
+
+    // A NULL address makes the command go out with Skip ROM, so every device
+    // on the bus starts its conversion at the same time
+    hal_ow_command(uart_path, CMD_START_TEMP_CONV, NULL);
+    stats_end(STATS_OW_COMMAND, t0);
+}
+
+uint8_t ds18b20_conv_done(hal_ow_t * uart_path)
+{
+    assert(NULL != uart_path);
+
+    // Generate a read time slot, the bus reads as 1 once every device
+    // addressed by the last Convert T has finished
+    return (1 == hal_ow_bit(uart_path, 1));
+}
+
+uint8_t ds18b20_wait_conv(hal_ow_t * uart_path, uint32_t timeout_ms)
+{
+    assert(NULL != uart_path);
+
+    struct timespec start, now;
+    uint32_t        elapsed_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for ( ; ; )
+    {
+        if (ds18b20_conv_done(uart_path))
+        {
+            #if defined(RUN_TIME_LOG)
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                printf("Conversion finished after %ld ms.\n",
+                        ((now.tv_sec - start.tv_sec) * 1000) +
+                        ((now.tv_nsec - start.tv_nsec) / 1000000));
+            #endif
+            return SUCCESS;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = ((now.tv_sec - start.tv_sec) * 1000) +
+                                        ((now.tv_nsec - start.tv_nsec) / 1000000);
+        if (elapsed_ms >= timeout_ms)
+        {
+            printf("Conversion not finished within %u ms.\n", timeout_ms);
+            return FAIL;
+        }
+
+        usleep(DS18B20_CONV_POLL_MS * 1000);
+    }
+}
+
+static uint8_t ds18b20_read_scratchpad(hal_ow_t * uart_path, 
+                        uint8_t sen_addr[DS18B20_ADDR_LEN], uint8_t * p_pad)
+{
+    int64_t      t0;
+    uint8_t      i;
+    hal_result_t hal_ret_val;
+
+    // Issue a scratchpad read command to the specified device
+    t0 = stats_begin();
+    hal_ret_val = hal_ow_command(uart_path, CMD_READ_SCRATCHPAD, sen_addr);
+    stats_end(STATS_OW_COMMAND, t0);
+    if (HAL_SUCCESS != hal_ret_val)
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("No presence pulse.\n");
+        #endif
+        memset(p_pad, 0xFF, DS18B20_SCRATCHPAD_LEN);
+        return FAIL;
+    }
+    
+    t0 = stats_begin();
+    for (i = 0; i < DS18B20_SCRATCHPAD_LEN; i++) 
+    {
+        p_pad[i] = (uint8_t)hal_ow_read_byte(uart_path);
+    }
+    stats_end(STATS_OW_SCRATCHPAD, t0);
+
+    return SUCCESS;
+}
+
+static uint8_t ds18b20_check_scratchpad(const uint8_t * p_pad)
+{
+    uint8_t i;
+    uint8_t num_zero = 0, num_ones = 0;
+
+    for (i = 0; i < DS18B20_SCRATCHPAD_LEN; i++)
+    {
+        num_zero += (0x00 == p_pad[i]);
+        num_ones += (0xFF == p_pad[i]);
+    }
+
+    // Calculate the CRC based on value read from scratchpad
+    //  Check if the calculated CRC match with the device internal's.
+    //  A bus held low reads all zeroes, which has a valid CRC as well, an
+    //  open bus reads all ones. Neither is a scratchpad (reserved bytes).
+    if ((hal_ow_crc8((uint8_t *)p_pad, DS18B20_SCRATCHPAD_LEN - 1) !=
+                                        p_pad[DS18B20_SCRATCHPAD_LEN - 1]) ||
+        (DS18B20_SCRATCHPAD_LEN == num_zero) || (DS18B20_SCRATCHPAD_LEN == num_ones))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("CRC Error.\n");
+        #endif
+        stats_count(STATS_CRC_ERRORS, 1);
+		
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
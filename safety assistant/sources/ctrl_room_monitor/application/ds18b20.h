@@ -0,0 +1,161 @@
+/******************************************************************************/
+
+/* File - ds18b20.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Driver of DS18B20 temperature sensors on a 1-wire bus (over UART).
+*/
+
+/******************************************************************************/
+
+#ifndef DS18B20_H
+#define DS18B20_H
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/******************************************************************************/
+
+/* Define DS18B20 search type in order to issue as new search (new iteration) 
+*  or continue with previous search (required for multiple sensors)
+*/
+#define NEW_SEARCH                  (1)
+#define CONTINUE_WITH_PREV_SEARCH   (0)
+
+/* Command to to issue read scratchpad and start temperature conversion 
+*  respectively from DS18B20
+*/
+#define CMD_READ_SCRATCHPAD         (0xBE)
+#define CMD_START_TEMP_CONV         (0x44)
+
+/* Commands to write TH, TL and the configuration register to the scratchpad
+*  and to copy them to the EEPROM of DS18B20, which takes up to
+*  DS18B20_COPY_TIME_MS. A device loads its EEPROM at power-up.
+*/
+#define CMD_WRITE_SCRATCHPAD        (0x4E)
+#define CMD_COPY_SCRATCHPAD         (0x48)
+#define DS18B20_COPY_TIME_MS        (10)
+
+/* Define the size of address ROM (8 bytes) of DS18B20 family
+*/
+#define DS18B20_ADDR_LEN            (HAL_OW_ROMCODE_SIZE)
+
+/* Scratchpad: temperature (2 bytes), TH, TL, configuration, 3 reserved bytes
+*  and the CRC of the first 8 bytes
+*/
+#define DS18B20_SCRATCHPAD_LEN      (9)
+#define DS18B20_PAD_TH              (2)
+#define DS18B20_PAD_TL              (3)
+#define DS18B20_PAD_CONFIG          (4)
+
+/* Resolution (9 to 12 bit, 0.5 to 0.0625 degree celsius) is bit 5 and 6 of
+*  the configuration register, the other bits read as 1
+*/
+#define DS18B20_RES_MIN             (9)
+#define DS18B20_RES_MAX             (12)
+#define DS18B20_CFG(res)            ((uint8_t)((((res) - DS18B20_RES_MIN) << 5) | 0x1F))
+#define DS18B20_CFG_RESOLUTION(cfg) ((uint8_t)((((cfg) >> 5) & 0x03) + DS18B20_RES_MIN))
+
+/* Maximum conversion time at 12-bit resolution and the upper bound we wait
+*  for it, i.e. a margin of DS18B20_CONV_MARGIN_MS at any resolution. While
+*  converting, a device answers read time slots with 0.
+*/
+#define DS18B20_CONV_TIME_MS        (750)
+#define DS18B20_CONV_MARGIN_MS      (250)
+#define DS18B20_CONV_TIMEOUT_MS     (DS18B20_CONV_TIME_MS + DS18B20_CONV_MARGIN_MS)
+#define DS18B20_CONV_POLL_MS        (10)
+
+/******************************************************************************/
+
+/* Function declaration to read temperature data from DS18B20, at the
+*  resolution of its configuration register.
+*  @param[in]  uart_path    - UART instance returned by  hal_ow_init() function
+*  @param[in]  sen_addr     - 8-byte ROM address of DS18B20
+*  @param[out] p_temp       - an int32_t pointer which contains temperature in 0.01 degree
+*                             celsius upon a valid read (see conv.h)
+*  @param[out] p_resolution - Resolution the temperature was converted at, in
+*                             bit (may be NULL). Differs from the one set last
+*                             once a device lost power and loaded its EEPROM.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t ds18b20_read_temp(hal_ow_t * uart_path, uint8_t 
+                    sen_addr[DS18B20_ADDR_LEN], int32_t * p_temp, uint8_t * p_resolution);
+
+/* Function declaration to check a scratchpad (CRC) and get its temperature,
+*  e.g. of a scratchpad captured into a trace (see trace.h)
+*  @param[in]  p_pad        - DS18B20_SCRATCHPAD_LEN bytes of scratchpad
+*  @param[out] p_temp       - Temperature in 0.01 degree celsius
+*  @param[out] p_resolution - Resolution the temperature was converted at (may be NULL)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on CRC error )
+*/
+uint8_t ds18b20_decode(const uint8_t * p_pad, int32_t * p_temp, uint8_t * p_resolution);
+
+/* Function declaration to read temperature data from DS18B20, a failed read
+*  (CRC error, no presence pulse) is retried after a bus reset
+*  @param[in]  uart_path    - UART instance returned by  hal_ow_init() function
+*  @param[in]  sen_addr     - 8-byte ROM address of DS18B20
+*  @param[in]  retries      - Maximum number of retries
+*  @param[out] p_temp       - Temperature in 0.01 degree celsius
+*  @param[out] p_resolution - Resolution the temperature was converted at (may be NULL)
+*  @param[out] p_failed     - Number of failed reads, on success as well
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) once all retries failed )
+*/
+uint8_t ds18b20_read_temp_retry(hal_ow_t * uart_path, uint8_t sen_addr[DS18B20_ADDR_LEN],
+                    uint8_t retries, int32_t * p_temp, uint8_t * p_resolution, uint8_t * p_failed);
+
+/* Function declaration to set the resolution of a DS18B20 (Write Scratchpad,
+*  checked by reading it back). Nothing is written if the device already
+*  converts at that resolution.
+*  @param[in] uart_path  - UART instance returned by  hal_ow_init() function
+*  @param[in] sen_addr   - 8-byte ROM address of DS18B20
+*  @param[in] resolution - DS18B20_RES_MIN to DS18B20_RES_MAX bit
+*  @param[in] is_persist - Non-zero to copy the scratchpad to EEPROM as well,
+*                          i.e. keep the resolution over a power cycle. The
+*                          EEPROM wears out, so not for frequent changes.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t ds18b20_set_resolution(hal_ow_t * uart_path, uint8_t sen_addr[DS18B20_ADDR_LEN],
+                                                uint8_t resolution, uint8_t is_persist);
+
+/* Function declaration to get the maximum conversion time at a resolution
+*  @param[in] resolution - DS18B20_RES_MIN to DS18B20_RES_MAX bit
+*  @return - uint32_t (94, 188, 375 or 750 ms)
+*/
+uint32_t ds18b20_conv_time_ms(uint8_t resolution);
+
+/* Function declaration to update i.e. start conversion in this case a specified DS18B20 
+*  with its address. 
+*  @param[in] uart_path - UART instance returned by  hal_ow_init() function
+*  @param[in] sen_addr  - 8-byte ROM address of DS18B20
+*  @return - None
+*/
+void ds18b20_update(hal_ow_t * uart_path, 
+                            uint8_t sen_addr[DS18B20_ADDR_LEN]);
+
+/* Function declaration to start conversion of all DS18B20 on the bus at once
+*  (Skip ROM followed by Convert T).
+*  @param[in] uart_path - UART instance returned by  hal_ow_init() function
+*  @return - None
+*/
+void ds18b20_update_all(hal_ow_t * uart_path);
+
+/* Function declaration to check (one read time slot) if the conversion
+*  started last is finished, for callers which must not block meanwhile.
+*  @param[in] uart_path - UART instance returned by  hal_ow_init() function
+*  @return - uint8_t (1 if finished, 0 otherwise)
+*/
+uint8_t ds18b20_conv_done(hal_ow_t * uart_path);
+
+/* Function declaration to wait until the conversion started last is finished.
+*  Read time slots are polled every DS18B20_CONV_POLL_MS instead of waiting
+*  the worst case conversion time. Requires externally powered sensors, in
+*  parasite power mode the bus is not released during conversion.
+*  @param[in] uart_path  - UART instance returned by  hal_ow_init() function
+*  @param[in] timeout_ms - Upper bound of the wait in milliseconds
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on timeout )
+*/
+uint8_t ds18b20_wait_conv(hal_ow_t * uart_path, uint32_t timeout_ms);
+
+#endif /* DS18B20_H */
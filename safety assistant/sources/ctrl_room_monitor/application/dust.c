@@ -0,0 +1,362 @@
+/******************************************************************************/
+
+/* File - dust.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Pulse engine of the GP2Y1010AU dust sensor. See dust.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "hal.h"
+#include "spsc.h"
+#include "dust.h"
+
+/******************************************************************************/
+
+#define NSEC_PER_USEC           (1000L)
+#define NSEC_PER_SEC            (1000000000L)
+
+/* Finished bursts waiting for the consumer
+*/
+#define DUST_RING_SIZE          (8)
+
+/******************************************************************************/
+
+static hal_gpio_t     *p_dust_gpio;
+static hal_aio_t      *p_dust_aio;
+static uint8_t         dust_num_samples;
+
+static pthread_t       dust_thread;
+static sem_t           dust_request;
+static atomic_int      dust_stop_flag;
+static spsc_ring_t     dust_ring;
+static uint8_t         is_started = 0;
+
+/******************************************************************************/
+
+/* Function declaration of the pulse thread
+*/
+static void * dust_thread_fn(void * p_arg);
+
+/* Function declaration to run one burst of pulses
+*  @param[out] p_result - Result of the burst
+*  @return - None
+*/
+static void dust_burst(dust_result_t * p_result);
+
+/* Function declarations of time helpers
+*/
+static void    ts_add_us(struct timespec * p_ts, uint32_t us);
+static int64_t ts_diff_ns(const struct timespec * p_a, const struct timespec * p_b);
+static void    sleep_until(const struct timespec * p_ts);
+
+/******************************************************************************/
+
+uint8_t dust_start(hal_gpio_t * p_gpio, hal_aio_t * p_aio, uint8_t num_samples,
+                                            int rt_priority, uint8_t lock_memory)
+{
+    pthread_attr_t     attr;
+    struct sched_param param;
+    int                ret_val;
+
+    if ((0 == num_samples) || (num_samples > DUST_MAX_SAMPLES))
+    {
+        printf("Invalid number of dust samples %d.\n", num_samples);
+        return FAIL;
+    }
+
+    p_dust_gpio = p_gpio;
+    p_dust_aio = p_aio;
+    dust_num_samples = num_samples;
+    atomic_init(&dust_stop_flag, 0);
+
+    if (SUCCESS != spsc_init(&dust_ring, sizeof(dust_result_t), DUST_RING_SIZE))
+    {
+        return FAIL;
+    }
+
+    if (0 != sem_init(&dust_request, 0, 0))
+    {
+        printf("sem_init() failed.\n");
+        spsc_free(&dust_ring);
+        return FAIL;
+    }
+
+    // Page faults in the middle of a pulse would spoil the timing
+    if (lock_memory && (0 != mlockall(MCL_CURRENT | MCL_FUTURE)))
+    {
+        printf("mlockall() failed (%s), memory not locked.\n", strerror(errno));
+    }
+
+    pthread_attr_init(&attr);
+    if (rt_priority > 0)
+    {
+        param.sched_priority = rt_priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    ret_val = pthread_create(&dust_thread, &attr, dust_thread_fn, NULL);
+    if ((0 != ret_val) && (rt_priority > 0))
+    {
+        // Typically EPERM without CAP_SYS_NICE, run with normal priority
+        printf("SCHED_FIFO priority %d not permitted (%s), using normal scheduling.\n",
+                                                        rt_priority, strerror(ret_val));
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        ret_val = pthread_create(&dust_thread, &attr, dust_thread_fn, NULL);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (0 != ret_val)
+    {
+        printf("pthread_create() failed (%s).\n", strerror(ret_val));
+        sem_destroy(&dust_request);
+        spsc_free(&dust_ring);
+        return FAIL;
+    }
+
+    is_started = 1;
+
+    return SUCCESS;
+}
+
+uint8_t dust_trigger(void)
+{
+    if (!is_started || (0 != sem_post(&dust_request)))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t dust_poll(dust_result_t * p_result)
+{
+    return spsc_pop(&dust_ring, p_result);
+}
+
+uint32_t dust_burst_ms(void)
+{
+    return ((dust_num_samples * DUST_PULSE_CYCLE_US) + 999) / 1000;
+}
+
+void dust_stop(void)
+{
+    if (!is_started)
+    {
+        return;
+    }
+
+    atomic_store(&dust_stop_flag, 1);
+    sem_post(&dust_request);
+    pthread_join(dust_thread, NULL);
+
+    sem_destroy(&dust_request);
+    spsc_free(&dust_ring);
+    is_started = 0;
+}
+
+void dust_jitter_reset(dust_jitter_t * p_jitter)
+{
+    memset(p_jitter, 0, sizeof(dust_jitter_t));
+}
+
+void dust_jitter_add(dust_jitter_t * p_jitter, const dust_result_t * p_result)
+{
+    uint8_t i;
+    int32_t offset_ns;
+    int32_t bucket;
+
+    for (i = 0; i < p_result->num_samples; i++)
+    {
+        offset_ns = p_result->offset_ns[i];
+
+        if ((0 == p_jitter->count) || (offset_ns < p_jitter->min_ns))
+        {
+            p_jitter->min_ns = offset_ns;
+        }
+        if ((0 == p_jitter->count) || (offset_ns > p_jitter->max_ns))
+        {
+            p_jitter->max_ns = offset_ns;
+        }
+        p_jitter->sum_ns += offset_ns;
+        p_jitter->count++;
+
+        bucket = offset_ns / NSEC_PER_USEC;
+        if (bucket < 0)
+        {
+            bucket = 0;
+        }
+        else if (bucket >= DUST_JITTER_BUCKETS)
+        {
+            bucket = DUST_JITTER_BUCKETS - 1;
+        }
+        p_jitter->hist[bucket]++;
+    }
+}
+
+int32_t dust_jitter_percentile(const dust_jitter_t * p_jitter, uint8_t percent)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+    int32_t  bucket;
+
+    if (0 == p_jitter->count)
+    {
+        return 0;
+    }
+
+    rank = (((uint64_t)p_jitter->count * percent) + 99) / 100;
+    for (bucket = 0; bucket < DUST_JITTER_BUCKETS; bucket++)
+    {
+        seen += p_jitter->hist[bucket];
+        if ((seen >= rank) && (seen > 0))
+        {
+            break;
+        }
+    }
+
+    return (bucket < DUST_JITTER_BUCKETS) ? (bucket * NSEC_PER_USEC) : (p_jitter->max_ns);
+}
+
+void dust_jitter_print(const dust_jitter_t * p_jitter)
+{
+    if (0 == p_jitter->count)
+    {
+        printf("Dust sample offset: no samples.\n");
+        return;
+    }
+
+    printf("Dust sample offset from %d us (%u samples): min %.1f us, mean %.1f us, "
+           "p99 %.0f us, max %.1f us.\n", DUST_SAMPLE_DELAY_US, p_jitter->count,
+                p_jitter->min_ns / 1000.0, (p_jitter->sum_ns / (double)p_jitter->count) / 1000.0,
+                dust_jitter_percentile(p_jitter, 99) / 1000.0, p_jitter->max_ns / 1000.0);
+}
+
+/******************************************************************************/
+
+static void * dust_thread_fn(void * p_arg)
+{
+    static dust_result_t result;
+
+    for ( ; ; )
+    {
+        while ((0 != sem_wait(&dust_request)) && (EINTR == errno))
+        {
+        }
+
+        if (atomic_load(&dust_stop_flag))
+        {
+            break;
+        }
+
+        dust_burst(&result);
+
+        if (SUCCESS != spsc_push(&dust_ring, &result))
+        {
+            // Consumer does not collect, the newest result is dropped
+            #if defined(RUN_TIME_LOG)
+                printf("Dust result ring full, burst dropped.\n");
+            #endif
+        }
+    }
+
+    return NULL;
+}
+
+static void dust_burst(dust_result_t * p_result)
+{
+    struct timespec t_cycle, t_led, t_target, t_now;
+    int             dust_adc_val;
+    uint8_t         i;
+
+    memset(p_result, 0, sizeof(dust_result_t));
+
+    // Pulses are placed on a fixed 10 msecs grid, the time a pulse takes
+    // does not shift the following ones
+    clock_gettime(CLOCK_MONOTONIC, &t_cycle);
+
+    for (i = 0; i < dust_num_samples; i++)
+    {
+        sleep_until(&t_cycle);
+
+        // Turn on IR LED, sample point is 0.28 msecs after the LED is
+        // really on
+        if (HAL_SUCCESS != hal_gpio_write(p_dust_gpio, 1))
+        {
+            printf("Falied to turn on IR LED.\n");
+            p_result->error = 1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t_led);
+
+        t_target = t_led;
+        ts_add_us(&t_target, DUST_SAMPLE_DELAY_US);
+        sleep_until(&t_target);
+
+        clock_gettime(CLOCK_MONOTONIC, &t_now);
+        dust_adc_val = hal_aio_read(p_dust_aio);
+        p_result->offset_ns[i] = (int32_t)ts_diff_ns(&t_now, &t_target);
+
+        // Turn off IR LED at the end of the pulse width of 0.32 msecs
+        t_target = t_led;
+        ts_add_us(&t_target, DUST_PULSE_WIDTH_US);
+        sleep_until(&t_target);
+
+        if (HAL_SUCCESS != hal_gpio_write(p_dust_gpio, 0))
+        {
+            printf("Falied to turn off IR LED.\n");
+            p_result->error = 1;
+            break;
+        }
+
+        if (dust_adc_val < 0)
+        {
+            printf("Failed to read dust sensor output.\n");
+            p_result->error = 1;
+            break;
+        }
+
+        p_result->adc[p_result->num_samples++] = (uint16_t)dust_adc_val;
+
+        ts_add_us(&t_cycle, DUST_PULSE_CYCLE_US);
+    }
+}
+
+static void ts_add_us(struct timespec * p_ts, uint32_t us)
+{
+    p_ts->tv_sec += us / 1000000;
+    p_ts->tv_nsec += (long)(us % 1000000) * NSEC_PER_USEC;
+    if (p_ts->tv_nsec >= NSEC_PER_SEC)
+    {
+        p_ts->tv_sec++;
+        p_ts->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+static int64_t ts_diff_ns(const struct timespec * p_a, const struct timespec * p_b)
+{
+    return ((int64_t)(p_a->tv_sec - p_b->tv_sec) * NSEC_PER_SEC) +
+                                                    (p_a->tv_nsec - p_b->tv_nsec);
+}
+
+static void sleep_until(const struct timespec * p_ts)
+{
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, p_ts, NULL))
+    {
+    }
+}
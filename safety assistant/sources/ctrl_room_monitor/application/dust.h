@@ -0,0 +1,124 @@
+/******************************************************************************/
+
+/* File - dust.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Pulse engine of the GP2Y1010AU dust sensor. The IR LED pulse train runs on
+*  a dedicated thread which sleeps on absolute CLOCK_MONOTONIC deadlines
+*  (clock_nanosleep(TIMER_ABSTIME)), optionally with SCHED_FIFO priority and
+*  locked memory. A burst is requested with dust_trigger() and returns
+*  immediately, the raw ADC counts of all pulses are handed back through a
+*  lock-free SPSC ring and collected with dust_poll(). Reducing them to one
+*  value is left to the consumer (see filter.h).
+*
+*  Timing of one pulse (datasheet):
+*     LED on ----- 280 us -----> ADC sample -- 40 us --> LED off
+*     |<-------------------------- 10 ms cycle ------------------------->|
+*
+*  Every result carries the offset of each ADC sample from the 280 us target,
+*  measured from the moment the LED was switched on, so the timing accuracy
+*  can be verified on the target under load (see dust_jitter_*()).
+*/
+
+/******************************************************************************/
+
+#ifndef DUST_H
+#define DUST_H
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/******************************************************************************/
+
+/* Pulse timing of the GP2Y1010AU in microseconds
+*/
+#define DUST_SAMPLE_DELAY_US        (280)
+#define DUST_PULSE_WIDTH_US         (320)
+#define DUST_PULSE_CYCLE_US         (10000)
+
+/* Maximum number of pulses per burst
+*/
+#define DUST_MAX_SAMPLES            (64)
+
+/* Jitter histogram resolution is 1 us, offsets of DUST_JITTER_BUCKETS - 1 us
+*  and more share the last bucket
+*/
+#define DUST_JITTER_BUCKETS         (1000)
+
+/* Result of one burst
+*/
+typedef struct
+{
+    uint16_t adc[DUST_MAX_SAMPLES];             // ADC count of each pulse
+    uint8_t  num_samples;
+    uint8_t  error;                             // Non-zero if a GPIO write failed
+    int32_t  offset_ns[DUST_MAX_SAMPLES];       // ADC sample offset from 280 us
+} dust_result_t;
+
+/* Accumulated sample point offsets, kept by the consumer
+*/
+typedef struct
+{
+    uint32_t count;
+    int32_t  min_ns;
+    int32_t  max_ns;
+    int64_t  sum_ns;
+    uint32_t hist[DUST_JITTER_BUCKETS];
+} dust_jitter_t;
+
+/******************************************************************************/
+
+/* Function declaration to start the pulse thread. If real-time priority or
+*  memory locking is not permitted, the thread runs without it.
+*  @param[in] p_gpio      - GPIO instance of the IR LED returned by hal_gpio_init()
+*  @param[in] p_aio       - AIO instance of the sensor output returned by hal_aio_init()
+*  @param[in] num_samples - Pulses per burst (1 ~ DUST_MAX_SAMPLES)
+*  @param[in] rt_priority - SCHED_FIFO priority (1 ~ 99), 0 for normal scheduling
+*  @param[in] lock_memory - Non-zero to lock all process memory (mlockall)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t dust_start(hal_gpio_t * p_gpio, hal_aio_t * p_aio, uint8_t num_samples,
+                                            int rt_priority, uint8_t lock_memory);
+
+/* Function declaration to request one burst, does not block
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t dust_trigger(void);
+
+/* Function declaration to collect the result of a finished burst
+*  @param[out] p_result - Result of the oldest finished burst
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if no burst finished yet )
+*/
+uint8_t dust_poll(dust_result_t * p_result);
+
+/* Function declaration to get the duration of a burst
+*  @return - uint32_t (milliseconds, rounded up)
+*/
+uint32_t dust_burst_ms(void);
+
+/* Function declaration to stop the pulse thread, waits for a running burst
+*  @return - None
+*/
+void dust_stop(void);
+
+/* Function declarations of the jitter statistics
+*/
+void    dust_jitter_reset(dust_jitter_t * p_jitter);
+void    dust_jitter_add(dust_jitter_t * p_jitter, const dust_result_t * p_result);
+
+/* Function declaration to get a percentile of the sample point offsets
+*  @param[in] p_jitter - Jitter statistics
+*  @param[in] percent  - Percentile (0 ~ 100)
+*  @return - int32_t (offset in nsecs, resolution 1 us, 0 if empty)
+*/
+int32_t dust_jitter_percentile(const dust_jitter_t * p_jitter, uint8_t percent);
+
+/* Function declaration to print min/mean/p99/max of the offsets
+*  @param[in] p_jitter - Jitter statistics
+*  @return - None
+*/
+void    dust_jitter_print(const dust_jitter_t * p_jitter);
+
+#endif /* DUST_H */
@@ -0,0 +1,116 @@
+/******************************************************************************/
+
+/* File - eval.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Evaluation thread. See eval.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "config.h"
+#include "worker.h"
+#include "ipc.h"
+#include "latest.h"
+#include "spool.h"
+#include "alarm.h"
+#include "load.h"
+#include "query.h"
+#include "health.h"
+#include "db.h"
+#include "eval.h"
+
+/******************************************************************************/
+
+/* Samples queued between the threads ('queue.samples')
+*/
+#define EVAL_QUEUE_SAMPLES          (1024)
+
+/******************************************************************************/
+
+static worker_t    eval_worker;
+static const char *p_eval_socket_path;
+
+/******************************************************************************/
+
+/* Function declarations of the worker callbacks
+*/
+static uint8_t eval_init_fn(worker_t * p_worker);
+static void    eval_item_fn(worker_t * p_worker, const void * p_item);
+static void    eval_fini_fn(worker_t * p_worker);
+
+/******************************************************************************/
+
+uint8_t eval_start(const char * p_socket_path)
+{
+    p_eval_socket_path = p_socket_path;
+
+    return worker_start(&eval_worker, "Evaluation", sizeof(sample_t),
+                        (uint32_t)config_get_int(EVAL_QUEUE_SAMPLES, "queue.samples"),
+                        eval_init_fn, eval_item_fn, eval_fini_fn, NULL);
+}
+
+uint8_t eval_submit(const sample_t * p_sample)
+{
+    return worker_submit(&eval_worker, p_sample);
+}
+
+void eval_stop(void)
+{
+    worker_stop(&eval_worker);
+}
+
+/******************************************************************************/
+
+static uint8_t eval_init_fn(worker_t * p_worker)
+{
+    // Dashboards read the latest values from here instead of the database.
+    // Sampling goes on without it.
+    if ((SUCCESS != ipc_open(p_eval_socket_path)) || (SUCCESS != latest_init()) ||
+        (SUCCESS != spool_register_cmd()) || (SUCCESS != load_register_cmd()) ||
+        (SUCCESS != query_register_cmd()))
+    {
+        printf("Control socket not available.\n");
+    }
+
+    // Without rules samples are not checked, everything else goes on
+    if (SUCCESS != alarm_init())
+    {
+        printf("Alarm rules not available.\n");
+    }
+
+    if (SUCCESS != health_init())
+    {
+        printf("Sensor health not available.\n");
+    }
+
+    // Rules are loaded above, from here on alarms, snapshots and range reads
+    // do not stall the samples behind a storage cycle
+    db_set_nowait(1);
+
+    return SUCCESS;
+}
+
+static void eval_item_fn(worker_t * p_worker, const void * p_item)
+{
+    const sample_t *p_sample = (const sample_t *)p_item;
+
+    latest_update(p_sample->sen_id, p_sample->sen_val, (time_t)p_sample->sen_time);
+    alarm_eval(p_sample);
+    load_eval(p_sample);
+    health_eval(p_sample);
+}
+
+static void eval_fini_fn(worker_t * p_worker)
+{
+    // The last alarms and snapshot are stored, waiting if need be
+    db_set_nowait(0);
+    alarm_close();
+    health_close();
+    ipc_close();
+}
@@ -0,0 +1,45 @@
+/******************************************************************************/
+
+/* File - eval.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Evaluation thread. Every sample submitted by the acquisition thread is
+*  evaluated here, off the acquisition path: the table of latest values is
+*  updated, the alarm rules and the rules of the loads are checked (see
+*  alarm.h, load.h) and subscribers are notified. The control socket (see ipc.h) is served by this thread as well,
+*  i.e. a slow client never delays a sensor read.
+*/
+
+/******************************************************************************/
+
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Function declaration to start the evaluation thread. If the control socket
+*  cannot be opened, the thread runs without it.
+*  @param[in] p_socket_path - Path of the control socket
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t eval_start(const char * p_socket_path);
+
+/* Function declaration to queue a sample, acquisition thread only. Does not
+*  block.
+*  @param[in] p_sample - Sample
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the queue is full )
+*/
+uint8_t eval_submit(const sample_t * p_sample);
+
+/* Function declaration to stop the evaluation thread after the queued
+*  samples, closes the control socket
+*  @return - None
+*/
+void eval_stop(void);
+
+#endif /* EVAL_H */
@@ -0,0 +1,284 @@
+/******************************************************************************/
+
+/* File - filter.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Robust filter stage of the analog channels. See filter.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "common.h"
+#include "config.h"
+#include "filter.h"
+
+/******************************************************************************/
+
+/* MAD of normally distributed noise times this factor is its standard
+*  deviation
+*/
+#define FILTER_MAD_SCALE        (1.4826f)
+
+/******************************************************************************/
+
+static const char *mode_names[] = { "none", "mean", "median", "trimmed" };
+
+/******************************************************************************/
+
+/* Function declarations of the helpers, buffers are sorted in place
+*/
+static void  sort_float(float * p_buf, uint8_t num);
+static void  sort_int32(int32_t * p_buf, uint8_t num);
+static float median_sorted(const float * p_buf, uint8_t num);
+static float reduce_sorted(filter_mode_t mode, uint8_t trim, const float * p_buf,
+                                                                        uint8_t num);
+static filter_mode_t mode_from_name(const char * p_name, filter_mode_t def);
+
+/******************************************************************************/
+
+uint8_t filter_init(filter_t * p_filter, const filter_cfg_t * p_cfg)
+{
+    if ((p_cfg->window > FILTER_MAX_WINDOW) || (p_cfg->mad_k < 0.0f) ||
+        (p_cfg->ema_alpha < 0.0f) || (p_cfg->ema_alpha > 1.0f))
+    {
+        printf("Invalid filter configuration.\n");
+        return FAIL;
+    }
+
+    memset(p_filter, 0, sizeof(filter_t));
+    p_filter->cfg = *p_cfg;
+
+    return SUCCESS;
+}
+
+uint8_t filter_init_from_config(filter_t * p_filter, const filter_cfg_t * p_def,
+                                                            const char * p_prefix)
+{
+    filter_cfg_t cfg;
+
+    cfg.burst_mode = mode_from_name(config_get_str(NULL, "%s.burst_mode", p_prefix),
+                                                                        p_def->burst_mode);
+    cfg.mode = mode_from_name(config_get_str(NULL, "%s.mode", p_prefix), p_def->mode);
+    cfg.trim = (uint8_t)config_get_int(p_def->trim, "%s.trim", p_prefix);
+    cfg.window = (uint8_t)config_get_int(p_def->window, "%s.window", p_prefix);
+    cfg.mad_k = (float)config_get_double(p_def->mad_k, "%s.mad_k", p_prefix);
+    cfg.mad_floor = (float)config_get_double(p_def->mad_floor, "%s.mad_floor", p_prefix);
+    cfg.ema_alpha = (float)config_get_double(p_def->ema_alpha, "%s.ema_alpha", p_prefix);
+
+    return filter_init(p_filter, &cfg);
+}
+
+float filter_reduce(const filter_t * p_filter, int32_t * p_buf, uint8_t num)
+{
+    float   sorted[FILTER_MAX_WINDOW];
+    int64_t sum = 0;
+    uint8_t i;
+
+    if ((FILTER_MODE_MEDIAN == p_filter->cfg.burst_mode) ||
+        (FILTER_MODE_TRIMMED == p_filter->cfg.burst_mode))
+    {
+        sort_int32(p_buf, num);
+        for (i = 0; i < num; i++)
+        {
+            sorted[i] = (float)p_buf[i];
+        }
+        return reduce_sorted(p_filter->cfg.burst_mode, p_filter->cfg.trim, sorted, num);
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        sum += p_buf[i];
+    }
+
+    return (float)sum / num;
+}
+
+float filter_update(filter_t * p_filter, float value, uint8_t * p_is_spike)
+{
+    const filter_cfg_t *p_cfg = &p_filter->cfg;
+    float               sorted[FILTER_MAX_WINDOW];
+    float               median, mad;
+    float               result = value;
+    uint8_t             is_spike = 0;
+    uint8_t             i;
+
+    if (p_cfg->window > 0)
+    {
+        // Spike test against the history before the value joins it. Needs
+        // half a window at least, a median of fewer values is not robust.
+        if ((p_cfg->mad_k > 0.0f) && (p_filter->count >= ((p_cfg->window + 1) / 2)))
+        {
+            memcpy(sorted, p_filter->hist, p_filter->count * sizeof(float));
+            sort_float(sorted, p_filter->count);
+            median = median_sorted(sorted, p_filter->count);
+
+            for (i = 0; i < p_filter->count; i++)
+            {
+                sorted[i] = fabsf(p_filter->hist[i] - median);
+            }
+            sort_float(sorted, p_filter->count);
+            mad = FILTER_MAD_SCALE * median_sorted(sorted, p_filter->count);
+            if (mad < p_cfg->mad_floor)
+            {
+                mad = p_cfg->mad_floor;
+            }
+
+            if (fabsf(value - median) > (p_cfg->mad_k * mad))
+            {
+                is_spike = 1;
+                p_filter->num_spikes++;
+                result = median;
+            }
+        }
+
+        // The raw value joins the history even if it is a spike, so a real
+        // step is followed once it fills half of the window
+        p_filter->hist[p_filter->pos] = value;
+        p_filter->pos = (p_filter->pos + 1) % p_cfg->window;
+        if (p_filter->count < p_cfg->window)
+        {
+            p_filter->count++;
+        }
+
+        if (!is_spike && (FILTER_MODE_NONE != p_cfg->mode))
+        {
+            memcpy(sorted, p_filter->hist, p_filter->count * sizeof(float));
+            sort_float(sorted, p_filter->count);
+            result = reduce_sorted(p_cfg->mode, p_cfg->trim, sorted, p_filter->count);
+        }
+    }
+
+    if (p_cfg->ema_alpha > 0.0f)
+    {
+        if (p_filter->is_ema_valid)
+        {
+            p_filter->ema += p_cfg->ema_alpha * (result - p_filter->ema);
+        }
+        else
+        {
+            p_filter->ema = result;
+            p_filter->is_ema_valid = 1;
+        }
+        result = p_filter->ema;
+    }
+
+    if (NULL != p_is_spike)
+    {
+        *p_is_spike = is_spike;
+    }
+
+    return result;
+}
+
+void filter_reset(filter_t * p_filter)
+{
+    p_filter->count = 0;
+    p_filter->pos = 0;
+    p_filter->is_ema_valid = 0;
+}
+
+/******************************************************************************/
+
+/* Insertion sort, the buffers hold FILTER_MAX_WINDOW values at most
+*/
+static void sort_float(float * p_buf, uint8_t num)
+{
+    uint8_t i, j;
+    float   value;
+
+    for (i = 1; i < num; i++)
+    {
+        value = p_buf[i];
+        for (j = i; (j > 0) && (p_buf[j - 1] > value); j--)
+        {
+            p_buf[j] = p_buf[j - 1];
+        }
+        p_buf[j] = value;
+    }
+}
+
+static void sort_int32(int32_t * p_buf, uint8_t num)
+{
+    uint8_t i, j;
+    int32_t value;
+
+    for (i = 1; i < num; i++)
+    {
+        value = p_buf[i];
+        for (j = i; (j > 0) && (p_buf[j - 1] > value); j--)
+        {
+            p_buf[j] = p_buf[j - 1];
+        }
+        p_buf[j] = value;
+    }
+}
+
+static float median_sorted(const float * p_buf, uint8_t num)
+{
+    return (num & 1) ? (p_buf[num / 2]) : ((p_buf[(num / 2) - 1] + p_buf[num / 2]) / 2.0f);
+}
+
+static float reduce_sorted(filter_mode_t mode, uint8_t trim, const float * p_buf,
+                                                                        uint8_t num)
+{
+    float   sum = 0.0f;
+    uint8_t i;
+
+    switch (mode)
+    {
+        case FILTER_MODE_MEDIAN:
+            return median_sorted(p_buf, num);
+
+        case FILTER_MODE_TRIMMED:
+            // Never trim away everything, the median remains at least
+            if ((2 * trim) >= num)
+            {
+                return median_sorted(p_buf, num);
+            }
+            for (i = trim; i < (num - trim); i++)
+            {
+                sum += p_buf[i];
+            }
+            return sum / (num - (2 * trim));
+
+        case FILTER_MODE_MEAN:
+            for (i = 0; i < num; i++)
+            {
+                sum += p_buf[i];
+            }
+            return sum / num;
+
+        default:
+            // Latest value is not known from a sorted buffer, callers
+            // handle FILTER_MODE_NONE themselves
+            return median_sorted(p_buf, num);
+    }
+}
+
+static filter_mode_t mode_from_name(const char * p_name, filter_mode_t def)
+{
+    uint8_t i;
+
+    if (NULL == p_name)
+    {
+        return def;
+    }
+
+    for (i = 0; i < (sizeof(mode_names) / sizeof(mode_names[0])); i++)
+    {
+        if (0 == strcasecmp(p_name, mode_names[i]))
+        {
+            return (filter_mode_t)i;
+        }
+    }
+
+    printf("Unknown filter mode %s, using %s.\n", p_name, mode_names[def]);
+
+    return def;
+}
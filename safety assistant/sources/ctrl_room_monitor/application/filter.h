@@ -0,0 +1,110 @@
+/******************************************************************************/
+
+/* File - filter.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Robust filter stage of the analog channels, applied to raw ADC counts
+*  before they are converted and stored. Two steps:
+*
+*  1. filter_reduce() - reduces a burst of readings (e.g. the 16 pulses of
+*     the dust sensor) to one value by mean, median or trimmed mean.
+*  2. filter_update() - streaming stage over the reduced values of a channel.
+*     A value deviating more than 'mad_k' scaled MADs (median absolute
+*     deviation) from the median of the last 'window' values is a spike and
+*     replaced by that median. The result is smoothed by 'mode' over the
+*     window and finally by an exponential moving average ('ema_alpha').
+*
+*  Every step can be switched off. State is a fixed size part of filter_t,
+*  nothing is allocated while filtering.
+*/
+
+/******************************************************************************/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+/* Maximum length of a burst and of the streaming window
+*/
+#define FILTER_MAX_WINDOW       (64)
+
+/* Reduction of a burst or the window to one value
+*/
+typedef enum
+{
+    FILTER_MODE_NONE = 0,           // Window: latest value, burst: mean
+    FILTER_MODE_MEAN,
+    FILTER_MODE_MEDIAN,
+    FILTER_MODE_TRIMMED             // Mean without 'trim' values on each side
+} filter_mode_t;
+
+typedef struct
+{
+    filter_mode_t burst_mode;       // Reduction of a burst
+    filter_mode_t mode;             // Smoothing over the window
+    uint8_t       trim;             // Values dropped on each side (TRIMMED)
+    uint8_t       window;           // Streaming window length, 0 = off
+    float         mad_k;            // Spike threshold in scaled MADs, 0 = off
+    float         mad_floor;        // Lower limit of the scaled MAD (counts)
+    float         ema_alpha;        // EMA weight of a new value, 0 = off
+} filter_cfg_t;
+
+typedef struct
+{
+    filter_cfg_t  cfg;
+    float         hist[FILTER_MAX_WINDOW];
+    uint8_t       count;
+    uint8_t       pos;
+    float         ema;
+    uint8_t       is_ema_valid;
+    uint32_t      num_spikes;
+} filter_t;
+
+/******************************************************************************/
+
+/* Function declaration to initialize a filter with its configuration
+*  @param[in] p_filter - Filter state
+*  @param[in] p_cfg    - Configuration
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on invalid configuration )
+*/
+uint8_t filter_init(filter_t * p_filter, const filter_cfg_t * p_cfg);
+
+/* Function declaration to initialize a filter from the configuration store,
+*  keys are "<prefix>.burst_mode", ".mode" (none, mean, median, trimmed),
+*  ".trim", ".window", ".mad_k", ".mad_floor" and ".ema_alpha"
+*  @param[in] p_filter - Filter state
+*  @param[in] p_def    - Defaults of keys not present
+*  @param[in] p_prefix - Key prefix, e.g. "filter.3"
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on invalid configuration )
+*/
+uint8_t filter_init_from_config(filter_t * p_filter, const filter_cfg_t * p_def,
+                                                            const char * p_prefix);
+
+/* Function declaration to reduce a burst of readings to one value. The
+*  buffer is sorted in place for median and trimmed mean.
+*  @param[in] p_filter - Filter (only 'burst_mode' and 'trim' are used)
+*  @param[in] p_buf    - Readings
+*  @param[in] num      - Number of readings (1 ~ FILTER_MAX_WINDOW)
+*  @return - float (reduced value)
+*/
+float filter_reduce(const filter_t * p_filter, int32_t * p_buf, uint8_t num);
+
+/* Function declaration to run a value through the streaming stage
+*  @param[in]  p_filter   - Filter state
+*  @param[in]  value      - New value
+*  @param[out] p_is_spike - Set to 1 if the value was rejected as spike, may be NULL
+*  @return - float (filtered value)
+*/
+float filter_update(filter_t * p_filter, float value, uint8_t * p_is_spike);
+
+/* Function declaration to forget the history, e.g. after a sensor fault
+*  @param[in] p_filter - Filter state
+*  @return - None
+*/
+void filter_reset(filter_t * p_filter);
+
+#endif /* FILTER_H */
@@ -0,0 +1,47 @@
+/******************************************************************************/
+
+/* File - gen_conv.c
+*
+*  Target Hardware: Build host
+*
+*  Generator of the ADC conversion tables (see conv.h), run by the Makefile.
+*  Every entry is the reference formula of conv_ref.h at that ADC count,
+*  rounded to 0.01.
+*
+*  Usage: gen_conv > conv_tables.c
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+
+#include "common.h"
+#include "conv.h"
+#include "conv_ref.h"
+
+/******************************************************************************/
+
+static void gen_table(const char * p_name, float (*fn)(float))
+{
+    int i;
+
+    printf("const int16_t %s[CONV_ADC_LEVELS] =\n{", p_name);
+    for (i = 0; i < CONV_ADC_LEVELS; i++)
+    {
+        printf("%s%6d%s", (0 == (i % 8)) ? ("\n   ") : (""), conv_ref_centi(fn((float)i)),
+                                            ((i + 1) < CONV_ADC_LEVELS) ? (",") : (""));
+    }
+    printf("\n};\n\n");
+}
+
+int main(int argc, char** argv)
+{
+    printf("/* Generated by gen_conv.c, do not edit. See conv.h. */\n\n");
+    printf("#include <stdint.h>\n\n#include \"conv.h\"\n\n");
+
+    // HSM-20G in 0.01 %RH, GP2Y1010AU0F in 0.01 mg/m3
+    gen_table("conv_hsm_table", conv_ref_hsm);
+    gen_table("conv_gp2y_table", conv_ref_gp2y);
+
+    return 0;
+}
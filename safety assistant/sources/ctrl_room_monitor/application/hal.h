@@ -0,0 +1,89 @@
+/******************************************************************************/
+
+/* File - hal.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Hardware abstraction layer used by the sensor drivers. Two backends
+*  implement this interface and one of them is selected at link time:
+*    - hal_mraa.c, Intel libmraa on the IoT2020 (default 'make')
+*    - hal_sim.c,  deterministic simulated sensors on any Linux host
+*                  ('make sim'), see sim.conf for its settings
+*/
+
+/******************************************************************************/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+/* Size of 1-wire ROM code, same as MRAA_UART_OW_ROMCODE_SIZE
+*/
+#define HAL_OW_ROMCODE_SIZE     (8)
+
+/* Return codes of the HAL functions
+*/
+typedef enum
+{
+    HAL_SUCCESS = 0,
+    HAL_ERROR_OW_NO_DEVICES,
+    HAL_ERROR_OW_DATA_ERROR,
+    HAL_ERROR
+} hal_result_t;
+
+/* Opaque instances, defined by each backend
+*/
+typedef struct hal_ow   hal_ow_t;
+typedef struct hal_gpio hal_gpio_t;
+typedef struct hal_aio  hal_aio_t;
+typedef struct hal_pwm  hal_pwm_t;
+
+/* Function declaration to initialize the backend, must be called once before
+*  any other hal_*() function.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t hal_init(void);
+
+/* 1-wire bus (over UART) functions, same semantic as mraa_uart_ow_*().
+*  'p_id' of hal_ow_command() may be NULL to address all devices (Skip ROM).
+*  hal_ow_bit() writes a bit and returns the bit read back, i.e. writing 1
+*  generates a read time slot.
+*  hal_ow_init() opens UART 'bus' of the board, or the serial device 'p_dev'
+*  (e.g. "/dev/ttyUSB0" of a USB-serial adapter) if it is neither NULL nor
+*  empty. Every bus is an instance of its own, different buses may be used
+*  by different threads at the same time.
+*/
+hal_ow_t *   hal_ow_init(int bus, const char * p_dev);
+void         hal_ow_stop(hal_ow_t * p_ow);
+hal_result_t hal_ow_reset(hal_ow_t * p_ow);
+hal_result_t hal_ow_rom_search(hal_ow_t * p_ow, uint8_t start, uint8_t * p_id);
+hal_result_t hal_ow_command(hal_ow_t * p_ow, uint8_t command, uint8_t * p_id);
+int          hal_ow_read_byte(hal_ow_t * p_ow);
+int          hal_ow_write_byte(hal_ow_t * p_ow, uint8_t byte);
+int          hal_ow_bit(hal_ow_t * p_ow, uint8_t bit);
+uint8_t      hal_ow_crc8(uint8_t * p_buf, uint16_t length);
+
+/* Digital output functions
+*/
+hal_gpio_t * hal_gpio_init(int pin);
+hal_result_t hal_gpio_dir_out(hal_gpio_t * p_gpio);
+hal_result_t hal_gpio_write(hal_gpio_t * p_gpio, int value);
+void         hal_gpio_close(hal_gpio_t * p_gpio);
+
+/* PWM output functions, same semantic as mraa_pwm_*(). The duty cycle of
+*  hal_pwm_write() is 0.0 ~ 1.0, the output is driven once enabled.
+*/
+hal_pwm_t *  hal_pwm_init(int pin);
+hal_result_t hal_pwm_period_us(hal_pwm_t * p_pwm, int period_us);
+hal_result_t hal_pwm_write(hal_pwm_t * p_pwm, float duty);
+hal_result_t hal_pwm_enable(hal_pwm_t * p_pwm, int enable);
+void         hal_pwm_close(hal_pwm_t * p_pwm);
+
+/* Analog input functions, hal_aio_read() returns 10-bit ADC count or -1
+*/
+hal_aio_t *  hal_aio_init(unsigned int pin);
+int          hal_aio_read(hal_aio_t * p_aio);
+void         hal_aio_close(hal_aio_t * p_aio);
+
+#endif /* HAL_H */
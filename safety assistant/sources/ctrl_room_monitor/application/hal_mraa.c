@@ -0,0 +1,240 @@
+/******************************************************************************/
+
+/* File - hal_mraa.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  HAL backend on top of Intel libmraa. Every function is a thin wrapper of
+*  the corresponding mraa call.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mraa.h"
+#include "common.h"
+#include "hal.h"
+
+/******************************************************************************/
+
+struct hal_ow
+{
+    mraa_uart_ow_context ctx;
+};
+
+struct hal_gpio
+{
+    mraa_gpio_context ctx;
+};
+
+struct hal_aio
+{
+    mraa_aio_context ctx;
+};
+
+struct hal_pwm
+{
+    mraa_pwm_context ctx;
+};
+
+/******************************************************************************/
+
+/* Function declaration to map mraa return codes to HAL return codes
+*  @param[in] mraa_ret_val - mraa return code
+*  @return - hal_result_t
+*/
+static hal_result_t hal_from_mraa(mraa_result_t mraa_ret_val);
+
+/******************************************************************************/
+
+uint8_t hal_init(void)
+{
+    // libmraa initializes itself when the library is loaded
+    return SUCCESS;
+}
+
+hal_ow_t * hal_ow_init(int bus, const char * p_dev)
+{
+    hal_ow_t *p_ow = (hal_ow_t *) malloc(sizeof(hal_ow_t));
+
+    if (NULL == p_ow)
+    {
+        return NULL;
+    }
+
+    p_ow->ctx = ((NULL != p_dev) && ('\0' != p_dev[0])) ? (mraa_uart_ow_init_raw(p_dev)) :
+                                                            (mraa_uart_ow_init(bus));
+    if (NULL == p_ow->ctx)
+    {
+        free(p_ow);
+        return NULL;
+    }
+
+    return p_ow;
+}
+
+void hal_ow_stop(hal_ow_t * p_ow)
+{
+    mraa_uart_ow_stop(p_ow->ctx);
+    free(p_ow);
+}
+
+hal_result_t hal_ow_reset(hal_ow_t * p_ow)
+{
+    return hal_from_mraa(mraa_uart_ow_reset(p_ow->ctx));
+}
+
+hal_result_t hal_ow_rom_search(hal_ow_t * p_ow, uint8_t start, uint8_t * p_id)
+{
+    return hal_from_mraa(mraa_uart_ow_rom_search(p_ow->ctx, start, p_id));
+}
+
+hal_result_t hal_ow_command(hal_ow_t * p_ow, uint8_t command, uint8_t * p_id)
+{
+    return hal_from_mraa(mraa_uart_ow_command(p_ow->ctx, command, p_id));
+}
+
+int hal_ow_read_byte(hal_ow_t * p_ow)
+{
+    return mraa_uart_ow_read_byte(p_ow->ctx);
+}
+
+int hal_ow_write_byte(hal_ow_t * p_ow, uint8_t byte)
+{
+    return mraa_uart_ow_write_byte(p_ow->ctx, byte);
+}
+
+int hal_ow_bit(hal_ow_t * p_ow, uint8_t bit)
+{
+    return mraa_uart_ow_bit(p_ow->ctx, bit);
+}
+
+uint8_t hal_ow_crc8(uint8_t * p_buf, uint16_t length)
+{
+    return mraa_uart_ow_crc8(p_buf, length);
+}
+
+hal_gpio_t * hal_gpio_init(int pin)
+{
+    hal_gpio_t *p_gpio = (hal_gpio_t *) malloc(sizeof(hal_gpio_t));
+
+    if (NULL == p_gpio)
+    {
+        return NULL;
+    }
+
+    p_gpio->ctx = mraa_gpio_init(pin);
+    if (NULL == p_gpio->ctx)
+    {
+        free(p_gpio);
+        return NULL;
+    }
+
+    return p_gpio;
+}
+
+hal_result_t hal_gpio_dir_out(hal_gpio_t * p_gpio)
+{
+    return hal_from_mraa(mraa_gpio_dir(p_gpio->ctx, MRAA_GPIO_OUT));
+}
+
+hal_result_t hal_gpio_write(hal_gpio_t * p_gpio, int value)
+{
+    return hal_from_mraa(mraa_gpio_write(p_gpio->ctx, value));
+}
+
+void hal_gpio_close(hal_gpio_t * p_gpio)
+{
+    mraa_gpio_close(p_gpio->ctx);
+    free(p_gpio);
+}
+
+hal_pwm_t * hal_pwm_init(int pin)
+{
+    hal_pwm_t *p_pwm = (hal_pwm_t *) malloc(sizeof(hal_pwm_t));
+
+    if (NULL == p_pwm)
+    {
+        return NULL;
+    }
+
+    p_pwm->ctx = mraa_pwm_init(pin);
+    if (NULL == p_pwm->ctx)
+    {
+        free(p_pwm);
+        return NULL;
+    }
+
+    return p_pwm;
+}
+
+hal_result_t hal_pwm_period_us(hal_pwm_t * p_pwm, int period_us)
+{
+    return hal_from_mraa(mraa_pwm_period_us(p_pwm->ctx, period_us));
+}
+
+hal_result_t hal_pwm_write(hal_pwm_t * p_pwm, float duty)
+{
+    return hal_from_mraa(mraa_pwm_write(p_pwm->ctx, duty));
+}
+
+hal_result_t hal_pwm_enable(hal_pwm_t * p_pwm, int enable)
+{
+    return hal_from_mraa(mraa_pwm_enable(p_pwm->ctx, enable));
+}
+
+void hal_pwm_close(hal_pwm_t * p_pwm)
+{
+    mraa_pwm_close(p_pwm->ctx);
+    free(p_pwm);
+}
+
+hal_aio_t * hal_aio_init(unsigned int pin)
+{
+    hal_aio_t *p_aio = (hal_aio_t *) malloc(sizeof(hal_aio_t));
+
+    if (NULL == p_aio)
+    {
+        return NULL;
+    }
+
+    p_aio->ctx = mraa_aio_init(pin);
+    if (NULL == p_aio->ctx)
+    {
+        free(p_aio);
+        return NULL;
+    }
+
+    return p_aio;
+}
+
+int hal_aio_read(hal_aio_t * p_aio)
+{
+    return mraa_aio_read(p_aio->ctx);
+}
+
+void hal_aio_close(hal_aio_t * p_aio)
+{
+    mraa_aio_close(p_aio->ctx);
+    free(p_aio);
+}
+
+static hal_result_t hal_from_mraa(mraa_result_t mraa_ret_val)
+{
+    switch (mraa_ret_val)
+    {
+        case MRAA_SUCCESS:
+            return HAL_SUCCESS;
+
+        case MRAA_ERROR_UART_OW_NO_DEVICES:
+            return HAL_ERROR_OW_NO_DEVICES;
+
+        case MRAA_ERROR_UART_OW_DATA_ERROR:
+            return HAL_ERROR_OW_DATA_ERROR;
+
+        default:
+            return HAL_ERROR;
+    }
+}
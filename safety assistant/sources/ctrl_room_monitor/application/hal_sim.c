@@ -0,0 +1,903 @@
+/******************************************************************************/
+
+/* File - hal_sim.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Simulated HAL backend, so the acquisition loop can be built, profiled and
+*  benchmarked without an IoT2020. It emulates:
+*    - DS18B20 devices on each 1-wire bus (ROM search, Match/Skip ROM,
+*      Convert T with conversion time, read time slots, Read/Write Scratchpad)
+*    - analog inputs driven by scriptable waveforms
+*    - digital outputs
+*  Faults (scratchpad CRC errors, ADC spikes) and latencies are injected as
+*  configured. All randomness comes from per-instance PRNGs seeded from
+*  'sim.seed', so a given configuration always produces the same data.
+*
+*  Settings are read from the file named by environment variable
+*  HAL_SIM_CONFIG (if set), see sim.conf for the available keys.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+
+/******************************************************************************/
+
+#define SIM_MAX_OW_SENSORS      (64)
+#define SIM_MAX_WAVE_POINTS     (16)
+#define SIM_SCRATCHPAD_LEN      (9)
+
+/* DS18B20 ROM and function commands understood by the simulated devices
+*/
+#define OW_CMD_MATCH_ROM        (0x55)
+#define OW_CMD_SKIP_ROM         (0xCC)
+#define OW_CMD_CONVERT_T        (0x44)
+#define OW_CMD_READ_SCRATCHPAD  (0xBE)
+#define OW_CMD_WRITE_SCRATCHPAD (0x4E)
+#define OW_CMD_COPY_SCRATCHPAD  (0x48)
+
+/* DS18B20 family code and temperature register power-on value (+85 C)
+*/
+#define DS18B20_FAMILY_CODE     (0x28)
+#define DS18B20_POWER_ON_RAW    (0x0550)
+
+/******************************************************************************/
+
+typedef enum
+{
+    SIM_WAVE_CONST = 0,
+    SIM_WAVE_SINE,
+    SIM_WAVE_RAMP,
+    SIM_WAVE_SQUARE,
+    SIM_WAVE_PWL
+} sim_wave_type_t;
+
+/* Waveform: offset +/- amplitude with the given period, or a repeating
+*  piecewise linear curve given as "t0:v0, t1:v1, ..." (time in seconds)
+*/
+typedef struct
+{
+    sim_wave_type_t type;
+    double          offset;
+    double          amplitude;
+    double          period_s;
+    double          noise;
+    uint8_t         num_points;
+    double          pt_time[SIM_MAX_WAVE_POINTS];
+    double          pt_val[SIM_MAX_WAVE_POINTS];
+} sim_wave_t;
+
+typedef struct
+{
+    uint8_t  rom[HAL_OW_ROMCODE_SIZE];
+    int16_t  raw;
+    int16_t  pending_raw;
+    double   conv_done_at;
+    uint8_t  th;
+    uint8_t  tl;
+    uint8_t  cfg;
+    uint8_t  selected;
+    double   crc_error_rate;
+} sim_ds18b20_t;
+
+/* 1-wire transaction state, driven byte by byte like the real bus
+*/
+typedef enum
+{
+    SIM_OW_IDLE = 0,
+    SIM_OW_ROM_CMD,
+    SIM_OW_MATCH_ROM,
+    SIM_OW_FUNC_CMD,
+    SIM_OW_READ,
+    SIM_OW_WRITE_SCRATCHPAD
+} sim_ow_state_t;
+
+struct hal_ow
+{
+    int            bus;
+    uint8_t        num_sensors;
+    sim_ds18b20_t  sensors[SIM_MAX_OW_SENSORS];
+    sim_wave_t     wave;
+    double         spread;
+    double         crc_error_rate;
+    double         conv_time_s;
+    unsigned int   byte_latency_us;
+    unsigned int   reset_latency_us;
+    uint64_t       prng;
+
+    sim_ow_state_t state;
+    uint8_t        search_index;
+    uint8_t        match_rom[HAL_OW_ROMCODE_SIZE];
+    uint8_t        match_pos;
+    uint8_t        read_buf[SIM_SCRATCHPAD_LEN];
+    uint8_t        read_pos;
+    uint8_t        write_pos;
+};
+
+struct hal_gpio
+{
+    int          pin;
+    int          value;
+};
+
+struct hal_pwm
+{
+    int          pin;
+    int          period_us;
+    float        duty;
+    int          is_enabled;
+};
+
+struct hal_aio
+{
+    unsigned int pin;
+    sim_wave_t   wave;
+    double       spike_rate;
+    uint64_t     prng;
+};
+
+/******************************************************************************/
+
+static struct timespec sim_start_time;
+static uint64_t        sim_seed;
+static unsigned int    sim_aio_latency_us;
+static unsigned int    sim_gpio_latency_us;
+
+/******************************************************************************/
+
+/* Function declaration to get the simulation time
+*  @return - double (seconds since hal_init())
+*/
+static double sim_time_s(void);
+
+/* Function declarations of the deterministic PRNG (xorshift64*)
+*/
+static uint64_t sim_rand_seed(uint64_t salt);
+static double   sim_rand_unit(uint64_t * p_state);
+static double   sim_rand_noise(uint64_t * p_state, double amplitude);
+
+/* Function declarations to load and evaluate a waveform from "<prefix>.*" keys
+*/
+static void   sim_wave_load(sim_wave_t * p_wave, const char * p_prefix, double def_offset,
+                                                                    double def_noise);
+static double sim_wave_eval(const sim_wave_t * p_wave, double t);
+
+/* Function declarations of the DS18B20 device emulation
+*/
+static void    sim_ow_delay(hal_ow_t * p_ow, unsigned int num_bytes);
+static void    sim_ow_func_cmd(hal_ow_t * p_ow, uint8_t command);
+static void    sim_ow_update(hal_ow_t * p_ow);
+static double  sim_ow_conv_time(const hal_ow_t * p_ow, uint8_t cfg);
+static int16_t sim_ow_temp_raw(hal_ow_t * p_ow, uint8_t index);
+
+/******************************************************************************/
+
+uint8_t hal_init(void)
+{
+    const char *p_path = getenv("HAL_SIM_CONFIG");
+
+    if ((NULL != p_path) && (SUCCESS != config_load(p_path)))
+    {
+        return FAIL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &sim_start_time);
+    sim_seed = (uint64_t)config_get_int(1, "sim.seed");
+    sim_aio_latency_us = (unsigned int)config_get_int(0, "sim.aio.read_latency_us");
+    sim_gpio_latency_us = (unsigned int)config_get_int(0, "sim.gpio.write_latency_us");
+
+    printf("Simulated HAL backend, seed %lu.\n", (unsigned long)sim_seed);
+
+    return SUCCESS;
+}
+
+/******************************************************************************/
+
+hal_ow_t * hal_ow_init(int bus, const char * p_dev)
+{
+    hal_ow_t *p_ow;
+    char      prefix[CONFIG_MAX_KEY_LEN];
+    uint8_t   i;
+
+    p_ow = (hal_ow_t *) calloc(1, sizeof(hal_ow_t));
+    if (NULL == p_ow)
+    {
+        return NULL;
+    }
+
+    // A bus is simulated by its index, whatever device it is configured on
+    snprintf(prefix, sizeof(prefix), "sim.ow.%d", bus);
+
+    p_ow->bus = bus;
+    p_ow->num_sensors = (uint8_t)config_get_int(2, "%s.sensors", prefix);
+    if (p_ow->num_sensors > SIM_MAX_OW_SENSORS)
+    {
+        p_ow->num_sensors = SIM_MAX_OW_SENSORS;
+    }
+    sim_wave_load(&p_ow->wave, prefix, 25.0, 0.0);
+    p_ow->spread = config_get_double(0.5, "%s.spread", prefix);
+    p_ow->crc_error_rate = config_get_double(0.0, "%s.crc_error_rate", prefix);
+    p_ow->conv_time_s = config_get_int(750, "%s.conv_time_ms", prefix) / 1e3;
+    p_ow->byte_latency_us = (unsigned int)config_get_int(0, "%s.byte_latency_us", prefix);
+    p_ow->reset_latency_us = (unsigned int)config_get_int(0, "%s.reset_latency_us", prefix);
+    p_ow->prng = sim_rand_seed(0x1000 + bus);
+
+    for (i = 0; i < p_ow->num_sensors; i++)
+    {
+        sim_ds18b20_t *p_sen = &p_ow->sensors[i];
+
+        // Serial number built from bus and index, so ROM codes are stable
+        p_sen->rom[0] = DS18B20_FAMILY_CODE;
+        p_sen->rom[1] = i;
+        p_sen->rom[2] = (uint8_t)bus;
+        p_sen->rom[3] = 0x5A;
+        p_sen->rom[4] = (uint8_t)(sim_seed & 0xFF);
+        p_sen->rom[5] = 0x00;
+        p_sen->rom[6] = 0x00;
+        p_sen->rom[7] = hal_ow_crc8(p_sen->rom, HAL_OW_ROMCODE_SIZE - 1);
+
+        p_sen->raw = DS18B20_POWER_ON_RAW;
+        p_sen->conv_done_at = -1.0;
+        p_sen->th = 0x4B;
+        p_sen->tl = 0x46;
+        p_sen->cfg = 0x7F;
+
+        // A single probe may be made flaky (or dead with 1.0)
+        p_sen->crc_error_rate = config_get_double(p_ow->crc_error_rate, "%s.%d.crc_error_rate",
+                                                                                prefix, i);
+    }
+
+    printf("Simulated 1-wire bus %d with %d DS18B20.\n", bus, p_ow->num_sensors);
+
+    return p_ow;
+}
+
+void hal_ow_stop(hal_ow_t * p_ow)
+{
+    free(p_ow);
+}
+
+hal_result_t hal_ow_reset(hal_ow_t * p_ow)
+{
+    uint8_t i;
+
+    if (p_ow->reset_latency_us)
+    {
+        usleep(p_ow->reset_latency_us);
+    }
+
+    for (i = 0; i < p_ow->num_sensors; i++)
+    {
+        p_ow->sensors[i].selected = 0;
+    }
+    p_ow->state = SIM_OW_ROM_CMD;
+
+    return (p_ow->num_sensors) ? (HAL_SUCCESS) : (HAL_ERROR_OW_NO_DEVICES);
+}
+
+hal_result_t hal_ow_rom_search(hal_ow_t * p_ow, uint8_t start, uint8_t * p_id)
+{
+    hal_result_t ret_val;
+
+    if (start)
+    {
+        p_ow->search_index = 0;
+    }
+
+    ret_val = hal_ow_reset(p_ow);
+    if (HAL_SUCCESS != ret_val)
+    {
+        return ret_val;
+    }
+
+    // Each search pass reads 64 bit pairs and writes 64 direction bits
+    sim_ow_delay(p_ow, 24);
+    p_ow->state = SIM_OW_IDLE;
+
+    if (p_ow->search_index >= p_ow->num_sensors)
+    {
+        return HAL_ERROR_OW_NO_DEVICES;
+    }
+
+    memcpy(p_id, p_ow->sensors[p_ow->search_index++].rom, HAL_OW_ROMCODE_SIZE);
+
+    return HAL_SUCCESS;
+}
+
+hal_result_t hal_ow_command(hal_ow_t * p_ow, uint8_t command, uint8_t * p_id)
+{
+    hal_result_t ret_val;
+    uint8_t      i;
+
+    ret_val = hal_ow_reset(p_ow);
+    if (HAL_SUCCESS != ret_val)
+    {
+        return ret_val;
+    }
+
+    if (NULL == p_id)
+    {
+        hal_ow_write_byte(p_ow, OW_CMD_SKIP_ROM);
+    }
+    else
+    {
+        hal_ow_write_byte(p_ow, OW_CMD_MATCH_ROM);
+        for (i = 0; i < HAL_OW_ROMCODE_SIZE; i++)
+        {
+            hal_ow_write_byte(p_ow, p_id[i]);
+        }
+    }
+    hal_ow_write_byte(p_ow, command);
+
+    return HAL_SUCCESS;
+}
+
+int hal_ow_read_byte(hal_ow_t * p_ow)
+{
+    sim_ow_delay(p_ow, 1);
+
+    if ((SIM_OW_READ == p_ow->state) && (p_ow->read_pos < SIM_SCRATCHPAD_LEN))
+    {
+        return p_ow->read_buf[p_ow->read_pos++];
+    }
+
+    // Nobody drives the bus, pull-up reads as 1s
+    return 0xFF;
+}
+
+int hal_ow_write_byte(hal_ow_t * p_ow, uint8_t byte)
+{
+    uint8_t i;
+
+    sim_ow_delay(p_ow, 1);
+
+    switch (p_ow->state)
+    {
+        case SIM_OW_ROM_CMD:
+            if (OW_CMD_SKIP_ROM == byte)
+            {
+                for (i = 0; i < p_ow->num_sensors; i++)
+                {
+                    p_ow->sensors[i].selected = 1;
+                }
+                p_ow->state = SIM_OW_FUNC_CMD;
+            }
+            else if (OW_CMD_MATCH_ROM == byte)
+            {
+                p_ow->match_pos = 0;
+                p_ow->state = SIM_OW_MATCH_ROM;
+            }
+            else
+            {
+                p_ow->state = SIM_OW_IDLE;
+            }
+        break;
+
+        case SIM_OW_MATCH_ROM:
+            p_ow->match_rom[p_ow->match_pos++] = byte;
+            if (HAL_OW_ROMCODE_SIZE == p_ow->match_pos)
+            {
+                for (i = 0; i < p_ow->num_sensors; i++)
+                {
+                    p_ow->sensors[i].selected = (0 == memcmp(p_ow->sensors[i].rom,
+                                                    p_ow->match_rom, HAL_OW_ROMCODE_SIZE));
+                }
+                p_ow->state = SIM_OW_FUNC_CMD;
+            }
+        break;
+
+        case SIM_OW_FUNC_CMD:
+            sim_ow_func_cmd(p_ow, byte);
+        break;
+
+        case SIM_OW_WRITE_SCRATCHPAD:
+            for (i = 0; i < p_ow->num_sensors; i++)
+            {
+                if (p_ow->sensors[i].selected)
+                {
+                    if (0 == p_ow->write_pos)
+                    {
+                        p_ow->sensors[i].th = byte;
+                    }
+                    else if (1 == p_ow->write_pos)
+                    {
+                        p_ow->sensors[i].tl = byte;
+                    }
+                    else
+                    {
+                        // Only R1/R0 bits are writable, the rest read as 1/0
+                        p_ow->sensors[i].cfg = (byte & 0x60) | 0x1F;
+                    }
+                }
+            }
+            if (++p_ow->write_pos >= 3)
+            {
+                p_ow->state = SIM_OW_IDLE;
+            }
+        break;
+
+        default:
+        break;
+    }
+
+    return byte;
+}
+
+int hal_ow_bit(hal_ow_t * p_ow, uint8_t bit)
+{
+    uint8_t i;
+
+    sim_ow_update(p_ow);
+
+    if (0 == bit)
+    {
+        return 0;
+    }
+
+    // Read time slot after Convert T, a device holds the bus low until its
+    // conversion is done
+    for (i = 0; i < p_ow->num_sensors; i++)
+    {
+        if (p_ow->sensors[i].selected && (p_ow->sensors[i].conv_done_at >= 0.0))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+uint8_t hal_ow_crc8(uint8_t * p_buf, uint16_t length)
+{
+    uint8_t crc = 0;
+    uint8_t byte, bit, mix;
+
+    while (length--)
+    {
+        byte = *p_buf++;
+        for (bit = 0; bit < 8; bit++)
+        {
+            mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix)
+            {
+                crc ^= 0x8C;
+            }
+            byte >>= 1;
+        }
+    }
+
+    return crc;
+}
+
+/******************************************************************************/
+
+hal_gpio_t * hal_gpio_init(int pin)
+{
+    hal_gpio_t *p_gpio = (hal_gpio_t *) calloc(1, sizeof(hal_gpio_t));
+
+    if (NULL != p_gpio)
+    {
+        p_gpio->pin = pin;
+    }
+
+    return p_gpio;
+}
+
+hal_result_t hal_gpio_dir_out(hal_gpio_t * p_gpio)
+{
+    return HAL_SUCCESS;
+}
+
+hal_result_t hal_gpio_write(hal_gpio_t * p_gpio, int value)
+{
+    if (sim_gpio_latency_us)
+    {
+        usleep(sim_gpio_latency_us);
+    }
+    p_gpio->value = value;
+
+    return HAL_SUCCESS;
+}
+
+void hal_gpio_close(hal_gpio_t * p_gpio)
+{
+    free(p_gpio);
+}
+
+hal_pwm_t * hal_pwm_init(int pin)
+{
+    hal_pwm_t *p_pwm = (hal_pwm_t *) calloc(1, sizeof(hal_pwm_t));
+
+    if (NULL != p_pwm)
+    {
+        p_pwm->pin = pin;
+    }
+
+    return p_pwm;
+}
+
+hal_result_t hal_pwm_period_us(hal_pwm_t * p_pwm, int period_us)
+{
+    p_pwm->period_us = period_us;
+
+    return HAL_SUCCESS;
+}
+
+hal_result_t hal_pwm_write(hal_pwm_t * p_pwm, float duty)
+{
+    // Same cost as a digital write, both are a sysfs write on the target
+    if (sim_gpio_latency_us)
+    {
+        usleep(sim_gpio_latency_us);
+    }
+    p_pwm->duty = duty;
+
+    return HAL_SUCCESS;
+}
+
+hal_result_t hal_pwm_enable(hal_pwm_t * p_pwm, int enable)
+{
+    p_pwm->is_enabled = enable;
+
+    return HAL_SUCCESS;
+}
+
+void hal_pwm_close(hal_pwm_t * p_pwm)
+{
+    free(p_pwm);
+}
+
+hal_aio_t * hal_aio_init(unsigned int pin)
+{
+    hal_aio_t *p_aio;
+    char       prefix[CONFIG_MAX_KEY_LEN];
+
+    p_aio = (hal_aio_t *) calloc(1, sizeof(hal_aio_t));
+    if (NULL == p_aio)
+    {
+        return NULL;
+    }
+
+    snprintf(prefix, sizeof(prefix), "sim.aio.%u", pin);
+
+    p_aio->pin = pin;
+    sim_wave_load(&p_aio->wave, prefix, 200.0, 2.0);
+    p_aio->spike_rate = config_get_double(0.0, "%s.spike_rate", prefix);
+    p_aio->prng = sim_rand_seed(0x2000 + pin);
+
+    return p_aio;
+}
+
+int hal_aio_read(hal_aio_t * p_aio)
+{
+    double val;
+
+    if (sim_aio_latency_us)
+    {
+        usleep(sim_aio_latency_us);
+    }
+
+    val = sim_wave_eval(&p_aio->wave, sim_time_s()) +
+                                sim_rand_noise(&p_aio->prng, p_aio->wave.noise);
+
+    // Injected spike, full scale glitch of the ADC
+    if ((p_aio->spike_rate > 0.0) && (sim_rand_unit(&p_aio->prng) < p_aio->spike_rate))
+    {
+        val = 1023.0;
+    }
+
+    if (val < 0.0)
+    {
+        val = 0.0;
+    }
+    else if (val > 1023.0)
+    {
+        val = 1023.0;
+    }
+
+    return (int)lrint(val);
+}
+
+void hal_aio_close(hal_aio_t * p_aio)
+{
+    free(p_aio);
+}
+
+/******************************************************************************/
+
+static double sim_time_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - sim_start_time.tv_sec) +
+                        ((now.tv_nsec - sim_start_time.tv_nsec) / 1e9);
+}
+
+static uint64_t sim_rand_seed(uint64_t salt)
+{
+    uint64_t state = (sim_seed ^ (salt * 0x9E3779B97F4A7C15ULL)) | 1;
+
+    return state;
+}
+
+static double sim_rand_unit(uint64_t * p_state)
+{
+    uint64_t x = *p_state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *p_state = x;
+
+    return ((x * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+static double sim_rand_noise(uint64_t * p_state, double amplitude)
+{
+    if (amplitude <= 0.0)
+    {
+        return 0.0;
+    }
+
+    return ((2.0 * sim_rand_unit(p_state)) - 1.0) * amplitude;
+}
+
+static void sim_wave_load(sim_wave_t * p_wave, const char * p_prefix, double def_offset,
+                                                                    double def_noise)
+{
+    const char *p_type = config_get_str("const", "%s.wave", p_prefix);
+    const char *p_points;
+    char       *p_next;
+
+    memset(p_wave, 0, sizeof(sim_wave_t));
+
+    if (0 == strcmp(p_type, "sine"))
+    {
+        p_wave->type = SIM_WAVE_SINE;
+    }
+    else if (0 == strcmp(p_type, "ramp"))
+    {
+        p_wave->type = SIM_WAVE_RAMP;
+    }
+    else if (0 == strcmp(p_type, "square"))
+    {
+        p_wave->type = SIM_WAVE_SQUARE;
+    }
+    else if (0 == strcmp(p_type, "pwl"))
+    {
+        p_wave->type = SIM_WAVE_PWL;
+    }
+    else
+    {
+        p_wave->type = SIM_WAVE_CONST;
+    }
+
+    p_wave->offset = config_get_double(def_offset, "%s.offset", p_prefix);
+    p_wave->amplitude = config_get_double(0.0, "%s.amplitude", p_prefix);
+    p_wave->period_s = config_get_double(600.0, "%s.period_s", p_prefix);
+    p_wave->noise = config_get_double(def_noise, "%s.noise", p_prefix);
+
+    // Points of piecewise linear wave as "t0:v0, t1:v1, ...", t ascending
+    p_points = config_get_str("", "%s.points", p_prefix);
+    while (('\0' != *p_points) && (p_wave->num_points < SIM_MAX_WAVE_POINTS))
+    {
+        p_wave->pt_time[p_wave->num_points] = strtod(p_points, &p_next);
+        if ((p_next == p_points) || (':' != *p_next))
+        {
+            break;
+        }
+        p_points = p_next + 1;
+        p_wave->pt_val[p_wave->num_points] = strtod(p_points, &p_next);
+        if (p_next == p_points)
+        {
+            break;
+        }
+        p_wave->num_points++;
+
+        p_points = p_next;
+        while ((',' == *p_points) || (' ' == *p_points))
+        {
+            p_points++;
+        }
+    }
+
+    if ((SIM_WAVE_PWL == p_wave->type) && (0 == p_wave->num_points))
+    {
+        printf("No points given for %s, using constant wave.\n", p_prefix);
+        p_wave->type = SIM_WAVE_CONST;
+    }
+}
+
+static double sim_wave_eval(const sim_wave_t * p_wave, double t)
+{
+    double  phase, span;
+    uint8_t i;
+
+    phase = (p_wave->period_s > 0.0) ? (fmod(t, p_wave->period_s) / p_wave->period_s) : (0.0);
+
+    switch (p_wave->type)
+    {
+        case SIM_WAVE_SINE:
+            return p_wave->offset + (p_wave->amplitude * sin(2.0 * M_PI * phase));
+
+        case SIM_WAVE_RAMP:
+            return p_wave->offset + (p_wave->amplitude * ((2.0 * phase) - 1.0));
+
+        case SIM_WAVE_SQUARE:
+            return p_wave->offset + ((phase < 0.5) ? (p_wave->amplitude) : (-p_wave->amplitude));
+
+        case SIM_WAVE_PWL:
+            // Curve repeats after its last point
+            span = p_wave->pt_time[p_wave->num_points - 1];
+            if (span > 0.0)
+            {
+                t = fmod(t, span);
+            }
+            for (i = 1; i < p_wave->num_points; i++)
+            {
+                if (t < p_wave->pt_time[i])
+                {
+                    return p_wave->pt_val[i - 1] + ((p_wave->pt_val[i] - p_wave->pt_val[i - 1]) *
+                            (t - p_wave->pt_time[i - 1]) / (p_wave->pt_time[i] - p_wave->pt_time[i - 1]));
+                }
+            }
+            return p_wave->pt_val[p_wave->num_points - 1];
+
+        default:
+            return p_wave->offset;
+    }
+}
+
+/******************************************************************************/
+
+static void sim_ow_delay(hal_ow_t * p_ow, unsigned int num_bytes)
+{
+    if (p_ow->byte_latency_us)
+    {
+        usleep(p_ow->byte_latency_us * num_bytes);
+    }
+}
+
+static void sim_ow_func_cmd(hal_ow_t * p_ow, uint8_t command)
+{
+    sim_ds18b20_t *p_sen;
+    uint8_t        i, num_selected = 0;
+    double         error_rate;
+
+    sim_ow_update(p_ow);
+
+    switch (command)
+    {
+        case OW_CMD_CONVERT_T:
+            for (i = 0; i < p_ow->num_sensors; i++)
+            {
+                p_sen = &p_ow->sensors[i];
+                if (p_sen->selected)
+                {
+                    p_sen->pending_raw = sim_ow_temp_raw(p_ow, i);
+                    p_sen->conv_done_at = sim_time_s() + sim_ow_conv_time(p_ow, p_sen->cfg);
+                }
+            }
+            p_ow->state = SIM_OW_IDLE;
+        break;
+
+        case OW_CMD_READ_SCRATCHPAD:
+            // Devices answering at the same time produce a wired-AND
+            memset(p_ow->read_buf, 0xFF, SIM_SCRATCHPAD_LEN);
+            error_rate = 0.0;
+            for (i = 0; i < p_ow->num_sensors; i++)
+            {
+                uint8_t pad[SIM_SCRATCHPAD_LEN];
+                uint8_t j;
+
+                p_sen = &p_ow->sensors[i];
+                if (!p_sen->selected)
+                {
+                    continue;
+                }
+                num_selected++;
+                if (p_sen->crc_error_rate > error_rate)
+                {
+                    error_rate = p_sen->crc_error_rate;
+                }
+
+                pad[0] = (uint8_t)(p_sen->raw & 0xFF);
+                pad[1] = (uint8_t)((p_sen->raw >> 8) & 0xFF);
+                pad[2] = p_sen->th;
+                pad[3] = p_sen->tl;
+                pad[4] = p_sen->cfg;
+                pad[5] = 0xFF;
+                pad[6] = 0x0C;
+                pad[7] = 0x10;
+                pad[8] = hal_ow_crc8(pad, SIM_SCRATCHPAD_LEN - 1);
+
+                for (j = 0; j < SIM_SCRATCHPAD_LEN; j++)
+                {
+                    p_ow->read_buf[j] &= pad[j];
+                }
+            }
+
+            // Injected transmission error, flip one bit of the scratchpad
+            if (num_selected && (error_rate > 0.0) &&
+                                    (sim_rand_unit(&p_ow->prng) < error_rate))
+            {
+                i = (uint8_t)(sim_rand_unit(&p_ow->prng) * SIM_SCRATCHPAD_LEN);
+                p_ow->read_buf[i] ^= (uint8_t)(1 << (uint8_t)(sim_rand_unit(&p_ow->prng) * 8));
+            }
+
+            p_ow->read_pos = 0;
+            p_ow->state = SIM_OW_READ;
+        break;
+
+        case OW_CMD_WRITE_SCRATCHPAD:
+            p_ow->write_pos = 0;
+            p_ow->state = SIM_OW_WRITE_SCRATCHPAD;
+        break;
+
+        default:
+            // Copy Scratchpad and others have no visible effect here
+            p_ow->state = SIM_OW_IDLE;
+        break;
+    }
+}
+
+static void sim_ow_update(hal_ow_t * p_ow)
+{
+    double  now = sim_time_s();
+    uint8_t i;
+
+    for (i = 0; i < p_ow->num_sensors; i++)
+    {
+        sim_ds18b20_t *p_sen = &p_ow->sensors[i];
+
+        if ((p_sen->conv_done_at >= 0.0) && (now >= p_sen->conv_done_at))
+        {
+            p_sen->raw = p_sen->pending_raw;
+            p_sen->conv_done_at = -1.0;
+        }
+    }
+}
+
+static double sim_ow_conv_time(const hal_ow_t * p_ow, uint8_t cfg)
+{
+    // 'conv_time_s' is for 12-bit, each bit less halves the conversion time
+    return p_ow->conv_time_s / (double)(1 << (3 - ((cfg >> 5) & 0x03)));
+}
+
+static int16_t sim_ow_temp_raw(hal_ow_t * p_ow, uint8_t index)
+{
+    const sim_ds18b20_t *p_sen = &p_ow->sensors[index];
+    double  temp;
+    int16_t raw;
+
+    temp = sim_wave_eval(&p_ow->wave, sim_time_s()) + (index * p_ow->spread) +
+                                            sim_rand_noise(&p_ow->prng, p_ow->wave.noise);
+    if (temp < -55.0)
+    {
+        temp = -55.0;
+    }
+    else if (temp > 125.0)
+    {
+        temp = 125.0;
+    }
+
+    // 1/16 C per LSB at 12-bit, undefined low bits are read as 0 at lower
+    // resolutions
+    raw = (int16_t)lrint(temp * 16.0);
+    raw &= (int16_t)(0xFFFF << (3 - ((p_sen->cfg >> 5) & 0x03)));
+
+    return raw;
+}
@@ -0,0 +1,614 @@
+/******************************************************************************/
+
+/* File - health.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Streaming statistics and drift detection of the sensors. See health.h for
+*  details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "config.h"
+#include "sched.h"
+#include "ipc.h"
+#include "db.h"
+#include "health.h"
+
+/******************************************************************************/
+
+/* Topic of the drift pushes
+*/
+#define HEALTH_TOPIC            "drift"
+
+/* Snapshots stored per transaction, and the retry interval while the
+*  database is busy with a storage cycle
+*/
+#define HEALTH_DB_BATCH         (32)
+#define HEALTH_RETRY_MS         (1000)
+
+/******************************************************************************/
+
+// Indexed by 'sen_id', which is assigned densely from 1 by the registry
+static health_t     *p_health = NULL;
+static uint32_t      max_health = 0;
+
+static health_cfg_t  health_cfg = { HEALTH_WINDOW, HEALTH_BASELINE, HEALTH_CUSUM_K,
+                                    HEALTH_CUSUM_H, HEALTH_MIN_SIGMA };
+static uint32_t      interval_ms = 0;
+static sched_task_t  snapshot_task;
+static sched_task_t  retry_task;
+
+/******************************************************************************/
+
+/* Function declaration to add a value to a P-square estimator
+*  @param[in] p_p2 - Estimator
+*  @param[in] p    - Quantile, 0 to 1
+*  @param[in] x    - Value
+*  @return - None
+*/
+static void    health_p2_add(health_p2_t * p_p2, double p, double x);
+
+/* Function declaration to get the estimate of a P-square estimator
+*  @param[in] p_p2 - Estimator
+*  @param[in] p    - Quantile, 0 to 1
+*  @return - double (estimate, 0 without samples)
+*/
+static double  health_p2_get(const health_p2_t * p_p2, double p);
+
+/* Function declaration to add a value to a monotonic deque
+*  @param[in] p_deque - Deque
+*  @param[in] seq     - Sequence number of the value
+*  @param[in] val     - Value
+*  @param[in] window  - Window in samples
+*  @param[in] is_max  - Non-zero to keep the maximum at the front, minimum
+*                       otherwise
+*  @return - None
+*/
+static void    health_deque_add(health_deque_t * p_deque, uint32_t seq, int32_t val,
+                                uint32_t window, uint8_t is_max);
+
+/* Function declaration to store a snapshot of every sensor with samples and
+*  start the interval statistics over. The sensors of a batch meeting a
+*  busy database keep their statistics.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the database was busy )
+*/
+static uint8_t health_store(void);
+
+/* Function declaration to store a batch of snapshots and start the interval
+*  statistics of its sensors over, also when the snapshots are lost
+*  @param[in] p_rows - Snapshots
+*  @param[in] num    - Number of snapshots
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the database was busy )
+*/
+static uint8_t health_store_rows(const db_health_t * p_rows, uint16_t num);
+
+static void    snapshot_task_fn(sched_task_t * p_task);
+static void    retry_task_fn(sched_task_t * p_task);
+
+/* Function declaration to reply the statistics of a sensor
+*  @param[in] p_client - Client
+*  @param[in] sen_id   - Sensor ID
+*  @return - None
+*/
+static void    health_reply(ipc_client_t * p_client, uint16_t sen_id);
+
+/* Function declarations of the control commands
+*/
+static uint8_t health_cmd_health(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t health_cmd_rebase(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t health_init(void)
+{
+    long window = config_get_int(HEALTH_WINDOW, "health.window");
+    long baseline = config_get_int(HEALTH_BASELINE, "health.baseline");
+
+    health_cfg.window = (uint32_t)((window < 1) ? (1) :
+                                   ((window > HEALTH_MAX_WINDOW) ? (HEALTH_MAX_WINDOW) : (window)));
+    health_cfg.baseline = (uint32_t)((baseline < 2) ? (2) : (baseline));
+    health_cfg.cusum_k = config_get_double(HEALTH_CUSUM_K, "health.cusum_k");
+    health_cfg.cusum_h = config_get_double(HEALTH_CUSUM_H, "health.cusum_h");
+    health_cfg.min_sigma = config_get_double(HEALTH_MIN_SIGMA, "health.min_sigma");
+    interval_ms = (uint32_t)config_get_int(HEALTH_INTERVAL_MS, "health.interval_ms");
+
+    sched_task_init(&snapshot_task, snapshot_task_fn, NULL);
+    sched_task_init(&retry_task, retry_task_fn, NULL);
+
+    if ((SUCCESS != ipc_register_cmd("HEALTH", health_cmd_health, "HEALTH [sen_id]")) ||
+        (SUCCESS != ipc_register_cmd("REBASE", health_cmd_rebase, "REBASE <sen_id>")))
+    {
+        return FAIL;
+    }
+
+    if (interval_ms && (SUCCESS != sched_start(&snapshot_task, interval_ms, 0)))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+void health_eval(const sample_t * p_sample)
+{
+    health_t *p_table;
+    health_t *p_sensor;
+    uint32_t  new_max;
+
+    if (p_sample->sen_id >= max_health)
+    {
+        new_max = (max_health) ? (max_health) : (16);
+        while (new_max <= p_sample->sen_id)
+        {
+            new_max *= 2;
+        }
+        // Every 'sen_id' fits, 0xFFFF included
+        if (new_max > 0x10000)
+        {
+            new_max = 0x10000;
+        }
+
+        p_table = (health_t *) realloc(p_health, new_max * sizeof(health_t));
+        if (NULL == p_table)
+        {
+            printf("realloc() failed to allocate.\n");
+            return;
+        }
+        memset(&p_table[max_health], 0, (new_max - max_health) * sizeof(health_t));
+        p_health = p_table;
+        max_health = new_max;
+    }
+
+    p_sensor = &p_health[p_sample->sen_id];
+    if (!health_update(p_sensor, &health_cfg, p_sample->sen_val))
+    {
+        return;
+    }
+
+    ipc_publish(HEALTH_TOPIC, p_sample->sen_id, "%d %s %0.2f %0.3f %ld", p_sample->sen_id,
+                (p_sensor->drift > 0) ? ("UP") : ((p_sensor->drift < 0) ? ("DOWN") : ("OK")),
+                (double)p_sample->sen_val / SAMPLE_SCALE, p_sensor->base_mean,
+                                                                    (long)p_sample->sen_time);
+
+    #if defined(RUN_TIME_LOG)
+        printf("Sensor ID=%d drift %s, value=%0.2f baseline=%0.3f.\n", p_sample->sen_id,
+               (p_sensor->drift > 0) ? ("up") : ((p_sensor->drift < 0) ? ("down") : ("cleared")),
+               (double)p_sample->sen_val / SAMPLE_SCALE, p_sensor->base_mean);
+    #endif
+}
+
+void health_close(void)
+{
+    if (interval_ms)
+    {
+        sched_stop(&snapshot_task);
+        sched_stop(&retry_task);
+        if (SUCCESS != health_store())
+        {
+            printf("Sensor health snapshot not stored, database busy.\n");
+        }
+    }
+}
+
+void health_get_cfg(health_cfg_t * p_cfg)
+{
+    *p_cfg = health_cfg;
+}
+
+uint8_t health_update(health_t * p_health, const health_cfg_t * p_cfg, int32_t sen_val)
+{
+    double  x = (double)sen_val / SAMPLE_SCALE;
+    double  delta;
+    double  sigma;
+    double  z;
+    int8_t  drift;
+
+    // Interval statistics
+    p_health->count++;
+    delta = x - p_health->mean;
+    p_health->mean += delta / p_health->count;
+    p_health->m2 += delta * (x - p_health->mean);
+
+    health_p2_add(&p_health->p50, 0.50, x);
+    health_p2_add(&p_health->p95, 0.95, x);
+    health_p2_add(&p_health->p99, 0.99, x);
+
+    // Sliding window
+    health_deque_add(&p_health->min, p_health->seq, sen_val, p_cfg->window, 0);
+    health_deque_add(&p_health->max, p_health->seq, sen_val, p_cfg->window, 1);
+    p_health->seq++;
+
+    // Baseline first, then drift against it
+    if (p_health->base_count < p_cfg->baseline)
+    {
+        p_health->base_count++;
+        delta = x - p_health->base_mean;
+        p_health->base_mean += delta / p_health->base_count;
+        p_health->base_m2 += delta * (x - p_health->base_mean);
+        return 0;
+    }
+
+    sigma = sqrt(p_health->base_m2 / (p_health->base_count - 1));
+    if (sigma < p_cfg->min_sigma)
+    {
+        sigma = p_cfg->min_sigma;
+    }
+    z = (x - p_health->base_mean) / sigma;
+    z = fmin(fmax(z, -HEALTH_CUSUM_CLIP), HEALTH_CUSUM_CLIP);
+
+    // The sums are held at the threshold, so a drift clears within h / k
+    // samples once the sensor is back
+    p_health->cusum_pos = fmin(fmax(0.0, p_health->cusum_pos + z - p_cfg->cusum_k),
+                                                                        p_cfg->cusum_h);
+    p_health->cusum_neg = fmin(fmax(0.0, p_health->cusum_neg - z - p_cfg->cusum_k),
+                                                                        p_cfg->cusum_h);
+
+    drift = p_health->drift;
+    if ((0 == drift) && (p_health->cusum_pos >= p_cfg->cusum_h))
+    {
+        drift = 1;
+    }
+    else if ((0 == drift) && (p_health->cusum_neg >= p_cfg->cusum_h))
+    {
+        drift = -1;
+    }
+    else if (((drift > 0) && (0.0 == p_health->cusum_pos)) ||
+             ((drift < 0) && (0.0 == p_health->cusum_neg)))
+    {
+        drift = 0;
+    }
+
+    if (drift == p_health->drift)
+    {
+        return 0;
+    }
+
+    p_health->drift = drift;
+
+    return 1;
+}
+
+void health_snapshot(const health_t * p_health, const health_cfg_t * p_cfg, db_health_t * p_row)
+{
+    p_row->count = p_health->count;
+    p_row->mean = p_health->mean;
+    p_row->stddev = (p_health->count > 1) ? (sqrt(p_health->m2 / (p_health->count - 1))) : (0.0);
+    p_row->win_min = (p_health->min.count) ?
+                     ((double)p_health->min.val[p_health->min.head] / SAMPLE_SCALE) : (0.0);
+    p_row->win_max = (p_health->max.count) ?
+                     ((double)p_health->max.val[p_health->max.head] / SAMPLE_SCALE) : (0.0);
+    p_row->p50 = health_p2_get(&p_health->p50, 0.50);
+    p_row->p95 = health_p2_get(&p_health->p95, 0.95);
+    p_row->p99 = health_p2_get(&p_health->p99, 0.99);
+    p_row->has_baseline = (p_health->base_count >= p_cfg->baseline);
+    p_row->baseline = p_health->base_mean;
+    p_row->cusum_pos = p_health->cusum_pos;
+    p_row->cusum_neg = p_health->cusum_neg;
+    p_row->drift = p_health->drift;
+}
+
+void health_reset(health_t * p_health)
+{
+    p_health->count = 0;
+    p_health->mean = 0.0;
+    p_health->m2 = 0.0;
+    memset(&p_health->p50, 0, sizeof(health_p2_t));
+    memset(&p_health->p95, 0, sizeof(health_p2_t));
+    memset(&p_health->p99, 0, sizeof(health_p2_t));
+}
+
+void health_rebase(health_t * p_health)
+{
+    p_health->base_count = 0;
+    p_health->base_mean = 0.0;
+    p_health->base_m2 = 0.0;
+    p_health->cusum_pos = 0.0;
+    p_health->cusum_neg = 0.0;
+    p_health->drift = 0;
+}
+
+/******************************************************************************/
+
+static void health_p2_add(health_p2_t * p_p2, double p, double x)
+{
+    double   d;
+    double   q;
+    double   ds;
+    uint8_t  i;
+    uint8_t  k;
+
+    if (p_p2->count < 5)
+    {
+        // Insertion sort of the first samples
+        for (i = p_p2->count; (i > 0) && (p_p2->q[i - 1] > x); i--)
+        {
+            p_p2->q[i] = p_p2->q[i - 1];
+        }
+        p_p2->q[i] = x;
+        p_p2->count++;
+
+        if (5 == p_p2->count)
+        {
+            for (i = 0; i < 5; i++)
+            {
+                p_p2->pos[i] = i + 1;
+            }
+            p_p2->want[0] = 1.0;
+            p_p2->want[1] = 1.0 + 2.0 * p;
+            p_p2->want[2] = 1.0 + 4.0 * p;
+            p_p2->want[3] = 3.0 + 2.0 * p;
+            p_p2->want[4] = 5.0;
+        }
+        return;
+    }
+
+    p_p2->count++;
+
+    // Cell of the value, the extreme markers follow new extremes
+    if (x < p_p2->q[0])
+    {
+        p_p2->q[0] = x;
+        k = 0;
+    }
+    else if (x >= p_p2->q[4])
+    {
+        p_p2->q[4] = x;
+        k = 3;
+    }
+    else
+    {
+        for (k = 0; x >= p_p2->q[k + 1]; k++)
+        {
+        }
+    }
+
+    for (i = k + 1; i < 5; i++)
+    {
+        p_p2->pos[i] += 1.0;
+    }
+    p_p2->want[1] += p / 2.0;
+    p_p2->want[2] += p;
+    p_p2->want[3] += (1.0 + p) / 2.0;
+    p_p2->want[4] += 1.0;
+
+    // Move the middle markers towards their desired positions, parabolic
+    // prediction of the height unless it breaks the order, linear then
+    for (i = 1; i < 4; i++)
+    {
+        d = p_p2->want[i] - p_p2->pos[i];
+        if (((d >= 1.0) && (p_p2->pos[i + 1] - p_p2->pos[i] > 1.0)) ||
+            ((d <= -1.0) && (p_p2->pos[i - 1] - p_p2->pos[i] < -1.0)))
+        {
+            ds = (d > 0.0) ? (1.0) : (-1.0);
+
+            q = p_p2->q[i] + ds / (p_p2->pos[i + 1] - p_p2->pos[i - 1]) *
+                ((p_p2->pos[i] - p_p2->pos[i - 1] + ds) * (p_p2->q[i + 1] - p_p2->q[i]) /
+                                                        (p_p2->pos[i + 1] - p_p2->pos[i]) +
+                 (p_p2->pos[i + 1] - p_p2->pos[i] - ds) * (p_p2->q[i] - p_p2->q[i - 1]) /
+                                                        (p_p2->pos[i] - p_p2->pos[i - 1]));
+
+            if ((p_p2->q[i - 1] < q) && (q < p_p2->q[i + 1]))
+            {
+                p_p2->q[i] = q;
+            }
+            else if (ds > 0.0)
+            {
+                p_p2->q[i] += (p_p2->q[i + 1] - p_p2->q[i]) / (p_p2->pos[i + 1] - p_p2->pos[i]);
+            }
+            else
+            {
+                p_p2->q[i] -= (p_p2->q[i - 1] - p_p2->q[i]) / (p_p2->pos[i - 1] - p_p2->pos[i]);
+            }
+            p_p2->pos[i] += ds;
+        }
+    }
+}
+
+static double health_p2_get(const health_p2_t * p_p2, double p)
+{
+    if (0 == p_p2->count)
+    {
+        return 0.0;
+    }
+
+    // Nearest rank until the markers are set up
+    if (p_p2->count < 5)
+    {
+        return p_p2->q[(uint32_t)(p * (p_p2->count - 1) + 0.5)];
+    }
+
+    return p_p2->q[2];
+}
+
+static void health_deque_add(health_deque_t * p_deque, uint32_t seq, int32_t val,
+                             uint32_t window, uint8_t is_max)
+{
+    uint16_t back;
+
+    // Drop the front once it left the window, then every value behind which
+    // the new one supersedes
+    if (p_deque->count && ((uint32_t)(seq - p_deque->seq[p_deque->head]) >= window))
+    {
+        p_deque->head = (p_deque->head + 1) % HEALTH_MAX_WINDOW;
+        p_deque->count--;
+    }
+
+    while (p_deque->count)
+    {
+        back = (p_deque->head + p_deque->count - 1) % HEALTH_MAX_WINDOW;
+        if ((is_max) ? (p_deque->val[back] > val) : (p_deque->val[back] < val))
+        {
+            break;
+        }
+        p_deque->count--;
+    }
+
+    back = (p_deque->head + p_deque->count) % HEALTH_MAX_WINDOW;
+    p_deque->seq[back] = seq;
+    p_deque->val[back] = val;
+    p_deque->count++;
+}
+
+static uint8_t health_store(void)
+{
+    db_health_t rows[HEALTH_DB_BATCH];
+    time_t      now = time(NULL);
+    uint16_t    num = 0;
+    uint32_t    sen_id;
+
+    for (sen_id = 0; sen_id < max_health; sen_id++)
+    {
+        if (0 == p_health[sen_id].count)
+        {
+            continue;
+        }
+
+        health_snapshot(&p_health[sen_id], &health_cfg, &rows[num]);
+        rows[num].sen_id = (uint16_t)sen_id;
+        rows[num].health_time = now;
+
+        if (HEALTH_DB_BATCH == ++num)
+        {
+            if (SUCCESS != health_store_rows(rows, num))
+            {
+                return FAIL;
+            }
+            num = 0;
+        }
+    }
+
+    return (num) ? (health_store_rows(rows, num)) : (SUCCESS);
+}
+
+static uint8_t health_store_rows(const db_health_t * p_rows, uint16_t num)
+{
+    uint8_t  ret_val;
+    uint16_t i;
+
+    ret_val = db_store_health(p_rows, num);
+    if (DB_BUSY == ret_val)
+    {
+        return FAIL;
+    }
+    if (SUCCESS != ret_val)
+    {
+        printf("Sensor health snapshot of %d sensors lost.\n", num);
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        health_reset(&p_health[p_rows[i].sen_id]);
+    }
+
+    return SUCCESS;
+}
+
+static void snapshot_task_fn(sched_task_t * p_task)
+{
+    // A pending retry takes the snapshot of this interval along
+    if (!sched_is_pending(&retry_task) && (SUCCESS != health_store()))
+    {
+        sched_after(&retry_task, HEALTH_RETRY_MS);
+    }
+}
+
+static void retry_task_fn(sched_task_t * p_task)
+{
+    if (SUCCESS != health_store())
+    {
+        sched_after(p_task, HEALTH_RETRY_MS);
+    }
+}
+
+static void health_reply(ipc_client_t * p_client, uint16_t sen_id)
+{
+    db_health_t row;
+    char        baseline[16];
+
+    health_snapshot(&p_health[sen_id], &health_cfg, &row);
+    if (row.has_baseline)
+    {
+        snprintf(baseline, sizeof(baseline), "%0.3f", row.baseline);
+    }
+    else
+    {
+        snprintf(baseline, sizeof(baseline), "-");
+    }
+
+    ipc_reply(p_client, "HLT %d %u %0.3f %0.3f %0.2f %0.2f %0.3f %0.3f %0.3f %s %0.2f %0.2f %d",
+              sen_id, row.count, row.mean, row.stddev, row.win_min, row.win_max, row.p50,
+              row.p95, row.p99, baseline, row.cusum_pos, row.cusum_neg, row.drift);
+}
+
+static uint8_t health_cmd_health(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    unsigned long sen_id;
+    char         *p_end;
+
+    if (argc >= 2)
+    {
+        sen_id = strtoul(argv[1], &p_end, 10);
+        if ((p_end == argv[1]) || ('\0' != *p_end) || (sen_id > 0xFFFF))
+        {
+            *p_err = "usage HEALTH [sen_id]";
+            return FAIL;
+        }
+        if ((sen_id >= max_health) || (0 == p_health[sen_id].seq))
+        {
+            *p_err = "no data";
+            return FAIL;
+        }
+        health_reply(p_client, (uint16_t)sen_id);
+        return SUCCESS;
+    }
+
+    for (sen_id = 0; sen_id < max_health; sen_id++)
+    {
+        if (p_health[sen_id].seq)
+        {
+            health_reply(p_client, (uint16_t)sen_id);
+        }
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t health_cmd_rebase(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    unsigned long sen_id;
+    char         *p_end;
+
+    *p_err = "usage REBASE <sen_id>";
+    if (argc < 2)
+    {
+        return FAIL;
+    }
+
+    sen_id = strtoul(argv[1], &p_end, 10);
+    if ((p_end == argv[1]) || ('\0' != *p_end) || (sen_id > 0xFFFF))
+    {
+        return FAIL;
+    }
+    if ((sen_id >= max_health) || (0 == p_health[sen_id].seq))
+    {
+        *p_err = "no data";
+        return FAIL;
+    }
+
+    health_rebase(&p_health[sen_id]);
+
+    return SUCCESS;
+}
@@ -0,0 +1,196 @@
+/******************************************************************************/
+
+/* File - health.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Streaming statistics of every sensor on the evaluation thread, so a
+*  DS18B20 going bad or the baseline of the dust sensor creeping up is seen
+*  without SQL over the raw history. Per sensor, in constant memory and time
+*  per sample:
+*
+*     mean, stddev   - Welford, over the samples since the last snapshot
+*     min, max       - over the last HEALTH_WINDOW ('health.window') samples,
+*                      monotonic deques
+*     p50, p95, p99  - P-square estimators (Jain and Chlamtac), over the
+*                      samples since the last snapshot
+*     drift          - two-sided CUSUM of the samples against a baseline
+*
+*  The baseline is the mean and standard deviation of the first
+*  HEALTH_BASELINE ('health.baseline') samples, the standard deviation at
+*  least HEALTH_MIN_SIGMA ('health.min_sigma'). Each sample then adds its
+*  distance from the baseline mean, in baseline standard deviations and at
+*  most HEALTH_CUSUM_CLIP, less HEALTH_CUSUM_K ('health.cusum_k') to the
+*  upper sum and the negative distance less the same to the lower sum,
+*  neither going below 0. Drift is
+*  raised once a sum reaches HEALTH_CUSUM_H ('health.cusum_h'), where it is
+*  held, and cleared once the sum is back to 0. The baseline is kept until
+*  REBASE, e.g. after a probe was replaced.
+*
+*  Every HEALTH_INTERVAL_MS ('health.interval_ms') a snapshot of the sensors
+*  with samples is stored in the 'sensor_health' table and the interval
+*  statistics start over. While the database is busy with a storage cycle
+*  the snapshot is taken again a second later, the interval going on until
+*  then. Over the control socket (see ipc.h):
+*
+*     SUB drift [sen_id]    - "PUB drift <sen_id> UP|DOWN|OK <value> <baseline>
+*                             <time>" per drift transition
+*     HEALTH [sen_id]       - One "HLT <sen_id> <count> <mean> <stddev> <min>
+*                             <max> <p50> <p95> <p99> <baseline> <cusum+>
+*                             <cusum-> <drift>" line per sensor, baseline "-"
+*                             while it is learned
+*     REBASE <sen_id>       - Learn the baseline of a sensor again
+*/
+
+/******************************************************************************/
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+
+#include "sample.h"
+#include "db.h"
+
+/******************************************************************************/
+
+/* Snapshot interval ('health.interval_ms', 0 stores none), sliding window
+*  in samples ('health.window', up to HEALTH_MAX_WINDOW) and baseline in
+*  samples ('health.baseline')
+*/
+#define HEALTH_INTERVAL_MS      (900000)
+#define HEALTH_WINDOW           (60)
+#define HEALTH_MAX_WINDOW       (128)
+#define HEALTH_BASELINE         (360)
+
+/* CUSUM slack and decision threshold in baseline standard deviations
+*  ('health.cusum_k', 'health.cusum_h') and floor of the baseline standard
+*  deviation in sensor units ('health.min_sigma'), the DS18B20 resolves
+*  0.0625 degree celsius
+*/
+#define HEALTH_CUSUM_K          (1.0)
+#define HEALTH_CUSUM_H          (10.0)
+#define HEALTH_MIN_SIGMA        (0.05)
+
+/* Largest distance of a sample from the baseline counted by the CUSUM, in
+*  baseline standard deviations, so bursts (e.g. of the dust sensor) do not
+*  raise drift on their own
+*/
+#define HEALTH_CUSUM_CLIP       (3.0)
+
+typedef struct
+{
+    uint32_t window;
+    uint32_t baseline;
+    double   cusum_k;
+    double   cusum_h;
+    double   min_sigma;
+} health_cfg_t;
+
+/* P-square estimator of one quantile: marker heights, actual and desired
+*  positions. The first 5 samples are kept sorted in 'q'.
+*/
+typedef struct
+{
+    double   q[5];
+    double   pos[5];
+    double   want[5];
+    uint32_t count;
+} health_p2_t;
+
+/* Monotonic deque of the sliding window, a ring of samples by sequence
+*  number with the extreme at the front
+*/
+typedef struct
+{
+    uint32_t seq[HEALTH_MAX_WINDOW];
+    int32_t  val[HEALTH_MAX_WINDOW];
+    uint16_t head;
+    uint16_t count;
+} health_deque_t;
+
+/* Statistics of a sensor, all zero is the state of a new sensor. Values in
+*  sensor units unless noted.
+*/
+typedef struct
+{
+    // Since the last snapshot
+    uint32_t       count;
+    double         mean;
+    double         m2;
+    health_p2_t    p50;
+    health_p2_t    p95;
+    health_p2_t    p99;
+
+    // Sliding window, values in 1 / SAMPLE_SCALE units
+    uint32_t       seq;
+    health_deque_t min;
+    health_deque_t max;
+
+    // Baseline and drift
+    uint32_t       base_count;
+    double         base_mean;
+    double         base_m2;
+    double         cusum_pos;
+    double         cusum_neg;
+    int8_t         drift;                       // 1 up, -1 down, 0 none
+} health_t;
+
+/******************************************************************************/
+
+/* Function declaration to read the configuration, add the HEALTH and
+*  REBASE commands to the control socket and start the snapshots.
+*  Evaluation thread only.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t health_init(void);
+
+/* Function declaration to add a sample to the statistics of its sensor.
+*  Evaluation thread only.
+*  @param[in] p_sample - Sample
+*  @return - None
+*/
+void health_eval(const sample_t * p_sample);
+
+/* Function declaration to store a last snapshot and stop the snapshots
+*  @return - None
+*/
+void health_close(void);
+
+/* Function declaration to get the configuration in use, the defaults before
+*  health_init()
+*  @param[out] p_cfg - Configuration
+*  @return - None
+*/
+void health_get_cfg(health_cfg_t * p_cfg);
+
+/* Function declaration to add a value to the statistics of a sensor
+*  @param[in] p_health - Statistics
+*  @param[in] p_cfg    - Configuration
+*  @param[in] sen_val  - Value in 1 / SAMPLE_SCALE units
+*  @return - uint8_t (1 if the drift state changed, 0 otherwise)
+*/
+uint8_t health_update(health_t * p_health, const health_cfg_t * p_cfg, int32_t sen_val);
+
+/* Function declaration to get a snapshot of the statistics of a sensor
+*  @param[in]  p_health - Statistics
+*  @param[in]  p_cfg    - Configuration
+*  @param[out] p_row    - Snapshot, 'sen_id' and 'health_time' are not set
+*  @return - None
+*/
+void health_snapshot(const health_t * p_health, const health_cfg_t * p_cfg, db_health_t * p_row);
+
+/* Function declaration to start the interval statistics over, the window,
+*  baseline and drift are kept
+*  @param[in] p_health - Statistics
+*  @return - None
+*/
+void health_reset(health_t * p_health);
+
+/* Function declaration to learn the baseline again, the drift is cleared
+*  @param[in] p_health - Statistics
+*  @return - None
+*/
+void health_rebase(health_t * p_health);
+
+#endif /* HEALTH_H */
@@ -0,0 +1,501 @@
+/******************************************************************************/
+
+/* File - ipc.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Local control socket. See ipc.h for details.
+*/
+
+/******************************************************************************/
+
+// accept4()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "common.h"
+#include "sched.h"
+#include "ipc.h"
+
+/******************************************************************************/
+
+/* Subscription of a client
+*/
+typedef struct
+{
+    char    topic[IPC_TOPIC_LEN];
+    int32_t id;
+} ipc_sub_t;
+
+/* Client slot, free if 'fd' is negative. Slots are static, so a client
+*  dropped while one of its requests runs stays valid memory.
+*/
+struct ipc_client
+{
+    int         fd;
+    sched_fd_t  watch;
+    char        in_buf[IPC_LINE_LEN];
+    uint16_t    in_len;
+    ipc_sub_t   subs[IPC_MAX_SUBS];
+    uint8_t     num_subs;
+};
+
+typedef struct
+{
+    const char   *p_name;
+    ipc_cmd_fn_t  fn;
+    const char   *p_help;
+} ipc_cmd_t;
+
+/******************************************************************************/
+
+static int           listen_fd = -1;
+static sched_fd_t    listen_watch;
+static char          socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static ipc_client_t  clients[IPC_MAX_CLIENTS];
+
+static ipc_cmd_t     cmds[IPC_MAX_CMDS];
+static uint8_t       num_cmds = 0;
+
+/******************************************************************************/
+
+/* Function declarations of the socket watchers
+*/
+static void ipc_accept(sched_fd_t * p_watch);
+static void ipc_read(sched_fd_t * p_watch);
+
+/* Function declaration to run one request line
+*  @param[in] p_client - Client
+*  @param[in] p_line   - Request, NUL terminated, without newline
+*  @return - None
+*/
+static void ipc_dispatch(ipc_client_t * p_client, char * p_line);
+
+/* Function declaration to send raw bytes. A client not able to take them
+*  right away (full socket buffer) is too slow and gets disconnected.
+*  @return - None
+*/
+static void ipc_send(ipc_client_t * p_client, const char * p_buf, size_t len);
+
+/* Function declaration to close a connection and free its slot
+*  @return - None
+*/
+static void ipc_drop(ipc_client_t * p_client);
+
+/* Function declarations of the built-in commands
+*/
+static uint8_t ipc_cmd_ping(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t ipc_cmd_help(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t ipc_cmd_sub(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t ipc_cmd_unsub(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t ipc_open(const char * p_path)
+{
+    struct sockaddr_un addr;
+    uint8_t            i;
+
+    for (i = 0; i < IPC_MAX_CLIENTS; i++)
+    {
+        clients[i].fd = -1;
+    }
+
+    if (strlen(p_path) >= sizeof(addr.sun_path))
+    {
+        printf("Socket path %s too long.\n", p_path);
+        return FAIL;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        printf("socket() failed (%s).\n", strerror(errno));
+        return FAIL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, p_path);
+    strcpy(socket_path, p_path);
+
+    // Left over by a previous run which did not exit cleanly
+    unlink(p_path);
+
+    if ((0 != bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))) ||
+        (0 != listen(listen_fd, IPC_MAX_CLIENTS)))
+    {
+        printf("Failed to listen on %s (%s).\n", p_path, strerror(errno));
+        close(listen_fd);
+        listen_fd = -1;
+        return FAIL;
+    }
+
+    if ((SUCCESS != sched_watch(&listen_watch, listen_fd, ipc_accept, NULL)) ||
+        (SUCCESS != ipc_register_cmd("PING", ipc_cmd_ping, "PING")) ||
+        (SUCCESS != ipc_register_cmd("HELP", ipc_cmd_help, "HELP")) ||
+        (SUCCESS != ipc_register_cmd("SUB", ipc_cmd_sub, "SUB <topic> [id]")) ||
+        (SUCCESS != ipc_register_cmd("UNSUB", ipc_cmd_unsub, "UNSUB <topic> [id]")))
+    {
+        ipc_close();
+        return FAIL;
+    }
+
+    printf("Control socket %s opened.\n", p_path);
+
+    return SUCCESS;
+}
+
+uint8_t ipc_register_cmd(const char * p_name, ipc_cmd_fn_t fn, const char * p_help)
+{
+    if (num_cmds >= IPC_MAX_CMDS)
+    {
+        printf("Too many control commands.\n");
+        return FAIL;
+    }
+
+    cmds[num_cmds].p_name = p_name;
+    cmds[num_cmds].fn = fn;
+    cmds[num_cmds].p_help = p_help;
+    num_cmds++;
+
+    return SUCCESS;
+}
+
+void ipc_reply(ipc_client_t * p_client, const char * p_fmt, ...)
+{
+    char    line[IPC_LINE_LEN];
+    va_list args;
+    int     len;
+
+    va_start(args, p_fmt);
+    len = vsnprintf(line, sizeof(line) - 1, p_fmt, args);
+    va_end(args);
+
+    if (len < 0)
+    {
+        return;
+    }
+    if (len > (int)(sizeof(line) - 2))
+    {
+        len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+
+    ipc_send(p_client, line, (size_t)len);
+}
+
+void ipc_reply_raw(ipc_client_t * p_client, const void * p_buf, size_t len)
+{
+    ipc_send(p_client, (const char *)p_buf, len);
+}
+
+void ipc_publish(const char * p_topic, int32_t id, const char * p_fmt, ...)
+{
+    char    line[IPC_LINE_LEN];
+    va_list args;
+    int     len, payload_len;
+    uint8_t i, j;
+
+    if (listen_fd < 0)
+    {
+        return;
+    }
+
+    len = snprintf(line, sizeof(line), "PUB %s ", p_topic);
+
+    va_start(args, p_fmt);
+    payload_len = vsnprintf(&line[len], sizeof(line) - len - 1, p_fmt, args);
+    va_end(args);
+
+    if (payload_len < 0)
+    {
+        return;
+    }
+    len += payload_len;
+    if (len > (int)(sizeof(line) - 2))
+    {
+        len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+
+    for (i = 0; i < IPC_MAX_CLIENTS; i++)
+    {
+        for (j = 0; (clients[i].fd >= 0) && (j < clients[i].num_subs); j++)
+        {
+            if ((0 == strcmp(clients[i].subs[j].topic, p_topic)) &&
+                ((IPC_ID_ALL == clients[i].subs[j].id) || (id == clients[i].subs[j].id)))
+            {
+                ipc_send(&clients[i], line, (size_t)len);
+                break;
+            }
+        }
+    }
+}
+
+void ipc_close(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < IPC_MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd >= 0)
+        {
+            ipc_drop(&clients[i]);
+        }
+    }
+
+    if (listen_fd >= 0)
+    {
+        sched_unwatch(&listen_watch);
+        close(listen_fd);
+        listen_fd = -1;
+        unlink(socket_path);
+    }
+    num_cmds = 0;
+}
+
+/******************************************************************************/
+
+static void ipc_accept(sched_fd_t * p_watch)
+{
+    ipc_client_t *p_client;
+    int           fd;
+    uint8_t       i;
+
+    fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    for (i = 0; (i < IPC_MAX_CLIENTS) && (clients[i].fd >= 0); i++)
+    {
+    }
+    if (i >= IPC_MAX_CLIENTS)
+    {
+        printf("Too many control clients, connection refused.\n");
+        close(fd);
+        return;
+    }
+
+    p_client = &clients[i];
+    if (SUCCESS != sched_watch(&p_client->watch, fd, ipc_read, p_client))
+    {
+        close(fd);
+        return;
+    }
+    p_client->fd = fd;
+    p_client->in_len = 0;
+    p_client->num_subs = 0;
+
+    #if defined(RUN_TIME_LOG)
+        printf("Control client connected.\n");
+    #endif
+}
+
+static void ipc_read(sched_fd_t * p_watch)
+{
+    ipc_client_t *p_client = (ipc_client_t *)p_watch->p_arg;
+    char         *p_nl;
+    ssize_t       len;
+    uint16_t      line_len;
+
+    len = recv(p_client->fd, &p_client->in_buf[p_client->in_len],
+                            sizeof(p_client->in_buf) - 1 - p_client->in_len, 0);
+    if ((len < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+    {
+        return;
+    }
+    if (len <= 0)
+    {
+        ipc_drop(p_client);
+        return;
+    }
+    p_client->in_len += (uint16_t)len;
+    p_client->in_buf[p_client->in_len] = '\0';
+
+    // Run every complete line, a partial one waits for more input
+    while ((p_client->fd >= 0) &&
+           (NULL != (p_nl = memchr(p_client->in_buf, '\n', p_client->in_len))))
+    {
+        *p_nl = '\0';
+        line_len = (uint16_t)(p_nl - p_client->in_buf) + 1;
+        if ((p_nl > p_client->in_buf) && ('\r' == p_nl[-1]))
+        {
+            p_nl[-1] = '\0';
+        }
+
+        ipc_dispatch(p_client, p_client->in_buf);
+
+        memmove(p_client->in_buf, &p_client->in_buf[line_len], p_client->in_len - line_len + 1);
+        p_client->in_len -= line_len;
+    }
+
+    if ((p_client->fd >= 0) && (p_client->in_len >= (sizeof(p_client->in_buf) - 1)))
+    {
+        ipc_send(p_client, "ERR line too long\n", 18);
+        ipc_drop(p_client);
+    }
+}
+
+static void ipc_dispatch(ipc_client_t * p_client, char * p_line)
+{
+    char       *argv[IPC_MAX_ARGS];
+    char       *p_save = NULL;
+    const char *p_err = "failed";
+    int         argc = 0;
+    uint8_t     i;
+
+    for (argv[argc] = strtok_r(p_line, " \t", &p_save);
+         (NULL != argv[argc]) && (argc < (IPC_MAX_ARGS - 1));
+         argv[argc] = strtok_r(NULL, " \t", &p_save))
+    {
+        argc++;
+    }
+
+    if (0 == argc)
+    {
+        return;
+    }
+
+    for (i = 0; i < num_cmds; i++)
+    {
+        if (0 == strcasecmp(argv[0], cmds[i].p_name))
+        {
+            break;
+        }
+    }
+
+    if (i >= num_cmds)
+    {
+        ipc_reply(p_client, "ERR unknown command %s", argv[0]);
+    }
+    else if (SUCCESS == cmds[i].fn(p_client, argc, argv, &p_err))
+    {
+        ipc_send(p_client, "OK\n", 3);
+    }
+    else
+    {
+        ipc_reply(p_client, "ERR %s", p_err);
+    }
+}
+
+static void ipc_send(ipc_client_t * p_client, const char * p_buf, size_t len)
+{
+    ssize_t sent;
+
+    if (p_client->fd < 0)
+    {
+        return;
+    }
+
+    sent = send(p_client->fd, p_buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent != (ssize_t)len)
+    {
+        // A subscriber not reading its socket must not stall the scheduler
+        printf("Control client too slow or gone, disconnected.\n");
+        ipc_drop(p_client);
+    }
+}
+
+static void ipc_drop(ipc_client_t * p_client)
+{
+    if (p_client->fd < 0)
+    {
+        return;
+    }
+
+    sched_unwatch(&p_client->watch);
+    close(p_client->fd);
+    p_client->fd = -1;
+    p_client->num_subs = 0;
+}
+
+static uint8_t ipc_cmd_ping(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    ipc_reply(p_client, "PONG");
+
+    return SUCCESS;
+}
+
+static uint8_t ipc_cmd_help(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    uint8_t i;
+
+    for (i = 0; i < num_cmds; i++)
+    {
+        ipc_reply(p_client, "%s", cmds[i].p_help);
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t ipc_cmd_sub(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    ipc_sub_t *p_sub;
+
+    if ((argc < 2) || (strlen(argv[1]) >= IPC_TOPIC_LEN))
+    {
+        *p_err = "usage SUB <topic> [id]";
+        return FAIL;
+    }
+    if (p_client->num_subs >= IPC_MAX_SUBS)
+    {
+        *p_err = "too many subscriptions";
+        return FAIL;
+    }
+
+    p_sub = &p_client->subs[p_client->num_subs++];
+    strcpy(p_sub->topic, argv[1]);
+    p_sub->id = (argc > 2) ? ((int32_t)atol(argv[2])) : (IPC_ID_ALL);
+
+    return SUCCESS;
+}
+
+static uint8_t ipc_cmd_unsub(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    int32_t id = (argc > 2) ? ((int32_t)atol(argv[2])) : (IPC_ID_ALL);
+    uint8_t i = 0;
+
+    if (argc < 2)
+    {
+        *p_err = "usage UNSUB <topic> [id]";
+        return FAIL;
+    }
+
+    // Without an ID all subscriptions of the topic are cancelled
+    while (i < p_client->num_subs)
+    {
+        if ((0 == strcmp(p_client->subs[i].topic, argv[1])) &&
+            ((IPC_ID_ALL == id) || (id == p_client->subs[i].id)))
+        {
+            p_client->subs[i] = p_client->subs[--p_client->num_subs];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,108 @@
+/******************************************************************************/
+
+/* File - ipc.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Local control socket (Unix domain, stream) served from the scheduler loop.
+*  The protocol is line based ASCII, one request per line:
+*
+*     <COMMAND> [arg ...]\n
+*
+*  A request is answered by zero or more data lines and a final status line,
+*  either "OK" or "ERR <reason>". Clients subscribed to a topic receive
+*  "PUB <topic> <payload>" lines at any time, e.g. "PUB val 1 25.06 1792106091"
+*  for every new sample. Built-in commands:
+*
+*     PING                  - "PONG"
+*     HELP                  - List of commands
+*     SUB <topic> [id]      - Subscribe to a topic, optionally a single ID
+*     UNSUB <topic> [id]    - Cancel a subscription
+*
+*  Further commands are added by the modules with ipc_register_cmd().
+*/
+
+/******************************************************************************/
+
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/******************************************************************************/
+
+/* Limits of the server
+*/
+#define IPC_MAX_CLIENTS         (8)
+#define IPC_MAX_CMDS            (32)
+#define IPC_MAX_SUBS            (16)
+#define IPC_MAX_ARGS            (8)
+#define IPC_LINE_LEN            (256)
+#define IPC_TOPIC_LEN           (16)
+
+/* Subscription to all IDs of a topic
+*/
+#define IPC_ID_ALL              (-1)
+
+typedef struct ipc_client ipc_client_t;
+
+/* Command handler. argv[0] is the command itself. The handler sends data
+*  lines with ipc_reply() and returns the status, the status line is sent by
+*  the server.
+*  @return - uint8_t ( SUCCESS(1) sends "OK", FAIL(0) sends "ERR <p_err>" )
+*/
+typedef uint8_t (*ipc_cmd_fn_t)(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+/* Function declaration to create the socket and watch it in the scheduler.
+*  A stale socket file at the same path is removed.
+*  @param[in] p_path - Path of the socket file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t ipc_open(const char * p_path);
+
+/* Function declaration to add a command
+*  @param[in] p_name - Command name (upper case by convention)
+*  @param[in] fn     - Handler
+*  @param[in] p_help - One line usage, shown by HELP
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t ipc_register_cmd(const char * p_name, ipc_cmd_fn_t fn, const char * p_help);
+
+/* Function declaration to send a data line to a client (printf format, the
+*  newline is appended)
+*  @param[in] p_client - Client of the running request
+*  @param[in] p_fmt    - Format string
+*  @return - None
+*/
+void ipc_reply(ipc_client_t * p_client, const char * p_fmt, ...)
+                                            __attribute__ ((format (printf, 2, 3)));
+
+/* Function declaration to send a block of data lines or binary data (which
+*  a data line announces with its size) to a client as it is
+*  @param[in] p_client - Client of the running request
+*  @param[in] p_buf    - Data
+*  @param[in] len      - Size of the data in bytes
+*  @return - None
+*/
+void ipc_reply_raw(ipc_client_t * p_client, const void * p_buf, size_t len);
+
+/* Function declaration to push a message to all clients subscribed to a
+*  topic and ID
+*  @param[in] p_topic - Topic name
+*  @param[in] id      - ID the message belongs to (e.g. sen_id)
+*  @param[in] p_fmt   - Format string of the payload
+*  @return - None
+*/
+void ipc_publish(const char * p_topic, int32_t id, const char * p_fmt, ...)
+                                            __attribute__ ((format (printf, 3, 4)));
+
+/* Function declaration to disconnect all clients and remove the socket
+*  @return - None
+*/
+void ipc_close(void);
+
+#endif /* IPC_H */
@@ -0,0 +1,153 @@
+/******************************************************************************/
+
+/* File - lat.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Latency statistics with a log-linear histogram. See lat.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "lat.h"
+
+/******************************************************************************/
+
+#define NSEC_PER_USEC           (1000L)
+#define NSEC_PER_SEC            (1000000000L)
+
+/******************************************************************************/
+
+/* Function declarations to map microseconds to a bucket and back
+*/
+static uint16_t lat_bucket(uint64_t us);
+static uint64_t lat_bucket_low_us(uint16_t bucket);
+
+/******************************************************************************/
+
+int64_t lat_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((int64_t)now.tv_sec * NSEC_PER_SEC) + now.tv_nsec;
+}
+
+void lat_reset(lat_t * p_lat)
+{
+    memset(p_lat, 0, sizeof(lat_t));
+}
+
+void lat_add(lat_t * p_lat, int64_t ns)
+{
+    if (ns < 0)
+    {
+        ns = 0;
+    }
+
+    if ((0 == p_lat->count) || (ns < p_lat->min_ns))
+    {
+        p_lat->min_ns = ns;
+    }
+    if (ns > p_lat->max_ns)
+    {
+        p_lat->max_ns = ns;
+    }
+    p_lat->count++;
+    p_lat->sum_ns += ns;
+    p_lat->hist[lat_bucket((uint64_t)ns / NSEC_PER_USEC)]++;
+}
+
+int64_t lat_percentile(const lat_t * p_lat, uint8_t percent)
+{
+    uint64_t rank, seen = 0;
+    int64_t  upper_ns;
+    uint16_t i;
+
+    if (0 == p_lat->count)
+    {
+        return 0;
+    }
+
+    rank = ((p_lat->count * percent) + 99) / 100;
+    if (0 == rank)
+    {
+        rank = 1;
+    }
+
+    for (i = 0; i < LAT_BUCKETS; i++)
+    {
+        seen += p_lat->hist[i];
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+
+    // Upper bound of the bucket, but never beyond what was really seen
+    upper_ns = (i + 1 < LAT_BUCKETS) ?
+                    ((int64_t)lat_bucket_low_us(i + 1) * NSEC_PER_USEC) - 1 : (p_lat->max_ns);
+
+    return (upper_ns < p_lat->max_ns) ? (upper_ns) : (p_lat->max_ns);
+}
+
+void lat_print(const lat_t * p_lat, const char * p_name)
+{
+    if (0 == p_lat->count)
+    {
+        printf("%s: no samples.\n", p_name);
+        return;
+    }
+
+    printf("%s (%llu samples): min %0.1f us, mean %0.1f us, p50 %0.1f us, "
+           "p99 %0.1f us, max %0.1f us.\n", p_name, (unsigned long long)p_lat->count,
+           p_lat->min_ns / 1000.0, ((double)p_lat->sum_ns / p_lat->count) / 1000.0,
+           lat_percentile(p_lat, 50) / 1000.0, lat_percentile(p_lat, 99) / 1000.0,
+           p_lat->max_ns / 1000.0);
+}
+
+/******************************************************************************/
+
+/* Values below LAT_SUB_BUCKETS us get a bucket each, above a power of two
+*  2^e is split into LAT_SUB_BUCKETS buckets
+*/
+static uint16_t lat_bucket(uint64_t us)
+{
+    uint16_t e = 0;
+    uint32_t bucket;
+
+    if (us < LAT_SUB_BUCKETS)
+    {
+        return (uint16_t)us;
+    }
+
+    while ((us >> (e + 1)) != 0)
+    {
+        e++;
+    }
+
+    // e >= 2 here, the two bits below the leading one select the sub-bucket
+    bucket = (LAT_SUB_BUCKETS * (e - 1)) + ((us >> (e - 2)) & (LAT_SUB_BUCKETS - 1));
+
+    return (bucket < LAT_BUCKETS) ? ((uint16_t)bucket) : (LAT_BUCKETS - 1);
+}
+
+static uint64_t lat_bucket_low_us(uint16_t bucket)
+{
+    uint16_t e;
+
+    if (bucket < LAT_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    e = (bucket / LAT_SUB_BUCKETS) + 1;
+
+    return (uint64_t)(LAT_SUB_BUCKETS + (bucket % LAT_SUB_BUCKETS)) << (e - 2);
+}
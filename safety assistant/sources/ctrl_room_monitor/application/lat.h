@@ -0,0 +1,70 @@
+/******************************************************************************/
+
+/* File - lat.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Latency statistics with a log-linear histogram: four buckets per power of
+*  two of microseconds, so percentiles are within 25 % of the true value
+*  from 1 us up to days, in a fixed size object. Used for the acquisition
+*  jitter (task run time versus its deadline) and the sample-to-disk
+*  latency (acquisition until commit). Not thread-safe, every thread keeps
+*  its own statistics.
+*/
+
+/******************************************************************************/
+
+#ifndef LAT_H
+#define LAT_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+#define LAT_SUB_BUCKETS         (4)
+#define LAT_BUCKETS             (LAT_SUB_BUCKETS * 40)
+
+typedef struct
+{
+    uint64_t count;
+    int64_t  min_ns;
+    int64_t  max_ns;
+    int64_t  sum_ns;
+    uint32_t hist[LAT_BUCKETS];
+} lat_t;
+
+/******************************************************************************/
+
+/* Function declaration to get the current CLOCK_MONOTONIC time
+*  @return - int64_t (nsecs)
+*/
+int64_t lat_now_ns(void);
+
+/* Function declaration to clear the statistics
+*  @param[in] p_lat - Statistics
+*  @return - None
+*/
+void lat_reset(lat_t * p_lat);
+
+/* Function declaration to add a latency, negative ones count as 0
+*  @param[in] p_lat - Statistics
+*  @param[in] ns    - Latency in nsecs
+*  @return - None
+*/
+void lat_add(lat_t * p_lat, int64_t ns);
+
+/* Function declaration to get a percentile
+*  @param[in] p_lat   - Statistics
+*  @param[in] percent - Percentile (0 ~ 100)
+*  @return - int64_t (upper bound of the bucket in nsecs, 0 if empty)
+*/
+int64_t lat_percentile(const lat_t * p_lat, uint8_t percent);
+
+/* Function declaration to print count and min/mean/p50/p99/max
+*  @param[in] p_lat  - Statistics
+*  @param[in] p_name - Name printed in front
+*  @return - None
+*/
+void lat_print(const lat_t * p_lat, const char * p_name);
+
+#endif /* LAT_H */
@@ -0,0 +1,161 @@
+/******************************************************************************/
+
+/* File - latest.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  In-memory table of the latest sensor values. See latest.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ipc.h"
+#include "sample.h"
+#include "latest.h"
+
+/******************************************************************************/
+
+/* Topic of the new sample pushes
+*/
+#define LATEST_TOPIC            "val"
+
+typedef struct
+{
+    int32_t  sen_val;
+    time_t   sen_time;
+    uint8_t  is_valid;
+} latest_t;
+
+/******************************************************************************/
+
+// Indexed by 'sen_id', which is assigned densely from 1 by the registry
+static latest_t *p_latest = NULL;
+static uint16_t  max_latest = 0;
+
+/******************************************************************************/
+
+/* Function declarations of the control commands
+*/
+static uint8_t latest_cmd_get(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t latest_cmd_list(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t latest_init(void)
+{
+    if ((SUCCESS != ipc_register_cmd("GET", latest_cmd_get, "GET <sen_id>")) ||
+        (SUCCESS != ipc_register_cmd("LIST", latest_cmd_list, "LIST")))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+void latest_update(uint16_t sen_id, int32_t sen_val, time_t sen_time)
+{
+    latest_t *p_table;
+    uint32_t  new_max;
+
+    if (sen_id >= max_latest)
+    {
+        new_max = (max_latest) ? (max_latest) : (16);
+        while (new_max <= sen_id)
+        {
+            new_max *= 2;
+        }
+        if (new_max > 0xFFFF)
+        {
+            new_max = 0xFFFF;
+        }
+
+        p_table = (latest_t *) realloc(p_latest, new_max * sizeof(latest_t));
+        if (NULL == p_table)
+        {
+            printf("realloc() failed to allocate.\n");
+            return;
+        }
+        memset(&p_table[max_latest], 0, (new_max - max_latest) * sizeof(latest_t));
+        p_latest = p_table;
+        max_latest = (uint16_t)new_max;
+    }
+
+    p_latest[sen_id].sen_val = sen_val;
+    p_latest[sen_id].sen_time = sen_time;
+    p_latest[sen_id].is_valid = 1;
+
+    ipc_publish(LATEST_TOPIC, sen_id, "%d %0.2f %ld", sen_id, (double)sen_val / SAMPLE_SCALE,
+                                                                            (long)sen_time);
+}
+
+uint8_t latest_get(uint16_t sen_id, int32_t * p_sen_val, time_t * p_sen_time)
+{
+    if ((sen_id >= max_latest) || !p_latest[sen_id].is_valid)
+    {
+        return FAIL;
+    }
+
+    *p_sen_val = p_latest[sen_id].sen_val;
+    *p_sen_time = p_latest[sen_id].sen_time;
+
+    return SUCCESS;
+}
+
+/******************************************************************************/
+
+static uint8_t latest_cmd_get(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    int32_t       sen_val;
+    time_t        sen_time;
+    char         *p_end;
+    unsigned long sen_id;
+
+    *p_err = "usage GET <sen_id>";
+    if (argc < 2)
+    {
+        return FAIL;
+    }
+
+    sen_id = strtoul(argv[1], &p_end, 10);
+    if ((p_end == argv[1]) || ('\0' != *p_end) || (sen_id > 0xFFFF))
+    {
+        return FAIL;
+    }
+
+    if (SUCCESS != latest_get((uint16_t)sen_id, &sen_val, &sen_time))
+    {
+        *p_err = "no data";
+        return FAIL;
+    }
+
+    ipc_reply(p_client, "VAL %lu %0.2f %ld", sen_id, (double)sen_val / SAMPLE_SCALE,
+                                                                            (long)sen_time);
+
+    return SUCCESS;
+}
+
+static uint8_t latest_cmd_list(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    uint16_t sen_id;
+
+    for (sen_id = 0; sen_id < max_latest; sen_id++)
+    {
+        if (p_latest[sen_id].is_valid)
+        {
+            ipc_reply(p_client, "VAL %d %0.2f %ld", sen_id,
+                      (double)p_latest[sen_id].sen_val / SAMPLE_SCALE,
+                                                    (long)p_latest[sen_id].sen_time);
+        }
+    }
+
+    return SUCCESS;
+}
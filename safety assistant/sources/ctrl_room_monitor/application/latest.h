@@ -0,0 +1,48 @@
+/******************************************************************************/
+
+/* File - latest.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  In-memory table of the latest value of every sensor, updated with each
+*  stored sample. It is served over the control socket (see ipc.h), so the
+*  dashboards read current values without touching the database:
+*
+*     GET <sen_id>          - "VAL <sen_id> <value> <time>"
+*     LIST                  - One "VAL" line per sensor with data
+*     SUB val [sen_id]      - "PUB val <sen_id> <value> <time>" per new sample
+*/
+
+/******************************************************************************/
+
+#ifndef LATEST_H
+#define LATEST_H
+
+#include <stdint.h>
+#include <time.h>
+
+/******************************************************************************/
+
+/* Function declaration to add the GET and LIST commands to the control socket
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t latest_init(void);
+
+/* Function declaration to set the latest value of a sensor and push it to
+*  the subscribers of topic "val"
+*  @param[in] sen_id   - Sensor ID
+*  @param[in] sen_val  - Sensor value in 1 / SAMPLE_SCALE units
+*  @param[in] sen_time - Acquisition time (unix seconds)
+*  @return - None
+*/
+void latest_update(uint16_t sen_id, int32_t sen_val, time_t sen_time);
+
+/* Function declaration to get the latest value of a sensor
+*  @param[in]  sen_id     - Sensor ID
+*  @param[out] p_sen_val  - Sensor value in 1 / SAMPLE_SCALE units
+*  @param[out] p_sen_time - Acquisition time (unix seconds)
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if there is no value yet )
+*/
+uint8_t latest_get(uint16_t sen_id, int32_t * p_sen_val, time_t * p_sen_time);
+
+#endif /* LATEST_H */
@@ -0,0 +1,732 @@
+/******************************************************************************/
+
+/* File - load.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Load control. See load.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "sched.h"
+#include "worker.h"
+#include "ipc.h"
+#include "latest.h"
+#include "lat.h"
+#include "db.h"
+#include "stats.h"
+#include "load.h"
+
+/******************************************************************************/
+
+/* Commands queued to the load thread
+*/
+#define LOAD_QUEUE_CMDS         (64)
+
+/* Transitions are stored LOAD_LOG_MS ('load.log_ms') after the first one of
+*  a batch, at once when LOAD_LOG_BATCH are pending. At most LOAD_LOG_PENDING
+*  (plus LOAD_LOG_QUEUE queued to the log thread) wait for the database, the
+*  oldest is dropped on overflow. A failed write is retried after
+*  LOAD_RETRY_MS.
+*/
+#define LOAD_LOG_MS             (1000)
+#define LOAD_LOG_BATCH          (64)
+#define LOAD_LOG_PENDING        (1024)
+#define LOAD_LOG_QUEUE          (1024)
+#define LOAD_RETRY_MS           (1000)
+
+/* Defaults of the per load keys 'load.<type>.*'
+*/
+#define LOAD_PWM_PERIOD_US      (1000)
+#define LOAD_DUTY               (100)
+#define LOAD_MIN_DUTY           (20)
+#define LOAD_STEP               (5)
+
+#define LOAD_NAME_LEN           (16)
+
+typedef enum
+{
+    LOAD_RULE_NONE = 0,
+    LOAD_RULE_HYSTERESIS,
+    LOAD_RULE_PROPORTIONAL
+} load_rule_t;
+
+typedef struct
+{
+    // Set by load_start(), read only afterwards
+    char         name[LOAD_NAME_LEN];
+    uint8_t      type;
+    int          pin;
+    uint8_t      is_pwm;
+    int          period_us;
+    load_rule_t  rule;
+    uint16_t     sensors[LOAD_MAX_SENSORS];
+    uint8_t      num_sensors;
+    double       on_above;
+    double       off_below;
+    double       low;
+    double       high;
+    uint8_t      duty;                          // Percent, all of them
+    uint8_t      min_duty;
+    uint8_t      max_duty;
+    uint8_t      step;
+    uint8_t      has_initial;                   // 'initial' configured
+
+    // Evaluation thread
+    uint8_t      is_manual;
+    uint8_t      level;                         // Last level requested
+    uint32_t     seq;                           // Last command queued
+
+    // Load thread
+    hal_gpio_t  *p_gpio;
+    hal_pwm_t   *p_pwm;
+    char         logged[4];                     // Last state handed to the log
+
+    // Written by the load thread, guarded by 'load_lock'
+    uint8_t      applied_level;
+    uint32_t     applied_seq;
+    int64_t      applied_ns;
+    int64_t      latency_ns;
+} load_t;
+
+typedef struct
+{
+    int64_t      t_cmd_ns;                      // CLOCK_MONOTONIC when requested
+    uint32_t     seq;
+    uint8_t      index;
+    uint8_t      level;                         // Percent, a GPIO load is on above 0
+} load_cmd_t;
+
+/******************************************************************************/
+
+static load_t          loads[LOAD_MAX];
+static uint8_t         num_loads = 0;
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static worker_t        load_worker;
+static worker_t        log_worker;
+
+// Log thread only
+static db_load_event_t pending[LOAD_LOG_PENDING];
+static uint16_t        num_pending = 0;
+static sched_task_t    log_task;
+static uint32_t        log_ms;
+
+/******************************************************************************/
+
+/* Function declaration to read the configuration of a load
+*  @param[out] p_load - Load
+*  @param[in]  type   - Load type
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the load is not configured )
+*/
+static uint8_t load_config(load_t * p_load, uint8_t type);
+
+/* Function declaration to queue a command for the load thread
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the queue is full )
+*/
+static uint8_t load_submit(load_t * p_load, uint8_t level);
+
+/* Function declaration to run the rule of a load on the latest values
+*  @return - None
+*/
+static void    load_rule_eval(load_t * p_load);
+
+/* Function declaration to set an output, load thread only
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t load_apply(load_t * p_load, uint8_t level);
+
+/* Function declaration to get the state of a level as stored in 'loads'
+*/
+static void    load_status(const load_t * p_load, uint8_t level, char * p_status);
+
+/* Function declarations of the worker callbacks
+*/
+static uint8_t load_init_fn(worker_t * p_worker);
+static void    load_item_fn(worker_t * p_worker, const void * p_item);
+static void    load_fini_fn(worker_t * p_worker);
+static uint8_t log_init_fn(worker_t * p_worker);
+static void    log_item_fn(worker_t * p_worker, const void * p_item);
+static void    log_fini_fn(worker_t * p_worker);
+
+/* Function declaration to store the pending transitions, log thread only
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t log_flush(void);
+static void    log_task_fn(sched_task_t * p_task);
+
+/* Function declarations of the control commands
+*/
+static uint8_t load_cmd_load(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+static uint8_t load_cmd_loads(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t load_start(void)
+{
+    uint8_t type;
+
+    for (type = 1; type <= LOAD_MAX; type++)
+    {
+        if (SUCCESS == load_config(&loads[num_loads], type))
+        {
+            num_loads++;
+        }
+    }
+
+    if (0 == num_loads)
+    {
+        return SUCCESS;
+    }
+
+    // The log thread first, it takes the states set at start
+    log_ms = (uint32_t)config_get_int(LOAD_LOG_MS, "load.log_ms");
+    if (SUCCESS != worker_start(&log_worker, "Load log", sizeof(db_load_event_t),
+                                LOAD_LOG_QUEUE, log_init_fn, log_item_fn, log_fini_fn, NULL))
+    {
+        num_loads = 0;
+        return FAIL;
+    }
+
+    if (SUCCESS != worker_start(&load_worker, "Load", sizeof(load_cmd_t), LOAD_QUEUE_CMDS,
+                                load_init_fn, load_item_fn, load_fini_fn, NULL))
+    {
+        worker_stop(&log_worker);
+        num_loads = 0;
+        return FAIL;
+    }
+
+    printf("%u load(s) in use.\n", num_loads);
+
+    return SUCCESS;
+}
+
+uint8_t load_register_cmd(void)
+{
+    if ((SUCCESS != ipc_register_cmd("LOAD", load_cmd_load, "LOAD <name|type> on|off|auto|<duty>")) ||
+        (SUCCESS != ipc_register_cmd("LOADS", load_cmd_loads, "LOADS")))
+    {
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+void load_eval(const sample_t * p_sample)
+{
+    uint8_t i;
+    uint8_t j;
+
+    for (i = 0; i < num_loads; i++)
+    {
+        if ((LOAD_RULE_NONE == loads[i].rule) || loads[i].is_manual)
+        {
+            continue;
+        }
+
+        for (j = 0; j < loads[i].num_sensors; j++)
+        {
+            if (p_sample->sen_id == loads[i].sensors[j])
+            {
+                load_rule_eval(&loads[i]);
+                break;
+            }
+        }
+    }
+}
+
+void load_stop(void)
+{
+    if (0 == num_loads)
+    {
+        return;
+    }
+
+    // The load thread feeds the log thread, it is stopped first
+    worker_stop(&load_worker);
+    worker_stop(&log_worker);
+    num_loads = 0;
+}
+
+/******************************************************************************/
+
+static uint8_t load_config(load_t * p_load, uint8_t type)
+{
+    const char *p_val;
+    char       *p_end;
+    long        sen_id;
+
+    memset(p_load, 0, sizeof(load_t));
+
+    p_load->pin = (int)config_get_int(-1, "load.%u.pin", type);
+    if (p_load->pin < 0)
+    {
+        return FAIL;
+    }
+
+    p_load->type = type;
+    snprintf(p_load->name, sizeof(p_load->name), "%s",
+                                config_get_str("", "load.%u.name", type));
+    if ('\0' == p_load->name[0])
+    {
+        snprintf(p_load->name, sizeof(p_load->name), "load%u", type);
+    }
+    p_load->is_pwm = (0 == strcmp(config_get_str("gpio", "load.%u.output", type), "pwm"));
+    p_load->period_us = (int)config_get_int(LOAD_PWM_PERIOD_US, "load.%u.period_us", type);
+
+    p_val = config_get_str("none", "load.%u.rule", type);
+    if (0 == strcmp(p_val, "hysteresis"))
+    {
+        p_load->rule = LOAD_RULE_HYSTERESIS;
+    }
+    else if (0 == strcmp(p_val, "proportional"))
+    {
+        p_load->rule = LOAD_RULE_PROPORTIONAL;
+    }
+    else if (0 != strcmp(p_val, "none"))
+    {
+        printf("Unknown rule '%s' of load %s.\n", p_val, p_load->name);
+    }
+
+    // Comma separated sensor IDs, their mean is the input of the rule
+    p_val = config_get_str("", "load.%u.sensors", type);
+    while (('\0' != *p_val) && (p_load->num_sensors < LOAD_MAX_SENSORS))
+    {
+        sen_id = strtol(p_val, &p_end, 10);
+        if (p_end == p_val)
+        {
+            break;
+        }
+        if ((sen_id > 0) && (sen_id <= 0xFFFF))
+        {
+            p_load->sensors[p_load->num_sensors++] = (uint16_t)sen_id;
+        }
+        p_val = ((',' == *p_end) || (' ' == *p_end)) ? (p_end + 1) : (p_end);
+    }
+    if ((LOAD_RULE_NONE != p_load->rule) && (0 == p_load->num_sensors))
+    {
+        printf("Rule of load %s has no sensors.\n", p_load->name);
+        p_load->rule = LOAD_RULE_NONE;
+    }
+
+    p_load->on_above = config_get_double(0.0, "load.%u.on_above", type);
+    p_load->off_below = config_get_double(p_load->on_above, "load.%u.off_below", type);
+    p_load->low = config_get_double(0.0, "load.%u.low", type);
+    p_load->high = config_get_double(p_load->low + 1.0, "load.%u.high", type);
+    p_load->duty = (uint8_t)config_get_int(LOAD_DUTY, "load.%u.duty", type);
+    p_load->min_duty = (uint8_t)config_get_int(LOAD_MIN_DUTY, "load.%u.min_duty", type);
+    p_load->max_duty = (uint8_t)config_get_int(LOAD_DUTY, "load.%u.max_duty", type);
+    p_load->step = (uint8_t)config_get_int(LOAD_STEP, "load.%u.step", type);
+    if ((p_load->duty > 100) || (p_load->max_duty > 100) || (p_load->min_duty > p_load->max_duty) ||
+        (0 == p_load->step) || (p_load->high <= p_load->low))
+    {
+        printf("Invalid duty cycle or range of load %s, rule not used.\n", p_load->name);
+        p_load->rule = LOAD_RULE_NONE;
+    }
+
+    p_load->has_initial = (NULL != config_get_str(NULL, "load.%u.initial", type));
+    p_load->level = (uint8_t)config_get_int(0, "load.%u.initial", type);
+    if (p_load->level > 100)
+    {
+        p_load->level = 100;
+    }
+    p_load->is_manual = (LOAD_RULE_NONE == p_load->rule);
+
+    return SUCCESS;
+}
+
+static uint8_t load_submit(load_t * p_load, uint8_t level)
+{
+    load_cmd_t cmd;
+
+    cmd.t_cmd_ns = lat_now_ns();
+    cmd.seq = p_load->seq + 1;
+    cmd.index = (uint8_t)(p_load - loads);
+    cmd.level = level;
+
+    if (SUCCESS != worker_submit(&load_worker, &cmd))
+    {
+        stats_count(STATS_LOAD_ERRORS, 1);
+        return FAIL;
+    }
+    p_load->seq = cmd.seq;
+    p_load->level = level;
+
+    return SUCCESS;
+}
+
+static void load_rule_eval(load_t * p_load)
+{
+    int32_t sen_val;
+    time_t  sen_time;
+    double  value = 0.0;
+    double  duty;
+    uint8_t num_values = 0;
+    uint8_t level = p_load->level;
+    uint8_t i;
+
+    for (i = 0; i < p_load->num_sensors; i++)
+    {
+        if (SUCCESS == latest_get(p_load->sensors[i], &sen_val, &sen_time))
+        {
+            value += (double)sen_val / SAMPLE_SCALE;
+            num_values++;
+        }
+    }
+    if (0 == num_values)
+    {
+        return;
+    }
+    value /= num_values;
+
+    if (LOAD_RULE_HYSTERESIS == p_load->rule)
+    {
+        if ((0 == level) && (value >= p_load->on_above))
+        {
+            level = p_load->duty;
+        }
+        else if ((level > 0) && (value < p_load->off_below))
+        {
+            level = 0;
+        }
+    }
+    else if (value < p_load->low)
+    {
+        level = 0;
+    }
+    else
+    {
+        duty = p_load->min_duty + ((value - p_load->low) / (p_load->high - p_load->low)) *
+                                            (p_load->max_duty - p_load->min_duty);
+        duty = p_load->step * round(duty / p_load->step);
+        level = (uint8_t)((duty > p_load->max_duty) ? (p_load->max_duty) :
+                         ((duty < p_load->min_duty) ? (p_load->min_duty) : (duty)));
+    }
+
+    if ((level != p_load->level) && (SUCCESS != load_submit(p_load, level)))
+    {
+        printf("Command of load %s dropped, queue full.\n", p_load->name);
+    }
+}
+
+static uint8_t load_apply(load_t * p_load, uint8_t level)
+{
+    if (NULL != p_load->p_pwm)
+    {
+        return (HAL_SUCCESS == hal_pwm_write(p_load->p_pwm, level / 100.0f)) ? (SUCCESS) : (FAIL);
+    }
+    if (NULL != p_load->p_gpio)
+    {
+        return (HAL_SUCCESS == hal_gpio_write(p_load->p_gpio, (level > 0))) ? (SUCCESS) : (FAIL);
+    }
+
+    return FAIL;
+}
+
+static void load_status(const load_t * p_load, uint8_t level, char * p_status)
+{
+    if (0 == level)
+    {
+        strcpy(p_status, "OFF");
+    }
+    else if (p_load->is_pwm)
+    {
+        snprintf(p_status, 4, "%u", level);
+    }
+    else
+    {
+        strcpy(p_status, "ON");
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t load_init_fn(worker_t * p_worker)
+{
+    load_cmd_t cmd;
+    uint8_t    i;
+
+    // A load without its output is reported, commands to it fail
+    for (i = 0; i < num_loads; i++)
+    {
+        if (loads[i].is_pwm)
+        {
+            loads[i].p_pwm = hal_pwm_init(loads[i].pin);
+            if ((NULL != loads[i].p_pwm) &&
+                ((HAL_SUCCESS != hal_pwm_period_us(loads[i].p_pwm, loads[i].period_us)) ||
+                 (HAL_SUCCESS != hal_pwm_enable(loads[i].p_pwm, 1))))
+            {
+                hal_pwm_close(loads[i].p_pwm);
+                loads[i].p_pwm = NULL;
+            }
+        }
+        else
+        {
+            loads[i].p_gpio = hal_gpio_init(loads[i].pin);
+            if ((NULL != loads[i].p_gpio) && (HAL_SUCCESS != hal_gpio_dir_out(loads[i].p_gpio)))
+            {
+                hal_gpio_close(loads[i].p_gpio);
+                loads[i].p_gpio = NULL;
+            }
+        }
+
+        if ((NULL == loads[i].p_gpio) && (NULL == loads[i].p_pwm))
+        {
+            printf("Output of load %s (pin %d) not available.\n", loads[i].name, loads[i].pin);
+            continue;
+        }
+
+        // Without 'initial' the output is left as found, e.g. still driven
+        // by another process. The state at start is stored as well, the
+        // outputs may have been changed while the application was not running.
+        if (!loads[i].has_initial)
+        {
+            continue;
+        }
+        cmd.t_cmd_ns = lat_now_ns();
+        cmd.seq = 0;
+        cmd.index = i;
+        cmd.level = loads[i].level;
+        load_item_fn(p_worker, &cmd);
+    }
+
+    return SUCCESS;
+}
+
+static void load_item_fn(worker_t * p_worker, const void * p_item)
+{
+    const load_cmd_t *p_cmd = (const load_cmd_t *)p_item;
+    load_t           *p_load = &loads[p_cmd->index];
+    db_load_event_t   event;
+    int64_t           t_ns;
+
+    if (SUCCESS != load_apply(p_load, p_cmd->level))
+    {
+        printf("Failed to set load %s.\n", p_load->name);
+        stats_count(STATS_LOAD_ERRORS, 1);
+        return;
+    }
+    t_ns = lat_now_ns();
+    stats_add(STATS_LOAD_ACTUATE, t_ns - p_cmd->t_cmd_ns);
+    stats_count(STATS_LOAD_COMMANDS, 1);
+
+    pthread_mutex_lock(&load_lock);
+    p_load->applied_level = p_cmd->level;
+    p_load->applied_seq = p_cmd->seq;
+    p_load->applied_ns = t_ns;
+    p_load->latency_ns = t_ns - p_cmd->t_cmd_ns;
+    pthread_mutex_unlock(&load_lock);
+
+    // Only transitions are stored, e.g. not every repeated "on"
+    load_status(p_load, p_cmd->level, event.status);
+    if (0 == strcmp(event.status, p_load->logged))
+    {
+        return;
+    }
+    strcpy(p_load->logged, event.status);
+    event.load_type = p_load->type;
+    event.load_time = time(NULL);
+
+    #if defined(RUN_TIME_LOG)
+        printf("Load %s %s.\n", p_load->name, event.status);
+    #endif
+
+    if (SUCCESS != worker_submit(&log_worker, &event))
+    {
+        printf("State %s of load %s not stored, queue full.\n", event.status, p_load->name);
+    }
+}
+
+static void load_fini_fn(worker_t * p_worker)
+{
+    uint8_t i;
+
+    for (i = 0; i < num_loads; i++)
+    {
+        if (NULL != loads[i].p_pwm)
+        {
+            hal_pwm_close(loads[i].p_pwm);
+            loads[i].p_pwm = NULL;
+        }
+        if (NULL != loads[i].p_gpio)
+        {
+            hal_gpio_close(loads[i].p_gpio);
+            loads[i].p_gpio = NULL;
+        }
+    }
+}
+
+static uint8_t log_init_fn(worker_t * p_worker)
+{
+    sched_task_init(&log_task, log_task_fn, NULL);
+
+    return SUCCESS;
+}
+
+static void log_item_fn(worker_t * p_worker, const void * p_item)
+{
+    if (LOAD_LOG_PENDING == num_pending)
+    {
+        printf("State of load type %u dropped.\n", pending[0].load_type);
+        memmove(&pending[0], &pending[1], (LOAD_LOG_PENDING - 1) * sizeof(db_load_event_t));
+        num_pending--;
+    }
+    memcpy(&pending[num_pending++], p_item, sizeof(db_load_event_t));
+
+    // Transitions of one period go in one transaction, a burst (or a
+    // database not available) does not wait for the end of the period
+    if (LOAD_LOG_BATCH == num_pending)
+    {
+        sched_after(&log_task, 0);
+    }
+    else if (!sched_is_pending(&log_task))
+    {
+        sched_after(&log_task, log_ms);
+    }
+}
+
+static void log_fini_fn(worker_t * p_worker)
+{
+    sched_stop(&log_task);
+
+    if (SUCCESS != log_flush())
+    {
+        printf("%u load state(s) not stored.\n", num_pending);
+    }
+}
+
+static uint8_t log_flush(void)
+{
+    if ((num_pending > 0) && (SUCCESS != db_store_loads(pending, num_pending)))
+    {
+        return FAIL;
+    }
+    num_pending = 0;
+
+    return SUCCESS;
+}
+
+static void log_task_fn(sched_task_t * p_task)
+{
+    if (SUCCESS != log_flush())
+    {
+        sched_after(p_task, LOAD_RETRY_MS);
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t load_cmd_load(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    load_t  *p_load = NULL;
+    char    *p_end;
+    long     duty;
+    uint8_t  level;
+    uint8_t  i;
+
+    if (argc < 3)
+    {
+        *p_err = "usage LOAD <name|type> on|off|auto|<duty>";
+        return FAIL;
+    }
+
+    for (i = 0; (i < num_loads) && (NULL == p_load); i++)
+    {
+        if ((0 == strcasecmp(argv[1], loads[i].name)) || (atoi(argv[1]) == loads[i].type))
+        {
+            p_load = &loads[i];
+        }
+    }
+    if (NULL == p_load)
+    {
+        *p_err = "unknown load";
+        return FAIL;
+    }
+
+    if (0 == strcasecmp(argv[2], "auto"))
+    {
+        if (LOAD_RULE_NONE == p_load->rule)
+        {
+            *p_err = "no rule";
+            return FAIL;
+        }
+        p_load->is_manual = 0;
+        load_rule_eval(p_load);
+        ipc_reply(p_client, "SEQ %u", p_load->seq);
+        return SUCCESS;
+    }
+
+    if (0 == strcasecmp(argv[2], "on"))
+    {
+        level = (p_load->is_pwm) ? (p_load->duty) : (100);
+    }
+    else if (0 == strcasecmp(argv[2], "off"))
+    {
+        level = 0;
+    }
+    else
+    {
+        duty = strtol(argv[2], &p_end, 10);
+        if ((p_end == argv[2]) || ('\0' != *p_end) || (duty < 0) || (duty > 100))
+        {
+            *p_err = "invalid state";
+            return FAIL;
+        }
+        level = (p_load->is_pwm || (0 == duty)) ? ((uint8_t)duty) : (100);
+    }
+
+    // Sent even if the level is the same, the output is set again
+    if (SUCCESS != load_submit(p_load, level))
+    {
+        *p_err = "queue full";
+        return FAIL;
+    }
+    p_load->is_manual = 1;
+    ipc_reply(p_client, "SEQ %u", p_load->seq);
+
+    return SUCCESS;
+}
+
+static uint8_t load_cmd_loads(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    char     status[4];
+    uint8_t  level;
+    uint32_t seq;
+    int64_t  applied_ns;
+    int64_t  latency_ns;
+    uint8_t  i;
+
+    for (i = 0; i < num_loads; i++)
+    {
+        pthread_mutex_lock(&load_lock);
+        level = loads[i].applied_level;
+        seq = loads[i].applied_seq;
+        applied_ns = loads[i].applied_ns;
+        latency_ns = loads[i].latency_ns;
+        pthread_mutex_unlock(&load_lock);
+
+        load_status(&loads[i], level, status);
+        ipc_reply(p_client, "LOAD %u %s %d %s %s %s %u %lld %lld", loads[i].type, loads[i].name,
+                  loads[i].pin, (loads[i].is_pwm) ? ("pwm") : ("gpio"),
+                  (loads[i].is_manual) ? ("manual") : ("auto"), status, seq,
+                  (long long)applied_ns, (long long)(latency_ns / 1000));
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,93 @@
+/******************************************************************************/
+
+/* File - load.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Load control. The actuators (light, air conditioner, door lock, alarm
+*  buzzer, cabinet fan) are owned by a thread of their own, fed by a command
+*  queue: a command is applied to its GPIO or PWM output as soon as it is
+*  queued, nothing else runs on that thread. State transitions are handed to
+*  a second thread and stored in the 'loads' table in batches, so a slow or
+*  locked database never delays an output.
+*
+*  Loads are configured per load type (the 'load_type' of the 'loads' table,
+*  1 ~ LOAD_MAX), a load exists once its 'load.<type>.pin' is set. Its
+*  output is set at start only if 'load.<type>.initial' is set, otherwise it
+*  is left as found until the first command. Commands
+*  come from the control socket (see ipc.h) and from the closed-loop rules,
+*  both on the evaluation thread:
+*
+*     LOAD <name|type> on|off   - Switch a load, rules no longer drive it
+*     LOAD <name|type> <duty>   - Duty cycle in percent (0 ~ 100), PWM loads
+*     LOAD <name|type> auto     - Hand the load back to its rule
+*                                 All answer "SEQ <seq>", the load is set once
+*                                 LOADS shows that sequence number
+*     LOADS                     - One "LOAD <type> <name> <pin> gpio|pwm
+*                                 auto|manual <state> <seq> <applied_ns>
+*                                 <latency_us>" line per load, 'applied_ns' is
+*                                 the CLOCK_MONOTONIC time the output was set,
+*                                 0 while it is left as found
+*
+*  Rules take the mean of the latest values of up to LOAD_MAX_SENSORS sensors
+*  and are checked with every new sample of these sensors:
+*
+*     hysteresis   - on (at 'duty') at value >= 'on_above', off again below
+*                    'off_below', e.g. the air conditioner on the cabinet
+*                    temperature band 24.5 .. 27.5
+*     proportional - off below 'low', from 'min_duty' at 'low' up to
+*                    'max_duty' at 'high' in steps of 'step' percent, e.g.
+*                    the fan speed following the cabinet temperature
+*
+*  The state stored in 'loads' is "ON" or "OFF" for a GPIO load and "OFF" or
+*  the duty cycle in percent for a PWM load.
+*/
+
+/******************************************************************************/
+
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Highest load type, i.e. number of loads
+*/
+#define LOAD_MAX                (8)
+
+/* Sensors averaged by a rule
+*/
+#define LOAD_MAX_SENSORS        (4)
+
+/******************************************************************************/
+
+/* Function declaration to read the configuration of the loads and start the
+*  load and log threads, the database must be open. Without any load
+*  configured no thread is started.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t load_start(void);
+
+/* Function declaration to add the LOAD and LOADS commands to the control
+*  socket. Evaluation thread only.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t load_register_cmd(void);
+
+/* Function declaration to check a sample against the rules of the loads,
+*  the latest values must be updated before. Evaluation thread only.
+*  @param[in] p_sample - Sample
+*  @return - None
+*/
+void load_eval(const sample_t * p_sample);
+
+/* Function declaration to stop the threads after the queued commands, the
+*  pending transitions are stored. The outputs are left as they are.
+*  @return - None
+*/
+void load_stop(void);
+
+#endif /* LOAD_H */
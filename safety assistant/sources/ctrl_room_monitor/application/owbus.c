@@ -0,0 +1,951 @@
+/******************************************************************************/
+
+/* File - owbus.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  DS18B20 acquisition, one thread per 1-wire bus. See owbus.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "sched.h"
+#include "spsc.h"
+#include "worker.h"
+#include "lat.h"
+#include "registry.h"
+#include "db.h"
+#include "alarm.h"
+#include "stats.h"
+#include "owbus.h"
+
+/******************************************************************************/
+
+/* Number of 1-wire buses ('ow.buses', 1 ~ OWBUS_MAX). Bus <n> is UART
+*  'ow.<n>.uart' (default <n>) of the board, or the serial device 'ow.<n>.dev'
+*  if set, e.g. "/dev/ttyUSB0" of a USB-serial adapter.
+*/
+#define OWBUS_BUSES                 (1)
+
+/* Samples read by a bus thread, not yet taken by the acquisition thread
+*/
+#define OWBUS_RING_SAMPLES          (256)
+
+/* Commands queued for a bus thread
+*/
+#define OWBUS_CMD_QUEUE             (8)
+
+/* DS18B20 probes are enumerated at start-up and every bus is searched again
+*  every REGISTRY_RESCAN_MS ('registry.rescan_ms'), so probes can be
+*  hot-plugged or removed while the application runs.
+*/
+#define REGISTRY_RESCAN_MS          (600000)
+
+/* Set to (1) to start conversion of all DS18B20 of a bus at once (Skip ROM)
+*  and read them back-to-back when done, so a temperature sweep costs one
+*  conversion time (750 ms at 12-bit) regardless of the number of sensors.
+*  Needs externally powered sensors. Set to (0) for one sensor at a time with
+*  a fixed 1 sec wait each, which also works in parasite power mode.
+*/
+#define DS18B20_PARALLEL_CONV       (1)
+
+/* Resolution of the DS18B20 probes in bit, 9 to 12 ('sensor.resolution',
+*  per probe 'sensor.<sen_id>.resolution'), kept in their EEPROM. Conversion
+*  takes 94, 188, 375 or 750 ms, so a lower resolution allows shorter periods.
+*  With an adaptive margin in degree celsius ('sensor.adaptive_margin', per
+*  probe as well, 0 = off) a probe converts at 12-bit while its reading is
+*  within the margin of a 'high' or 'low' alarm threshold, and returns to its
+*  resolution once it is twice the margin away. The thresholds are loaded
+*  from 'alarm_rules' at start-up and with every bus search.
+*/
+#define DS18B20_RESOLUTION          (12)
+#define DS18B20_ADAPTIVE_MARGIN     (0.0)
+
+/* 1-wire error recovery. A failed scratchpad read (CRC error, no presence
+*  pulse) is retried up to OW_RETRIES times after a bus reset ('ow.retries').
+*  A probe losing a sample is quarantined, i.e. no longer sampled, once
+*  OW_QUARANTINE_LOST samples in a row are lost ('ow.quarantine_lost') or the
+*  moving rate of its failed reads (over about 1 / OW_ERROR_RATE_ALPHA reads)
+*  reaches OW_QUARANTINE_RATE ('ow.quarantine_rate'). Quarantined probes are probed
+*  every OW_REPROBE_MS ('ow.reprobe_ms') and return to service after
+*  OW_REPROBE_READS good reads in a row.
+*/
+#define OW_RETRIES                  (2)
+#define OW_QUARANTINE_LOST          (3)
+#define OW_QUARANTINE_RATE          (0.7)
+#define OW_ERROR_RATE_ALPHA         (0.05f)
+#define OW_REPROBE_MS               (60000)
+#define OW_REPROBE_READS            (3)
+
+/* Commands of the acquisition thread to a bus thread
+*/
+#define OWBUS_CMD_REPORT            (1)
+
+/******************************************************************************/
+
+typedef struct
+{
+    uint8_t          bus;
+    char             name[24];
+    hal_ow_t        *p_ow;
+    worker_t         worker;
+    uint8_t          is_started;
+
+    // Samples read, from the bus thread to the acquisition thread
+    spsc_ring_t      samples;
+    int              event_fd;
+    sched_fd_t       watch;
+    uint32_t         dropped;
+
+    // Conversion in progress on the bus, finished by 'conv_task'
+    sched_task_t     conv_task;
+    uint8_t          busy;
+    uint16_t         conv_polls;
+    uint32_t         conv_timeout_ms;
+    int64_t          conv_start_ns;
+    #if !(DS18B20_PARALLEL_CONV)
+    sensor_t        *p_conv_sen;
+    #endif
+
+    // Bus search and probing of quarantined probes wait for a running
+    // conversion, a reset would abort it
+    sched_task_t     rescan_task;
+    uint8_t          rescan_pending;
+    sched_task_t     reprobe_task;
+    uint8_t          reprobe_pending;
+
+    // Task run time versus deadline of the probes and sweep time
+    lat_t            jitter;
+    lat_t            sweep;
+
+    db_alarm_rule_t  rules[ALARM_MAX_RULES];
+} owbus_t;
+
+/******************************************************************************/
+
+static owbus_t           buses[OWBUS_MAX];
+static uint8_t           num_buses = 0;
+static owbus_sample_fn_t sample_fn = NULL;
+
+/******************************************************************************/
+
+/* Worker functions of a bus thread, 'p_worker->p_arg' is its owbus_t
+*/
+static uint8_t owbus_init_fn(worker_t * p_worker);
+static void    owbus_cmd_fn(worker_t * p_worker, const void * p_item);
+
+/* Function declaration of the watcher of the samples of a bus, acquisition
+*  thread
+*/
+static void owbus_samples_fn(sched_fd_t * p_watch);
+
+/* Function declaration to hand the samples of a bus to the sample handler
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_drain(owbus_t * p_bus);
+
+/* Function declaration to close a bus whose thread is not running
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_close(owbus_t * p_bus);
+
+/* Scheduler task functions of a bus thread. 'p_task->p_arg' of a probe task
+*  is its sensor_t, of the other tasks the owbus_t.
+*/
+static void ds18b20_task(sched_task_t * p_task);
+static void owbus_conv_task_fn(sched_task_t * p_task);
+static void owbus_rescan_task_fn(sched_task_t * p_task);
+static void owbus_reprobe_task_fn(sched_task_t * p_task);
+
+/* Scheduler observer of a bus thread, counts its busy time
+*/
+static void owbus_observer(const sched_task_t * p_task, int64_t run_ns);
+
+/* Function declaration to start the next conversion on a bus for the probes
+*  marked due, if any
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_start_conv(owbus_t * p_bus);
+
+/* Function declaration to read a converted DS18B20 with retries, track its
+*  bus health and quarantine it if it keeps failing. A good sample is handed
+*  over to the acquisition thread.
+*  @param[in] p_bus - Bus of the probe
+*  @param[in] p_sen - DS18B20 due
+*  @return - None
+*/
+static void owbus_read_sensor(owbus_t * p_bus, sensor_t * p_sen);
+
+/* Function declaration to queue a sample for the acquisition thread, it is
+*  timestamped here
+*  @param[in] p_bus   - Bus
+*  @param[in] sen_id  - Sensor ID
+*  @param[in] sen_val - Sensor value in 1 / SAMPLE_SCALE units
+*  @return - None
+*/
+static void owbus_submit(owbus_t * p_bus, uint16_t sen_id, int32_t sen_val);
+
+/* Function declaration to (re)schedule the tasks of the probes of a bus,
+*  present probes get started, absent or quarantined ones stopped. Probes
+*  are configured first (see owbus_setup_sensors()).
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_schedule(owbus_t * p_bus);
+
+/* Function declaration to configure the probes of a bus, new ones get their
+*  resolution, all get the alarm thresholds of the adaptive resolution
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_setup_sensors(owbus_t * p_bus);
+
+/* Function declaration to switch the resolution of a probe, if its reading
+*  approaches (or leaves) an alarm threshold or it lost its configuration
+*  @param[in] p_bus      - Bus of the probe
+*  @param[in] p_sen      - DS18B20 just read
+*  @param[in] temp       - Temperature read in 0.01 degree celsius
+*  @param[in] resolution - Resolution the temperature was converted at
+*  @return - None
+*/
+static void owbus_adapt_resolution(owbus_t * p_bus, sensor_t * p_sen, int32_t temp,
+                                                                    uint8_t resolution);
+
+/* Function declaration to print task jitter, sweep time and the bus health
+*  of every DS18B20 of a bus, by its thread or once it has stopped
+*  @param[in] p_bus - Bus
+*  @return - None
+*/
+static void owbus_print(owbus_t * p_bus);
+
+/******************************************************************************/
+
+uint8_t owbus_start(owbus_sample_fn_t p_fn)
+{
+    owbus_t *p_bus;
+    long     num;
+    uint8_t  i;
+
+    num = config_get_int(OWBUS_BUSES, "ow.buses");
+    if ((num < 1) || (num > OWBUS_MAX))
+    {
+        printf("Number of 1-wire buses out of range (1 ~ %u), 1 used.\n", OWBUS_MAX);
+        num = 1;
+    }
+
+    sample_fn = p_fn;
+    num_buses = 0;
+    for (i = 0; i < num; i++)
+    {
+        p_bus = &buses[i];
+        memset(p_bus, 0, sizeof(owbus_t));
+        p_bus->bus = i;
+        snprintf(p_bus->name, sizeof(p_bus->name), "1-wire bus %u", i);
+        lat_reset(&p_bus->jitter);
+        lat_reset(&p_bus->sweep);
+        p_bus->conv_timeout_ms = DS18B20_CONV_TIMEOUT_MS;
+
+        if (SUCCESS != spsc_init(&p_bus->samples, sizeof(sample_t), OWBUS_RING_SAMPLES))
+        {
+            owbus_stop();
+            return FAIL;
+        }
+        p_bus->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (p_bus->event_fd < 0)
+        {
+            printf("eventfd() failed (%s).\n", strerror(errno));
+            spsc_free(&p_bus->samples);
+            owbus_stop();
+            return FAIL;
+        }
+
+        // Bus is opened and searched by its thread before this returns
+        if (SUCCESS != worker_start(&p_bus->worker, p_bus->name, sizeof(uint8_t),
+                                    OWBUS_CMD_QUEUE, owbus_init_fn, owbus_cmd_fn, NULL, p_bus))
+        {
+            owbus_close(p_bus);
+            owbus_stop();
+            return FAIL;
+        }
+        p_bus->is_started = 1;
+        num_buses++;
+
+        if (SUCCESS != sched_watch(&p_bus->watch, p_bus->event_fd, owbus_samples_fn, p_bus))
+        {
+            owbus_stop();
+            return FAIL;
+        }
+    }
+
+    return SUCCESS;
+}
+
+uint8_t owbus_count(void)
+{
+    return num_buses;
+}
+
+void owbus_report(void)
+{
+    uint8_t cmd = OWBUS_CMD_REPORT;
+    uint8_t i;
+
+    for (i = 0; i < num_buses; i++)
+    {
+        if (buses[i].is_started && (SUCCESS != worker_submit(&buses[i].worker, &cmd)))
+        {
+            printf("Report of 1-wire bus %u not queued.\n", i);
+        }
+    }
+}
+
+uint8_t owbus_sweep_lat(uint8_t bus, lat_t * p_lat)
+{
+    if (bus >= num_buses)
+    {
+        return FAIL;
+    }
+
+    *p_lat = buses[bus].sweep;
+
+    return SUCCESS;
+}
+
+void owbus_stop(void)
+{
+    owbus_t *p_bus;
+    uint8_t  i;
+
+    for (i = 0; i < num_buses; i++)
+    {
+        p_bus = &buses[i];
+        if (!p_bus->is_started)
+        {
+            continue;
+        }
+
+        worker_stop(&p_bus->worker);
+        p_bus->is_started = 0;
+        sched_unwatch(&p_bus->watch);
+
+        // Thread has ended, the rest of its samples and its statistics are
+        // taken from here
+        owbus_drain(p_bus);
+        owbus_print(p_bus);
+        owbus_close(p_bus);
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t owbus_init_fn(worker_t * p_worker)
+{
+    owbus_t     *p_bus = (owbus_t *)p_worker->p_arg;
+    const char  *p_dev;
+    int          uart;
+    hal_result_t hal_ret_val;
+
+    uart = (int)config_get_int(p_bus->bus, "ow.%u.uart", p_bus->bus);
+    p_dev = config_get_str("", "ow.%u.dev", p_bus->bus);
+
+    p_bus->p_ow = hal_ow_init(uart, p_dev);
+    if (NULL == p_bus->p_ow)
+    {
+        if ('\0' != p_dev[0])
+        {
+            printf("hal_ow_init() failed, 1-wire bus %u on %s.\n", p_bus->bus, p_dev);
+        }
+        else
+        {
+            printf("hal_ow_init() failed, 1-wire bus %u on UART %d.\n", p_bus->bus, uart);
+        }
+        return FAIL;
+    }
+    printf("1-wire bus %u created.\n", p_bus->bus);
+
+    // Probes may be plugged in later, an empty bus is not fatal here
+    hal_ret_val = hal_ow_reset(p_bus->p_ow);
+    if (HAL_SUCCESS == hal_ret_val)
+    {
+        printf("Reset of bus %u succeeded, device(s) found on bus!\n", p_bus->bus);
+    }
+    else
+    {
+        printf("Reset of bus %u failed, returned %d. No devices on bus?\n", p_bus->bus,
+                                                                        hal_ret_val);
+    }
+
+    // Known probes keep their IDs from the 'sensors' table
+    printf("Seraching for devices on bus %u.\n", p_bus->bus);
+    registry_scan(p_bus->p_ow, p_bus->bus);
+
+    // Busy time of the bus counts as acquisition time
+    if (NULL != p_stats)
+    {
+        sched_set_observer(owbus_observer);
+    }
+
+    sched_task_init(&p_bus->conv_task, owbus_conv_task_fn, p_bus);
+    sched_task_init(&p_bus->rescan_task, owbus_rescan_task_fn, p_bus);
+    sched_task_init(&p_bus->reprobe_task, owbus_reprobe_task_fn, p_bus);
+
+    owbus_schedule(p_bus);
+
+    return sched_start(&p_bus->rescan_task,
+                       (uint32_t)config_get_int(REGISTRY_RESCAN_MS, "registry.rescan_ms"), 0) &&
+           sched_start(&p_bus->reprobe_task,
+                       (uint32_t)config_get_int(OW_REPROBE_MS, "ow.reprobe_ms"), 0);
+}
+
+static void owbus_cmd_fn(worker_t * p_worker, const void * p_item)
+{
+    owbus_t *p_bus = (owbus_t *)p_worker->p_arg;
+
+    if (OWBUS_CMD_REPORT == *(const uint8_t *)p_item)
+    {
+        owbus_print(p_bus);
+    }
+}
+
+static void owbus_samples_fn(sched_fd_t * p_watch)
+{
+    owbus_t *p_bus = (owbus_t *)p_watch->p_arg;
+    uint64_t count;
+
+    // Reading resets the counter, samples pushed later wake us again
+    if (sizeof(count) != read(p_bus->event_fd, &count, sizeof(count)))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("1-wire bus %u woken without samples.\n", p_bus->bus);
+        #endif
+    }
+
+    owbus_drain(p_bus);
+}
+
+static void owbus_drain(owbus_t * p_bus)
+{
+    sample_t sample;
+
+    while (SUCCESS == spsc_pop(&p_bus->samples, &sample))
+    {
+        sample_fn(&sample);
+    }
+}
+
+static void owbus_close(owbus_t * p_bus)
+{
+    if (NULL != p_bus->p_ow)
+    {
+        hal_ow_stop(p_bus->p_ow);
+        p_bus->p_ow = NULL;
+    }
+    close(p_bus->event_fd);
+    spsc_free(&p_bus->samples);
+
+    if (p_bus->dropped)
+    {
+        printf("1-wire bus %u dropped %u sample(s).\n", p_bus->bus, p_bus->dropped);
+    }
+}
+
+/* A DS18B20 is due, it is read with the next conversion on its bus
+*/
+static void ds18b20_task(sched_task_t * p_task)
+{
+    sensor_t *p_sen = (sensor_t *)p_task->p_arg;
+    owbus_t  *p_bus = &buses[p_sen->bus];
+
+    lat_add(&p_bus->jitter, p_task->late_ns);
+    p_sen->due = 1;
+
+    if (!p_bus->busy)
+    {
+        owbus_start_conv(p_bus);
+    }
+}
+
+static void owbus_start_conv(owbus_t * p_bus)
+{
+    sensor_t *p_sen;
+    uint16_t  index = 0;
+    #if (DS18B20_PARALLEL_CONV)
+    uint8_t   resolution;
+    uint32_t  conv_ms;
+    #endif
+
+    while ((NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index))) && !p_sen->due)
+    {
+    }
+    if (NULL == p_sen)
+    {
+        p_bus->busy = 0;
+        return;
+    }
+
+    p_bus->busy = 1;
+    p_bus->conv_polls = 0;
+    p_bus->conv_start_ns = lat_now_ns();
+
+    #if (DS18B20_PARALLEL_CONV)
+        // Every probe converts, the one at the highest resolution takes longest
+        p_bus->conv_timeout_ms = 0;
+        index = 0;
+        while (NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index)))
+        {
+            resolution = p_sen->resolution;
+            conv_ms = ds18b20_conv_time_ms((resolution) ? (resolution) : (DS18B20_RES_MAX));
+            if (conv_ms > p_bus->conv_timeout_ms)
+            {
+                p_bus->conv_timeout_ms = conv_ms;
+            }
+        }
+        p_bus->conv_timeout_ms += DS18B20_CONV_MARGIN_MS;
+
+        // All probes convert, only the due ones are read afterwards. The bus
+        // is polled from a one-shot task, so the other tasks of the bus are
+        // served while the conversion runs.
+        ds18b20_update_all(p_bus->p_ow);
+        sched_after(&p_bus->conv_task, DS18B20_CONV_POLL_MS);
+    #else
+        // The maximum conversion time of the resolution plus a margin, i.e.
+        // 1 sec at 12-bit
+        p_bus->p_conv_sen = p_sen;
+        ds18b20_update(p_bus->p_ow, p_sen->rom);
+        sched_after(&p_bus->conv_task, ds18b20_conv_time_ms((p_sen->resolution) ?
+                        (p_sen->resolution) : (DS18B20_RES_MAX)) + DS18B20_CONV_MARGIN_MS);
+    #endif
+}
+
+static void owbus_conv_task_fn(sched_task_t * p_task)
+{
+    owbus_t  *p_bus = (owbus_t *)p_task->p_arg;
+    sensor_t *p_sen;
+    #if (DS18B20_PARALLEL_CONV)
+    uint16_t  index = 0;
+    #endif
+
+    #if (DS18B20_PARALLEL_CONV)
+        if (!ds18b20_conv_done(p_bus->p_ow))
+        {
+            if ((++p_bus->conv_polls * DS18B20_CONV_POLL_MS) < p_bus->conv_timeout_ms)
+            {
+                sched_after(p_task, DS18B20_CONV_POLL_MS);
+                return;
+            }
+
+            // A probe holding the bus low or a broken bus. The samples of
+            // this conversion are lost, acquisition goes on.
+            printf("Conversion on bus %u not finished within %u ms, bus reset.\n",
+                                                    p_bus->bus, p_bus->conv_timeout_ms);
+            stats_count(STATS_OW_TIMEOUTS, 1);
+            hal_ow_reset(p_bus->p_ow);
+
+            while (NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index)))
+            {
+                if (p_sen->due)
+                {
+                    p_sen->due = 0;
+                    stats_count(STATS_OW_LOST, 1);
+                }
+            }
+        }
+        else
+        {
+            // All sensors converted already, read every due scratchpad
+            // back-to-back
+            while (NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index)))
+            {
+                if (!p_sen->due)
+                {
+                    continue;
+                }
+                p_sen->due = 0;
+
+                owbus_read_sensor(p_bus, p_sen);
+            }
+            lat_add(&p_bus->sweep, lat_now_ns() - p_bus->conv_start_ns);
+        }
+    #else
+        p_sen = p_bus->p_conv_sen;
+        p_sen->due = 0;
+
+        owbus_read_sensor(p_bus, p_sen);
+        lat_add(&p_bus->sweep, lat_now_ns() - p_bus->conv_start_ns);
+    #endif
+
+    // Bus is idle until the next conversion
+    p_bus->busy = 0;
+
+    if (p_bus->rescan_pending)
+    {
+        p_bus->rescan_pending = 0;
+        registry_scan(p_bus->p_ow, p_bus->bus);
+        owbus_schedule(p_bus);
+    }
+    if (p_bus->reprobe_pending)
+    {
+        p_bus->reprobe_pending = 0;
+        owbus_reprobe_task_fn(&p_bus->reprobe_task);
+    }
+
+    // Probes which became due meanwhile are converted right away
+    owbus_start_conv(p_bus);
+}
+
+/* Search the bus again for added or removed probes. A failed search keeps
+*  the previous set of probes.
+*/
+static void owbus_rescan_task_fn(sched_task_t * p_task)
+{
+    owbus_t *p_bus = (owbus_t *)p_task->p_arg;
+
+    if (p_bus->busy)
+    {
+        p_bus->rescan_pending = 1;
+        return;
+    }
+
+    registry_scan(p_bus->p_ow, p_bus->bus);
+    owbus_schedule(p_bus);
+}
+
+static void owbus_reprobe_task_fn(sched_task_t * p_task)
+{
+    owbus_t  *p_bus = (owbus_t *)p_task->p_arg;
+    sensor_t *p_sen;
+    uint16_t  index = 0;
+    int32_t   temp;
+    uint8_t   i, is_back = 0;
+
+    // A read would abort the running conversion
+    if (p_bus->busy)
+    {
+        p_bus->reprobe_pending = 1;
+        return;
+    }
+
+    while (NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index)))
+    {
+        if (!p_sen->quarantined)
+        {
+            continue;
+        }
+
+        for (i = 0; i < OW_REPROBE_READS; i++)
+        {
+            p_sen->reads++;
+            if (SUCCESS != ds18b20_read_temp(p_bus->p_ow, p_sen->rom, &temp, NULL))
+            {
+                p_sen->read_errors++;
+                break;
+            }
+        }
+        if (i < OW_REPROBE_READS)
+        {
+            continue;
+        }
+
+        printf("Sensor ID=%d back in service.\n", p_sen->sen_id);
+        p_sen->quarantined = 0;
+        p_sen->lost_in_row = 0;
+        p_sen->error_rate = 0.0f;
+        is_back = 1;
+    }
+
+    if (is_back)
+    {
+        owbus_schedule(p_bus);
+    }
+}
+
+static void owbus_observer(const sched_task_t * p_task, int64_t run_ns)
+{
+    stats_count(STATS_ACQ_BUSY_NS, (uint64_t)run_ns);
+}
+
+static void owbus_read_sensor(owbus_t * p_bus, sensor_t * p_sen)
+{
+    int32_t  temp = 0;
+    uint8_t  resolution = 0;
+    uint8_t  num_failed, i;
+    uint8_t  is_ok;
+    long     retries;
+
+    retries = config_get_int(OW_RETRIES, "ow.retries");
+    retries = (retries < 0) ? (0) : ((retries > UINT8_MAX) ? (UINT8_MAX) : (retries));
+
+    is_ok = ds18b20_read_temp_retry(p_bus->p_ow, p_sen->rom, (uint8_t)retries, &temp,
+                                                                &resolution, &num_failed);
+
+    p_sen->reads += num_failed + is_ok;
+    p_sen->read_errors += num_failed;
+    for (i = 0; i < num_failed; i++)
+    {
+        p_sen->error_rate += OW_ERROR_RATE_ALPHA * (1.0f - p_sen->error_rate);
+    }
+
+    if (is_ok)
+    {
+        p_sen->error_rate -= OW_ERROR_RATE_ALPHA * p_sen->error_rate;
+        p_sen->lost_in_row = 0;
+
+        owbus_submit(p_bus, p_sen->sen_id, temp);
+        owbus_adapt_resolution(p_bus, p_sen, temp, resolution);
+        return;
+    }
+
+    // Lost, but only this probe is affected
+    printf("Sensor ID=%d not read, %u attempt(s) failed.\n", p_sen->sen_id, num_failed);
+    stats_count(STATS_OW_LOST, 1);
+    if (p_sen->lost_in_row < UINT8_MAX)
+    {
+        p_sen->lost_in_row++;
+    }
+
+    if ((p_sen->lost_in_row >= config_get_int(OW_QUARANTINE_LOST, "ow.quarantine_lost")) ||
+        (p_sen->error_rate >= config_get_double(OW_QUARANTINE_RATE, "ow.quarantine_rate")))
+    {
+        printf("Sensor ID=%d quarantined, %u sample(s) lost in a row, %0.0f %% of reads "
+               "failing.\n", p_sen->sen_id, p_sen->lost_in_row, p_sen->error_rate * 100.0);
+        stats_count(STATS_OW_QUARANTINES, 1);
+
+        p_sen->quarantined = 1;
+        sched_stop(&p_sen->task);
+    }
+}
+
+static void owbus_submit(owbus_t * p_bus, uint16_t sen_id, int32_t sen_val)
+{
+    sample_t sample;
+    uint64_t one = 1;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.sen_id = sen_id;
+    sample.sen_val = sen_val;
+    sample.sen_time = (int64_t)time(NULL);
+    sample.t_acq_ns = lat_now_ns();
+
+    // Only fills up if the acquisition thread is stuck
+    if (SUCCESS != spsc_push(&p_bus->samples, &sample))
+    {
+        printf("1-wire bus %u queue full, sample of sensor ID=%d dropped.\n", p_bus->bus,
+                                                                            sen_id);
+        stats_count(STATS_QUEUE_DROPS, 1);
+        p_bus->dropped++;
+        return;
+    }
+
+    // Counter of the eventfd only saturates, a failed write is harmless
+    if (sizeof(one) != write(p_bus->event_fd, &one, sizeof(one)))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("1-wire bus %u wake-up not sent.\n", p_bus->bus);
+        #endif
+    }
+}
+
+static void owbus_schedule(owbus_t * p_bus)
+{
+    sensor_t *p_sen;
+    uint16_t  index;
+    uint32_t  period_ms, phase_ms;
+
+    owbus_setup_sensors(p_bus);
+
+    // Absent probes of the bus as well, their tasks are stopped
+    for (index = 0; NULL != (p_sen = registry_get(index)); index++)
+    {
+        if ((SENSOR_TYPE_DS18B20 != p_sen->type) || (p_bus->bus != p_sen->bus))
+        {
+            continue;
+        }
+
+        if (NULL == p_sen->task.fn)
+        {
+            sched_task_init(&p_sen->task, ds18b20_task, p_sen);
+        }
+
+        if (!p_sen->present || p_sen->quarantined)
+        {
+            sched_stop(&p_sen->task);
+            p_sen->due = 0;
+        }
+        else if (!sched_is_pending(&p_sen->task))
+        {
+            period_ms = (uint32_t)config_get_int(config_get_int(SENSOR_PERIOD_MS, "sensor.period_ms"),
+                                                        "sensor.%d.period_ms", p_sen->sen_id);
+            phase_ms = (uint32_t)config_get_int(config_get_int(SENSOR_PHASE_MS, "sensor.phase_ms"),
+                                                        "sensor.%d.phase_ms", p_sen->sen_id);
+
+            printf("Sensor ID=%d sampled every %u ms, phase %u ms, bus %u.\n", p_sen->sen_id,
+                                                        period_ms, phase_ms, p_bus->bus);
+            if (SUCCESS != sched_start(&p_sen->task, period_ms, phase_ms))
+            {
+                printf("Sensor ID=%d not scheduled.\n", p_sen->sen_id);
+            }
+        }
+    }
+}
+
+static void owbus_setup_sensors(owbus_t * p_bus)
+{
+    uint16_t  num_rules = 0;
+    uint16_t  index = 0, i;
+    sensor_t *p_sen;
+    int32_t   threshold;
+    long      resolution;
+
+    // Without rules the adaptive mode keeps every probe at its resolution
+    if (SUCCESS != db_load_alarm_rules(p_bus->rules, ALARM_MAX_RULES, &num_rules))
+    {
+        num_rules = 0;
+    }
+
+    while (NULL != (p_sen = registry_next_on_bus(p_bus->bus, &index)))
+    {
+        p_sen->alarm_low = INT32_MIN;
+        p_sen->alarm_high = INT32_MAX;
+        for (i = 0; i < num_rules; i++)
+        {
+            if (p_bus->rules[i].sen_id != p_sen->sen_id)
+            {
+                continue;
+            }
+            threshold = (int32_t)lrint(p_bus->rules[i].threshold * SAMPLE_SCALE);
+            if ((0 == strcmp(p_bus->rules[i].kind, "high")) && (threshold < p_sen->alarm_high))
+            {
+                p_sen->alarm_high = threshold;
+            }
+            else if ((0 == strcmp(p_bus->rules[i].kind, "low")) && (threshold > p_sen->alarm_low))
+            {
+                p_sen->alarm_low = threshold;
+            }
+        }
+
+        // Probes seen the first time get their resolution, kept in EEPROM.
+        // A quarantined one gets it once back in service.
+        if ((0 == p_sen->resolution) && !p_sen->quarantined)
+        {
+            resolution = config_get_int(config_get_int(DS18B20_RESOLUTION, "sensor.resolution"),
+                                                        "sensor.%d.resolution", p_sen->sen_id);
+            if ((resolution < DS18B20_RES_MIN) || (resolution > DS18B20_RES_MAX))
+            {
+                printf("Resolution of sensor ID=%d out of range, %u-bit used.\n",
+                                                        p_sen->sen_id, DS18B20_RES_MAX);
+                resolution = DS18B20_RES_MAX;
+            }
+
+            if (SUCCESS == ds18b20_set_resolution(p_bus->p_ow, p_sen->rom, (uint8_t)resolution, 1))
+            {
+                p_sen->resolution = (uint8_t)resolution;
+                printf("Sensor ID=%d converts at %ld-bit, %u ms.\n", p_sen->sen_id,
+                                            resolution, ds18b20_conv_time_ms((uint8_t)resolution));
+            }
+            else
+            {
+                printf("Resolution of sensor ID=%d not set, tried again with the next "
+                       "bus search.\n", p_sen->sen_id);
+            }
+        }
+    }
+}
+
+static void owbus_adapt_resolution(owbus_t * p_bus, sensor_t * p_sen, int32_t temp,
+                                                                    uint8_t resolution)
+{
+    uint8_t  wanted;
+    int64_t  margin;
+    uint8_t  is_near;
+
+    // Not configured yet, done with the next bus search
+    if (0 == p_sen->resolution)
+    {
+        return;
+    }
+
+    wanted = (uint8_t)config_get_int(config_get_int(DS18B20_RESOLUTION, "sensor.resolution"),
+                                                        "sensor.%d.resolution", p_sen->sen_id);
+    if ((wanted < DS18B20_RES_MIN) || (wanted > DS18B20_RES_MAX))
+    {
+        wanted = DS18B20_RES_MAX;
+    }
+
+    margin = llrint(config_get_double(config_get_double(DS18B20_ADAPTIVE_MARGIN,
+                    "sensor.adaptive_margin"), "sensor.%d.adaptive_margin", p_sen->sen_id) *
+                                                                            SAMPLE_SCALE);
+    if ((margin > 0) && (wanted < DS18B20_RES_MAX))
+    {
+        // Twice the margin to leave, a reading close to the margin does not
+        // switch back and forth
+        if (DS18B20_RES_MAX == resolution)
+        {
+            margin *= 2;
+        }
+        is_near = ((int64_t)temp >= ((int64_t)p_sen->alarm_high - margin)) ||
+                  ((int64_t)temp <= ((int64_t)p_sen->alarm_low + margin));
+        if (is_near)
+        {
+            wanted = DS18B20_RES_MAX;
+        }
+    }
+
+    // A probe which lost power converts at the resolution of its EEPROM
+    p_sen->resolution = resolution;
+    if (wanted == resolution)
+    {
+        return;
+    }
+
+    if (SUCCESS == ds18b20_set_resolution(p_bus->p_ow, p_sen->rom, wanted, 0))
+    {
+        p_sen->resolution = wanted;
+
+        #if defined(RUN_TIME_LOG)
+            printf("Sensor ID=%d switched to %u-bit at %0.2f.\n", p_sen->sen_id, wanted,
+                                                        (double)temp / SAMPLE_SCALE);
+        #endif
+    }
+}
+
+static void owbus_print(owbus_t * p_bus)
+{
+    sensor_t *p_sen;
+    uint16_t  index;
+    char      name[40];
+
+    snprintf(name, sizeof(name), "Bus %u task jitter", p_bus->bus);
+    lat_print(&p_bus->jitter, name);
+    snprintf(name, sizeof(name), "Bus %u sweep time", p_bus->bus);
+    lat_print(&p_bus->sweep, name);
+
+    for (index = 0; NULL != (p_sen = registry_get(index)); index++)
+    {
+        if ((SENSOR_TYPE_DS18B20 != p_sen->type) || (p_bus->bus != p_sen->bus) ||
+            (0 == p_sen->reads))
+        {
+            continue;
+        }
+
+        printf("Sensor ID=%d: %u reads, %u failed (%0.2f %%, recent %0.0f %%)%s.\n",
+               p_sen->sen_id, p_sen->reads, p_sen->read_errors,
+               (100.0 * p_sen->read_errors) / p_sen->reads, p_sen->error_rate * 100.0,
+               (p_sen->quarantined) ? (", quarantined") : (""));
+    }
+}
@@ -0,0 +1,85 @@
+/******************************************************************************/
+
+/* File - owbus.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  DS18B20 acquisition on several 1-wire buses, the UART of the IoT2020 and
+*  USB-serial adapters ('ow.buses', per bus 'ow.<n>.uart' or 'ow.<n>.dev').
+*  Every bus is driven by a thread of its own (a worker, see worker.h) which
+*  owns the bus instance and the probes found on it: ROM search, conversion,
+*  scratchpad reads, resolution, retries and quarantine all run on that
+*  thread, buses do not wait for each other. A temperature sweep thus takes
+*  as long as the busiest bus, not the sum of all buses.
+*
+*  Samples are timestamped when read and handed back to the acquisition
+*  thread through a ring per bus, which merges them into the one stream of
+*  samples going to storage and evaluation.
+*
+*  Every probe is sampled by a scheduler task of its bus thread with the
+*  period and phase of its sensor ID ('sensor.<sen_id>.period_ms'). Due
+*  probes are converted together and read back-to-back (DS18B20_PARALLEL_CONV).
+*  Each bus is searched again every 'registry.rescan_ms' and its quarantined
+*  probes are probed every 'ow.reprobe_ms', see app.conf.
+*/
+
+/******************************************************************************/
+
+#ifndef OWBUS_H
+#define OWBUS_H
+
+#include <stdint.h>
+
+#include "lat.h"
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Maximum number of 1-wire buses
+*/
+#define OWBUS_MAX               (4)
+
+/* Sample handler, called on the acquisition thread
+*/
+typedef void (*owbus_sample_fn_t)(const sample_t * p_sample);
+
+/******************************************************************************/
+
+/* Function declaration to open and search all configured buses and start
+*  their threads. Buses are started one after the other, so on a fresh
+*  database the probes get their IDs in bus and search order. Must be called
+*  on the acquisition thread once its scheduler is initialized and the
+*  database is open.
+*  @param[in] sample_fn - Handler of the samples read
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if a bus failed to open, no bus
+*            thread is left running then )
+*/
+uint8_t owbus_start(owbus_sample_fn_t sample_fn);
+
+/* Function declaration to get the number of buses started
+*  @return - uint8_t (number of buses)
+*/
+uint8_t owbus_count(void);
+
+/* Function declaration to have every bus thread print its task jitter,
+*  sweep time and the bus health of its probes
+*  @return - None
+*/
+void owbus_report(void);
+
+/* Function declaration to get the sweep time of a bus, i.e. from the start of
+*  a conversion until the last of its probes is read. Only after owbus_stop().
+*  @param[in]  bus   - Index of the bus
+*  @param[out] p_lat - Copy of the statistics
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if there is no such bus )
+*/
+uint8_t owbus_sweep_lat(uint8_t bus, lat_t * p_lat);
+
+/* Function declaration to stop the bus threads and close the buses. The
+*  samples read so far are handed to the sample handler before it returns,
+*  a conversion in progress is abandoned.
+*  @return - None
+*/
+void owbus_stop(void);
+
+#endif /* OWBUS_H */
@@ -0,0 +1,701 @@
+/******************************************************************************/
+
+/* File - query.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Time range queries of the sensor history. See query.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "common.h"
+#include "config.h"
+#include "ipc.h"
+#include "db.h"
+#include "sample.h"
+#include "query.h"
+
+/******************************************************************************/
+
+#define QUERY_DAY_S             (86400)
+
+/******************************************************************************/
+
+// Query of the running RANGE request and its reply, requests are served one
+// at a time by the scheduler loop
+static query_t       cmd_query;
+static query_point_t cmd_points[QUERY_MAX_CHUNK];
+static char          cmd_buf[QUERY_MAX_CHUNK * QUERY_CSV_LEN];
+
+/******************************************************************************/
+
+/* Function declarations of the read position
+*  query_iter_open()  - Positions at the first sample not before 'from'
+*  query_iter_peek()  - Next sample without reading it
+*  query_iter_next()  - Reads the next sample
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) at the end of the range )
+*/
+static void    query_iter_open(query_iter_t * p_iter, uint16_t sen_id, int64_t from, int64_t to,
+                                                                        const char * p_dir);
+static uint8_t query_iter_peek(const query_iter_t * p_iter, query_point_t * p_point,
+                                                                        uint8_t * p_is_arch);
+static uint8_t query_iter_next(query_iter_t * p_iter, query_point_t * p_point);
+static void    query_iter_close(query_iter_t * p_iter);
+
+/* Function declaration to get the database status of an iterator
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), DB_BUSY(2) )
+*/
+static uint8_t query_iter_status(const query_iter_t * p_iter);
+
+/* Function declarations to advance the archive and the database side
+*/
+static void    query_arch_next(query_iter_t * p_iter);
+static void    query_db_fill(query_iter_t * p_iter);
+static void    query_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg);
+
+/* Function declarations of the equal time buckets of the downsampling
+*/
+static uint32_t query_bucket_of(const query_t * p_query, int64_t sen_time);
+static int64_t  query_bucket_start(const query_t * p_query, uint32_t bucket);
+
+/* Function declaration to read a downsampled chunk, see query_read()
+*/
+static uint8_t query_read_lttb(query_t * p_query, query_point_t * p_points, uint32_t max,
+                               uint32_t max_scan, uint32_t * p_num);
+
+/* Function declaration of the control command
+*/
+static uint8_t query_cmd_range(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t query_register_cmd(void)
+{
+    return ipc_register_cmd("RANGE", query_cmd_range,
+                            "RANGE <sen_id> <from> <to> [points] [csv|bin] [cursor]");
+}
+
+uint8_t query_open(query_t * p_query, uint16_t sen_id, int64_t from, int64_t to,
+                   uint32_t max_points, const char * p_cursor)
+{
+    const char   *p_dir = config_get_str(ARCHIVE_PATH, "archive.path");
+    long long     sen_time;
+    unsigned long num;
+    int           sen_val;
+    char          extra;
+    uint32_t      i;
+    query_point_t point;
+
+    if ((from < 0) || (to <= from) || (to > UINT32_MAX) || ((0 != max_points) && (max_points < 3)))
+    {
+        return FAIL;
+    }
+
+    p_query->sen_id = sen_id;
+    p_query->from = from;
+    p_query->to = to;
+    p_query->cur_time = from;
+    p_query->cur_run = 0;
+    p_query->bucket = 0;
+    p_query->has_prev = 0;
+    p_query->has_next = 0;
+    p_query->is_done = 0;
+
+    // First and last sample plus one per bucket, at least a second a bucket
+    p_query->num_buckets = (max_points) ? (max_points - 1) : (0);
+    if (p_query->num_buckets > (uint64_t)(to - from))
+    {
+        p_query->num_buckets = (uint32_t)(to - from);
+    }
+
+    if (0 == p_query->num_buckets)
+    {
+        // "<time>:<samples of that time returned>"
+        if (NULL != p_cursor)
+        {
+            if ((2 != sscanf(p_cursor, "%lld:%lu%c", &sen_time, &num, &extra)) ||
+                (sen_time < from) || (sen_time >= to))
+            {
+                return FAIL;
+            }
+            p_query->cur_time = (int64_t)sen_time;
+            p_query->cur_run = (uint32_t)num;
+        }
+
+        query_iter_open(&p_query->iter, sen_id, p_query->cur_time, to, p_dir);
+
+        // Stops early if samples of that time were deleted meanwhile
+        for (i = 0; (i < p_query->cur_run) &&
+                    (SUCCESS == query_iter_peek(&p_query->iter, &point, NULL)) &&
+                    (point.sen_time == p_query->cur_time); i++)
+        {
+            query_iter_next(&p_query->iter, &point);
+        }
+
+        return SUCCESS;
+    }
+
+    // "<next bucket>:<time>:<value of the previous pick>"
+    if (NULL != p_cursor)
+    {
+        if ((3 != sscanf(p_cursor, "%lu:%lld:%d%c", &num, &sen_time, &sen_val, &extra)) ||
+            (num > p_query->num_buckets) || (sen_time < from) || (sen_time >= to))
+        {
+            return FAIL;
+        }
+        p_query->bucket = (uint32_t)num;
+        p_query->prev.sen_time = (int64_t)sen_time;
+        p_query->prev.sen_val = (int32_t)sen_val;
+        p_query->has_prev = 1;
+    }
+
+    query_iter_open(&p_query->iter, sen_id, query_bucket_start(p_query, p_query->bucket), to, p_dir);
+    query_iter_open(&p_query->ahead, sen_id,
+                    query_bucket_start(p_query, p_query->bucket + 1), to, p_dir);
+
+    // The first sample is returned on its own
+    if (p_query->has_prev && (0 == p_query->bucket))
+    {
+        query_iter_next(&p_query->iter, &point);
+    }
+
+    return SUCCESS;
+}
+
+uint8_t query_read(query_t * p_query, query_point_t * p_points, uint32_t max,
+                   uint32_t max_scan, uint32_t * p_num)
+{
+    query_point_t point;
+
+    *p_num = 0;
+
+    if (p_query->num_buckets)
+    {
+        return query_read_lttb(p_query, p_points, max, max_scan, p_num);
+    }
+
+    while ((*p_num < max) && (SUCCESS == query_iter_next(&p_query->iter, &point)))
+    {
+        p_points[(*p_num)++] = point;
+
+        if (point.sen_time == p_query->cur_time)
+        {
+            p_query->cur_run++;
+        }
+        else
+        {
+            p_query->cur_time = point.sen_time;
+            p_query->cur_run = 1;
+        }
+    }
+
+    if (SUCCESS != query_iter_peek(&p_query->iter, &point, NULL))
+    {
+        p_query->is_done = 1;
+    }
+
+    return query_iter_status(&p_query->iter);
+}
+
+uint8_t query_cursor(const query_t * p_query, char * p_cursor)
+{
+    if (p_query->is_done)
+    {
+        return FAIL;
+    }
+
+    if (p_query->num_buckets)
+    {
+        snprintf(p_cursor, QUERY_CURSOR_LEN, "%u:%lld:%d", p_query->bucket,
+                        (long long)p_query->prev.sen_time, p_query->prev.sen_val);
+    }
+    else
+    {
+        snprintf(p_cursor, QUERY_CURSOR_LEN, "%lld:%u", (long long)p_query->cur_time,
+                                                                    p_query->cur_run);
+    }
+
+    return SUCCESS;
+}
+
+void query_close(query_t * p_query)
+{
+    query_iter_close(&p_query->iter);
+    if (p_query->num_buckets)
+    {
+        query_iter_close(&p_query->ahead);
+    }
+}
+
+uint32_t query_encode(const query_point_t * p_points, uint32_t num, uint8_t is_bin, char * p_buf)
+{
+    uint8_t  *p_rec = (uint8_t *)p_buf;
+    uint32_t  sen_time, sen_val;
+    uint32_t  len = 0;
+    uint32_t  i;
+
+    if (!is_bin)
+    {
+        for (i = 0; i < num; i++)
+        {
+            len += (uint32_t)sprintf(&p_buf[len], "%lld,%0.2f\n", (long long)p_points[i].sen_time,
+                                            (double)p_points[i].sen_val / SAMPLE_SCALE);
+        }
+
+        return len;
+    }
+
+    for (i = 0; i < num; i++, p_rec += QUERY_BIN_LEN)
+    {
+        sen_time = (uint32_t)p_points[i].sen_time;
+        sen_val = (uint32_t)p_points[i].sen_val;
+
+        p_rec[0] = (uint8_t)sen_time;
+        p_rec[1] = (uint8_t)(sen_time >> 8);
+        p_rec[2] = (uint8_t)(sen_time >> 16);
+        p_rec[3] = (uint8_t)(sen_time >> 24);
+        p_rec[4] = (uint8_t)sen_val;
+        p_rec[5] = (uint8_t)(sen_val >> 8);
+        p_rec[6] = (uint8_t)(sen_val >> 16);
+        p_rec[7] = (uint8_t)(sen_val >> 24);
+    }
+
+    return num * QUERY_BIN_LEN;
+}
+
+/******************************************************************************/
+
+static void query_iter_open(query_iter_t * p_iter, uint16_t sen_id, int64_t from, int64_t to,
+                                                                        const char * p_dir)
+{
+    p_iter->sen_id = sen_id;
+    p_iter->from = from;
+    p_iter->to = to;
+    p_iter->p_dir = p_dir;
+
+    p_iter->is_mapped = 0;
+    p_iter->day = from - (from % QUERY_DAY_S);
+    p_iter->has_arch = 0;
+
+    p_iter->num_rows = 0;
+    p_iter->row = 0;
+    p_iter->last_time = from;
+    p_iter->last_sl = -1;
+    p_iter->is_db_end = 0;
+
+    p_iter->is_err = 0;
+    p_iter->is_busy = 0;
+    p_iter->num_read = 0;
+
+    if ('\0' != p_dir[0])
+    {
+        query_arch_next(p_iter);
+    }
+    query_db_fill(p_iter);
+}
+
+static uint8_t query_iter_peek(const query_iter_t * p_iter, query_point_t * p_point,
+                                                                        uint8_t * p_is_arch)
+{
+    uint8_t is_arch;
+
+    // Archived samples first on equal times, the database holds the later
+    // rows of a day
+    if (p_iter->has_arch &&
+        ((p_iter->row >= p_iter->num_rows) ||
+         (p_iter->arch_head.sen_time <= p_iter->rows[p_iter->row].sen_time)))
+    {
+        *p_point = p_iter->arch_head;
+        is_arch = 1;
+    }
+    else if (p_iter->row < p_iter->num_rows)
+    {
+        *p_point = p_iter->rows[p_iter->row];
+        is_arch = 0;
+    }
+    else
+    {
+        return FAIL;
+    }
+
+    if (NULL != p_is_arch)
+    {
+        *p_is_arch = is_arch;
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t query_iter_next(query_iter_t * p_iter, query_point_t * p_point)
+{
+    uint8_t is_arch;
+
+    if (SUCCESS != query_iter_peek(p_iter, p_point, &is_arch))
+    {
+        return FAIL;
+    }
+
+    if (is_arch)
+    {
+        query_arch_next(p_iter);
+    }
+    else if (++p_iter->row >= p_iter->num_rows)
+    {
+        query_db_fill(p_iter);
+    }
+    p_iter->num_read++;
+
+    return SUCCESS;
+}
+
+static void query_iter_close(query_iter_t * p_iter)
+{
+    if (p_iter->is_mapped)
+    {
+        archive_unmap(&p_iter->seg);
+        p_iter->is_mapped = 0;
+    }
+}
+
+static void query_arch_next(query_iter_t * p_iter)
+{
+    char    path[ARCHIVE_PATH_LEN];
+    int64_t sen_time, value;
+    int64_t scale;
+
+    p_iter->has_arch = 0;
+
+    for (;;)
+    {
+        if (p_iter->is_mapped)
+        {
+            scale = (int64_t)p_iter->seg.p_header->scale;
+
+            while (SUCCESS == archive_next(&p_iter->seg, &sen_time, &value))
+            {
+                if (sen_time < p_iter->from)
+                {
+                    continue;
+                }
+                if (sen_time >= p_iter->to)
+                {
+                    // Later days are past the range as well
+                    p_iter->day = p_iter->to;
+                    break;
+                }
+
+                p_iter->arch_head.sen_time = sen_time;
+                p_iter->arch_head.sen_val = (scale == SAMPLE_SCALE) ? ((int32_t)value) :
+                                        ((int32_t)llround((double)value * SAMPLE_SCALE / scale));
+                p_iter->has_arch = 1;
+                return;
+            }
+
+            archive_unmap(&p_iter->seg);
+            p_iter->is_mapped = 0;
+        }
+
+        if (p_iter->day >= p_iter->to)
+        {
+            return;
+        }
+
+        // Days without a segment are skipped
+        archive_path(path, p_iter->p_dir, p_iter->sen_id, (time_t)p_iter->day);
+        p_iter->day += QUERY_DAY_S;
+        if (SUCCESS == archive_map(path, &p_iter->seg))
+        {
+            p_iter->is_mapped = 1;
+        }
+    }
+}
+
+static uint8_t query_iter_status(const query_iter_t * p_iter)
+{
+    if (!p_iter->is_err)
+    {
+        return SUCCESS;
+    }
+
+    return (p_iter->is_busy) ? (DB_BUSY) : (FAIL);
+}
+
+static void query_db_fill(query_iter_t * p_iter)
+{
+    uint8_t ret_val;
+
+    p_iter->num_rows = 0;
+    p_iter->row = 0;
+
+    if (p_iter->is_db_end)
+    {
+        return;
+    }
+
+    ret_val = db_read_range(p_iter->sen_id, (time_t)p_iter->last_time, p_iter->last_sl,
+                            (time_t)p_iter->to, QUERY_DB_BATCH, query_row_fn, p_iter);
+    if (SUCCESS != ret_val)
+    {
+        p_iter->is_err = 1;
+        p_iter->is_busy = (DB_BUSY == ret_val) ? (1) : (0);
+        p_iter->num_rows = 0;
+    }
+
+    // A short batch is the end of the range
+    if (p_iter->num_rows < QUERY_DB_BATCH)
+    {
+        p_iter->is_db_end = 1;
+    }
+}
+
+static void query_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg)
+{
+    query_iter_t *p_iter = (query_iter_t *)p_arg;
+
+    if (p_iter->num_rows >= QUERY_DB_BATCH)
+    {
+        return;
+    }
+
+    p_iter->rows[p_iter->num_rows].sen_time = (int64_t)sen_time;
+    p_iter->rows[p_iter->num_rows++].sen_val = (int32_t)lround(sen_val * SAMPLE_SCALE);
+    p_iter->last_time = (int64_t)sen_time;
+    p_iter->last_sl = sl;
+}
+
+static uint32_t query_bucket_of(const query_t * p_query, int64_t sen_time)
+{
+    return (uint32_t)(((sen_time - p_query->from) * p_query->num_buckets) /
+                                                        (p_query->to - p_query->from));
+}
+
+static int64_t query_bucket_start(const query_t * p_query, uint32_t bucket)
+{
+    int64_t span = p_query->to - p_query->from;
+
+    // First time of the bucket, i.e. query_bucket_of() of it is 'bucket'
+    return p_query->from + ((((int64_t)bucket * span) + p_query->num_buckets - 1) /
+                                                                    p_query->num_buckets);
+}
+
+static uint8_t query_read_lttb(query_t * p_query, query_point_t * p_points, uint32_t max,
+                               uint32_t max_scan, uint32_t * p_num)
+{
+    query_point_t point, best;
+    double        prev_time, area, best_area, sum_time, sum_val;
+    int64_t       end, next_end;
+    uint32_t      bucket, num;
+
+    if (!p_query->has_prev)
+    {
+        if (SUCCESS != query_iter_next(&p_query->iter, &point))
+        {
+            p_query->is_done = 1;
+            return query_iter_status(&p_query->iter);
+        }
+        p_points[(*p_num)++] = point;
+        p_query->prev = point;
+        p_query->has_prev = 1;
+    }
+
+    while (!p_query->is_done && (*p_num < max) &&
+           ((p_query->iter.num_read + p_query->ahead.num_read) < max_scan))
+    {
+        // Empty buckets are skipped
+        if (SUCCESS != query_iter_peek(&p_query->iter, &point, NULL))
+        {
+            p_query->is_done = 1;
+            break;
+        }
+        bucket = query_bucket_of(p_query, point.sen_time);
+        end = query_bucket_start(p_query, bucket + 1);
+        best = point;
+
+        // Mean of the next bucket with samples, read one bucket ahead
+        if (!p_query->has_next || (p_query->next_bucket <= bucket))
+        {
+            p_query->has_next = 0;
+
+            while ((SUCCESS == query_iter_peek(&p_query->ahead, &point, NULL)) &&
+                   (point.sen_time < end))
+            {
+                query_iter_next(&p_query->ahead, &point);
+            }
+
+            if (SUCCESS == query_iter_peek(&p_query->ahead, &point, NULL))
+            {
+                p_query->next_bucket = query_bucket_of(p_query, point.sen_time);
+                next_end = query_bucket_start(p_query, p_query->next_bucket + 1);
+                sum_time = 0.0;
+                sum_val = 0.0;
+                num = 0;
+
+                while ((SUCCESS == query_iter_peek(&p_query->ahead, &point, NULL)) &&
+                       (point.sen_time < next_end))
+                {
+                    query_iter_next(&p_query->ahead, &point);
+                    sum_time += (double)(point.sen_time - p_query->from);
+                    sum_val += (double)point.sen_val;
+                    num++;
+                }
+
+                p_query->next_time = sum_time / num;
+                p_query->next_val = sum_val / num;
+                p_query->has_next = 1;
+            }
+        }
+
+        // The last bucket with samples ends with the last sample
+        if (!p_query->has_next)
+        {
+            while (SUCCESS == query_iter_next(&p_query->iter, &point))
+            {
+                best = point;
+            }
+            p_points[(*p_num)++] = best;
+            p_query->prev = best;
+            p_query->is_done = 1;
+            break;
+        }
+
+        // Largest triangle with the previous pick and the mean of the next
+        // bucket (twice its area, times relative to 'from')
+        prev_time = (double)(p_query->prev.sen_time - p_query->from);
+        best_area = -1.0;
+
+        while ((SUCCESS == query_iter_peek(&p_query->iter, &point, NULL)) &&
+               (point.sen_time < end))
+        {
+            query_iter_next(&p_query->iter, &point);
+
+            area = fabs(((prev_time - p_query->next_time) *
+                         ((double)point.sen_val - p_query->prev.sen_val)) -
+                        ((prev_time - (double)(point.sen_time - p_query->from)) *
+                         (p_query->next_val - p_query->prev.sen_val)));
+            if (area > best_area)
+            {
+                best_area = area;
+                best = point;
+            }
+        }
+
+        p_points[(*p_num)++] = best;
+        p_query->prev = best;
+        p_query->bucket = bucket + 1;
+    }
+
+    if (SUCCESS != query_iter_status(&p_query->iter))
+    {
+        return query_iter_status(&p_query->iter);
+    }
+
+    return query_iter_status(&p_query->ahead);
+}
+
+static uint8_t query_cmd_range(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    char          cursor[QUERY_CURSOR_LEN];
+    char         *p_end;
+    int64_t       from, to;
+    long          chunk;
+    unsigned long sen_id;
+    uint32_t      max_points = 0;
+    uint32_t      num, len;
+    uint8_t       is_bin = 0;
+    uint8_t       ret_val;
+
+    *p_err = "usage RANGE <sen_id> <from> <to> [points] [csv|bin] [cursor]";
+    if (argc < 4)
+    {
+        return FAIL;
+    }
+
+    sen_id = strtoul(argv[1], &p_end, 10);
+    if ((p_end == argv[1]) || ('\0' != *p_end) || (sen_id > 0xFFFF))
+    {
+        return FAIL;
+    }
+    from = (int64_t)strtoll(argv[2], &p_end, 10);
+    if ('\0' != *p_end)
+    {
+        return FAIL;
+    }
+    to = (int64_t)strtoll(argv[3], &p_end, 10);
+    if ('\0' != *p_end)
+    {
+        return FAIL;
+    }
+    if (argc > 4)
+    {
+        max_points = (uint32_t)strtoul(argv[4], &p_end, 10);
+        if ('\0' != *p_end)
+        {
+            return FAIL;
+        }
+    }
+    if (argc > 5)
+    {
+        if (0 == strcasecmp(argv[5], "bin"))
+        {
+            is_bin = 1;
+        }
+        else if (0 != strcasecmp(argv[5], "csv"))
+        {
+            return FAIL;
+        }
+    }
+
+    chunk = config_get_int(QUERY_CHUNK, "query.chunk");
+    if ((chunk < 1) || (chunk > QUERY_MAX_CHUNK))
+    {
+        chunk = QUERY_MAX_CHUNK;
+    }
+
+    if (SUCCESS != query_open(&cmd_query, (uint16_t)sen_id, from, to, max_points,
+                              (argc > 6) ? (argv[6]) : (NULL)))
+    {
+        *p_err = "bad range or cursor";
+        return FAIL;
+    }
+
+    // The cursor of the request is still valid after a busy database
+    ret_val = query_read(&cmd_query, cmd_points, (uint32_t)chunk,
+                         (uint32_t)config_get_int(QUERY_MAX_SCAN, "query.max_scan"), &num);
+    if (SUCCESS != ret_val)
+    {
+        query_close(&cmd_query);
+        *p_err = (DB_BUSY == ret_val) ? (QUERY_ERR_BUSY) : ("database error");
+        return FAIL;
+    }
+
+    len = query_encode(cmd_points, num, is_bin, cmd_buf);
+    if (is_bin)
+    {
+        ipc_reply(p_client, "BIN %u", num);
+    }
+    ipc_reply_raw(p_client, cmd_buf, len);
+
+    if (SUCCESS == query_cursor(&cmd_query, cursor))
+    {
+        ipc_reply(p_client, "NEXT %s", cursor);
+    }
+    else
+    {
+        ipc_reply(p_client, "END");
+    }
+
+    query_close(&cmd_query);
+
+    return SUCCESS;
+}
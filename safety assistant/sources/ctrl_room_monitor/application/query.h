@@ -0,0 +1,196 @@
+/******************************************************************************/
+
+/* File - query.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Time range queries of the history of a sensor, served over the control
+*  socket (see ipc.h) so the dashboards no longer load whole result sets
+*  through ad-hoc SQL:
+*
+*     RANGE <sen_id> <from> <to> [points] [csv|bin] [cursor]
+*
+*  'from' and 'to' are unix seconds, 'to' excluded. Samples come from the
+*  archive segments (see archive.h) and from 'sensor_data', merged in time
+*  order. A reply holds one chunk of at most QUERY_CHUNK ('query.chunk')
+*  samples, then "NEXT <cursor>" if there are more or "END":
+*
+*     csv - one "<time>,<value>" data line per sample
+*     bin - a "BIN <n>" data line followed by n records of 8 bytes, time
+*           (uint32) and value in 1 / SAMPLE_SCALE units (int32), both
+*           little endian
+*
+*  The next chunk is read by repeating the request with the cursor. The
+*  cursor holds the whole read position, the server keeps no state between
+*  requests, so a client may stop at any time or resume after a restart.
+*  The database is not waited for while the storage thread commits a cycle,
+*  the request is answered "ERR " QUERY_ERR_BUSY then and may be repeated.
+*
+*  With 'points' (3 or more, 0 = all samples) the range is downsampled on
+*  the server with Largest-Triangle-Three-Buckets over equal time buckets:
+*  the first sample, then per bucket the sample spanning the largest
+*  triangle with the previous pick and the mean of the next bucket with
+*  samples, and the last sample. At most 'points' samples are returned. A
+*  request reads up to QUERY_MAX_SCAN ('query.max_scan') samples and ends
+*  its chunk at the next bucket boundary past it, so a long window takes
+*  several requests rather than stalling the control socket.
+*
+*  Memory use is constant (sizeof(query_t) and one chunk), independent of
+*  the window: the samples are streamed through a batch of QUERY_DB_BATCH
+*  rows and one mapped segment. Downsampling reads the range twice, one
+*  bucket apart, instead of buffering a bucket.
+*/
+
+/******************************************************************************/
+
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdint.h>
+
+#include "archive.h"
+
+/******************************************************************************/
+
+/* Samples per reply ('query.chunk', up to QUERY_MAX_CHUNK) and samples read
+*  per downsampled request ('query.max_scan')
+*/
+#define QUERY_CHUNK             (1024)
+#define QUERY_MAX_CHUNK         (2048)
+#define QUERY_MAX_SCAN          (131072)
+
+/* Rows read from the database at a time
+*/
+#define QUERY_DB_BATCH          (256)
+
+/* Size of a cursor, of a binary record and upper bound of a CSV line
+*  ("-2147483648,-21474836.48\n" is 25 bytes)
+*/
+#define QUERY_CURSOR_LEN        (64)
+#define QUERY_BIN_LEN           (8)
+#define QUERY_CSV_LEN           (32)
+
+/* Reason of the error reply while the database is busy
+*/
+#define QUERY_ERR_BUSY          "database busy"
+
+/* A sample, value in 1 / SAMPLE_SCALE units
+*/
+typedef struct
+{
+    int64_t sen_time;
+    int32_t sen_val;
+} query_point_t;
+
+/* Read position in the samples of a sensor, archive and database merged
+*/
+typedef struct
+{
+    uint16_t       sen_id;
+    int64_t        from;
+    int64_t        to;
+    const char    *p_dir;
+
+    archive_seg_t  seg;
+    uint8_t        is_mapped;
+    int64_t        day;                         // Day of the segment mapped next
+    query_point_t  arch_head;
+    uint8_t        has_arch;
+
+    query_point_t  rows[QUERY_DB_BATCH];
+    uint16_t       num_rows;
+    uint16_t       row;
+    int64_t        last_time;                   // Last row read from the database
+    int64_t        last_sl;
+    uint8_t        is_db_end;
+
+    uint8_t        is_err;
+    uint8_t        is_busy;                     // The error was DB_BUSY
+    uint32_t       num_read;
+} query_iter_t;
+
+/* A running query
+*/
+typedef struct
+{
+    uint16_t       sen_id;
+    int64_t        from;
+    int64_t        to;
+    uint32_t       num_buckets;                 // 0 returns all samples
+
+    query_iter_t   iter;                        // Samples returned or picked
+    query_iter_t   ahead;                       // Next bucket of the downsampling
+
+    // Position of all samples: time and number of samples of that time
+    // returned so far
+    int64_t        cur_time;
+    uint32_t       cur_run;
+
+    // Position of the downsampling: next bucket, previous pick and mean of
+    // the next bucket with samples
+    uint32_t       bucket;
+    query_point_t  prev;
+    uint8_t        has_prev;
+    uint32_t       next_bucket;
+    double         next_time;
+    double         next_val;
+    uint8_t        has_next;
+
+    uint8_t        is_done;
+} query_t;
+
+/******************************************************************************/
+
+/* Function declaration to add the RANGE command to the control socket
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t query_register_cmd(void);
+
+/* Function declaration to start or resume a query. Segments are read from
+*  'archive.path'.
+*  @param[out] p_query    - Query
+*  @param[in]  sen_id     - Sensor ID
+*  @param[in]  from       - Start of the range (unix seconds)
+*  @param[in]  to         - End of the range (unix seconds), excluded
+*  @param[in]  max_points - Samples downsampled to, 0 for all samples
+*  @param[in]  p_cursor   - Cursor of the previous chunk, NULL to start
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a bad range or cursor )
+*/
+uint8_t query_open(query_t * p_query, uint16_t sen_id, int64_t from, int64_t to,
+                   uint32_t max_points, const char * p_cursor);
+
+/* Function declaration to read the next chunk
+*  @param[in]  p_query  - Query
+*  @param[out] p_points - Samples in time order
+*  @param[in]  max      - Size of 'p_points'
+*  @param[in]  max_scan - Samples read before a downsampled chunk ends early
+*  @param[out] p_num    - Number of samples
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on a database error, DB_BUSY(2)
+*            while the database is busy )
+*/
+uint8_t query_read(query_t * p_query, query_point_t * p_points, uint32_t max,
+                   uint32_t max_scan, uint32_t * p_num);
+
+/* Function declaration to get the cursor of the next chunk
+*  @param[in]  p_query  - Query
+*  @param[out] p_cursor - Buffer of QUERY_CURSOR_LEN bytes
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the query is complete )
+*/
+uint8_t query_cursor(const query_t * p_query, char * p_cursor);
+
+/* Function declaration to end a query
+*  @param[in] p_query - Query
+*  @return - None
+*/
+void query_close(query_t * p_query);
+
+/* Function declaration to encode samples for a reply
+*  @param[in]  p_points - Samples
+*  @param[in]  num      - Number of samples
+*  @param[in]  is_bin   - Non-zero for binary records, CSV lines otherwise
+*  @param[out] p_buf    - Buffer of num * QUERY_CSV_LEN bytes
+*  @return - uint32_t (bytes encoded)
+*/
+uint32_t query_encode(const query_point_t * p_points, uint32_t num, uint8_t is_bin, char * p_buf);
+
+#endif /* QUERY_H */
@@ -0,0 +1,286 @@
+/******************************************************************************/
+
+/* File - registry.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  In-memory registry of the sensors in use. See registry.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "db.h"
+#include "registry.h"
+#include "trace.h"
+
+/******************************************************************************/
+
+/* Upper bound of devices a single ROM search may return, protects against a
+*  broken bus reporting devices forever
+*/
+#define REGISTRY_MAX_SCAN       (256)
+
+/******************************************************************************/
+
+static sensor_t **p_sensors = NULL;
+static uint16_t  num_sensors = 0;
+static uint16_t  max_sensors = 0;
+
+// Guards the table, the bus threads add probes while others iterate
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/******************************************************************************/
+
+/* Function declaration to append a sensor, its 'sen_id' is looked up (or
+*  assigned) in the database. Called with 'registry_lock' held.
+*  @return - sensor_t * (appended sensor, NULL on failure)
+*/
+static sensor_t * registry_append(const char * p_key, sensor_type_t type);
+
+/******************************************************************************/
+
+uint8_t registry_scan(hal_ow_t * uart_path, uint8_t bus)
+{
+    static uint8_t found[REGISTRY_MAX_SCAN][DS18B20_ADDR_LEN];
+    uint16_t       num_found = 0;
+    uint16_t       i, j;
+    hal_result_t   hal_ret_val;
+    sensor_t      *p_sen;
+    char           key[SENSOR_KEY_LEN];
+
+    // First collect all ROM codes, the registry is only touched (and locked)
+    // if the search went through
+    hal_ret_val = hal_ow_rom_search(uart_path, NEW_SEARCH, found[0]);
+    while ((HAL_SUCCESS == hal_ret_val) && (num_found < REGISTRY_MAX_SCAN))
+    {
+        num_found++;
+        if (num_found < REGISTRY_MAX_SCAN)
+        {
+            hal_ret_val = hal_ow_rom_search(uart_path, CONTINUE_WITH_PREV_SEARCH,
+                                                                    found[num_found]);
+        }
+    }
+    if (HAL_ERROR_OW_DATA_ERROR == hal_ret_val)
+    {
+        printf("Bus %u: bus or data error.\n", bus);
+        return FAIL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    for (i = 0; i < num_sensors; i++)
+    {
+        if ((SENSOR_TYPE_DS18B20 == p_sensors[i]->type) && (bus == p_sensors[i]->bus))
+        {
+            p_sensors[i]->present = 0;
+        }
+    }
+
+    for (j = 0; j < num_found; j++)
+    {
+        for (i = 0; i < num_sensors; i++)
+        {
+            if ((SENSOR_TYPE_DS18B20 == p_sensors[i]->type) &&
+                (0 == memcmp(p_sensors[i]->rom, found[j], DS18B20_ADDR_LEN)))
+            {
+                break;
+            }
+        }
+
+        if (i < num_sensors)
+        {
+            // Its task runs on the thread of the other bus
+            p_sen = p_sensors[i];
+            if (bus != p_sen->bus)
+            {
+                printf("DS18B20 %s (sensor ID=%d) found on bus %u, kept on bus %u until "
+                       "restart.\n", p_sen->key, p_sen->sen_id, bus, p_sen->bus);
+                continue;
+            }
+        }
+        else
+        {
+            // Key is the ROM code in the byte order printed by the driver,
+            // i.e. family code first, CRC last
+            for (i = 0; i < DS18B20_ADDR_LEN; i++)
+            {
+                sprintf(&key[2 * i], "%02x", found[j][i]);
+            }
+
+            p_sen = registry_append(key, SENSOR_TYPE_DS18B20);
+            if (NULL == p_sen)
+            {
+                pthread_mutex_unlock(&registry_lock);
+                return FAIL;
+            }
+            memcpy(p_sen->rom, found[j], DS18B20_ADDR_LEN);
+            p_sen->bus = bus;
+
+            printf("DS18B20 %s found on bus %u, sensor ID=%d.\n", p_sen->key, bus,
+                                                                        p_sen->sen_id);
+        }
+        p_sen->present = 1;
+    }
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if ((SENSOR_TYPE_DS18B20 == p_sensors[i]->type) && (bus == p_sensors[i]->bus) &&
+            !p_sensors[i]->present)
+        {
+            printf("DS18B20 %s (sensor ID=%d) not present on bus %u.\n", p_sensors[i]->key,
+                                                            p_sensors[i]->sen_id, bus);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return SUCCESS;
+}
+
+sensor_t * registry_add_analog(const char * p_key, sensor_type_t type)
+{
+    sensor_t *p_sen = NULL;
+    uint16_t  i;
+
+    pthread_mutex_lock(&registry_lock);
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (0 == strcmp(p_sensors[i]->key, p_key))
+        {
+            p_sen = p_sensors[i];
+            break;
+        }
+    }
+
+    if (NULL == p_sen)
+    {
+        p_sen = registry_append(p_key, type);
+        if (NULL != p_sen)
+        {
+            p_sen->present = 1;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return p_sen;
+}
+
+uint16_t registry_count(void)
+{
+    uint16_t count;
+
+    pthread_mutex_lock(&registry_lock);
+    count = num_sensors;
+    pthread_mutex_unlock(&registry_lock);
+
+    return count;
+}
+
+sensor_t * registry_get(uint16_t index)
+{
+    sensor_t *p_sen;
+
+    pthread_mutex_lock(&registry_lock);
+    p_sen = (index < num_sensors) ? (p_sensors[index]) : (NULL);
+    pthread_mutex_unlock(&registry_lock);
+
+    return p_sen;
+}
+
+uint16_t registry_next(sensor_type_t type, uint16_t from)
+{
+    pthread_mutex_lock(&registry_lock);
+    while ((from < num_sensors) &&
+           ((type != p_sensors[from]->type) || !p_sensors[from]->present))
+    {
+        from++;
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return from;
+}
+
+sensor_t * registry_next_on_bus(uint8_t bus, uint16_t * p_index)
+{
+    sensor_t *p_sen = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    while ((NULL == p_sen) && (*p_index < num_sensors))
+    {
+        p_sen = p_sensors[(*p_index)++];
+        if ((SENSOR_TYPE_DS18B20 != p_sen->type) || (bus != p_sen->bus) || !p_sen->present)
+        {
+            p_sen = NULL;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return p_sen;
+}
+
+uint16_t registry_count_present(sensor_type_t type)
+{
+    uint16_t i, count = 0;
+
+    pthread_mutex_lock(&registry_lock);
+    for (i = 0; i < num_sensors; i++)
+    {
+        if ((type == p_sensors[i]->type) && p_sensors[i]->present)
+        {
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    return count;
+}
+
+static sensor_t * registry_append(const char * p_key, sensor_type_t type)
+{
+    sensor_t  *p_new;
+    sensor_t **p_table;
+    uint16_t   sen_id;
+
+    if (SUCCESS != db_map_sensor(p_key, type, &sen_id))
+    {
+        return NULL;
+    }
+
+    // Table of pointers grows, the sensors themselves never move
+    if (num_sensors >= max_sensors)
+    {
+        p_table = (sensor_t **) realloc(p_sensors,
+                            ((max_sensors) ? (2 * max_sensors) : (8)) * sizeof(sensor_t *));
+        if (NULL == p_table)
+        {
+            printf("realloc() failed to allocate.\n");
+            return NULL;
+        }
+        p_sensors = p_table;
+        max_sensors = (max_sensors) ? (2 * max_sensors) : (8);
+    }
+
+    p_new = (sensor_t *) calloc(1, sizeof(sensor_t));
+    if (NULL == p_new)
+    {
+        printf("calloc() failed to allocate.\n");
+        return NULL;
+    }
+    strncpy(p_new->key, p_key, SENSOR_KEY_LEN - 1);
+    p_new->sen_id = sen_id;
+    p_new->type = type;
+    p_new->alarm_low = INT32_MIN;
+    p_new->alarm_high = INT32_MAX;
+    sched_task_init(&p_new->task, NULL, p_new);
+
+    p_sensors[num_sensors++] = p_new;
+    trace_sensor(sen_id, (uint8_t)type, p_key);
+
+    return p_new;
+}
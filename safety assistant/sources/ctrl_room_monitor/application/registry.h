@@ -0,0 +1,129 @@
+/******************************************************************************/
+
+/* File - registry.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  In-memory registry of the sensors in use. DS18B20 probes are enumerated by
+*  a full ROM search at start-up and re-scanned periodically, so probes can be
+*  added or removed without restarting (or recompiling) the application.
+*  Every sensor is identified by a key (hex ROM code for DS18B20, a fixed name
+*  for analog sensors) which is mapped to its 'sen_id' through the 'sensors'
+*  table, so a probe keeps its ID across restarts and re-scans.
+*
+*  Every 1-wire bus is scanned by its own thread (see owbus.h), so the table
+*  is guarded by a mutex. The fields of a DS18B20 belong to the thread of its
+*  bus, the fields of an analog sensor to the acquisition thread.
+*/
+
+/******************************************************************************/
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "ds18b20.h"
+#include "sched.h"
+
+/******************************************************************************/
+
+/* Sensor types, stored as 'sen_type' in the 'sensors' table
+*/
+typedef enum
+{
+    SENSOR_TYPE_DS18B20 = 1,
+    SENSOR_TYPE_GP2Y    = 2,
+    SENSOR_TYPE_HSM     = 3
+} sensor_type_t;
+
+/* Default sampling period and phase of a sensor, overridden per sensor by
+*  'sensor.<sen_id>.period_ms' and 'sensor.<sen_id>.phase_ms'
+*/
+#define SENSOR_PERIOD_MS        (60000)
+#define SENSOR_PHASE_MS         (0)
+
+/* Maximum length of a sensor key (16 hex digits of a ROM code)
+*/
+#define SENSOR_KEY_LEN          (2 * DS18B20_ADDR_LEN + 1)
+
+/* A sensor in use. 'task' samples the sensor with its own period and phase,
+*  'due' marks a DS18B20 waiting for the next conversion on its bus, 'bus'
+*  is the bus it was found on.
+*  'resolution' of a DS18B20 is the one it converted at last (0 until it is
+*  configured), 'alarm_low' and 'alarm_high' are the closest 'low' and 'high'
+*  alarm thresholds in 1 / SAMPLE_SCALE units (INT32_MIN / INT32_MAX if none).
+*  Bus health of a DS18B20: scratchpad reads (retries included), failed ones
+*  and their moving rate, samples lost in a row and the quarantine flag.
+*/
+typedef struct
+{
+    char         key[SENSOR_KEY_LEN];
+    uint8_t      rom[DS18B20_ADDR_LEN];
+    uint16_t     sen_id;
+    uint8_t      type;
+    uint8_t      present;
+    uint8_t      bus;
+    sched_task_t task;
+    uint8_t      due;
+    uint8_t      resolution;
+    int32_t      alarm_low;
+    int32_t      alarm_high;
+    uint32_t     reads;
+    uint32_t     read_errors;
+    float        error_rate;
+    uint8_t      lost_in_row;
+    uint8_t      quarantined;
+} sensor_t;
+
+/******************************************************************************/
+
+/* Function declaration to enumerate all DS18B20 on a bus (full ROM search).
+*  New probes are added (and get a 'sen_id'), probes of the bus no longer
+*  answering are marked absent, known probes found again are marked present.
+*  A probe moved from another bus stays with that bus until the next start.
+*  @param[in] uart_path - UART instance returned by hal_ow_init() function
+*  @param[in] bus       - Index of the bus
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on bus or database error, on a bus
+*            error the registry is left unchanged )
+*/
+uint8_t registry_scan(hal_ow_t * uart_path, uint8_t bus);
+
+/* Function declaration to register an analog sensor under a fixed key
+*  @param[in] p_key - Key of the sensor, e.g. "GP2Y-A0"
+*  @param[in] type  - Sensor type
+*  @return - sensor_t * (registered sensor, NULL on failure)
+*/
+sensor_t * registry_add_analog(const char * p_key, sensor_type_t type);
+
+/* Function declarations to iterate over the registry. Sensors are never
+*  removed, so pointers and indexes stay valid for the life time of the
+*  application.
+*/
+uint16_t   registry_count(void);
+sensor_t * registry_get(uint16_t index);
+
+/* Function declaration to find the next present sensor of a type
+*  @param[in] type - Sensor type, DS18B20 of all buses
+*  @param[in] from - Index to start from (inclusive)
+*  @return - uint16_t (index of the sensor, registry_count() if there is none)
+*/
+uint16_t registry_next(sensor_type_t type, uint16_t from);
+
+/* Function declaration to find the next present DS18B20 of a bus. Safe
+*  while other buses add probes, unlike registry_next() with registry_get().
+*  @param[in]     bus     - Index of the bus
+*  @param[in,out] p_index - Index to start from (inclusive), set past the
+*                           sensor found
+*  @return - sensor_t * (sensor, NULL if there is none)
+*/
+sensor_t * registry_next_on_bus(uint8_t bus, uint16_t * p_index);
+
+/* Function declaration to count present sensors of a type
+*  @param[in] type - Sensor type
+*  @return - uint16_t (number of present sensors)
+*/
+uint16_t registry_count_present(sensor_type_t type);
+
+#endif /* REGISTRY_H */
@@ -0,0 +1,595 @@
+/******************************************************************************/
+
+/* File - replay.c
+*
+*  Target Hardware: Any Linux host
+*
+*  Replay of a raw sensor trace captured by the application ('trace.path',
+*  see trace.h) through its conversion, filtering and storage path: the
+*  scratchpads are checked and converted (ds18b20_decode()), the ADC bursts
+*  reduced, filtered and converted (analog.h), and the samples pass the
+*  compression, spool and batched commits of the storage thread (storage.h)
+*  into a database. Sensors get their IDs from the 'sensors' table of that
+*  database, as in the application.
+*
+*  Sample times come from the trace (virtual clock), not from the replay, so
+*  a day of trace replays in seconds and ends up in the database as in the
+*  field. With '-x N' the trace is paced at N times real time instead. The
+*  replay reports samples per second, the latency of the stages (processing
+*  of a reading, sample-to-disk, database commits) and the growth of the
+*  database file, as a benchmark of processing and storage changes.
+*
+*  Retention, archive, spill file and uplink are switched off: retention
+*  would prune the samples of an old trace by the wall clock. Evaluation
+*  (alarms, loads) is not part of the replay.
+*
+*  '-g hours' first writes a synthetic trace of that length to the trace
+*  file: REPLAY_GEN_PROBES DS18B20 and the dust sensor every 10 s, humidity
+*  every minute, with daily temperature swings, dust puffs, LED edge spikes
+*  and CRC errors followed by their retry.
+*
+*  Usage: replay -d db_path [-s schema.sql] [-c config] [-x speed] [-g hours]
+*                trace_file
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "common.h"
+#include "config.h"
+#include "hal.h"
+#include "ds18b20.h"
+#include "analog.h"
+#include "registry.h"
+#include "db.h"
+#include "sample.h"
+#include "storage.h"
+#include "spool.h"
+#include "stats.h"
+#include "lat.h"
+#include "trace.h"
+
+/******************************************************************************/
+
+/* Self-profiling region of the replay, for the commit latency and counters
+*  of the storage path. Not the one of the application, which may be running.
+*/
+#define REPLAY_STATS_PATH       "/dev/shm/ctrl_room_monitor_replay.stats"
+
+/* Wait of the replay while the storage queue is full
+*/
+#define REPLAY_BACKOFF_US       (200)
+
+/* Synthetic trace ('-g'): probes, periods, readings per analog sample and
+*  rate of corrupted scratchpads
+*/
+#define REPLAY_GEN_PROBES       (8)
+#define REPLAY_GEN_PERIOD_MS    (10000)
+#define REPLAY_GEN_HUM_PERIOD   (6)
+#define REPLAY_GEN_DUST_PULSES  (16)
+#define REPLAY_GEN_HUM_READS    (8)
+#define REPLAY_GEN_CRC_RATE     (0.001)
+
+/******************************************************************************/
+
+/* Sensor of the trace and where its samples go
+*/
+typedef struct
+{
+    uint16_t trace_id;
+    uint16_t sen_id;
+    uint8_t  type;
+    analog_t analog;
+} replay_sensor_t;
+
+static replay_sensor_t sensors[TRACE_MAX_SENSORS];
+static uint16_t        num_sensors = 0;
+
+static uint64_t        gen_prng = 0x9E3779B97F4A7C15ULL;
+
+/******************************************************************************/
+
+/* Function declaration to find the sensor of a trace record
+*  @return - replay_sensor_t * (sensor, NULL if not defined by the trace)
+*/
+static replay_sensor_t * replay_find(uint16_t trace_id);
+
+/* Function declaration to define a sensor of the trace, mapped to its ID in
+*  the database
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t replay_define(const trace_rec_t * p_rec);
+
+/* Function declaration to hand a sample to the storage thread, waits while
+*  its queue is full
+*  @return - uint32_t (number of waits)
+*/
+static uint32_t replay_submit(const sample_t * p_sample);
+
+/* Function declaration to create a database from a schema file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t replay_create_db(const char * p_path, const char * p_schema);
+
+/* Function declaration to get the size of a database, its WAL included
+*  @return - int64_t (bytes)
+*/
+static int64_t replay_db_size(const char * p_path);
+
+/* Function declaration to count the raw rows of a database
+*  @return - int64_t (rows in 'sensor_data', 0 if it cannot be read)
+*/
+static int64_t replay_db_rows(const char * p_path);
+
+/* Function declaration to write a synthetic trace
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t replay_generate(const char * p_path, double hours);
+
+static double  gen_noise(double amplitude);
+
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    trace_reader_t   reader;
+    trace_rec_t      rec;
+    sample_t         sample;
+    replay_sensor_t *p_sen;
+    spool_stats_t    spool_stats;
+    lat_t            proc_lat, commit_lat;
+    struct timespec  ts;
+    const char      *p_db_path = NULL;
+    const char      *p_schema = NULL;
+    const char      *p_config = NULL;
+    const char      *p_trace;
+    double           speed = 0.0, gen_hours = 0.0, elapsed_s;
+    int64_t          t_start_ns, t_acq_ns, t_due_ns, db_size, db_rows;
+    uint64_t         num_records = 0, num_samples = 0, num_bad = 0, num_waits = 0;
+    uint64_t         crc_errors = 0;
+    uint8_t          is_stats = 0;
+    int              opt, ret_val;
+
+    while (-1 != (opt = getopt(argc, argv, "d:s:c:x:g:")))
+    {
+        switch (opt)
+        {
+            case 'd':
+                p_db_path = optarg;
+            break;
+
+            case 's':
+                p_schema = optarg;
+            break;
+
+            case 'c':
+                p_config = optarg;
+            break;
+
+            case 'x':
+                speed = atof(optarg);
+            break;
+
+            case 'g':
+                gen_hours = atof(optarg);
+            break;
+
+            default:
+                p_db_path = NULL;
+            break;
+        }
+    }
+    if ((NULL == p_db_path) || (optind != (argc - 1)) || (speed < 0.0) || (gen_hours < 0.0))
+    {
+        printf("Usage: %s -d db_path [-s schema.sql] [-c config] [-x speed] [-g hours] "
+               "trace_file\n", argv[0]);
+        return 1;
+    }
+    p_trace = argv[optind];
+
+    // Filters and compression as configured in the field, the rest off
+    if ((NULL != p_config) && (SUCCESS != config_load(p_config)))
+    {
+        return 1;
+    }
+    config_set("retention.raw_days", "0");
+    config_set("retention.1m_days", "0");
+    config_set("archive.after_days", "0");
+    config_set("spool.spill_path", "");
+    config_set("uplink.addr", "");
+    config_set("stats.report_ms", "0");
+    config_set("stats.prom_path", "");
+
+    if ((gen_hours > 0.0) && (SUCCESS != replay_generate(p_trace, gen_hours)))
+    {
+        return 1;
+    }
+    if (SUCCESS != trace_reader_open(&reader, p_trace))
+    {
+        return 1;
+    }
+
+    if ((NULL != p_schema) && (0 != access(p_db_path, F_OK)) &&
+        (SUCCESS != replay_create_db(p_db_path, p_schema)))
+    {
+        trace_reader_close(&reader);
+        return 1;
+    }
+    db_size = replay_db_size(p_db_path);
+    db_rows = replay_db_rows(p_db_path);
+
+    is_stats = (SUCCESS == stats_open(REPLAY_STATS_PATH));
+    if ((SUCCESS != db_open(p_db_path, 0)) || (SUCCESS != storage_start()))
+    {
+        db_close();
+        stats_close();
+        trace_reader_close(&reader);
+        return 1;
+    }
+
+    lat_reset(&proc_lat);
+    t_start_ns = lat_now_ns();
+
+    while (1 == (ret_val = trace_read(&reader, &rec)))
+    {
+        num_records++;
+
+        // Virtual clock, a trace of N hours takes N / speed hours
+        if (speed > 0.0)
+        {
+            t_due_ns = t_start_ns + (int64_t)((rec.t_ms * 1e6) / speed);
+            ts.tv_sec = t_due_ns / 1000000000;
+            ts.tv_nsec = t_due_ns % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        if (TRACE_REC_SENSOR == rec.kind)
+        {
+            if (SUCCESS != replay_define(&rec))
+            {
+                ret_val = -1;
+                break;
+            }
+            continue;
+        }
+
+        p_sen = replay_find(rec.sen_id);
+        if (NULL == p_sen)
+        {
+            num_bad++;
+            continue;
+        }
+
+        memset(&sample, 0, sizeof(sample));
+        sample.sen_id = p_sen->sen_id;
+        sample.sen_time = (reader.header.start_ms + rec.t_ms) / 1000;
+        t_acq_ns = lat_now_ns();
+
+        if (TRACE_REC_OW == rec.kind)
+        {
+            // A corrupted scratchpad is lost as in the field, its retry is
+            // the next record
+            if ((SENSOR_TYPE_DS18B20 != p_sen->type) ||
+                (SUCCESS != ds18b20_decode(rec.pad, &sample.sen_val, NULL)))
+            {
+                num_bad++;
+                continue;
+            }
+        }
+        else if ((SENSOR_TYPE_GP2Y == p_sen->type) || (SENSOR_TYPE_HSM == p_sen->type))
+        {
+            sample.sen_val = analog_process(&p_sen->analog, rec.adc, rec.num_adc);
+        }
+        else
+        {
+            num_bad++;
+            continue;
+        }
+
+        sample.t_acq_ns = lat_now_ns();
+        lat_add(&proc_lat, sample.t_acq_ns - t_acq_ns);
+        num_waits += replay_submit(&sample);
+        num_samples++;
+    }
+
+    // Stored up to the last sample before the clock stops
+    storage_stop();
+    elapsed_s = (lat_now_ns() - t_start_ns) / 1e9;
+    trace_reader_close(&reader);
+    spool_get_stats(&spool_stats);
+
+    lat_reset(&commit_lat);
+    if (is_stats)
+    {
+        stats_read_hist(p_stats, STATS_DB_COMMIT, &commit_lat);
+        crc_errors = stats_read_counter(p_stats, STATS_CRC_ERRORS);
+        stats_close();
+        unlink(REPLAY_STATS_PATH);
+    }
+    db_close();
+
+    if (ret_val < 0)
+    {
+        printf("Trace corrupted at byte %llu, replay ends there.\n",
+                                                (unsigned long long)reader.offset);
+    }
+
+    printf("Trace of %.2f h, %llu records, %u sensor(s), replayed in %.2f s (%.0fx real time)\n",
+           reader.t_ms / 3.6e6, (unsigned long long)num_records, num_sensors, elapsed_s,
+           (elapsed_s > 0.0) ? ((reader.t_ms / 1e3) / elapsed_s) : (0.0));
+    printf("Samples: %llu (%.0f/s), lost readings %llu (CRC errors %llu), queue waits %llu\n",
+           (unsigned long long)num_samples, (elapsed_s > 0.0) ? (num_samples / elapsed_s) : (0.0),
+           (unsigned long long)num_bad, (unsigned long long)crc_errors,
+           (unsigned long long)num_waits);
+    printf("Committed %llu (raw rows %lld, see compress.h), dropped %llu\n",
+           (unsigned long long)spool_stats.stored, (long long)(replay_db_rows(p_db_path) - db_rows),
+           (unsigned long long)spool_stats.dropped);
+    lat_print(&proc_lat, "Processing of a reading");
+    if (is_stats)
+    {
+        lat_print(&commit_lat, "Database commit");
+    }
+    db_size = replay_db_size(p_db_path) - db_size;
+    printf("Database grew by %lld bytes (%.1f bytes a sample)\n", (long long)db_size,
+                        (num_samples) ? ((double)db_size / num_samples) : (0.0));
+
+    return ((ret_val < 0) || spool_stats.dropped) ? (1) : (0);
+}
+
+/******************************************************************************/
+
+static replay_sensor_t * replay_find(uint16_t trace_id)
+{
+    uint16_t i;
+
+    for (i = 0; i < num_sensors; i++)
+    {
+        if (trace_id == sensors[i].trace_id)
+        {
+            return &sensors[i];
+        }
+    }
+
+    return NULL;
+}
+
+static uint8_t replay_define(const trace_rec_t * p_rec)
+{
+    replay_sensor_t *p_sen = replay_find(p_rec->sen_id);
+
+    if (NULL == p_sen)
+    {
+        if (num_sensors >= TRACE_MAX_SENSORS)
+        {
+            printf("More than %d sensors in the trace.\n", TRACE_MAX_SENSORS);
+            return FAIL;
+        }
+        p_sen = &sensors[num_sensors++];
+    }
+
+    p_sen->trace_id = p_rec->sen_id;
+    p_sen->type = p_rec->type;
+    if (SUCCESS != db_map_sensor(p_rec->key, p_rec->type, &p_sen->sen_id))
+    {
+        return FAIL;
+    }
+    if ((SENSOR_TYPE_GP2Y == p_sen->type) || (SENSOR_TYPE_HSM == p_sen->type))
+    {
+        return analog_init(&p_sen->analog, p_sen->type, p_sen->sen_id);
+    }
+
+    return SUCCESS;
+}
+
+static uint32_t replay_submit(const sample_t * p_sample)
+{
+    uint32_t num_waits = 0;
+
+    // Nothing is dropped here, the replay runs at the pace of the storage
+    while (!storage_has_room())
+    {
+        num_waits++;
+        usleep(REPLAY_BACKOFF_US);
+    }
+    if (SUCCESS != storage_submit(p_sample))
+    {
+        printf("Storage queue full, sample of sensor ID=%d dropped.\n", p_sample->sen_id);
+        stats_count(STATS_QUEUE_DROPS, 1);
+        return num_waits;
+    }
+    stats_count(STATS_SAMPLES, 1);
+
+    return num_waits;
+}
+
+static uint8_t replay_create_db(const char * p_path, const char * p_schema)
+{
+    sqlite3 *p_db = NULL;
+    FILE    *p_file;
+    char    *p_sql;
+    long     size;
+    uint8_t  ret_val;
+
+    p_file = fopen(p_schema, "r");
+    if (NULL == p_file)
+    {
+        printf("%s not found.\n", p_schema);
+        return FAIL;
+    }
+    fseek(p_file, 0, SEEK_END);
+    size = ftell(p_file);
+    rewind(p_file);
+    p_sql = (char *) calloc(1, (size_t)size + 1);
+    ret_val = (NULL != p_sql) && (fread(p_sql, 1, (size_t)size, p_file) == (size_t)size);
+    fclose(p_file);
+
+    ret_val = ret_val && (SQLITE_OK == sqlite3_open(p_path, &p_db)) &&
+              (SQLITE_OK == sqlite3_exec(p_db, p_sql, NULL, NULL, NULL));
+    sqlite3_close(p_db);
+    free(p_sql);
+    if (!ret_val)
+    {
+        printf("Failed to create %s from %s.\n", p_path, p_schema);
+    }
+
+    return ret_val;
+}
+
+static int64_t replay_db_size(const char * p_path)
+{
+    struct stat st;
+    char        wal_path[PATH_MAX];
+    int64_t     size = 0;
+
+    if (0 == stat(p_path, &st))
+    {
+        size += st.st_size;
+    }
+    snprintf(wal_path, sizeof(wal_path), "%s-wal", p_path);
+    if (0 == stat(wal_path, &st))
+    {
+        size += st.st_size;
+    }
+
+    return size;
+}
+
+static int64_t replay_db_rows(const char * p_path)
+{
+    sqlite3      *p_db = NULL;
+    sqlite3_stmt *p_stmt = NULL;
+    int64_t       rows = 0;
+
+    if ((SQLITE_OK == sqlite3_open_v2(p_path, &p_db, SQLITE_OPEN_READONLY, NULL)) &&
+        (SQLITE_OK == sqlite3_prepare_v2(p_db, "SELECT COUNT(*) FROM sensor_data;", -1,
+                                                                    &p_stmt, NULL)) &&
+        (SQLITE_ROW == sqlite3_step(p_stmt)))
+    {
+        rows = sqlite3_column_int64(p_stmt, 0);
+    }
+    sqlite3_finalize(p_stmt);
+    sqlite3_close(p_db);
+
+    return rows;
+}
+
+/******************************************************************************/
+
+static uint8_t replay_generate(const char * p_path, double hours)
+{
+    trace_rec_t rec;
+    int64_t     t_ms, end_ms;
+    uint32_t    period = 0;
+    double      temp, phase, dust;
+    uint8_t     i, j;
+
+    if (SUCCESS != trace_open(p_path, 0))
+    {
+        return FAIL;
+    }
+
+    // Probes with ROM codes of the DS18B20 family, then the analog sensors,
+    // i.e. the IDs the application assigns on a fresh database
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = TRACE_REC_SENSOR;
+    rec.type = SENSOR_TYPE_DS18B20;
+    for (i = 0; i < REPLAY_GEN_PROBES; i++)
+    {
+        rec.sen_id = i + 1;
+        snprintf(rec.key, sizeof(rec.key), "28%02x0000000000%02x", i + 1, i * 37);
+        trace_put(&rec);
+    }
+    rec.sen_id = REPLAY_GEN_PROBES + 1;
+    rec.type = SENSOR_TYPE_GP2Y;
+    snprintf(rec.key, sizeof(rec.key), "%s", DUST_SENSOR_KEY);
+    trace_put(&rec);
+    rec.sen_id = REPLAY_GEN_PROBES + 2;
+    rec.type = SENSOR_TYPE_HSM;
+    snprintf(rec.key, sizeof(rec.key), "%s", HUMIDITY_SENSOR_KEY);
+    trace_put(&rec);
+
+    end_ms = (int64_t)(hours * 3.6e6);
+    for (t_ms = 0; t_ms < end_ms; t_ms += REPLAY_GEN_PERIOD_MS, period++)
+    {
+        // Cabinet temperatures swing over the day, each probe a bit warmer,
+        // read at 12-bit
+        phase = (2.0 * M_PI * (t_ms % 86400000)) / 86400000.0;
+        rec.kind = TRACE_REC_OW;
+        for (i = 0; i < REPLAY_GEN_PROBES; i++)
+        {
+            temp = 25.0 + (3.0 * sin(phase)) + (0.5 * i) + gen_noise(0.1);
+            rec.sen_id = i + 1;
+            rec.t_ms = t_ms + (i * 15);
+            rec.pad[0] = (uint8_t)((int16_t)lrint(temp * 16.0) & 0xFF);
+            rec.pad[1] = (uint8_t)(((int16_t)lrint(temp * 16.0) >> 8) & 0xFF);
+            rec.pad[DS18B20_PAD_TH] = 0x4B;
+            rec.pad[DS18B20_PAD_TL] = 0x46;
+            rec.pad[DS18B20_PAD_CONFIG] = DS18B20_CFG(DS18B20_RES_MAX);
+            rec.pad[5] = 0xFF;
+            rec.pad[6] = 0x0C;
+            rec.pad[7] = 0x10;
+            rec.pad[8] = hal_ow_crc8(rec.pad, TRACE_PAD_LEN - 1);
+
+            // A glitch on the bus, read again after a reset
+            if (((gen_noise(0.5) + 0.5) < REPLAY_GEN_CRC_RATE))
+            {
+                rec.pad[0] ^= 0x04;
+                trace_put(&rec);
+                rec.pad[0] ^= 0x04;
+            }
+            trace_put(&rec);
+        }
+
+        // Dust puff every 10 minutes, now and then a pulse hit by an LED edge
+        j = (uint8_t)((t_ms / 1000) % 600 / 30);
+        dust = ((j >= 10) && (j < 14)) ? (400.0) : (150.0);
+        rec.kind = TRACE_REC_AIO;
+        rec.sen_id = REPLAY_GEN_PROBES + 1;
+        rec.t_ms = t_ms + 200;
+        rec.num_adc = REPLAY_GEN_DUST_PULSES;
+        for (i = 0; i < REPLAY_GEN_DUST_PULSES; i++)
+        {
+            rec.adc[i] = (int32_t)lrint(dust + gen_noise(4.0));
+            if ((gen_noise(0.5) + 0.5) < 0.01)
+            {
+                rec.adc[i] += 300;
+            }
+        }
+        trace_put(&rec);
+
+        if (0 == (period % REPLAY_GEN_HUM_PERIOD))
+        {
+            rec.sen_id = REPLAY_GEN_PROBES + 2;
+            rec.t_ms = t_ms + 300;
+            rec.num_adc = REPLAY_GEN_HUM_READS;
+            for (i = 0; i < REPLAY_GEN_HUM_READS; i++)
+            {
+                rec.adc[i] = (int32_t)lrint(290.0 + (20.0 * sin(phase)) + gen_noise(2.0));
+            }
+            trace_put(&rec);
+        }
+    }
+    trace_close();
+
+    return SUCCESS;
+}
+
+/* Uniform noise of +/- amplitude, xorshift64* as the simulated HAL
+*/
+static double gen_noise(double amplitude)
+{
+    gen_prng ^= gen_prng >> 12;
+    gen_prng ^= gen_prng << 25;
+    gen_prng ^= gen_prng >> 27;
+
+    return amplitude * ((((gen_prng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0) * 2.0 - 1.0);
+}
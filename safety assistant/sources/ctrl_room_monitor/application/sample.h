@@ -0,0 +1,41 @@
+/******************************************************************************/
+
+/* File - sample.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  A timestamped sensor sample as passed from the acquisition thread to the
+*  storage and evaluation threads (see storage.h, eval.h). It is also the
+*  record of the spool spill file (see spool.h).
+*/
+
+/******************************************************************************/
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+/* Sample values are scaled integers, 'sen_val' is in 1 / SAMPLE_SCALE units
+*  (e.g. 2506 is 25.06 degree celsius), the resolution they are stored with
+*/
+#define SAMPLE_SCALE            (100)
+
+/* Flags of a sample on its way to the database: the raw row and the rollup
+*  buckets are written unless left out (see compress.h)
+*/
+#define SAMPLE_NO_RAW           (0x0001)
+#define SAMPLE_NO_ROLLUP        (0x0002)
+
+typedef struct
+{
+    int64_t  sen_time;                          // Acquisition time (unix seconds)
+    int64_t  t_acq_ns;                          // CLOCK_MONOTONIC at acquisition, 0 if unknown
+    int32_t  sen_val;
+    uint16_t sen_id;
+    uint16_t flags;                             // SAMPLE_NO_*, 0 stores both
+} sample_t;
+
+#endif /* SAMPLE_H */
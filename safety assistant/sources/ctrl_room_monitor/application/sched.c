@@ -0,0 +1,428 @@
+/******************************************************************************/
+
+/* File - sched.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Drift-free task scheduler on CLOCK_MONOTONIC. See sched.h for details.
+*/
+
+/******************************************************************************/
+
+// ppoll()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+
+#include "common.h"
+#include "sched.h"
+
+/******************************************************************************/
+
+#define NSEC_PER_MSEC           (1000000L)
+#define NSEC_PER_SEC            (1000000000L)
+
+/******************************************************************************/
+
+// Every thread has a scheduler of its own
+static __thread sched_task_t   *p_heap[SCHED_MAX_TASKS];
+static __thread uint16_t        heap_size = 0;
+static __thread struct timespec sched_epoch;
+
+static __thread struct pollfd   poll_fds[SCHED_MAX_FDS];
+static __thread sched_fd_t     *p_watches[SCHED_MAX_FDS];
+static __thread uint16_t        num_fds = 0;
+
+static __thread sched_observer_fn_t observer_fn = NULL;
+
+/******************************************************************************/
+
+/* Function declarations of time helpers
+*/
+static void    ts_add_ms(struct timespec * p_ts, uint32_t ms);
+static int     ts_cmp(const struct timespec * p_a, const struct timespec * p_b);
+static int64_t ts_diff_ms(const struct timespec * p_a, const struct timespec * p_b);
+
+/* Function declaration to wait for the earliest deadline or input on a
+*  watched descriptor
+*  @return - int (number of watchers run, 0 once the deadline is reached)
+*/
+static int     sched_wait(void);
+
+/* Function declarations of the min-heap
+*/
+static uint8_t heap_insert(sched_task_t * p_task);
+static void    heap_remove(sched_task_t * p_task);
+static void    heap_sift_up(uint16_t index);
+static void    heap_sift_down(uint16_t index);
+static void    heap_swap(uint16_t a, uint16_t b);
+
+/******************************************************************************/
+
+void sched_init(void)
+{
+    heap_size = 0;
+    num_fds = 0;
+    observer_fn = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &sched_epoch);
+}
+
+void sched_task_init(sched_task_t * p_task, sched_fn_t fn, void * p_arg)
+{
+    p_task->fn = fn;
+    p_task->p_arg = p_arg;
+    p_task->period_ms = 0;
+    p_task->heap_index = -1;
+    p_task->overruns = 0;
+    p_task->late_ns = 0;
+}
+
+uint8_t sched_start(sched_task_t * p_task, uint32_t period_ms, uint32_t phase_ms)
+{
+    struct timespec now;
+    int64_t         late_ms;
+
+    if (0 == period_ms)
+    {
+        return FAIL;
+    }
+
+    sched_stop(p_task);
+
+    // Align to the common epoch, so tasks with the same period and phase
+    // always run together, no matter when they were started
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    p_task->deadline = sched_epoch;
+    ts_add_ms(&p_task->deadline, phase_ms);
+
+    late_ms = ts_diff_ms(&now, &p_task->deadline);
+    if (late_ms > 0)
+    {
+        ts_add_ms(&p_task->deadline, (uint32_t)(((late_ms + period_ms - 1) / period_ms) * period_ms));
+    }
+    p_task->period_ms = period_ms;
+
+    return heap_insert(p_task);
+}
+
+uint8_t sched_after(sched_task_t * p_task, uint32_t delay_ms)
+{
+    sched_stop(p_task);
+
+    clock_gettime(CLOCK_MONOTONIC, &p_task->deadline);
+    ts_add_ms(&p_task->deadline, delay_ms);
+    p_task->period_ms = 0;
+
+    return heap_insert(p_task);
+}
+
+void sched_stop(sched_task_t * p_task)
+{
+    if (p_task->heap_index >= 0)
+    {
+        heap_remove(p_task);
+    }
+}
+
+uint8_t sched_is_pending(const sched_task_t * p_task)
+{
+    return (p_task->heap_index >= 0);
+}
+
+int sched_run(void)
+{
+    struct timespec now, t_run, t_end;
+    sched_task_t   *p_task;
+    int             num_run = 0;
+    int64_t         late_ms;
+
+    if ((0 == heap_size) && (0 == num_fds))
+    {
+        return -1;
+    }
+
+    num_run = sched_wait();
+    if (num_run > 0)
+    {
+        return num_run;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    while ((heap_size > 0) && (ts_cmp(&p_heap[0]->deadline, &now) <= 0))
+    {
+        p_task = p_heap[0];
+        heap_remove(p_task);
+
+        clock_gettime(CLOCK_MONOTONIC, &t_run);
+        p_task->late_ns = ((int64_t)(t_run.tv_sec - p_task->deadline.tv_sec) * NSEC_PER_SEC) +
+                                                (t_run.tv_nsec - p_task->deadline.tv_nsec);
+
+        if (p_task->period_ms)
+        {
+            ts_add_ms(&p_task->deadline, p_task->period_ms);
+
+            // Deadlines missed completely are skipped instead of running the
+            // task several times back-to-back
+            late_ms = ts_diff_ms(&now, &p_task->deadline);
+            if (late_ms >= 0)
+            {
+                p_task->overruns += (uint32_t)(late_ms / p_task->period_ms) + 1;
+                ts_add_ms(&p_task->deadline,
+                          (uint32_t)((late_ms / p_task->period_ms) + 1) * p_task->period_ms);
+
+                #if defined(RUN_TIME_LOG)
+                    printf("Task %p overrun, %u deadline(s) missed so far.\n",
+                                                    (void *)p_task, p_task->overruns);
+                #endif
+            }
+            heap_insert(p_task);
+        }
+
+        // A task may re-arm or stop itself (or others) from here
+        if (NULL == observer_fn)
+        {
+            p_task->fn(p_task);
+        }
+        else
+        {
+            p_task->fn(p_task);
+            clock_gettime(CLOCK_MONOTONIC, &t_end);
+            observer_fn(p_task, ((int64_t)(t_end.tv_sec - t_run.tv_sec) * NSEC_PER_SEC) +
+                                                    (t_end.tv_nsec - t_run.tv_nsec));
+        }
+        num_run++;
+    }
+
+    return num_run;
+}
+
+void sched_set_observer(sched_observer_fn_t fn)
+{
+    observer_fn = fn;
+}
+
+uint8_t sched_watch(sched_fd_t * p_watch, int fd, sched_fd_fn_t fn, void * p_arg)
+{
+    if (num_fds >= SCHED_MAX_FDS)
+    {
+        printf("Too many watched file descriptors.\n");
+        return FAIL;
+    }
+
+    p_watch->fd = fd;
+    p_watch->fn = fn;
+    p_watch->p_arg = p_arg;
+    p_watch->index = num_fds;
+
+    poll_fds[num_fds].fd = fd;
+    poll_fds[num_fds].events = POLLIN;
+    poll_fds[num_fds].revents = 0;
+    p_watches[num_fds++] = p_watch;
+
+    return SUCCESS;
+}
+
+void sched_unwatch(sched_fd_t * p_watch)
+{
+    uint16_t index = (uint16_t)p_watch->index;
+
+    if (p_watch->index < 0)
+    {
+        return;
+    }
+    p_watch->index = -1;
+
+    // Last entry takes the free slot, including its pending events
+    num_fds--;
+    if (index != num_fds)
+    {
+        poll_fds[index] = poll_fds[num_fds];
+        p_watches[index] = p_watches[num_fds];
+        p_watches[index]->index = index;
+    }
+}
+
+/******************************************************************************/
+
+static int sched_wait(void)
+{
+    struct timespec now, timeout;
+    int             num_run = 0;
+    int             ret_val;
+    int16_t         i;
+    sched_fd_t     *p_watch;
+
+    for ( ; ; )
+    {
+        if (0 == num_fds)
+        {
+            // Absolute sleep, a late wake-up does not add up over periods
+            while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                                        &p_heap[0]->deadline, NULL))
+            {
+            }
+            return 0;
+        }
+
+        // ppoll() only takes a relative timeout, the deadline itself stays
+        // absolute, so a wake-up by input does not shift it
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (heap_size > 0)
+        {
+            if (ts_cmp(&p_heap[0]->deadline, &now) <= 0)
+            {
+                return 0;
+            }
+            timeout.tv_sec = p_heap[0]->deadline.tv_sec - now.tv_sec;
+            timeout.tv_nsec = p_heap[0]->deadline.tv_nsec - now.tv_nsec;
+            if (timeout.tv_nsec < 0)
+            {
+                timeout.tv_sec--;
+                timeout.tv_nsec += NSEC_PER_SEC;
+            }
+        }
+
+        ret_val = ppoll(poll_fds, num_fds, (heap_size > 0) ? (&timeout) : (NULL), NULL);
+        if (ret_val > 0)
+        {
+            break;
+        }
+    }
+
+    // Backwards, a watcher removed meanwhile is replaced by an entry already
+    // handled and a new one is appended behind
+    for (i = (int16_t)num_fds - 1; i >= 0; i--)
+    {
+        if (i >= num_fds)
+        {
+            continue;
+        }
+        if (0 == poll_fds[i].revents)
+        {
+            continue;
+        }
+        poll_fds[i].revents = 0;
+
+        p_watch = p_watches[i];
+        p_watch->fn(p_watch);
+        num_run++;
+    }
+
+    return num_run;
+}
+
+static void ts_add_ms(struct timespec * p_ts, uint32_t ms)
+{
+    p_ts->tv_sec += ms / 1000;
+    p_ts->tv_nsec += (long)(ms % 1000) * NSEC_PER_MSEC;
+    if (p_ts->tv_nsec >= NSEC_PER_SEC)
+    {
+        p_ts->tv_sec++;
+        p_ts->tv_nsec -= NSEC_PER_SEC;
+    }
+}
+
+static int ts_cmp(const struct timespec * p_a, const struct timespec * p_b)
+{
+    if (p_a->tv_sec != p_b->tv_sec)
+    {
+        return (p_a->tv_sec < p_b->tv_sec) ? (-1) : (1);
+    }
+    if (p_a->tv_nsec != p_b->tv_nsec)
+    {
+        return (p_a->tv_nsec < p_b->tv_nsec) ? (-1) : (1);
+    }
+    return 0;
+}
+
+static int64_t ts_diff_ms(const struct timespec * p_a, const struct timespec * p_b)
+{
+    return ((int64_t)(p_a->tv_sec - p_b->tv_sec) * 1000) +
+                                    ((p_a->tv_nsec - p_b->tv_nsec) / NSEC_PER_MSEC);
+}
+
+static uint8_t heap_insert(sched_task_t * p_task)
+{
+    if (heap_size >= SCHED_MAX_TASKS)
+    {
+        printf("Too many scheduled tasks.\n");
+        return FAIL;
+    }
+
+    p_heap[heap_size] = p_task;
+    p_task->heap_index = heap_size;
+    heap_sift_up(heap_size++);
+
+    return SUCCESS;
+}
+
+static void heap_remove(sched_task_t * p_task)
+{
+    uint16_t index = (uint16_t)p_task->heap_index;
+
+    p_task->heap_index = -1;
+    heap_size--;
+
+    if (index != heap_size)
+    {
+        p_heap[index] = p_heap[heap_size];
+        p_heap[index]->heap_index = index;
+        heap_sift_up(index);
+        heap_sift_down((uint16_t)p_heap[index]->heap_index);
+    }
+}
+
+static void heap_sift_up(uint16_t index)
+{
+    uint16_t parent;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (ts_cmp(&p_heap[index]->deadline, &p_heap[parent]->deadline) >= 0)
+        {
+            break;
+        }
+        heap_swap(index, parent);
+        index = parent;
+    }
+}
+
+static void heap_sift_down(uint16_t index)
+{
+    uint16_t child;
+
+    for ( ; ; )
+    {
+        child = (2 * index) + 1;
+        if (child >= heap_size)
+        {
+            break;
+        }
+        if (((child + 1) < heap_size) &&
+            (ts_cmp(&p_heap[child + 1]->deadline, &p_heap[child]->deadline) < 0))
+        {
+            child++;
+        }
+        if (ts_cmp(&p_heap[index]->deadline, &p_heap[child]->deadline) <= 0)
+        {
+            break;
+        }
+        heap_swap(index, child);
+        index = child;
+    }
+}
+
+static void heap_swap(uint16_t a, uint16_t b)
+{
+    sched_task_t *p_tmp = p_heap[a];
+
+    p_heap[a] = p_heap[b];
+    p_heap[b] = p_tmp;
+    p_heap[a]->heap_index = a;
+    p_heap[b]->heap_index = b;
+}
@@ -0,0 +1,153 @@
+/******************************************************************************/
+
+/* File - sched.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Drift-free task scheduler on CLOCK_MONOTONIC. Tasks are kept in a binary
+*  min-heap ordered by their absolute deadline. A periodic task is due at
+*  epoch + phase + k * period, i.e. the time a task needs to run does not
+*  shift its next deadline. One-shot tasks are used to continue slow jobs
+*  (e.g. DS18B20 conversion) later without blocking other tasks meanwhile.
+*
+*  File descriptors (e.g. sockets) can be watched as well, the scheduler then
+*  waits with ppoll() instead of clock_nanosleep() and calls the watcher once
+*  the descriptor is readable. Everything runs on the calling thread, and
+*  the scheduler state is per thread, so every thread calling sched_init()
+*  runs a scheduler of its own.
+*
+*  Task and watcher objects are owned by the caller, the scheduler does not
+*  allocate.
+*/
+
+/******************************************************************************/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <time.h>
+
+/******************************************************************************/
+
+/* Maximum number of tasks scheduled at the same time
+*/
+#define SCHED_MAX_TASKS         (128)
+
+/* Maximum number of watched file descriptors
+*/
+#define SCHED_MAX_FDS           (32)
+
+typedef struct sched_task sched_task_t;
+
+/* Task function, called with the task itself once its deadline is reached
+*/
+typedef void (*sched_fn_t)(sched_task_t * p_task);
+
+struct sched_task
+{
+    struct timespec deadline;
+    uint32_t        period_ms;
+    sched_fn_t      fn;
+    void           *p_arg;
+    int16_t         heap_index;
+    uint32_t        overruns;
+    int64_t         late_ns;                    // Run time minus deadline, last run
+};
+
+/* Observer, called after every task function with its run time, e.g. to
+*  profile the tasks of a thread
+*/
+typedef void (*sched_observer_fn_t)(const sched_task_t * p_task, int64_t run_ns);
+
+typedef struct sched_fd sched_fd_t;
+
+/* Watcher function, called once the descriptor is readable (or hung up)
+*/
+typedef void (*sched_fd_fn_t)(sched_fd_t * p_watch);
+
+struct sched_fd
+{
+    int             fd;
+    sched_fd_fn_t   fn;
+    void           *p_arg;
+    int16_t         index;
+};
+
+/******************************************************************************/
+
+/* Function declaration to initialize the scheduler of the calling thread, sets
+*  the common epoch all its periodic tasks are aligned to
+*  @return - None
+*/
+void sched_init(void);
+
+/* Function declaration to prepare a task object, must be called once before
+*  the task is started
+*  @param[in] p_task - Task object
+*  @param[in] fn     - Task function
+*  @param[in] p_arg  - User argument, available as p_task->p_arg
+*  @return - None
+*/
+void sched_task_init(sched_task_t * p_task, sched_fn_t fn, void * p_arg);
+
+/* Function declaration to start a periodic task. It first runs at the next
+*  epoch + phase_ms + k * period_ms not in the past.
+*  @param[in] p_task    - Task object
+*  @param[in] period_ms - Period in milliseconds, must not be 0
+*  @param[in] phase_ms  - Phase in milliseconds
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t sched_start(sched_task_t * p_task, uint32_t period_ms, uint32_t phase_ms);
+
+/* Function declaration to run a task once after a delay
+*  @param[in] p_task   - Task object
+*  @param[in] delay_ms - Delay from now in milliseconds
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t sched_after(sched_task_t * p_task, uint32_t delay_ms);
+
+/* Function declaration to remove a task from the schedule
+*  @param[in] p_task - Task object
+*  @return - None
+*/
+void sched_stop(sched_task_t * p_task);
+
+/* Function declaration to check if a task is scheduled
+*  @param[in] p_task - Task object
+*  @return - uint8_t (1 if scheduled, 0 otherwise)
+*/
+uint8_t sched_is_pending(const sched_task_t * p_task);
+
+/* Function declaration to watch a file descriptor for input
+*  @param[in] p_watch - Watcher object
+*  @param[in] fd      - File descriptor
+*  @param[in] fn      - Watcher function
+*  @param[in] p_arg   - User argument, available as p_watch->p_arg
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t sched_watch(sched_fd_t * p_watch, int fd, sched_fd_fn_t fn, void * p_arg);
+
+/* Function declaration to stop watching a file descriptor, may be called
+*  from any task or watcher function
+*  @param[in] p_watch - Watcher object
+*  @return - None
+*/
+void sched_unwatch(sched_fd_t * p_watch);
+
+/* Function declaration to set the observer of the calling thread's
+*  scheduler. Without an observer the run time is not measured.
+*  @param[in] fn - Observer function, NULL to remove it
+*  @return - None
+*/
+void sched_set_observer(sched_observer_fn_t fn);
+
+/* Function declaration to sleep until the earliest deadline and run all
+*  tasks due by then. If a watched descriptor gets readable first, its
+*  watcher is run instead and due tasks follow with the next call.
+*  @return - int (number of tasks and watchers run, -1 if nothing is scheduled
+*            or watched)
+*/
+int sched_run(void);
+
+#endif /* SCHED_H */
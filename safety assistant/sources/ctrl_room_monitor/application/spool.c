@@ -0,0 +1,374 @@
+/******************************************************************************/
+
+/* File - spool.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Store-and-forward buffer between acquisition and the database. See
+*  spool.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "ipc.h"
+#include "spool.h"
+
+/******************************************************************************/
+
+/* Spill file identification, "SPL2". "SPL1" files hold the float values of
+*  the former sample layout, they are converted on open.
+*/
+#define SPOOL_MAGIC             (0x324C5053)
+#define SPOOL_MAGIC_FLOAT       (0x314C5053)
+
+/* Spill file header, followed by 'capacity' records. 'head' and 'tail' count
+*  samples since the file was created, the record of a sample is at index
+*  count % capacity.
+*/
+typedef struct
+{
+    uint32_t magic;
+    uint32_t rec_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    uint64_t head;
+    uint64_t tail;
+} spool_header_t;
+
+/******************************************************************************/
+
+static sample_t       *p_ram = NULL;
+static uint32_t        ram_capacity = 0;
+static uint32_t        ram_head = 0;
+static uint32_t        ram_count = 0;
+
+static spool_header_t *p_spill = NULL;
+static sample_t       *p_spill_recs = NULL;
+static size_t          spill_size = 0;
+
+static spool_stats_t   stats;
+
+// Guards depth and counters against spool_get_stats() of another thread
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/******************************************************************************/
+
+/* Function declaration to map the spill file, created if needed
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t spool_map_spill(const char * p_path, uint32_t capacity);
+
+/* Function declaration to append a sample to the spill file, its oldest
+*  sample is dropped if it is full
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if a sample was dropped )
+*/
+static uint8_t spool_spill(const sample_t * p_sample);
+
+static uint8_t spool_cmd(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err);
+
+/******************************************************************************/
+
+uint8_t spool_open(uint32_t capacity, const char * p_spill_path, uint32_t spill_capacity)
+{
+    if (0 == capacity)
+    {
+        printf("Invalid spool capacity.\n");
+        return FAIL;
+    }
+
+    p_ram = (sample_t *) calloc(capacity, sizeof(sample_t));
+    if (NULL == p_ram)
+    {
+        printf("calloc() failed to allocate.\n");
+        return FAIL;
+    }
+    ram_capacity = capacity;
+    ram_head = 0;
+    ram_count = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    if ((NULL != p_spill_path) && ('\0' != p_spill_path[0]) && (spill_capacity > 0))
+    {
+        if (SUCCESS != spool_map_spill(p_spill_path, spill_capacity))
+        {
+            free(p_ram);
+            p_ram = NULL;
+            return FAIL;
+        }
+
+        if (p_spill->tail != p_spill->head)
+        {
+            printf("%u sample(s) of the spill file to be stored.\n",
+                                            (unsigned)(p_spill->tail - p_spill->head));
+        }
+    }
+
+    return SUCCESS;
+}
+
+uint8_t spool_push(const sample_t * p_sample)
+{
+    uint8_t ret_val = SUCCESS;
+
+    pthread_mutex_lock(&stats_lock);
+    stats.pushed++;
+
+    if (ram_count == ram_capacity)
+    {
+        // Oldest sample of the RAM ring is still newer than everything in
+        // the spill file, so it goes behind them
+        if (NULL != p_spill)
+        {
+            ret_val = spool_spill(&p_ram[ram_head]);
+        }
+        else
+        {
+            stats.dropped++;
+            ret_val = FAIL;
+        }
+        ram_head = (ram_head + 1) % ram_capacity;
+        ram_count--;
+    }
+
+    p_ram[(ram_head + ram_count) % ram_capacity] = *p_sample;
+    ram_count++;
+    pthread_mutex_unlock(&stats_lock);
+
+    return ret_val;
+}
+
+uint32_t spool_peek(sample_t * p_samples, uint32_t max)
+{
+    uint64_t index;
+    uint32_t num = 0;
+    uint32_t i;
+
+    if (NULL != p_spill)
+    {
+        for (index = p_spill->head; (index < p_spill->tail) && (num < max); index++)
+        {
+            p_samples[num++] = p_spill_recs[index % p_spill->capacity];
+        }
+    }
+
+    for (i = 0; (i < ram_count) && (num < max); i++)
+    {
+        p_samples[num++] = p_ram[(ram_head + i) % ram_capacity];
+    }
+
+    return num;
+}
+
+void spool_consume(uint32_t num)
+{
+    uint64_t spill_num;
+
+    pthread_mutex_lock(&stats_lock);
+    stats.stored += num;
+
+    if (NULL != p_spill)
+    {
+        spill_num = p_spill->tail - p_spill->head;
+        if (spill_num > num)
+        {
+            spill_num = num;
+        }
+        p_spill->head += spill_num;
+        num -= (uint32_t)spill_num;
+    }
+
+    if (num > ram_count)
+    {
+        num = ram_count;
+    }
+    ram_head = (ram_head + num) % ram_capacity;
+    ram_count -= num;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void spool_retry(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    stats.retries++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+uint32_t spool_count(void)
+{
+    return ram_count + ((NULL != p_spill) ? ((uint32_t)(p_spill->tail - p_spill->head)) : (0));
+}
+
+void spool_get_stats(spool_stats_t * p_stats)
+{
+    pthread_mutex_lock(&stats_lock);
+    *p_stats = stats;
+    p_stats->ram_depth = ram_count;
+    p_stats->ram_capacity = ram_capacity;
+    if (NULL != p_spill)
+    {
+        p_stats->spill_depth = (uint32_t)(p_spill->tail - p_spill->head);
+        p_stats->spill_capacity = p_spill->capacity;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+uint8_t spool_register_cmd(void)
+{
+    return ipc_register_cmd("SPOOL", spool_cmd, "SPOOL");
+}
+
+void spool_close(void)
+{
+    pthread_mutex_lock(&stats_lock);
+    if (NULL != p_spill)
+    {
+        while (ram_count > 0)
+        {
+            spool_spill(&p_ram[ram_head]);
+            ram_head = (ram_head + 1) % ram_capacity;
+            ram_count--;
+        }
+
+        msync(p_spill, spill_size, MS_SYNC);
+        munmap(p_spill, spill_size);
+        p_spill = NULL;
+        p_spill_recs = NULL;
+    }
+    else if (ram_count > 0)
+    {
+        printf("%u sample(s) not stored.\n", ram_count);
+    }
+
+    free(p_ram);
+    p_ram = NULL;
+    ram_count = 0;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/******************************************************************************/
+
+static uint8_t spool_map_spill(const char * p_path, uint32_t capacity)
+{
+    struct stat st;
+    size_t      size = sizeof(spool_header_t) + ((size_t)capacity * sizeof(sample_t));
+    void       *p_map;
+    uint64_t    index;
+    float       sen_val;
+    int         fd;
+
+    fd = open(p_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        printf("Failed to open spill file %s: %s\n", p_path, strerror(errno));
+        return FAIL;
+    }
+
+    if ((0 != fstat(fd, &st)) || (((size_t)st.st_size != size) && (0 != ftruncate(fd, size))))
+    {
+        printf("Failed to size spill file %s: %s\n", p_path, strerror(errno));
+        close(fd);
+        return FAIL;
+    }
+
+    p_map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p_map)
+    {
+        printf("Failed to map spill file %s: %s\n", p_path, strerror(errno));
+        return FAIL;
+    }
+
+    p_spill = (spool_header_t *)p_map;
+    p_spill_recs = (sample_t *)(p_spill + 1);
+    spill_size = size;
+
+    // Former float values, rounded to 0.01 as they would have been stored
+    if ((SPOOL_MAGIC_FLOAT == p_spill->magic) && (sizeof(sample_t) == p_spill->rec_size) &&
+        (capacity == p_spill->capacity) && (p_spill->tail >= p_spill->head) &&
+        ((p_spill->tail - p_spill->head) <= capacity))
+    {
+        for (index = p_spill->head; index < p_spill->tail; index++)
+        {
+            memcpy(&sen_val, &p_spill_recs[index % capacity].sen_val, sizeof(sen_val));
+            p_spill_recs[index % capacity].sen_val = (int32_t)rint((double)sen_val * SAMPLE_SCALE);
+        }
+        p_spill->magic = SPOOL_MAGIC;
+    }
+
+    // A new file, a file of another layout or a damaged one starts empty
+    if ((SPOOL_MAGIC != p_spill->magic) || (sizeof(sample_t) != p_spill->rec_size) ||
+        (capacity != p_spill->capacity) || (p_spill->tail < p_spill->head) ||
+        ((p_spill->tail - p_spill->head) > capacity))
+    {
+        if (SPOOL_MAGIC == p_spill->magic)
+        {
+            printf("Spill file %s does not match, samples discarded.\n", p_path);
+        }
+        memset(p_spill, 0, sizeof(spool_header_t));
+        p_spill->magic = SPOOL_MAGIC;
+        p_spill->rec_size = sizeof(sample_t);
+        p_spill->capacity = capacity;
+    }
+    else
+    {
+        // Monotonic time of a run before the last boot is meaningless
+        for (index = p_spill->head; index < p_spill->tail; index++)
+        {
+            p_spill_recs[index % capacity].t_acq_ns = 0;
+        }
+    }
+
+    return SUCCESS;
+}
+
+static uint8_t spool_spill(const sample_t * p_sample)
+{
+    uint8_t ret_val = SUCCESS;
+
+    if ((p_spill->tail - p_spill->head) >= p_spill->capacity)
+    {
+        p_spill->head++;
+        stats.dropped++;
+        ret_val = FAIL;
+    }
+
+    // Record first, a crash in between leaves the previous tail valid
+    p_spill_recs[p_spill->tail % p_spill->capacity] = *p_sample;
+    p_spill->tail++;
+    stats.spilled++;
+
+    return ret_val;
+}
+
+static uint8_t spool_cmd(ipc_client_t * p_client, int argc, char ** argv,
+                                                            const char ** p_err)
+{
+    spool_stats_t s;
+
+    spool_get_stats(&s);
+
+    ipc_reply(p_client, "ram_depth %u", s.ram_depth);
+    ipc_reply(p_client, "ram_capacity %u", s.ram_capacity);
+    ipc_reply(p_client, "spill_depth %u", s.spill_depth);
+    ipc_reply(p_client, "spill_capacity %u", s.spill_capacity);
+    ipc_reply(p_client, "pushed %llu", (unsigned long long)s.pushed);
+    ipc_reply(p_client, "stored %llu", (unsigned long long)s.stored);
+    ipc_reply(p_client, "spilled %llu", (unsigned long long)s.spilled);
+    ipc_reply(p_client, "dropped %llu", (unsigned long long)s.dropped);
+    ipc_reply(p_client, "retries %u", s.retries);
+
+    return SUCCESS;
+}
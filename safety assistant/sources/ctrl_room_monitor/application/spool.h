@@ -0,0 +1,111 @@
+/******************************************************************************/
+
+/* File - spool.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Store-and-forward buffer between acquisition and the database. Every
+*  sample is queued here first and written to the database later, so
+*  sampling goes on while the database is locked (e.g. Node-RED writing) or
+*  unavailable. Samples leave the spool only after their transaction was
+*  committed, i.e. they are replayed in order once the database recovers.
+*
+*  The spool is a RAM ring in front of an optional spill file. Once the RAM
+*  ring is full its oldest sample moves to the spill file, a ring of fixed
+*  size mapped with mmap(). Samples in the spill file are always older than
+*  the ones in RAM, so the oldest sample is taken from the spill file first.
+*  The spill file survives a restart of the application, its samples are
+*  replayed after start-up. Only if the spill file is full as well the
+*  oldest sample is dropped.
+*
+*  Not thread-safe, all calls must come from the same thread, except for
+*  spool_get_stats() (and the SPOOL command) which may be called from any.
+*/
+
+/******************************************************************************/
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Queue depth and counters since start-up
+*/
+typedef struct
+{
+    uint32_t ram_depth;
+    uint32_t ram_capacity;
+    uint32_t spill_depth;
+    uint32_t spill_capacity;
+    uint64_t pushed;                            // Samples queued
+    uint64_t stored;                            // Samples committed to the database
+    uint64_t spilled;                           // Samples moved to the spill file
+    uint64_t dropped;                           // Samples lost, spool was full
+    uint32_t retries;                           // Failed flush attempts
+} spool_stats_t;
+
+/******************************************************************************/
+
+/* Function declaration to allocate the RAM ring and map the spill file. An
+*  existing spill file of the same capacity is kept, its samples are queued
+*  ahead of all new ones.
+*  @param[in] ram_capacity   - Samples held in RAM (at least 1)
+*  @param[in] p_spill_path   - Path of the spill file, NULL or "" for RAM only
+*  @param[in] spill_capacity - Samples held in the spill file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t spool_open(uint32_t ram_capacity, const char * p_spill_path,
+                                                    uint32_t spill_capacity);
+
+/* Function declaration to queue a sample. Never blocks, the oldest sample is
+*  dropped if the spool is full.
+*  @param[in] p_sample - Sample
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if a sample was dropped )
+*/
+uint8_t spool_push(const sample_t * p_sample);
+
+/* Function declaration to copy the oldest samples without removing them
+*  @param[out] p_samples - Buffer for the samples, oldest first
+*  @param[in]  max       - Size of the buffer in samples
+*  @return - uint32_t (number of samples copied)
+*/
+uint32_t spool_peek(sample_t * p_samples, uint32_t max);
+
+/* Function declaration to remove the oldest samples once they are stored
+*  @param[in] num - Number of samples, as returned by spool_peek() at most
+*  @return - None
+*/
+void spool_consume(uint32_t num);
+
+/* Function declaration to count a failed flush attempt
+*  @return - None
+*/
+void spool_retry(void);
+
+/* Function declaration to get the number of queued samples
+*  @return - uint32_t (samples in RAM and spill file)
+*/
+uint32_t spool_count(void);
+
+/* Function declaration to get queue depth and counters
+*  @param[out] p_stats - Statistics
+*  @return - None
+*/
+void spool_get_stats(spool_stats_t * p_stats);
+
+/* Function declaration to add the SPOOL command to the control socket
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t spool_register_cmd(void);
+
+/* Function declaration to move the samples still in RAM to the spill file,
+*  so they are replayed after a restart, and to unmap it
+*  @return - None
+*/
+void spool_close(void);
+
+#endif /* SPOOL_H */
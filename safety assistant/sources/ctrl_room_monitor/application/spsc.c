@@ -0,0 +1,93 @@
+/******************************************************************************/
+
+/* File - spsc.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Lock-free single-producer/single-consumer ring. See spsc.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "spsc.h"
+
+/******************************************************************************/
+
+uint8_t spsc_init(spsc_ring_t * p_ring, uint32_t elem_size, uint32_t capacity)
+{
+    uint32_t size = 1;
+
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    p_ring->p_buf = (uint8_t *) malloc((size_t)size * elem_size);
+    if (NULL == p_ring->p_buf)
+    {
+        printf("malloc() failed to allocate.\n");
+        return FAIL;
+    }
+    p_ring->elem_size = elem_size;
+    p_ring->mask = size - 1;
+    atomic_init(&p_ring->head, 0);
+    atomic_init(&p_ring->tail, 0);
+
+    return SUCCESS;
+}
+
+void spsc_free(spsc_ring_t * p_ring)
+{
+    free(p_ring->p_buf);
+    p_ring->p_buf = NULL;
+}
+
+uint8_t spsc_push(spsc_ring_t * p_ring, const void * p_elem)
+{
+    unsigned int head = atomic_load_explicit(&p_ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&p_ring->tail, memory_order_acquire);
+
+    // Indexes run freely, the difference is the fill level
+    if ((head - tail) > p_ring->mask)
+    {
+        return FAIL;
+    }
+
+    memcpy(&p_ring->p_buf[(head & p_ring->mask) * p_ring->elem_size], p_elem,
+                                                                p_ring->elem_size);
+
+    // Element must be visible before the consumer sees the new head
+    atomic_store_explicit(&p_ring->head, head + 1, memory_order_release);
+
+    return SUCCESS;
+}
+
+uint8_t spsc_pop(spsc_ring_t * p_ring, void * p_elem)
+{
+    unsigned int tail = atomic_load_explicit(&p_ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&p_ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return FAIL;
+    }
+
+    memcpy(p_elem, &p_ring->p_buf[(tail & p_ring->mask) * p_ring->elem_size],
+                                                                p_ring->elem_size);
+
+    // Slot may be overwritten by the producer once the new tail is visible
+    atomic_store_explicit(&p_ring->tail, tail + 1, memory_order_release);
+
+    return SUCCESS;
+}
+
+uint32_t spsc_count(spsc_ring_t * p_ring)
+{
+    return atomic_load_explicit(&p_ring->head, memory_order_acquire) -
+                        atomic_load_explicit(&p_ring->tail, memory_order_acquire);
+}
@@ -0,0 +1,75 @@
+/******************************************************************************/
+
+/* File - spsc.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Lock-free single-producer/single-consumer ring of fixed size elements.
+*  Exactly one thread may push and exactly one (other) thread may pop, no
+*  lock or system call is involved on either side, so a real-time producer
+*  is never blocked by the consumer. Elements are copied in and out.
+*/
+
+/******************************************************************************/
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/******************************************************************************/
+
+/* Head and tail are written by different threads, keep them on separate
+*  cache lines
+*/
+#define SPSC_CACHE_LINE         (64)
+
+typedef struct
+{
+    _Alignas(SPSC_CACHE_LINE) atomic_uint head;     // Written by the producer
+    _Alignas(SPSC_CACHE_LINE) atomic_uint tail;     // Written by the consumer
+    _Alignas(SPSC_CACHE_LINE) uint8_t    *p_buf;
+    uint32_t                              elem_size;
+    uint32_t                              mask;
+} spsc_ring_t;
+
+/******************************************************************************/
+
+/* Function declaration to allocate a ring
+*  @param[in] p_ring    - Ring object
+*  @param[in] elem_size - Size of one element in bytes
+*  @param[in] capacity  - Number of elements, rounded up to a power of 2
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t spsc_init(spsc_ring_t * p_ring, uint32_t elem_size, uint32_t capacity);
+
+/* Function declaration to free the buffer of a ring, no thread may use the
+*  ring anymore
+*  @param[in] p_ring - Ring object
+*  @return - None
+*/
+void spsc_free(spsc_ring_t * p_ring);
+
+/* Function declaration to append an element, producer side only
+*  @param[in] p_ring - Ring object
+*  @param[in] p_elem - Element to copy into the ring
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the ring is full )
+*/
+uint8_t spsc_push(spsc_ring_t * p_ring, const void * p_elem);
+
+/* Function declaration to take the oldest element, consumer side only
+*  @param[in]  p_ring - Ring object
+*  @param[out] p_elem - Element copied out of the ring
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the ring is empty )
+*/
+uint8_t spsc_pop(spsc_ring_t * p_ring, void * p_elem);
+
+/* Function declaration to get the number of queued elements. It is a snapshot
+*  only, the other side may change it right after.
+*  @param[in] p_ring - Ring object
+*  @return - uint32_t (number of elements)
+*/
+uint32_t spsc_count(spsc_ring_t * p_ring);
+
+#endif /* SPSC_H */
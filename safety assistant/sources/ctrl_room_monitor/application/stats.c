@@ -0,0 +1,320 @@
+/******************************************************************************/
+
+/* File - stats.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Self-profiling of the application. See stats.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "lat.h"
+#include "stats.h"
+
+/******************************************************************************/
+
+/* Attempts of a reader to get an untorn copy of a histogram
+*/
+#define STATS_READ_RETRIES      (1000)
+
+/* Maximum length of the export file path
+*/
+#define STATS_PATH_LEN          (256)
+
+#define NSEC_PER_SEC            (1000000000.0)
+
+/******************************************************************************/
+
+stats_region_t *p_stats = NULL;
+
+static const char * const hist_names[STATS_NUM_HISTS] =
+{
+    "ow_command", "ow_scratchpad", "aio_read", "db_commit", "task_run", "task_drift",
+    "load_actuate"
+};
+
+static const char * const counter_names[STATS_NUM_COUNTERS] =
+{
+    "samples", "crc_errors", "db_retries", "queue_drops", "acq_busy_ns",
+    "ow_retries", "ow_lost", "ow_quarantines", "ow_timeouts", "uplink_samples", "uplink_errors",
+    "load_commands", "load_errors", "raw_skipped", "aio_errors"
+};
+
+static const char * const counter_help[STATS_NUM_COUNTERS] =
+{
+    "Samples handed over to storage",
+    "DS18B20 scratchpad CRC errors",
+    "Failed database flushes, retried later",
+    "Samples dropped because the storage queue was full",
+    "Run time of acquisition tasks, the rest of the uptime is spent sleeping",
+    "1-Wire reads retried after a bus reset",
+    "DS18B20 samples lost after all retries",
+    "DS18B20 probes taken out of service",
+    "DS18B20 conversions not finished in time",
+    "Samples acknowledged by the collector",
+    "Uplink connections failed or lost",
+    "Load commands applied to the outputs",
+    "Load commands failed or dropped",
+    "Samples left out of sensor_data by the compression",
+    "Analog sensor reads failed, the sample was skipped"
+};
+
+/******************************************************************************/
+
+uint8_t stats_open(const char * p_path)
+{
+    stats_region_t *p_region;
+    int             fd;
+
+    // A new file instead of truncating the old one, a reader still mapping
+    // the old file keeps its pages
+    unlink(p_path);
+    fd = open(p_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        printf("Failed to create stats region %s.\n", p_path);
+        return FAIL;
+    }
+    if (0 != ftruncate(fd, sizeof(stats_region_t)))
+    {
+        printf("Failed to size stats region %s.\n", p_path);
+        close(fd);
+        return FAIL;
+    }
+
+    p_region = (stats_region_t *) mmap(NULL, sizeof(stats_region_t), PROT_READ | PROT_WRITE,
+                                                                    MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p_region)
+    {
+        printf("Failed to map stats region %s.\n", p_path);
+        return FAIL;
+    }
+
+    // The file is all zeroes, i.e. empty histograms and counters, the magic
+    // is published last
+    p_region->version = STATS_VERSION;
+    p_region->num_hists = STATS_NUM_HISTS;
+    p_region->num_counters = STATS_NUM_COUNTERS;
+    p_region->pid = (int32_t)getpid();
+    p_region->start_time = (int64_t)time(NULL);
+    atomic_thread_fence(memory_order_release);
+    p_region->magic = STATS_MAGIC;
+
+    p_stats = p_region;
+
+    return SUCCESS;
+}
+
+void stats_close(void)
+{
+    stats_region_t *p_region = p_stats;
+
+    if (NULL == p_region)
+    {
+        return;
+    }
+
+    p_stats = NULL;
+    munmap(p_region, sizeof(stats_region_t));
+}
+
+void stats_add(stats_hist_id_t id, int64_t ns)
+{
+    stats_hist_t *p_hist;
+    unsigned int  seq;
+
+    if (NULL == p_stats)
+    {
+        return;
+    }
+    p_hist = &p_stats->hists[id];
+
+    // The 1-Wire histograms are written by the thread of every bus. A writer
+    // finding another one busy drops its latency instead of waiting.
+    seq = atomic_load_explicit(&p_hist->seq, memory_order_relaxed);
+    if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&p_hist->seq, &seq, seq + 1,
+                                            memory_order_acquire, memory_order_relaxed))
+    {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    lat_add(&p_hist->lat, ns);
+
+    atomic_store_explicit(&p_hist->seq, seq + 2, memory_order_release);
+}
+
+const stats_region_t * stats_map(const char * p_path)
+{
+    stats_region_t *p_region;
+    struct stat     st;
+    int             fd;
+
+    fd = open(p_path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Failed to open stats region %s.\n", p_path);
+        return NULL;
+    }
+    if ((0 != fstat(fd, &st)) || (st.st_size < (off_t)sizeof(stats_region_t)))
+    {
+        printf("Stats region %s is not initialized.\n", p_path);
+        close(fd);
+        return NULL;
+    }
+
+    p_region = (stats_region_t *) mmap(NULL, sizeof(stats_region_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p_region)
+    {
+        printf("Failed to map stats region %s.\n", p_path);
+        return NULL;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if ((STATS_MAGIC != p_region->magic) || (STATS_VERSION != p_region->version) ||
+        (STATS_NUM_HISTS != p_region->num_hists) ||
+        (STATS_NUM_COUNTERS != p_region->num_counters))
+    {
+        printf("Stats region %s has an unknown layout.\n", p_path);
+        munmap(p_region, sizeof(stats_region_t));
+        return NULL;
+    }
+
+    return p_region;
+}
+
+void stats_unmap(const stats_region_t * p_region)
+{
+    munmap((void *)p_region, sizeof(stats_region_t));
+}
+
+uint8_t stats_read_hist(const stats_region_t * p_region, stats_hist_id_t id, lat_t * p_lat)
+{
+    stats_hist_t *p_hist = (stats_hist_t *)&p_region->hists[id];
+    unsigned int  seq_begin, seq_end;
+    uint16_t      i;
+
+    for (i = 0; i < STATS_READ_RETRIES; i++)
+    {
+        seq_begin = atomic_load_explicit(&p_hist->seq, memory_order_acquire);
+        if (seq_begin & 1)
+        {
+            continue;
+        }
+
+        memcpy(p_lat, &p_hist->lat, sizeof(lat_t));
+
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&p_hist->seq, memory_order_relaxed);
+        if (seq_begin == seq_end)
+        {
+            return SUCCESS;
+        }
+    }
+
+    return FAIL;
+}
+
+uint64_t stats_read_counter(const stats_region_t * p_region, stats_counter_id_t id)
+{
+    return atomic_load_explicit((_Atomic uint64_t *)&p_region->counters[id], memory_order_relaxed);
+}
+
+const char * stats_hist_name(stats_hist_id_t id)
+{
+    return (id < STATS_NUM_HISTS) ? (hist_names[id]) : ("unknown");
+}
+
+const char * stats_counter_name(stats_counter_id_t id)
+{
+    return (id < STATS_NUM_COUNTERS) ? (counter_names[id]) : ("unknown");
+}
+
+void stats_export(const stats_region_t * p_region, FILE * p_file)
+{
+    static const uint8_t quantiles[] = { 50, 90, 99 };
+    lat_t    lat;
+    uint16_t i, q;
+    uint64_t value;
+
+    fprintf(p_file, "# HELP crm_start_time_seconds Start time of the application.\n");
+    fprintf(p_file, "# TYPE crm_start_time_seconds gauge\n");
+    fprintf(p_file, "crm_start_time_seconds %lld\n", (long long)p_region->start_time);
+
+    fprintf(p_file, "# HELP crm_stage_seconds Latency of the application stages.\n");
+    fprintf(p_file, "# TYPE crm_stage_seconds summary\n");
+    for (i = 0; i < STATS_NUM_HISTS; i++)
+    {
+        if (SUCCESS != stats_read_hist(p_region, (stats_hist_id_t)i, &lat))
+        {
+            continue;
+        }
+        for (q = 0; q < sizeof(quantiles); q++)
+        {
+            fprintf(p_file, "crm_stage_seconds{stage=\"%s\",quantile=\"0.%02u\"} %.9f\n",
+                    hist_names[i], quantiles[q],
+                    (lat.count) ? (lat_percentile(&lat, quantiles[q]) / NSEC_PER_SEC) : (0.0));
+        }
+        fprintf(p_file, "crm_stage_seconds_sum{stage=\"%s\"} %.9f\n", hist_names[i],
+                                                                lat.sum_ns / NSEC_PER_SEC);
+        fprintf(p_file, "crm_stage_seconds_count{stage=\"%s\"} %llu\n", hist_names[i],
+                                                                (unsigned long long)lat.count);
+    }
+
+    for (i = 0; i < STATS_NUM_COUNTERS; i++)
+    {
+        value = stats_read_counter(p_region, (stats_counter_id_t)i);
+
+        if (STATS_ACQ_BUSY_NS == i)
+        {
+            fprintf(p_file, "# HELP crm_acq_busy_seconds_total %s.\n", counter_help[i]);
+            fprintf(p_file, "# TYPE crm_acq_busy_seconds_total counter\n");
+            fprintf(p_file, "crm_acq_busy_seconds_total %.9f\n", value / NSEC_PER_SEC);
+            continue;
+        }
+
+        fprintf(p_file, "# HELP crm_%s_total %s.\n", counter_names[i], counter_help[i]);
+        fprintf(p_file, "# TYPE crm_%s_total counter\n", counter_names[i]);
+        fprintf(p_file, "crm_%s_total %llu\n", counter_names[i], (unsigned long long)value);
+    }
+}
+
+uint8_t stats_export_file(const stats_region_t * p_region, const char * p_path)
+{
+    char  tmp_path[STATS_PATH_LEN + 4];
+    FILE *p_file;
+    int   ret_val;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", p_path);
+
+    p_file = fopen(tmp_path, "w");
+    if (NULL == p_file)
+    {
+        printf("Failed to create %s.\n", tmp_path);
+        return FAIL;
+    }
+
+    stats_export(p_region, p_file);
+
+    ret_val = ferror(p_file);
+    if ((0 != fclose(p_file)) || (0 != ret_val) || (0 != rename(tmp_path, p_path)))
+    {
+        printf("Failed to write %s.\n", p_path);
+        unlink(tmp_path);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
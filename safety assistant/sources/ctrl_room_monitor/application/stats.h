@@ -0,0 +1,213 @@
+/******************************************************************************/
+
+/* File - stats.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Self-profiling of the application. Latency histograms of the hot paths
+*  (1-Wire commands, scratchpad reads, analog reads, database commits, task
+*  run time and start drift, load actuation) and event counters (CRC errors,
+*  bus retries, quarantined probes, flush retries, dropped samples, load
+*  commands) are kept in a shared memory region, a file mapped with
+*  MAP_SHARED (by default on /dev/shm). The 'appstat' tool maps the same file
+*  read-only, so the statistics can be inspected without touching the
+*  application. The region can also be exported in the Prometheus text format.
+*
+*  Every histogram is guarded by a sequence counter (seqlock), the reader
+*  retries a copy that was torn by a concurrent update. Most histograms have a
+*  single writer thread, the 1-Wire ones one per bus: a writer finding the
+*  histogram taken by another drops its latency. Counters are atomic and may be updated by any thread. Nothing
+*  blocks on the writer side.
+*
+*  Without a region (stats_open() not called or failed) every hook is a
+*  single pointer test, the clock is not even read.
+*/
+
+/******************************************************************************/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "lat.h"
+
+/******************************************************************************/
+
+/* Magic ("STA1") and version of the region layout
+*/
+#define STATS_MAGIC             (0x31415453)
+#define STATS_VERSION           (1)
+
+/* Default path of the region, shared by the application and 'appstat'
+*/
+#define STATS_PATH              "/dev/shm/ctrl_room_monitor.stats"
+
+/* Histograms, written by a single thread except for the 1-Wire ones
+*/
+typedef enum
+{
+    STATS_OW_COMMAND = 0,       // 1-Wire reset, ROM select and command
+    STATS_OW_SCRATCHPAD,        // 1-Wire scratchpad read (9 bytes)
+    STATS_AIO_READ,             // Analog read of the acquisition thread
+    STATS_DB_COMMIT,            // Database cycle commit (storage thread)
+    STATS_TASK_RUN,             // Run time of an acquisition task
+    STATS_TASK_DRIFT,           // Start of an acquisition task past its deadline
+    STATS_LOAD_ACTUATE,         // Load command received until the output is set
+    STATS_NUM_HISTS
+} stats_hist_id_t;
+
+/* Counters, may be updated by any thread
+*/
+typedef enum
+{
+    STATS_SAMPLES = 0,          // Samples handed over to storage
+    STATS_CRC_ERRORS,           // DS18B20 scratchpad CRC errors
+    STATS_DB_RETRIES,           // Failed database flushes, retried later
+    STATS_QUEUE_DROPS,          // Samples dropped, storage queue full
+    STATS_ACQ_BUSY_NS,          // Total run time of acquisition tasks
+    STATS_OW_RETRIES,           // 1-Wire reads retried after a bus reset
+    STATS_OW_LOST,              // DS18B20 samples lost, all retries failed
+    STATS_OW_QUARANTINES,       // DS18B20 taken out of service
+    STATS_OW_TIMEOUTS,          // Conversions not finished in time
+    STATS_UPLINK_SAMPLES,       // Samples acknowledged by the collector
+    STATS_UPLINK_ERRORS,        // Uplink connections failed or lost
+    STATS_LOAD_COMMANDS,        // Load commands applied to the outputs
+    STATS_LOAD_ERRORS,          // Load commands failed or dropped
+    STATS_RAW_SKIPPED,          // Samples left out of sensor_data (compress.h)
+    STATS_AIO_ERRORS,           // Analog sensor reads failed, sample skipped
+    STATS_NUM_COUNTERS
+} stats_counter_id_t;
+
+typedef struct
+{
+    atomic_uint             seq;                // Odd while an update is running
+    uint32_t                reserved;
+    lat_t                   lat;
+} stats_hist_t;
+
+typedef struct
+{
+    uint32_t                magic;
+    uint16_t                version;
+    uint16_t                num_hists;
+    uint16_t                num_counters;
+    uint16_t                reserved;
+    int32_t                 pid;
+    int64_t                 start_time;         // UNIX time of stats_open()
+    stats_hist_t            hists[STATS_NUM_HISTS];
+    _Atomic uint64_t        counters[STATS_NUM_COUNTERS];
+} stats_region_t;
+
+/* Region of the application, NULL if disabled
+*/
+extern stats_region_t *p_stats;
+
+/******************************************************************************/
+
+/* Function declaration to create (or reset) and map the region of the
+*  application
+*  @param[in] p_path - Path of the region file, e.g. on /dev/shm
+*  @return - uint8_t ( SUCCESS(1), FAIL(0), the hooks stay disabled )
+*/
+uint8_t stats_open(const char * p_path);
+
+/* Function declaration to unmap the region of the application, the file is
+*  kept, so the last values can still be read
+*  @return - None
+*/
+void stats_close(void);
+
+/* Function declaration to add a latency to a histogram. Dropped if another
+*  thread is adding to the same histogram at the moment.
+*  @param[in] id - Histogram
+*  @param[in] ns - Latency in nanoseconds
+*  @return - None
+*/
+void stats_add(stats_hist_id_t id, int64_t ns);
+
+/* Function to start a measurement
+*  @return - int64_t (start time, 0 if disabled)
+*/
+static inline int64_t stats_begin(void)
+{
+    return (NULL != p_stats) ? (lat_now_ns()) : (0);
+}
+
+/* Function to end a measurement started with stats_begin()
+*  @param[in] id - Histogram
+*  @param[in] t0 - Start time returned by stats_begin()
+*  @return - None
+*/
+static inline void stats_end(stats_hist_id_t id, int64_t t0)
+{
+    if (NULL != p_stats)
+    {
+        stats_add(id, lat_now_ns() - t0);
+    }
+}
+
+/* Function to add to a counter
+*  @param[in] id - Counter
+*  @param[in] n  - Value to add
+*  @return - None
+*/
+static inline void stats_count(stats_counter_id_t id, uint64_t n)
+{
+    if (NULL != p_stats)
+    {
+        atomic_fetch_add_explicit(&p_stats->counters[id], n, memory_order_relaxed);
+    }
+}
+
+/* Function declaration to map the region of another process read-only
+*  @param[in] p_path - Path of the region file
+*  @return - const stats_region_t * (mapped region, NULL on failure)
+*/
+const stats_region_t * stats_map(const char * p_path);
+
+/* Function declaration to unmap a region mapped with stats_map()
+*  @param[in] p_region - Mapped region
+*  @return - None
+*/
+void stats_unmap(const stats_region_t * p_region);
+
+/* Function declaration to take a consistent copy of a histogram
+*  @param[in]  p_region - Region
+*  @param[in]  id       - Histogram
+*  @param[out] p_lat    - Copy of the histogram
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the writer kept updating it )
+*/
+uint8_t stats_read_hist(const stats_region_t * p_region, stats_hist_id_t id, lat_t * p_lat);
+
+/* Function declaration to read a counter
+*  @param[in] p_region - Region
+*  @param[in] id       - Counter
+*  @return - uint64_t (counter value)
+*/
+uint64_t stats_read_counter(const stats_region_t * p_region, stats_counter_id_t id);
+
+/* Function declarations to get the names of histograms and counters
+*/
+const char * stats_hist_name(stats_hist_id_t id);
+const char * stats_counter_name(stats_counter_id_t id);
+
+/* Function declaration to write a region in the Prometheus text format
+*  @param[in] p_region - Region
+*  @param[in] p_file   - Output stream
+*  @return - None
+*/
+void stats_export(const stats_region_t * p_region, FILE * p_file);
+
+/* Function declaration to export a region to a file, the file is replaced
+*  atomically so a scraper (e.g. the node exporter textfile collector) never
+*  reads it half written
+*  @param[in] p_region - Region
+*  @param[in] p_path   - Path of the output file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t stats_export_file(const stats_region_t * p_region, const char * p_path);
+
+#endif /* STATS_H */
@@ -0,0 +1,560 @@
+/******************************************************************************/
+
+/* File - storage.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Storage thread. See storage.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "config.h"
+#include "sched.h"
+#include "worker.h"
+#include "lat.h"
+#include "spool.h"
+#include "archive.h"
+#include "db.h"
+#include "storage.h"
+#include "stats.h"
+#include "uplink.h"
+#include "compress.h"
+
+/******************************************************************************/
+
+/* Samples queued between the threads ('queue.samples')
+*/
+#define STORAGE_QUEUE_SAMPLES       (1024)
+
+/* Samples are queued in RAM (SPOOL_RAM_SAMPLES, 'spool.ram_samples') and
+*  written to the database in batches of up to SPOOL_BATCH samples. While the
+*  database is busy or unavailable, samples beyond the RAM ring go to the
+*  spill file ('spool.spill_path', SPOOL_SPILL_SAMPLES 'spool.spill_samples',
+*  24 bytes each, "" for none). A failed write is retried after
+*  SPOOL_RETRY_MIN_MS ('spool.retry_min_ms'), doubled with every further
+*  failure up to SPOOL_RETRY_MAX_MS ('spool.retry_max_ms').
+*/
+#define SPOOL_RAM_SAMPLES           (4096)
+#define SPOOL_SPILL_PATH            "/home/root/ctrl_room_monitor/database/spool.bin"
+#define SPOOL_SPILL_SAMPLES         (262144)
+#define SPOOL_BATCH                 (256)
+#define SPOOL_RETRY_MIN_MS          (100)
+#define SPOOL_RETRY_MAX_MS          (30000)
+
+/* Raw samples are kept RETENTION_RAW_DAYS ('retention.raw_days'), 1 minute
+*  rollups RETENTION_MINUTE_DAYS ('retention.1m_days'), 0 keeps them forever.
+*  Hourly and daily rollups are never pruned. Retention is applied every
+*  RETENTION_INTERVAL_MS ('retention.interval_ms').
+*/
+#define RETENTION_RAW_DAYS          (30)
+#define RETENTION_MINUTE_DAYS       (90)
+#define RETENTION_INTERVAL_MS       (3600000)
+
+/* Raw samples older than ARCHIVE_AFTER_DAYS ('archive.after_days', rounded
+*  down to UTC midnight, 0 = off) are moved to segment files in ARCHIVE_PATH
+*  ('archive.path', "" = off, default in archive.h). Checked every
+*  ARCHIVE_INTERVAL_MS ('archive.interval_ms'), a backlog is moved in batches
+*  of ARCHIVE_BATCH rows ('archive.batch') with new samples written between.
+*/
+#define ARCHIVE_AFTER_DAYS          (7)
+#define ARCHIVE_INTERVAL_MS         (3600000)
+#define ARCHIVE_BATCH               (65536)
+
+/* Statistics are printed every 'stats.report_ms', 0 = off
+*/
+#define STATS_REPORT_MS             (0)
+
+/* The self-profiling region (see stats.h) is exported in the Prometheus text
+*  format to STATS_PROM_PATH ('stats.prom_path', "" = off) every
+*  STATS_PROM_MS ('stats.prom_ms'), e.g. for the node exporter textfile
+*  collector
+*/
+#define STATS_PROM_PATH             ""
+#define STATS_PROM_MS               (15000)
+
+/******************************************************************************/
+
+static worker_t      storage_worker;
+
+// Writes the spooled samples to the database, backs off while it fails
+static sched_task_t  flush_task;
+static uint32_t      flush_retry_ms = 0;
+
+static sched_task_t  prune_task;
+static sched_task_t  report_task;
+static sched_task_t  prom_task;
+static const char   *p_prom_path;
+
+// Rows of the running archive batch, one sensor and day at a time
+static sched_task_t     archive_task;
+static const char      *p_archive_dir;
+static archive_point_t *p_archive_points = NULL;
+static uint32_t         max_archive_points = 0;
+static uint32_t         num_archive_points = 0;
+static uint32_t         num_archive_rows;
+static uint16_t         archive_sen_id;
+static time_t           archive_day;
+static uint8_t          is_archive_ok;
+
+// Acquisition until commit
+static lat_t         disk_lat;
+
+// Compression of the raw samples per sensor ID, set up with the first sample
+static compress_t   *p_comps = NULL;
+static uint8_t      *p_comp_is_set = NULL;
+static uint32_t      max_comps = 0;
+
+/******************************************************************************/
+
+/* Function declarations of the worker callbacks
+*/
+static uint8_t storage_init_fn(worker_t * p_worker);
+static void    storage_item_fn(worker_t * p_worker, const void * p_item);
+static void    storage_fini_fn(worker_t * p_worker);
+
+/* Function declarations of the task functions
+*/
+static void    flush_task_fn(sched_task_t * p_task);
+static void    prune_task_fn(sched_task_t * p_task);
+static void    report_task_fn(sched_task_t * p_task);
+static void    prom_task_fn(sched_task_t * p_task);
+static void    archive_task_fn(sched_task_t * p_task);
+
+/* Function declarations to collect the rows of an archive batch and write
+*  them per sensor and day
+*/
+static void    archive_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg);
+static void    archive_flush(void);
+
+/* Function declaration to get the compression state of a sensor
+*  @return - compress_t * (NULL if out of memory)
+*/
+static compress_t *storage_compress(uint16_t sen_id);
+
+/* Function declaration to hand a sample to the spool
+*/
+static void    storage_spool(const sample_t * p_sample);
+
+/* Function declaration to write the oldest batch of the spool
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the batch was rolled back )
+*/
+static uint8_t storage_flush(void);
+
+/******************************************************************************/
+
+uint8_t storage_start(void)
+{
+    uint32_t ram_samples = (uint32_t)config_get_int(SPOOL_RAM_SAMPLES, "spool.ram_samples");
+
+    // Without spill file samples are kept in RAM only
+    if ((SUCCESS != spool_open(ram_samples, config_get_str(SPOOL_SPILL_PATH, "spool.spill_path"),
+                        (uint32_t)config_get_int(SPOOL_SPILL_SAMPLES, "spool.spill_samples"))) &&
+        (SUCCESS != spool_open(ram_samples, NULL, 0)))
+    {
+        return FAIL;
+    }
+
+    if (SUCCESS != worker_start(&storage_worker, "Storage", sizeof(sample_t),
+                        (uint32_t)config_get_int(STORAGE_QUEUE_SAMPLES, "queue.samples"),
+                        storage_init_fn, storage_item_fn, storage_fini_fn, NULL))
+    {
+        spool_close();
+        return FAIL;
+    }
+
+    // Streams what the storage thread commits, runs without collector too
+    if (SUCCESS != uplink_start())
+    {
+        printf("Uplink not available.\n");
+    }
+
+    return SUCCESS;
+}
+
+uint8_t storage_submit(const sample_t * p_sample)
+{
+    return worker_submit(&storage_worker, p_sample);
+}
+
+uint8_t storage_has_room(void)
+{
+    return (spsc_count(&storage_worker.ring) <= storage_worker.ring.mask);
+}
+
+void storage_stop(void)
+{
+    worker_stop(&storage_worker);
+    uplink_stop();
+}
+
+/******************************************************************************/
+
+static uint8_t storage_init_fn(worker_t * p_worker)
+{
+    uint32_t report_ms = (uint32_t)config_get_int(STATS_REPORT_MS, "stats.report_ms");
+
+    lat_reset(&disk_lat);
+
+    sched_task_init(&flush_task, flush_task_fn, NULL);
+    sched_task_init(&prune_task, prune_task_fn, NULL);
+    sched_task_init(&report_task, report_task_fn, NULL);
+    sched_task_init(&prom_task, prom_task_fn, NULL);
+    sched_task_init(&archive_task, archive_task_fn, NULL);
+
+    sched_start(&prune_task, (uint32_t)config_get_int(RETENTION_INTERVAL_MS,
+                                                    "retention.interval_ms"), 0);
+    if (report_ms)
+    {
+        sched_start(&report_task, report_ms, report_ms);
+    }
+
+    p_prom_path = config_get_str(STATS_PROM_PATH, "stats.prom_path");
+    if ((NULL != p_stats) && ('\0' != p_prom_path[0]))
+    {
+        sched_start(&prom_task, (uint32_t)config_get_int(STATS_PROM_MS, "stats.prom_ms"), 0);
+    }
+
+    p_archive_dir = config_get_str(ARCHIVE_PATH, "archive.path");
+    if (('\0' != p_archive_dir[0]) &&
+        (0 != config_get_int(ARCHIVE_AFTER_DAYS, "archive.after_days")))
+    {
+        sched_after(&archive_task, 0);
+    }
+
+    // Samples of the spill file left by the last run go first
+    if (spool_count() > 0)
+    {
+        sched_after(&flush_task, 0);
+    }
+
+    return SUCCESS;
+}
+
+static void storage_item_fn(worker_t * p_worker, const void * p_item)
+{
+    const sample_t *p_sample = (const sample_t *)p_item;
+    compress_t     *p_comp = storage_compress(p_sample->sen_id);
+    sample_t        out[2];
+    uint8_t         num_out, i;
+
+    // Samples left out of 'sensor_data' still go to the rollups
+    if (NULL == p_comp)
+    {
+        storage_spool(p_sample);
+    }
+    else
+    {
+        num_out = compress_push(p_comp, p_sample, out);
+        for (i = 0; i < num_out; i++)
+        {
+            storage_spool(&out[i]);
+        }
+    }
+
+    // All samples woken up for are written together, a pending retry is not
+    // brought forward
+    if (!sched_is_pending(&flush_task))
+    {
+        sched_after(&flush_task, 0);
+    }
+}
+
+static void storage_fini_fn(worker_t * p_worker)
+{
+    sample_t sample;
+    uint32_t i;
+
+    sched_stop(&flush_task);
+    sched_stop(&prune_task);
+    sched_stop(&report_task);
+    sched_stop(&prom_task);
+    sched_stop(&archive_task);
+    free(p_archive_points);
+    p_archive_points = NULL;
+
+    // Samples held back by the compression end the stored series
+    for (i = 0; i < max_comps; i++)
+    {
+        if (p_comp_is_set[i] && compress_flush(&p_comps[i], &sample))
+        {
+            storage_spool(&sample);
+        }
+    }
+    free(p_comps);
+    free(p_comp_is_set);
+    p_comps = NULL;
+    p_comp_is_set = NULL;
+    max_comps = 0;
+
+    // Until the first failure, the rest waits in the spill file
+    while ((spool_count() > 0) && (SUCCESS == storage_flush()))
+    {
+    }
+
+    spool_close();
+    lat_print(&disk_lat, "Sample-to-disk latency");
+}
+
+/* Write the spooled samples, oldest first, one transaction per batch. The
+*  samples leave the spool only once committed, on failure the same batch is
+*  tried again later.
+*/
+static void flush_task_fn(sched_task_t * p_task)
+{
+    uint32_t retry_max_ms;
+
+    if (SUCCESS != storage_flush())
+    {
+        stats_count(STATS_DB_RETRIES, 1);
+        retry_max_ms = (uint32_t)config_get_int(SPOOL_RETRY_MAX_MS, "spool.retry_max_ms");
+        if (0 == flush_retry_ms)
+        {
+            flush_retry_ms = (uint32_t)config_get_int(SPOOL_RETRY_MIN_MS, "spool.retry_min_ms");
+            printf("Database not available, %u sample(s) spooled.\n", spool_count());
+        }
+        else if ((flush_retry_ms *= 2) > retry_max_ms)
+        {
+            flush_retry_ms = retry_max_ms;
+        }
+        sched_after(p_task, flush_retry_ms);
+        return;
+    }
+
+    if (flush_retry_ms)
+    {
+        printf("Database available again.\n");
+        flush_retry_ms = 0;
+    }
+
+    // Backlog is written batch by batch, new samples are taken in between
+    if (spool_count() > 0)
+    {
+        sched_after(p_task, 0);
+    }
+}
+
+/* Drop data past its retention. A failure is retried with the next interval.
+*/
+static void prune_task_fn(sched_task_t * p_task)
+{
+    if ((SUCCESS != db_begin_cycle()) ||
+        (SUCCESS != db_prune(time(NULL),
+                    (uint32_t)config_get_int(RETENTION_RAW_DAYS, "retention.raw_days"),
+                    (uint32_t)config_get_int(RETENTION_MINUTE_DAYS, "retention.1m_days"))) ||
+        (SUCCESS != db_commit_cycle()))
+    {
+        printf("Failed to apply data retention.\n");
+        db_rollback_cycle();
+    }
+}
+
+static void report_task_fn(sched_task_t * p_task)
+{
+    lat_print(&disk_lat, "Sample-to-disk latency");
+}
+
+static void prom_task_fn(sched_task_t * p_task)
+{
+    stats_export_file(p_stats, p_prom_path);
+}
+
+/* Move a batch of aged rows to the archive. The rows are deleted only once
+*  all their segments are on disk, a failure leaves them for the next try.
+*/
+static void archive_task_fn(sched_task_t * p_task)
+{
+    uint32_t interval_ms = (uint32_t)config_get_int(ARCHIVE_INTERVAL_MS, "archive.interval_ms");
+    uint32_t max_rows = (uint32_t)config_get_int(ARCHIVE_BATCH, "archive.batch");
+    time_t   cut_off;
+    int64_t  end_sl;
+
+    cut_off = time(NULL) - ((time_t)config_get_int(ARCHIVE_AFTER_DAYS, "archive.after_days") * 86400);
+    cut_off -= cut_off % 86400;
+
+    num_archive_points = 0;
+    num_archive_rows = 0;
+    is_archive_ok = 1;
+
+    if (SUCCESS != db_read_archive(cut_off, max_rows, archive_row_fn, NULL, &end_sl))
+    {
+        is_archive_ok = 0;
+    }
+    archive_flush();
+
+    if (is_archive_ok && num_archive_rows &&
+        ((SUCCESS != db_begin_cycle()) || (SUCCESS != db_delete_archived(end_sl)) ||
+         (SUCCESS != db_commit_cycle())))
+    {
+        db_rollback_cycle();
+        is_archive_ok = 0;
+    }
+
+    if (!is_archive_ok)
+    {
+        printf("Failed to archive sensor data.\n");
+    }
+
+    #if defined(RUN_TIME_LOG)
+        if (is_archive_ok && num_archive_rows)
+        {
+            printf("%u rows archived.\n", num_archive_rows);
+        }
+    #endif
+
+    // A full batch means there is more
+    sched_after(p_task, (is_archive_ok && (num_archive_rows >= max_rows)) ? (0) : (interval_ms));
+}
+
+static void archive_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg)
+{
+    archive_point_t *p_points;
+    time_t           day = sen_time - (sen_time % 86400);
+
+    num_archive_rows++;
+
+    if (num_archive_points && ((sen_id != archive_sen_id) || (day != archive_day)))
+    {
+        archive_flush();
+    }
+    archive_sen_id = sen_id;
+    archive_day = day;
+
+    if (num_archive_points >= max_archive_points)
+    {
+        p_points = (archive_point_t *) realloc(p_archive_points,
+                    ((max_archive_points) ? (2 * max_archive_points) : (4096)) *
+                                                            sizeof(archive_point_t));
+        if (NULL == p_points)
+        {
+            printf("realloc() failed to allocate.\n");
+            is_archive_ok = 0;
+            return;
+        }
+        p_archive_points = p_points;
+        max_archive_points = (max_archive_points) ? (2 * max_archive_points) : (4096);
+    }
+
+    p_archive_points[num_archive_points].sen_time = (int64_t)sen_time;
+    p_archive_points[num_archive_points].sl = sl;
+    p_archive_points[num_archive_points++].value = (int32_t)lround(sen_val * ARCHIVE_SCALE);
+}
+
+static void archive_flush(void)
+{
+    if (num_archive_points && is_archive_ok &&
+        (SUCCESS != archive_write(p_archive_dir, archive_sen_id, archive_day,
+                                            p_archive_points, num_archive_points)))
+    {
+        is_archive_ok = 0;
+    }
+    num_archive_points = 0;
+}
+
+static uint8_t storage_flush(void)
+{
+    static sample_t batch[SPOOL_BATCH];
+    uint32_t        num, i;
+    int64_t         now_ns, t0;
+
+    num = spool_peek(batch, SPOOL_BATCH);
+
+    for (i = 0; i < num; i++)
+    {
+        if ((SUCCESS != db_begin_cycle()) ||
+            (!(batch[i].flags & SAMPLE_NO_RAW) &&
+             (SUCCESS != db_store_raw(batch[i].sen_id, batch[i].sen_val, (time_t)batch[i].sen_time))) ||
+            (!(batch[i].flags & SAMPLE_NO_ROLLUP) &&
+             (SUCCESS != db_store_rollups(batch[i].sen_id, batch[i].sen_val, (time_t)batch[i].sen_time))))
+        {
+            break;
+        }
+    }
+
+    t0 = stats_begin();
+    if ((i < num) || (SUCCESS != db_commit_cycle()))
+    {
+        db_rollback_cycle();
+        spool_retry();
+        return FAIL;
+    }
+    stats_end(STATS_DB_COMMIT, t0);
+
+    spool_consume(num);
+    uplink_notify();
+
+    // Every sample once, not again when stored after being held back
+    now_ns = lat_now_ns();
+    for (i = 0; i < num; i++)
+    {
+        if (batch[i].flags & SAMPLE_NO_RAW)
+        {
+            stats_count(STATS_RAW_SKIPPED, 1);
+        }
+        if (batch[i].t_acq_ns && !(batch[i].flags & SAMPLE_NO_ROLLUP))
+        {
+            lat_add(&disk_lat, now_ns - batch[i].t_acq_ns);
+        }
+    }
+
+    return SUCCESS;
+}
+
+static compress_t *storage_compress(uint16_t sen_id)
+{
+    compress_t *p_table;
+    uint8_t    *p_is_set;
+    uint32_t    new_max;
+
+    if (sen_id >= max_comps)
+    {
+        new_max = (max_comps) ? (max_comps) : (16);
+        while (new_max <= sen_id)
+        {
+            new_max *= 2;
+        }
+
+        p_table = (compress_t *) realloc(p_comps, new_max * sizeof(compress_t));
+        if (NULL == p_table)
+        {
+            return NULL;
+        }
+        p_comps = p_table;
+
+        p_is_set = (uint8_t *) realloc(p_comp_is_set, new_max);
+        if (NULL == p_is_set)
+        {
+            return NULL;
+        }
+        memset(&p_is_set[max_comps], 0, new_max - max_comps);
+        p_comp_is_set = p_is_set;
+        max_comps = new_max;
+    }
+
+    if (!p_comp_is_set[sen_id])
+    {
+        compress_config(&p_comps[sen_id], sen_id);
+        p_comp_is_set[sen_id] = 1;
+    }
+
+    return &p_comps[sen_id];
+}
+
+static void storage_spool(const sample_t * p_sample)
+{
+    if (SUCCESS != spool_push(p_sample))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("Spool full, oldest sample dropped.\n");
+        #endif
+    }
+}
@@ -0,0 +1,59 @@
+/******************************************************************************/
+
+/* File - storage.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Storage thread. Samples submitted by the acquisition thread pass the
+*  compression of the raw samples (see compress.h), are queued in the spool
+*  (see spool.h) and written to the database in batches, one transaction
+*  each, with retries while the database is busy. Retention (db_prune())
+*  runs on this thread as well, so no database write ever delays a sensor
+*  read.
+*
+*  Committed samples are streamed to a collector by the uplink thread (see
+*  uplink.h), which storage_start() starts if configured.
+*
+*  The sample-to-disk latency, from acquisition until the commit of the
+*  sample, is kept by this thread and printed every 'stats.report_ms'.
+*/
+
+/******************************************************************************/
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdint.h>
+
+#include "sample.h"
+
+/******************************************************************************/
+
+/* Function declaration to open the spool and start the storage thread, the
+*  database must be open
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t storage_start(void);
+
+/* Function declaration to queue a sample, acquisition thread only. Does not
+*  block.
+*  @param[in] p_sample - Sample
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the queue is full )
+*/
+uint8_t storage_submit(const sample_t * p_sample);
+
+/* Function declaration to check for room in the queue, acquisition thread
+*  only. A producer which may wait (e.g. the trace replay) waits for room
+*  instead of losing samples.
+*  @return - uint8_t (1 if storage_submit() would take a sample, 0 otherwise)
+*/
+uint8_t storage_has_room(void);
+
+/* Function declaration to stop the storage thread. Queued samples are
+*  written (one attempt), whatever the database does not take is kept in the
+*  spill file for the next start. The uplink is stopped last.
+*  @return - None
+*/
+void storage_stop(void);
+
+#endif /* STORAGE_H */
@@ -0,0 +1,466 @@
+/******************************************************************************/
+
+/* File - trace.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Capture and reading of raw sensor traces. See trace.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "lat.h"
+#include "trace.h"
+
+/******************************************************************************/
+
+/* Worst case bytes of a record: kind, four varints and the key, or the ADC
+*  counts as 32 bit varints
+*/
+#define TRACE_MAX_REC_LEN       (1 + (4 * 10) + (TRACE_MAX_ADC * 5))
+
+/* Buffer of the capture file
+*/
+#define TRACE_BUF_LEN           (65536)
+
+/******************************************************************************/
+
+typedef struct
+{
+    uint16_t sen_id;
+    char     key[TRACE_KEY_LEN];
+} trace_sensor_t;
+
+// Capture in progress, guarded by 'trace_lock' since every bus thread and
+// the acquisition thread capture
+static FILE           *p_trace_file = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t         trace_start_ns;
+static int64_t         trace_last_ms;
+static int64_t         trace_flush_ms;
+static uint64_t        trace_bytes;
+static uint64_t        trace_max_bytes;
+static trace_sensor_t  trace_sensors[TRACE_MAX_SENSORS];
+static uint16_t        num_trace_sensors;
+
+/******************************************************************************/
+
+/* Function declaration to append a record, 'trace_lock' held
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t   trace_write(const trace_rec_t * p_rec);
+
+/* Function declaration to get the capture time, 'trace_lock' held
+*  @return - int64_t (milliseconds since the capture start)
+*/
+static int64_t   trace_now_ms(void);
+
+/* Function declarations of the varint coding
+*/
+static uint8_t  *trace_put_varint(uint8_t * p_buf, int64_t value);
+static int       trace_get_varint(trace_reader_t * p_reader, int64_t * p_value);
+
+/******************************************************************************/
+
+uint8_t trace_open(const char * p_path, uint64_t max_bytes)
+{
+    trace_header_t  header;
+    struct timespec ts;
+    FILE           *p_file;
+
+    p_file = fopen(p_path, "wb");
+    if (NULL == p_file)
+    {
+        printf("Failed to create trace file %s.\n", p_path);
+        return FAIL;
+    }
+    setvbuf(p_file, NULL, _IOFBF, TRACE_BUF_LEN);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memset(&header, 0, sizeof(header));
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.start_ms = ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+    if (1 != fwrite(&header, sizeof(header), 1, p_file))
+    {
+        printf("Failed to write trace file %s.\n", p_path);
+        fclose(p_file);
+        return FAIL;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    p_trace_file = p_file;
+    trace_start_ns = lat_now_ns();
+    trace_last_ms = 0;
+    trace_flush_ms = 0;
+    trace_bytes = sizeof(header);
+    trace_max_bytes = max_bytes;
+    num_trace_sensors = 0;
+    pthread_mutex_unlock(&trace_lock);
+
+    printf("Capturing sensor readings to %s.\n", p_path);
+
+    return SUCCESS;
+}
+
+void trace_close(void)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (NULL != p_trace_file)
+    {
+        fclose(p_trace_file);
+        p_trace_file = NULL;
+        printf("Trace closed, %llu bytes captured.\n", (unsigned long long)trace_bytes);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_sensor(uint16_t sen_id, uint8_t type, const char * p_key)
+{
+    trace_rec_t rec;
+
+    pthread_mutex_lock(&trace_lock);
+    if ((NULL != p_trace_file) && (num_trace_sensors < TRACE_MAX_SENSORS))
+    {
+        rec.kind = TRACE_REC_SENSOR;
+        rec.type = type;
+        rec.sen_id = sen_id;
+        rec.t_ms = trace_now_ms();
+        memset(rec.key, 0, sizeof(rec.key));
+        strncpy(rec.key, p_key, TRACE_KEY_LEN - 1);
+        if (SUCCESS == trace_write(&rec))
+        {
+            trace_sensors[num_trace_sensors].sen_id = sen_id;
+            memcpy(trace_sensors[num_trace_sensors].key, rec.key, TRACE_KEY_LEN);
+            num_trace_sensors++;
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_ow(const uint8_t * p_rom, const uint8_t * p_pad)
+{
+    trace_rec_t rec;
+    char        key[TRACE_KEY_LEN];
+    uint16_t    i;
+
+    if (NULL == p_trace_file)
+    {
+        return;
+    }
+
+    // Key as built by the registry, family code first
+    for (i = 0; i < 8; i++)
+    {
+        sprintf(&key[2 * i], "%02x", p_rom[i]);
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    for (i = 0; i < num_trace_sensors; i++)
+    {
+        if (0 == strcmp(trace_sensors[i].key, key))
+        {
+            break;
+        }
+    }
+    if ((NULL != p_trace_file) && (i < num_trace_sensors))
+    {
+        rec.kind = TRACE_REC_OW;
+        rec.sen_id = trace_sensors[i].sen_id;
+        rec.t_ms = trace_now_ms();
+        memcpy(rec.pad, p_pad, TRACE_PAD_LEN);
+        trace_write(&rec);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_aio(uint16_t sen_id, const int32_t * p_adc, uint8_t num)
+{
+    trace_rec_t rec;
+
+    if (NULL == p_trace_file)
+    {
+        return;
+    }
+
+    rec.kind = TRACE_REC_AIO;
+    rec.sen_id = sen_id;
+    rec.num_adc = (num > TRACE_MAX_ADC) ? (TRACE_MAX_ADC) : (num);
+    memcpy(rec.adc, p_adc, rec.num_adc * sizeof(int32_t));
+
+    pthread_mutex_lock(&trace_lock);
+    if (NULL != p_trace_file)
+    {
+        rec.t_ms = trace_now_ms();
+        trace_write(&rec);
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+uint8_t trace_put(const trace_rec_t * p_rec)
+{
+    uint8_t ret_val = FAIL;
+
+    pthread_mutex_lock(&trace_lock);
+    if ((NULL != p_trace_file) && (p_rec->t_ms >= trace_last_ms))
+    {
+        ret_val = trace_write(p_rec);
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    return ret_val;
+}
+
+/******************************************************************************/
+
+uint8_t trace_reader_open(trace_reader_t * p_reader, const char * p_path)
+{
+    memset(p_reader, 0, sizeof(trace_reader_t));
+
+    p_reader->p_file = fopen(p_path, "rb");
+    if (NULL == p_reader->p_file)
+    {
+        printf("Failed to open trace file %s.\n", p_path);
+        return FAIL;
+    }
+
+    if ((1 != fread(&p_reader->header, sizeof(trace_header_t), 1, p_reader->p_file)) ||
+        (TRACE_MAGIC != p_reader->header.magic) || (TRACE_VERSION != p_reader->header.version))
+    {
+        printf("%s is not a trace file of version %d.\n", p_path, TRACE_VERSION);
+        fclose(p_reader->p_file);
+        p_reader->p_file = NULL;
+        return FAIL;
+    }
+    p_reader->offset = sizeof(trace_header_t);
+
+    return SUCCESS;
+}
+
+int trace_read(trace_reader_t * p_reader, trace_rec_t * p_rec)
+{
+    int64_t  dt, sen_id, value, prev;
+    int      kind, ret_val;
+    uint16_t i;
+
+    kind = getc(p_reader->p_file);
+    if (EOF == kind)
+    {
+        return 0;
+    }
+    p_reader->offset++;
+
+    // A record cut off at the end of the file is where the capture stopped
+    if ((1 != (ret_val = trace_get_varint(p_reader, &dt))) ||
+        (1 != (ret_val = trace_get_varint(p_reader, &sen_id))))
+    {
+        return ret_val;
+    }
+    if ((dt < 0) || (sen_id < 0) || (sen_id > UINT16_MAX))
+    {
+        return -1;
+    }
+    p_reader->t_ms += dt;
+    p_rec->kind = (uint8_t)kind;
+    p_rec->sen_id = (uint16_t)sen_id;
+    p_rec->t_ms = p_reader->t_ms;
+
+    switch (kind)
+    {
+        case TRACE_REC_SENSOR:
+            if (1 != (ret_val = trace_get_varint(p_reader, &value)))
+            {
+                return ret_val;
+            }
+            p_rec->type = (uint8_t)value;
+            if (1 != (ret_val = trace_get_varint(p_reader, &value)))
+            {
+                return ret_val;
+            }
+            if ((value < 0) || (value >= TRACE_KEY_LEN))
+            {
+                return -1;
+            }
+            memset(p_rec->key, 0, sizeof(p_rec->key));
+            if ((size_t)value != fread(p_rec->key, 1, (size_t)value, p_reader->p_file))
+            {
+                return 0;
+            }
+            p_reader->offset += (uint64_t)value;
+        break;
+
+        case TRACE_REC_OW:
+            if (TRACE_PAD_LEN != fread(p_rec->pad, 1, TRACE_PAD_LEN, p_reader->p_file))
+            {
+                return 0;
+            }
+            p_reader->offset += TRACE_PAD_LEN;
+        break;
+
+        case TRACE_REC_AIO:
+            if (1 != (ret_val = trace_get_varint(p_reader, &value)))
+            {
+                return ret_val;
+            }
+            if ((value < 1) || (value > TRACE_MAX_ADC))
+            {
+                return -1;
+            }
+            p_rec->num_adc = (uint8_t)value;
+            prev = 0;
+            for (i = 0; i < p_rec->num_adc; i++)
+            {
+                if (1 != (ret_val = trace_get_varint(p_reader, &value)))
+                {
+                    return ret_val;
+                }
+                prev += value;
+                p_rec->adc[i] = (int32_t)prev;
+            }
+        break;
+
+        default:
+            return -1;
+    }
+
+    return 1;
+}
+
+void trace_reader_close(trace_reader_t * p_reader)
+{
+    if (NULL != p_reader->p_file)
+    {
+        fclose(p_reader->p_file);
+        p_reader->p_file = NULL;
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t trace_write(const trace_rec_t * p_rec)
+{
+    uint8_t   buf[TRACE_MAX_REC_LEN];
+    uint8_t  *p_pos = buf;
+    size_t    len;
+    uint16_t  i;
+
+    *p_pos++ = p_rec->kind;
+    p_pos = trace_put_varint(p_pos, p_rec->t_ms - trace_last_ms);
+    p_pos = trace_put_varint(p_pos, p_rec->sen_id);
+
+    switch (p_rec->kind)
+    {
+        case TRACE_REC_SENSOR:
+            len = strnlen(p_rec->key, TRACE_KEY_LEN - 1);
+            p_pos = trace_put_varint(p_pos, p_rec->type);
+            p_pos = trace_put_varint(p_pos, (int64_t)len);
+            memcpy(p_pos, p_rec->key, len);
+            p_pos += len;
+        break;
+
+        case TRACE_REC_OW:
+            memcpy(p_pos, p_rec->pad, TRACE_PAD_LEN);
+            p_pos += TRACE_PAD_LEN;
+        break;
+
+        case TRACE_REC_AIO:
+            p_pos = trace_put_varint(p_pos, p_rec->num_adc);
+            for (i = 0; i < p_rec->num_adc; i++)
+            {
+                p_pos = trace_put_varint(p_pos,
+                            (int64_t)p_rec->adc[i] - ((i) ? (p_rec->adc[i - 1]) : (0)));
+            }
+        break;
+
+        default:
+            return FAIL;
+    }
+
+    len = (size_t)(p_pos - buf);
+    if (trace_max_bytes && ((trace_bytes + len) > trace_max_bytes))
+    {
+        // Capture ends, what is in the file stays readable
+        printf("Trace file full, capture stopped.\n");
+        fclose(p_trace_file);
+        p_trace_file = NULL;
+        return FAIL;
+    }
+    if (len != fwrite(buf, 1, len, p_trace_file))
+    {
+        printf("Failed to write trace file, capture stopped.\n");
+        fclose(p_trace_file);
+        p_trace_file = NULL;
+        return FAIL;
+    }
+    trace_bytes += len;
+    trace_last_ms = p_rec->t_ms;
+
+    // A crash loses no more than the last TRACE_FLUSH_MS
+    if ((trace_last_ms - trace_flush_ms) >= TRACE_FLUSH_MS)
+    {
+        fflush(p_trace_file);
+        trace_flush_ms = trace_last_ms;
+    }
+
+    return SUCCESS;
+}
+
+static int64_t trace_now_ms(void)
+{
+    int64_t t_ms = (lat_now_ns() - trace_start_ns) / 1000000;
+
+    return (t_ms > trace_last_ms) ? (t_ms) : (trace_last_ms);
+}
+
+/* Zigzag, then 7 bits a byte, least significant first, MSB set on all but
+*  the last byte (as archive.c)
+*/
+static uint8_t * trace_put_varint(uint8_t * p_buf, int64_t value)
+{
+    uint64_t zz = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+
+    while (zz >= 0x80)
+    {
+        *p_buf++ = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    *p_buf++ = (uint8_t)zz;
+
+    return p_buf;
+}
+
+/* @return - int (1 on success, 0 at the end of the file, -1 if too long)
+*/
+static int trace_get_varint(trace_reader_t * p_reader, int64_t * p_value)
+{
+    uint64_t zz = 0;
+    uint8_t  shift = 0;
+    int      byte;
+
+    do
+    {
+        if (shift > 63)
+        {
+            return -1;
+        }
+        byte = getc(p_reader->p_file);
+        if (EOF == byte)
+        {
+            return 0;
+        }
+        p_reader->offset++;
+        zz |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    *p_value = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+
+    return 1;
+}
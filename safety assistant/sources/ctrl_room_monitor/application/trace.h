@@ -0,0 +1,162 @@
+/******************************************************************************/
+
+/* File - trace.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Capture of the raw sensor readings into a compact binary trace file, for
+*  reproducing a field incident or benchmarking the processing and storage
+*  path off the target with the 'replay' tool. The application captures while
+*  'trace.path' is set, see app.conf.
+*
+*     header  - trace_header_t (little endian, 16 bytes)
+*     records - kind byte followed by zigzag varints (as in archive.h):
+*                 TRACE_REC_SENSOR: dt, sen_id, type, key length, key bytes
+*                 TRACE_REC_OW    : dt, sen_id, 9 scratchpad bytes as read
+*                 TRACE_REC_AIO   : dt, sen_id, count, first ADC count, then
+*                                   the delta to the previous count
+*
+*  'dt' is the time since the previous record in milliseconds (CLOCK_MONOTONIC
+*  of the application), the first record counts from 'start_ms'. Every sensor
+*  is defined by a TRACE_REC_SENSOR record before its first reading. A
+*  scratchpad is recorded whether it passed its CRC or not, every retry is a
+*  record of its own. A DS18B20 read costs 12 bytes, a dust burst of 16
+*  pulses about 20.
+*
+*  The capture hooks may be called by any thread and do nothing unless a
+*  capture is open. Records are buffered and written at least every
+*  TRACE_FLUSH_MS, a capture stops once the file reaches 'trace.max_mb'.
+*/
+
+/******************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/******************************************************************************/
+
+#define TRACE_MAGIC             (0x31435254)        // "TRC1"
+#define TRACE_VERSION           (1)
+
+/* Capture file size limit in MiB ('trace.max_mb') and flush interval
+*/
+#define TRACE_MAX_MB            (64)
+#define TRACE_FLUSH_MS          (1000)
+
+/* Sensors of a trace, key length and ADC counts of a reading
+*/
+#define TRACE_MAX_SENSORS       (64)
+#define TRACE_KEY_LEN           (24)
+#define TRACE_MAX_ADC           (64)
+#define TRACE_PAD_LEN           (9)
+
+typedef enum
+{
+    TRACE_REC_SENSOR = 1,
+    TRACE_REC_OW     = 2,
+    TRACE_REC_AIO    = 3
+} trace_rec_kind_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    int64_t  start_ms;                          // UNIX time of the capture start
+} trace_header_t;
+
+/* A decoded record
+*/
+typedef struct
+{
+    uint8_t  kind;                              // trace_rec_kind_t
+    uint8_t  type;                              // TRACE_REC_SENSOR: sensor_type_t
+    uint16_t sen_id;
+    int64_t  t_ms;                              // Since 'start_ms'
+    char     key[TRACE_KEY_LEN];                // TRACE_REC_SENSOR
+    uint8_t  pad[TRACE_PAD_LEN];                // TRACE_REC_OW
+    uint8_t  num_adc;                           // TRACE_REC_AIO
+    int32_t  adc[TRACE_MAX_ADC];
+} trace_rec_t;
+
+/* Read position in a trace file
+*/
+typedef struct
+{
+    FILE           *p_file;
+    trace_header_t  header;
+    int64_t         t_ms;
+    uint64_t        offset;                     // Bytes read so far
+} trace_reader_t;
+
+/******************************************************************************/
+
+/* Function declaration to start a capture, an existing file is replaced
+*  @param[in] p_path    - Path of the trace file
+*  @param[in] max_bytes - Size limit of the file, 0 for none
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t trace_open(const char * p_path, uint64_t max_bytes);
+
+/* Function declaration to end the capture and close its file
+*  @return - None
+*/
+void trace_close(void);
+
+/* Function declaration to define a sensor of the capture, called when it
+*  gets its sensor ID (see registry.h)
+*  @param[in] sen_id - Sensor ID
+*  @param[in] type   - sensor_type_t
+*  @param[in] p_key  - Key in the 'sensors' table (ROM code of a DS18B20)
+*  @return - None
+*/
+void trace_sensor(uint16_t sen_id, uint8_t type, const char * p_key);
+
+/* Function declaration to capture a scratchpad read of a DS18B20 as it came
+*  off the bus, the probe is known by its ROM code
+*  @param[in] p_rom - 8-byte ROM address
+*  @param[in] p_pad - TRACE_PAD_LEN bytes of scratchpad
+*  @return - None
+*/
+void trace_ow(const uint8_t * p_rom, const uint8_t * p_pad);
+
+/* Function declaration to capture a burst of ADC counts of an analog sensor
+*  @param[in] sen_id - Sensor ID
+*  @param[in] p_adc  - ADC counts
+*  @param[in] num    - Number of counts (up to TRACE_MAX_ADC)
+*  @return - None
+*/
+void trace_aio(uint16_t sen_id, const int32_t * p_adc, uint8_t num);
+
+/* Function declaration to append a record with its own time, e.g. of a
+*  synthetic trace. Times must not go backwards.
+*  @param[in] p_rec - Record
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if no capture is open or full )
+*/
+uint8_t trace_put(const trace_rec_t * p_rec);
+
+/* Function declaration to open a trace file for reading
+*  @param[out] p_reader - Read position
+*  @param[in]  p_path   - Path of the trace file
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if missing or not a trace )
+*/
+uint8_t trace_reader_open(trace_reader_t * p_reader, const char * p_path);
+
+/* Function declaration to read the next record
+*  @param[in]  p_reader - Read position
+*  @param[out] p_rec    - Record
+*  @return - int (1 for a record, 0 at the end, -1 if the file is corrupted;
+*            a record cut off by a crash of the capture ends the trace)
+*/
+int trace_read(trace_reader_t * p_reader, trace_rec_t * p_rec);
+
+/* Function declaration to close a trace file opened for reading
+*  @param[in] p_reader - Read position
+*  @return - None
+*/
+void trace_reader_close(trace_reader_t * p_reader);
+
+#endif /* TRACE_H */
@@ -0,0 +1,534 @@
+/******************************************************************************/
+
+/* File - uplink.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Uplink thread to the collector. See uplink.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "config.h"
+#include "sched.h"
+#include "worker.h"
+#include "sample.h"
+#include "wire.h"
+#include "db.h"
+#include "stats.h"
+#include "uplink.h"
+
+/******************************************************************************/
+
+/* Collector address UPLINK_ADDR ('uplink.addr', "" = off, see wire.h) and
+*  name of this gateway ('uplink.node', "" = host name), the namespace of its
+*  sensor IDs at the collector
+*/
+#define UPLINK_ADDR                 ""
+#define UPLINK_NODE                 ""
+
+/* Samples per batch UPLINK_BATCH ('uplink.batch') and batches sent ahead of
+*  the acknowledgement UPLINK_WINDOW ('uplink.window')
+*/
+#define UPLINK_BATCH                (256)
+#define UPLINK_WINDOW               (4)
+#define UPLINK_MAX_WINDOW           (16)
+
+/* Timeout of connect, handshake and send UPLINK_TIMEOUT_MS
+*  ('uplink.timeout_ms'). A lost connection is retried after
+*  UPLINK_RETRY_MIN_MS ('uplink.retry_min_ms'), doubled with every further
+*  failure up to UPLINK_RETRY_MAX_MS ('uplink.retry_max_ms').
+*/
+#define UPLINK_TIMEOUT_MS           (5000)
+#define UPLINK_RETRY_MIN_MS         (1000)
+#define UPLINK_RETRY_MAX_MS         (60000)
+
+/******************************************************************************/
+
+/* Batch sent and not acknowledged yet
+*/
+typedef struct
+{
+    int64_t  end_seq;
+    uint32_t count;
+} uplink_batch_t;
+
+/******************************************************************************/
+
+static worker_t        uplink_worker;
+static uint8_t         is_started = 0;
+static atomic_uint     is_notified;
+static _Atomic int64_t acked_seq_shared;
+
+static const char     *p_addr;
+static char            node_name[WIRE_NAME_LEN + 1];
+static uint32_t        batch_max;
+static uint32_t        window;
+static uint32_t        timeout_ms;
+
+static int             sock_fd = -1;
+static sched_fd_t      sock_watch;
+static sched_task_t    connect_task;
+static uint32_t        retry_ms = 0;
+
+// Sequence numbers sent and acknowledged, batches in flight oldest first
+static int64_t         sent_seq;
+static int64_t         acked_seq;
+static uplink_batch_t  in_flight[UPLINK_MAX_WINDOW];
+static uint8_t         num_in_flight;
+
+// Sensors the collector knows of, IDs are handed out in ascending order
+static uint16_t        max_sen_id_sent;
+
+// Frame being built, a batch or the sensor list
+static uint8_t         out_buf[WIRE_HDR_LEN + WIRE_MAX_PAYLOAD];
+static uint32_t        out_len;
+static uint32_t        out_count;
+static int64_t         out_seq;
+static uint16_t        out_max_sen_id;
+
+// Frames received, acknowledgements only
+static uint8_t         in_buf[4 * (WIRE_HDR_LEN + WIRE_SEQ_LEN)];
+static uint32_t        in_len;
+
+/******************************************************************************/
+
+/* Function declarations of the worker callbacks
+*/
+static uint8_t uplink_init_fn(worker_t * p_worker);
+static void    uplink_item_fn(worker_t * p_worker, const void * p_item);
+static void    uplink_fini_fn(worker_t * p_worker);
+
+/* Function declarations of the task and watcher functions
+*/
+static void    connect_task_fn(sched_task_t * p_task);
+static void    uplink_read(sched_fd_t * p_watch);
+
+/* Function declarations to add a row to the batch or a sensor to the list
+*  being built
+*/
+static void    uplink_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg);
+static void    uplink_sensor_fn(uint16_t sen_id, const char * p_key, uint8_t sen_type,
+                                                                            void * p_arg);
+
+/* Function declaration to connect, say hello and take the resume point
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t uplink_connect(void);
+
+/* Function declaration to send the sensor list
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t uplink_send_sensors(void);
+
+/* Function declaration to send batches until the window is full or all
+*  committed samples are sent
+*  @return - None
+*/
+static void    uplink_pump(void);
+
+/* Function declaration to close the connection and retry later
+*  @param[in] p_reason - Printed with the message
+*  @return - None
+*/
+static void    uplink_drop(const char * p_reason);
+
+/******************************************************************************/
+
+uint8_t uplink_start(void)
+{
+    p_addr = config_get_str(UPLINK_ADDR, "uplink.addr");
+    if ('\0' == p_addr[0])
+    {
+        return SUCCESS;
+    }
+
+    snprintf(node_name, sizeof(node_name), "%s", config_get_str(UPLINK_NODE, "uplink.node"));
+    if (('\0' == node_name[0]) && (0 != gethostname(node_name, sizeof(node_name) - 1)))
+    {
+        printf("Uplink without node name.\n");
+        return FAIL;
+    }
+    node_name[WIRE_NAME_LEN] = '\0';
+
+    batch_max = (uint32_t)config_get_int(UPLINK_BATCH, "uplink.batch");
+    if ((0 == batch_max) || (batch_max > WIRE_MAX_BATCH))
+    {
+        batch_max = UPLINK_BATCH;
+    }
+    window = (uint32_t)config_get_int(UPLINK_WINDOW, "uplink.window");
+    if ((0 == window) || (window > UPLINK_MAX_WINDOW))
+    {
+        window = UPLINK_WINDOW;
+    }
+    timeout_ms = (uint32_t)config_get_int(UPLINK_TIMEOUT_MS, "uplink.timeout_ms");
+
+    atomic_store(&is_notified, 0);
+    atomic_store(&acked_seq_shared, 0);
+
+    // A notification is a wake-up only, one queued at a time is enough
+    if (SUCCESS != worker_start(&uplink_worker, "Uplink", sizeof(uint8_t), 4,
+                                uplink_init_fn, uplink_item_fn, uplink_fini_fn, NULL))
+    {
+        return FAIL;
+    }
+    is_started = 1;
+
+    return SUCCESS;
+}
+
+void uplink_notify(void)
+{
+    uint8_t item = 0;
+
+    if (is_started && (0 == atomic_exchange(&is_notified, 1)))
+    {
+        worker_submit(&uplink_worker, &item);
+    }
+}
+
+int64_t uplink_acked(void)
+{
+    return atomic_load(&acked_seq_shared);
+}
+
+void uplink_stop(void)
+{
+    if (is_started)
+    {
+        worker_stop(&uplink_worker);
+        is_started = 0;
+    }
+}
+
+/******************************************************************************/
+
+static uint8_t uplink_init_fn(worker_t * p_worker)
+{
+    sched_task_init(&connect_task, connect_task_fn, NULL);
+    sched_after(&connect_task, 0);
+
+    printf("Uplink of node %s to %s started.\n", node_name, p_addr);
+
+    return SUCCESS;
+}
+
+static void uplink_item_fn(worker_t * p_worker, const void * p_item)
+{
+    atomic_store(&is_notified, 0);
+    uplink_pump();
+}
+
+static void uplink_fini_fn(worker_t * p_worker)
+{
+    sched_stop(&connect_task);
+    if (sock_fd >= 0)
+    {
+        sched_unwatch(&sock_watch);
+        close(sock_fd);
+        sock_fd = -1;
+    }
+
+    printf("Uplink stopped, samples acknowledged up to %lld.\n", (long long)acked_seq);
+}
+
+static void connect_task_fn(sched_task_t * p_task)
+{
+    uint32_t retry_max_ms;
+
+    if (SUCCESS == uplink_connect())
+    {
+        retry_ms = 0;
+        uplink_pump();
+        return;
+    }
+
+    stats_count(STATS_UPLINK_ERRORS, 1);
+    retry_max_ms = (uint32_t)config_get_int(UPLINK_RETRY_MAX_MS, "uplink.retry_max_ms");
+    if (0 == retry_ms)
+    {
+        retry_ms = (uint32_t)config_get_int(UPLINK_RETRY_MIN_MS, "uplink.retry_min_ms");
+        printf("Collector %s not available, retrying.\n", p_addr);
+    }
+    else if ((retry_ms *= 2) > retry_max_ms)
+    {
+        retry_ms = retry_max_ms;
+    }
+    sched_after(p_task, retry_ms);
+}
+
+static uint8_t uplink_connect(void)
+{
+    uint8_t  frame[WIRE_HDR_LEN + WIRE_SEQ_LEN + 1 + WIRE_NAME_LEN];
+    uint8_t  name_len = (uint8_t)strlen(node_name);
+    int64_t  max_sl;
+    ssize_t  len;
+
+    if (SUCCESS != db_read_max_sl(&max_sl))
+    {
+        return FAIL;
+    }
+
+    sock_fd = wire_connect(p_addr, timeout_ms);
+    if (sock_fd < 0)
+    {
+        return FAIL;
+    }
+
+    wire_put_hdr(frame, WIRE_HELLO, WIRE_SEQ_LEN + 1 + name_len);
+    wire_put_u64(&frame[WIRE_HDR_LEN], (uint64_t)max_sl);
+    frame[WIRE_HDR_LEN + WIRE_SEQ_LEN] = name_len;
+    memcpy(&frame[WIRE_HDR_LEN + WIRE_SEQ_LEN + 1], node_name, name_len);
+
+    // Handshake is blocking, bounded by the receive timeout
+    if (SUCCESS != wire_send(sock_fd, frame, WIRE_HDR_LEN + WIRE_SEQ_LEN + 1 + name_len))
+    {
+        close(sock_fd);
+        sock_fd = -1;
+        return FAIL;
+    }
+    len = recv(sock_fd, frame, WIRE_HDR_LEN + WIRE_SEQ_LEN, MSG_WAITALL);
+    if ((len != (WIRE_HDR_LEN + WIRE_SEQ_LEN)) ||
+        (wire_frame_len(frame, (uint32_t)len) != len) || (WIRE_RESUME != frame[4]))
+    {
+        printf("Collector %s did not accept node %s.\n", p_addr, node_name);
+        close(sock_fd);
+        sock_fd = -1;
+        return FAIL;
+    }
+
+    sent_seq = (int64_t)wire_get_u64(&frame[WIRE_HDR_LEN]);
+    acked_seq = sent_seq;
+    atomic_store(&acked_seq_shared, acked_seq);
+    num_in_flight = 0;
+    in_len = 0;
+
+    // The collector gets the keys of all sensors with every connection
+    max_sen_id_sent = 0;
+    if ((SUCCESS != uplink_send_sensors()) ||
+        (SUCCESS != sched_watch(&sock_watch, sock_fd, uplink_read, NULL)))
+    {
+        close(sock_fd);
+        sock_fd = -1;
+        return FAIL;
+    }
+
+    printf("Uplink connected to %s, %lld sample(s) to send.\n", p_addr,
+           (long long)((max_sl > sent_seq) ? (max_sl - sent_seq) : (0)));
+
+    return SUCCESS;
+}
+
+static void uplink_read(sched_fd_t * p_watch)
+{
+    ssize_t  len;
+    int32_t  frame_len;
+    int64_t  seq;
+    uint32_t acked = 0;
+
+    len = recv(sock_fd, &in_buf[in_len], sizeof(in_buf) - in_len, MSG_DONTWAIT);
+    if ((len < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+    {
+        return;
+    }
+    if (len <= 0)
+    {
+        uplink_drop("connection closed by the collector");
+        return;
+    }
+    in_len += (uint32_t)len;
+
+    while ((frame_len = wire_frame_len(in_buf, in_len)) > 0)
+    {
+        if ((WIRE_ACK != in_buf[4]) || (frame_len != (WIRE_HDR_LEN + WIRE_SEQ_LEN)))
+        {
+            uplink_drop("unexpected message");
+            return;
+        }
+
+        // Acknowledgements are cumulative
+        seq = (int64_t)wire_get_u64(&in_buf[WIRE_HDR_LEN]);
+        while ((num_in_flight > 0) && (in_flight[0].end_seq <= seq))
+        {
+            acked += in_flight[0].count;
+            memmove(&in_flight[0], &in_flight[1], --num_in_flight * sizeof(uplink_batch_t));
+        }
+        if (seq > acked_seq)
+        {
+            acked_seq = seq;
+        }
+
+        in_len -= (uint32_t)frame_len;
+        memmove(in_buf, &in_buf[frame_len], in_len);
+    }
+
+    if ((frame_len < 0) || (in_len >= sizeof(in_buf)))
+    {
+        uplink_drop("invalid frame");
+        return;
+    }
+
+    atomic_store(&acked_seq_shared, acked_seq);
+    stats_count(STATS_UPLINK_SAMPLES, acked);
+
+    uplink_pump();
+}
+
+static uint8_t uplink_send_sensors(void)
+{
+    out_len = WIRE_HDR_LEN + 2;
+    out_count = 0;
+
+    if (SUCCESS != db_read_sensors(uplink_sensor_fn, NULL))
+    {
+        return FAIL;
+    }
+
+    wire_put_hdr(out_buf, WIRE_SENSORS, out_len - WIRE_HDR_LEN);
+    wire_put_u16(&out_buf[WIRE_HDR_LEN], (uint16_t)out_count);
+
+    return wire_send(sock_fd, out_buf, out_len);
+}
+
+static void uplink_sensor_fn(uint16_t sen_id, const char * p_key, uint8_t sen_type,
+                                                                            void * p_arg)
+{
+    size_t key_len = (NULL != p_key) ? (strlen(p_key)) : (0);
+
+    if (key_len > UINT8_MAX)
+    {
+        key_len = UINT8_MAX;
+    }
+    if ((out_len + 4 + key_len) > sizeof(out_buf))
+    {
+        return;
+    }
+
+    wire_put_u16(&out_buf[out_len], sen_id);
+    out_buf[out_len + 2] = sen_type;
+    out_buf[out_len + 3] = (uint8_t)key_len;
+    memcpy(&out_buf[out_len + 4], p_key, key_len);
+    out_len += 4 + (uint32_t)key_len;
+    out_count++;
+
+    if (sen_id > max_sen_id_sent)
+    {
+        max_sen_id_sent = sen_id;
+    }
+}
+
+static void uplink_pump(void)
+{
+    while ((sock_fd >= 0) && (num_in_flight < window))
+    {
+        out_len = WIRE_HDR_LEN + WIRE_BATCH_HDR_LEN;
+        out_count = 0;
+        out_seq = sent_seq;
+        out_max_sen_id = 0;
+
+        // Database busy or failing, the next commit notifies again
+        if (SUCCESS != db_read_since(sent_seq, batch_max, uplink_row_fn, NULL))
+        {
+            return;
+        }
+        if (0 == out_count)
+        {
+            return;
+        }
+
+        // A sensor found since the last list, the collector gets its key
+        // first. The list shares the buffer, so the batch is read again.
+        if (out_max_sen_id > max_sen_id_sent)
+        {
+            if (SUCCESS != uplink_send_sensors())
+            {
+                uplink_drop("sensor list not sent");
+                return;
+            }
+            if (out_max_sen_id > max_sen_id_sent)
+            {
+                // Sensor not in the 'sensors' table, its samples go without key
+                max_sen_id_sent = out_max_sen_id;
+            }
+            continue;
+        }
+
+        if (SUCCESS != wire_send(sock_fd, out_buf, out_len))
+        {
+            uplink_drop("send failed");
+            return;
+        }
+
+        in_flight[num_in_flight].end_seq = out_seq;
+        in_flight[num_in_flight++].count = out_count;
+        sent_seq = out_seq;
+
+        // Everything committed so far is sent
+        if (out_count < batch_max)
+        {
+            return;
+        }
+    }
+}
+
+static void uplink_row_fn(int64_t sl, uint16_t sen_id, double sen_val, time_t sen_time,
+                                                                            void * p_arg)
+{
+    uint8_t *p_rec = &out_buf[out_len];
+
+    if (0 == out_count)
+    {
+        wire_put_u64(&out_buf[WIRE_HDR_LEN], (uint64_t)sl);
+        wire_put_u32(p_rec, 0);
+    }
+    else
+    {
+        wire_put_u32(p_rec, (uint32_t)(sl - out_seq));
+    }
+    wire_put_u16(&p_rec[4], sen_id);
+    wire_put_u32(&p_rec[6], (uint32_t)(int32_t)lround(sen_val * SAMPLE_SCALE));
+    wire_put_u32(&p_rec[10], (uint32_t)sen_time);
+
+    out_len += WIRE_SAMPLE_LEN;
+    out_seq = sl;
+    out_count++;
+    if (sen_id > out_max_sen_id)
+    {
+        out_max_sen_id = sen_id;
+    }
+
+    wire_put_hdr(out_buf, WIRE_BATCH, out_len - WIRE_HDR_LEN);
+    wire_put_u16(&out_buf[WIRE_HDR_LEN + WIRE_SEQ_LEN], (uint16_t)out_count);
+}
+
+static void uplink_drop(const char * p_reason)
+{
+    uint32_t delay_ms;
+
+    if (sock_fd < 0)
+    {
+        return;
+    }
+
+    printf("Uplink to %s lost (%s).\n", p_addr, p_reason);
+    stats_count(STATS_UPLINK_ERRORS, 1);
+
+    sched_unwatch(&sock_watch);
+    close(sock_fd);
+    sock_fd = -1;
+    num_in_flight = 0;
+
+    // Unacknowledged batches are sent again from the resume point
+    delay_ms = (uint32_t)config_get_int(UPLINK_RETRY_MIN_MS, "uplink.retry_min_ms");
+    sched_after(&connect_task, delay_ms);
+}
@@ -0,0 +1,57 @@
+/******************************************************************************/
+
+/* File - uplink.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Uplink thread, streams the samples committed to the database to a
+*  collector daemon (collector.c) in the binary protocol of wire.h. The
+*  database is the send buffer: samples are read in 'sl' order and the 'sl'
+*  is the sequence number, so after a lost connection or a restart of either
+*  side the collector tells where to resume and nothing is sent twice or
+*  lost (as long as the samples are not archived or pruned meanwhile).
+*
+*  At most 'uplink.window' batches are unacknowledged at a time, the
+*  collector acknowledges a batch once it is committed. A slow collector so
+*  slows the uplink down instead of the samples piling up in RAM, the
+*  backlog stays in the database.
+*
+*  The storage thread calls uplink_notify() after every commit. Without
+*  'uplink.addr' the uplink is off and every call is a no-op.
+*/
+
+/******************************************************************************/
+
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+/* Function declaration to start the uplink thread if 'uplink.addr' is set,
+*  the database must be open. The connection is made on the thread and
+*  retried as long as it fails.
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+uint8_t uplink_start(void);
+
+/* Function declaration to tell the uplink about newly committed samples, may
+*  be called by one thread only. Does not block.
+*  @return - None
+*/
+void uplink_notify(void);
+
+/* Function declaration to get the last sequence number acknowledged by the
+*  collector, may be called from any thread
+*  @return - int64_t (sequence number, 0 if none yet)
+*/
+int64_t uplink_acked(void);
+
+/* Function declaration to stop the uplink thread. Samples not acknowledged
+*  are sent again after the next start.
+*  @return - None
+*/
+void uplink_stop(void);
+
+#endif /* UPLINK_H */
@@ -0,0 +1,243 @@
+/******************************************************************************/
+
+/* File - wire.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Sockets of the gateway to collector protocol. See wire.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "common.h"
+#include "wire.h"
+
+/******************************************************************************/
+
+#define WIRE_UNIX_PREFIX        "unix:"
+#define WIRE_ADDR_LEN           (128)
+
+/* Pending connections of a listening socket
+*/
+#define WIRE_BACKLOG            (16)
+
+/******************************************************************************/
+
+/* Function declaration to resolve an address
+*  @param[in]  p_addr    - Address, see wire.h
+*  @param[in]  is_listen - Non-zero to resolve for bind()
+*  @param[out] p_un      - Unix socket address, if 'p_addr' is one
+*  @param[out] pp_ai     - TCP addresses otherwise, freed with freeaddrinfo()
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) )
+*/
+static uint8_t wire_resolve(const char * p_addr, uint8_t is_listen, struct sockaddr_un * p_un,
+                                                                struct addrinfo ** pp_ai);
+
+/******************************************************************************/
+
+int wire_connect(const char * p_addr, uint32_t timeout_ms)
+{
+    struct sockaddr_un  un;
+    struct addrinfo    *p_ai = NULL, *p_cur;
+    struct timeval      tv;
+    int                 fd = -1, one = 1;
+
+    if (SUCCESS != wire_resolve(p_addr, 0, &un, &p_ai))
+    {
+        return -1;
+    }
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    // On Linux the send timeout bounds connect() as well
+    if (NULL == p_ai)
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            if (0 != connect(fd, (struct sockaddr *)&un, sizeof(un)))
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    for (p_cur = p_ai; (NULL != p_cur) && (fd < 0); p_cur = p_cur->ai_next)
+    {
+        fd = socket(p_cur->ai_family, SOCK_STREAM | SOCK_CLOEXEC, p_cur->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (0 != connect(fd, p_cur->ai_addr, p_cur->ai_addrlen))
+        {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+
+        // Batches are sent whole, no need to wait for more data
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (NULL != p_ai)
+    {
+        freeaddrinfo(p_ai);
+    }
+
+    #if defined(RUN_TIME_LOG)
+        if (fd < 0)
+        {
+            printf("Failed to connect to %s (%s).\n", p_addr, strerror(errno));
+        }
+    #endif
+
+    return fd;
+}
+
+int wire_listen(const char * p_addr)
+{
+    struct sockaddr_un  un;
+    struct addrinfo    *p_ai = NULL;
+    int                 fd, one = 1, ret_val;
+
+    if (SUCCESS != wire_resolve(p_addr, 1, &un, &p_ai))
+    {
+        return -1;
+    }
+
+    fd = socket((NULL != p_ai) ? (p_ai->ai_family) : (AF_UNIX),
+                SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, (NULL != p_ai) ? (p_ai->ai_protocol) : (0));
+    if (fd < 0)
+    {
+        printf("socket() failed (%s).\n", strerror(errno));
+        if (NULL != p_ai)
+        {
+            freeaddrinfo(p_ai);
+        }
+        return -1;
+    }
+
+    if (NULL != p_ai)
+    {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        ret_val = bind(fd, p_ai->ai_addr, p_ai->ai_addrlen);
+        freeaddrinfo(p_ai);
+    }
+    else
+    {
+        // Left over by a previous run which did not exit cleanly
+        unlink(un.sun_path);
+        ret_val = bind(fd, (struct sockaddr *)&un, sizeof(un));
+    }
+
+    if ((0 != ret_val) || (0 != listen(fd, WIRE_BACKLOG)))
+    {
+        printf("Failed to listen on %s (%s).\n", p_addr, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+uint8_t wire_send(int fd, const uint8_t * p_buf, uint32_t len)
+{
+    ssize_t sent;
+
+    while (len > 0)
+    {
+        sent = send(fd, p_buf, len, MSG_NOSIGNAL);
+        if ((sent < 0) && (EINTR == errno))
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return FAIL;
+        }
+        p_buf += sent;
+        len -= (uint32_t)sent;
+    }
+
+    return SUCCESS;
+}
+
+/******************************************************************************/
+
+static uint8_t wire_resolve(const char * p_addr, uint8_t is_listen, struct sockaddr_un * p_un,
+                                                                struct addrinfo ** pp_ai)
+{
+    struct addrinfo  hints;
+    char             host[WIRE_ADDR_LEN];
+    const char      *p_port;
+    char            *p_colon;
+    int              ret_val;
+
+    *pp_ai = NULL;
+
+    if (0 == strncmp(p_addr, WIRE_UNIX_PREFIX, strlen(WIRE_UNIX_PREFIX)))
+    {
+        p_addr += strlen(WIRE_UNIX_PREFIX);
+        if (('\0' == p_addr[0]) || (strlen(p_addr) >= sizeof(p_un->sun_path)))
+        {
+            printf("Invalid socket path %s.\n", p_addr);
+            return FAIL;
+        }
+        memset(p_un, 0, sizeof(*p_un));
+        p_un->sun_family = AF_UNIX;
+        strcpy(p_un->sun_path, p_addr);
+        return SUCCESS;
+    }
+
+    if (strlen(p_addr) >= sizeof(host))
+    {
+        printf("Invalid address %s.\n", p_addr);
+        return FAIL;
+    }
+    strcpy(host, p_addr);
+
+    // "host:port", "host" or ":port"
+    p_port = WIRE_PORT;
+    p_colon = strrchr(host, ':');
+    if (NULL != p_colon)
+    {
+        *p_colon = '\0';
+        if ('\0' != p_colon[1])
+        {
+            p_port = &p_colon[1];
+        }
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = (is_listen) ? (AI_PASSIVE) : (0);
+
+    ret_val = getaddrinfo(('\0' != host[0]) ? (host) : (NULL), p_port, &hints, pp_ai);
+    if (0 != ret_val)
+    {
+        printf("Failed to resolve %s (%s).\n", p_addr, gai_strerror(ret_val));
+        *pp_ai = NULL;
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
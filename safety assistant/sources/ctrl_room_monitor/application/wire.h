@@ -0,0 +1,173 @@
+/******************************************************************************/
+
+/* File - wire.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Binary protocol between the gateways (see uplink.h) and the collector
+*  (collector.c), over a stream socket. Every message is a frame of an
+*  8 byte header and a payload, all fields little endian:
+*
+*     header  : u32 payload length, u8 type, u8 version, u16 reserved
+*
+*  Gateway to collector:
+*
+*     HELLO   : u64 last sequence number of the gateway, u8 name length, name
+*     SENSORS : u16 count, per sensor u16 sen_id, u8 sen_type, u8 key length,
+*               key
+*     BATCH   : u64 sequence number of the first sample, u16 count, per sample
+*               u32 distance to the sequence number of the sample before
+*               (0 for the first), u16 sen_id, i32 sen_val (1 / SAMPLE_SCALE
+*               units), u32 sen_time (unix seconds)
+*
+*  Collector to gateway:
+*
+*     RESUME  : u64 sequence number, the gateway continues after it
+*     ACK     : u64 sequence number, every sample up to it is committed
+*
+*  A sequence number is the 'sl' of the sample in the database of the
+*  gateway, so it only grows and survives restarts of both sides. The name
+*  of the gateway is the namespace of its sensor IDs at the collector.
+*
+*  Addresses are "unix:<path>" for a Unix domain socket, anything else is
+*  "<host>:<port>" (TCP, host may be empty).
+*/
+
+/******************************************************************************/
+
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+
+#define WIRE_VERSION            (1)
+
+/* Default TCP port of the collector
+*/
+#define WIRE_PORT               "5020"
+
+/* Frame and record sizes in bytes
+*/
+#define WIRE_HDR_LEN            (8)
+#define WIRE_MAX_PAYLOAD        (65536)
+#define WIRE_SEQ_LEN            (8)
+#define WIRE_BATCH_HDR_LEN      (10)
+#define WIRE_SAMPLE_LEN         (14)
+
+/* Samples of the largest batch
+*/
+#define WIRE_MAX_BATCH          ((WIRE_MAX_PAYLOAD - WIRE_BATCH_HDR_LEN) / WIRE_SAMPLE_LEN)
+
+/* Longest gateway name
+*/
+#define WIRE_NAME_LEN           (32)
+
+typedef enum
+{
+    WIRE_HELLO = 1,
+    WIRE_SENSORS,
+    WIRE_BATCH,
+    WIRE_RESUME,
+    WIRE_ACK
+} wire_type_t;
+
+/******************************************************************************/
+
+static inline void wire_put_u16(uint8_t * p_buf, uint16_t val)
+{
+    p_buf[0] = (uint8_t)val;
+    p_buf[1] = (uint8_t)(val >> 8);
+}
+
+static inline void wire_put_u32(uint8_t * p_buf, uint32_t val)
+{
+    wire_put_u16(p_buf, (uint16_t)val);
+    wire_put_u16(&p_buf[2], (uint16_t)(val >> 16));
+}
+
+static inline void wire_put_u64(uint8_t * p_buf, uint64_t val)
+{
+    wire_put_u32(p_buf, (uint32_t)val);
+    wire_put_u32(&p_buf[4], (uint32_t)(val >> 32));
+}
+
+static inline uint16_t wire_get_u16(const uint8_t * p_buf)
+{
+    return (uint16_t)(p_buf[0] | (p_buf[1] << 8));
+}
+
+static inline uint32_t wire_get_u32(const uint8_t * p_buf)
+{
+    return wire_get_u16(p_buf) | ((uint32_t)wire_get_u16(&p_buf[2]) << 16);
+}
+
+static inline uint64_t wire_get_u64(const uint8_t * p_buf)
+{
+    return wire_get_u32(p_buf) | ((uint64_t)wire_get_u32(&p_buf[4]) << 32);
+}
+
+/* Function to write a frame header
+*  @param[out] p_buf - Start of the frame
+*  @param[in]  type  - Message type
+*  @param[in]  len   - Payload length
+*  @return - None
+*/
+static inline void wire_put_hdr(uint8_t * p_buf, wire_type_t type, uint32_t len)
+{
+    wire_put_u32(p_buf, len);
+    p_buf[4] = (uint8_t)type;
+    p_buf[5] = WIRE_VERSION;
+    wire_put_u16(&p_buf[6], 0);
+}
+
+/* Function to check for a complete frame at the start of a buffer
+*  @param[in] p_buf - Received bytes
+*  @param[in] len   - Number of received bytes
+*  @return - int32_t (frame length, 0 if incomplete, -1 if not a valid frame)
+*/
+static inline int32_t wire_frame_len(const uint8_t * p_buf, uint32_t len)
+{
+    uint32_t payload_len;
+
+    if (len < WIRE_HDR_LEN)
+    {
+        return 0;
+    }
+
+    payload_len = wire_get_u32(p_buf);
+    if ((WIRE_VERSION != p_buf[5]) || (payload_len > WIRE_MAX_PAYLOAD))
+    {
+        return -1;
+    }
+
+    return (len >= (WIRE_HDR_LEN + payload_len)) ? ((int32_t)(WIRE_HDR_LEN + payload_len)) : (0);
+}
+
+/******************************************************************************/
+
+/* Function declaration to connect to an address, the socket is blocking with
+*  send and receive timeouts
+*  @param[in] p_addr     - Address, see above
+*  @param[in] timeout_ms - Timeout of connect, send and receive
+*  @return - int (socket, -1 on failure)
+*/
+int wire_connect(const char * p_addr, uint32_t timeout_ms);
+
+/* Function declaration to listen on an address, the socket is non-blocking.
+*  A stale Unix socket file is removed.
+*  @param[in] p_addr - Address, see above
+*  @return - int (socket, -1 on failure)
+*/
+int wire_listen(const char * p_addr);
+
+/* Function declaration to send a whole buffer on a blocking socket
+*  @param[in] fd    - Socket
+*  @param[in] p_buf - Bytes to send
+*  @param[in] len   - Number of bytes
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) on error or timeout )
+*/
+uint8_t wire_send(int fd, const uint8_t * p_buf, uint32_t len);
+
+#endif /* WIRE_H */
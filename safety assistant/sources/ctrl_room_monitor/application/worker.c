@@ -0,0 +1,213 @@
+/******************************************************************************/
+
+/* File - worker.c
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Consumer thread fed by a lock-free SPSC ring. See worker.h for details.
+*/
+
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "sched.h"
+#include "spsc.h"
+#include "worker.h"
+
+/******************************************************************************/
+
+/* Function declaration of the worker thread
+*/
+static void * worker_thread_fn(void * p_arg);
+
+/* Function declaration of the eventfd watcher, hands over all queued items
+*/
+static void worker_wake_fn(sched_fd_t * p_watch);
+
+/* Function declaration to hand over all queued items
+*/
+static void worker_drain(worker_t * p_worker);
+
+/******************************************************************************/
+
+uint8_t worker_start(worker_t * p_worker, const char * p_name, uint32_t elem_size,
+                     uint32_t capacity, worker_init_fn_t init_fn,
+                     worker_item_fn_t item_fn, worker_fini_fn_t fini_fn, void * p_arg)
+{
+    int ret_val;
+
+    memset(p_worker, 0, sizeof(worker_t));
+    p_worker->p_name = p_name;
+    p_worker->init_fn = init_fn;
+    p_worker->item_fn = item_fn;
+    p_worker->fini_fn = fini_fn;
+    p_worker->p_arg = p_arg;
+    atomic_init(&p_worker->stop, 0);
+
+    p_worker->p_item = malloc(elem_size);
+    if (NULL == p_worker->p_item)
+    {
+        printf("malloc() failed to allocate.\n");
+        return FAIL;
+    }
+
+    if (SUCCESS != spsc_init(&p_worker->ring, elem_size, capacity))
+    {
+        free(p_worker->p_item);
+        return FAIL;
+    }
+
+    p_worker->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (p_worker->event_fd < 0)
+    {
+        printf("eventfd() failed (%s).\n", strerror(errno));
+        spsc_free(&p_worker->ring);
+        free(p_worker->p_item);
+        return FAIL;
+    }
+
+    sem_init(&p_worker->started, 0, 0);
+
+    ret_val = pthread_create(&p_worker->thread, NULL, worker_thread_fn, p_worker);
+    if (0 != ret_val)
+    {
+        printf("pthread_create() failed (%s).\n", strerror(ret_val));
+        sem_destroy(&p_worker->started);
+        close(p_worker->event_fd);
+        spsc_free(&p_worker->ring);
+        free(p_worker->p_item);
+        return FAIL;
+    }
+
+    while ((0 != sem_wait(&p_worker->started)) && (EINTR == errno))
+    {
+    }
+    sem_destroy(&p_worker->started);
+
+    if (!p_worker->is_init_ok)
+    {
+        printf("%s thread failed to start.\n", p_name);
+        pthread_join(p_worker->thread, NULL);
+        close(p_worker->event_fd);
+        spsc_free(&p_worker->ring);
+        free(p_worker->p_item);
+        return FAIL;
+    }
+
+    return SUCCESS;
+}
+
+uint8_t worker_submit(worker_t * p_worker, const void * p_item)
+{
+    uint64_t one = 1;
+
+    if (SUCCESS != spsc_push(&p_worker->ring, p_item))
+    {
+        p_worker->dropped++;
+        return FAIL;
+    }
+
+    // Counter of the eventfd only saturates, a failed write is harmless
+    if (sizeof(one) != write(p_worker->event_fd, &one, sizeof(one)))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("%s wake-up not sent.\n", p_worker->p_name);
+        #endif
+    }
+
+    return SUCCESS;
+}
+
+void worker_stop(worker_t * p_worker)
+{
+    uint64_t one = 1;
+
+    atomic_store(&p_worker->stop, 1);
+    if (sizeof(one) != write(p_worker->event_fd, &one, sizeof(one)))
+    {
+        printf("%s stop not sent.\n", p_worker->p_name);
+    }
+
+    pthread_join(p_worker->thread, NULL);
+
+    close(p_worker->event_fd);
+    spsc_free(&p_worker->ring);
+    free(p_worker->p_item);
+
+    if (p_worker->dropped)
+    {
+        printf("%s dropped %u item(s).\n", p_worker->p_name, p_worker->dropped);
+    }
+}
+
+/******************************************************************************/
+
+static void * worker_thread_fn(void * p_arg)
+{
+    worker_t *p_worker = (worker_t *)p_arg;
+
+    sched_init();
+
+    p_worker->is_init_ok = (SUCCESS == sched_watch(&p_worker->watch, p_worker->event_fd,
+                                                            worker_wake_fn, p_worker));
+    if (p_worker->is_init_ok && (NULL != p_worker->init_fn))
+    {
+        p_worker->is_init_ok = (SUCCESS == p_worker->init_fn(p_worker));
+    }
+    sem_post(&p_worker->started);
+
+    if (!p_worker->is_init_ok)
+    {
+        return NULL;
+    }
+
+    while (!atomic_load(&p_worker->stop))
+    {
+        if (sched_run() < 0)
+        {
+            break;
+        }
+    }
+
+    // Producer has stopped before, whatever is queued now is the rest
+    worker_drain(p_worker);
+    sched_unwatch(&p_worker->watch);
+
+    if (NULL != p_worker->fini_fn)
+    {
+        p_worker->fini_fn(p_worker);
+    }
+
+    return NULL;
+}
+
+static void worker_wake_fn(sched_fd_t * p_watch)
+{
+    worker_t *p_worker = (worker_t *)p_watch->p_arg;
+    uint64_t  count;
+
+    // Reading resets the counter, items pushed later wake the worker again
+    if (sizeof(count) != read(p_worker->event_fd, &count, sizeof(count)))
+    {
+        #if defined(RUN_TIME_LOG)
+            printf("%s woken without event.\n", p_worker->p_name);
+        #endif
+    }
+
+    worker_drain(p_worker);
+}
+
+static void worker_drain(worker_t * p_worker)
+{
+    while (SUCCESS == spsc_pop(&p_worker->ring, p_worker->p_item))
+    {
+        p_worker->item_fn(p_worker, p_worker->p_item);
+    }
+}
@@ -0,0 +1,98 @@
+/******************************************************************************/
+
+/* File - worker.h
+*
+*  Target Hardware: SIEMENS IoT2020
+*
+*  Consumer thread fed by a lock-free SPSC ring. Every worker runs its own
+*  scheduler (see sched.h, its state is per thread), so it can have tasks
+*  and watched descriptors of its own, e.g. retry timers or sockets. Items
+*  submitted by the producer wake the worker through an eventfd watched by
+*  that scheduler and are handed to the item function one by one.
+*
+*  On worker_stop() the worker leaves its scheduler loop, hands over the
+*  items still queued and calls the finish function, i.e. nothing submitted
+*  before worker_stop() is lost.
+*/
+
+/******************************************************************************/
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "sched.h"
+#include "spsc.h"
+
+/******************************************************************************/
+
+typedef struct worker worker_t;
+
+/* Start function, runs on the worker thread before the first item. May start
+*  tasks and watchers on the scheduler of the worker.
+*/
+typedef uint8_t (*worker_init_fn_t)(worker_t * p_worker);
+
+/* Item function, runs on the worker thread for every item in order
+*/
+typedef void (*worker_item_fn_t)(worker_t * p_worker, const void * p_item);
+
+/* Finish function, runs on the worker thread after the last item
+*/
+typedef void (*worker_fini_fn_t)(worker_t * p_worker);
+
+struct worker
+{
+    const char       *p_name;
+    pthread_t         thread;
+    spsc_ring_t       ring;
+    int               event_fd;
+    sched_fd_t        watch;
+    atomic_uint       stop;
+    uint32_t          dropped;                  // Items lost, ring was full
+    worker_init_fn_t  init_fn;
+    worker_item_fn_t  item_fn;
+    worker_fini_fn_t  fini_fn;
+    void             *p_arg;
+    void             *p_item;                   // Item popped off the ring
+    sem_t             started;
+    uint8_t           is_init_ok;
+};
+
+/******************************************************************************/
+
+/* Function declaration to start a worker thread, returns once its start
+*  function returned
+*  @param[in] p_worker  - Worker object
+*  @param[in] p_name    - Name used in messages
+*  @param[in] elem_size - Size of an item in bytes
+*  @param[in] capacity  - Items queued at most
+*  @param[in] init_fn   - Start function, may be NULL
+*  @param[in] item_fn   - Item function
+*  @param[in] fini_fn   - Finish function, may be NULL
+*  @param[in] p_arg     - User argument, available as p_worker->p_arg
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) also if the start function failed )
+*/
+uint8_t worker_start(worker_t * p_worker, const char * p_name, uint32_t elem_size,
+                     uint32_t capacity, worker_init_fn_t init_fn,
+                     worker_item_fn_t item_fn, worker_fini_fn_t fini_fn, void * p_arg);
+
+/* Function declaration to queue an item, producer side only. Does not block.
+*  @param[in] p_worker - Worker object
+*  @param[in] p_item   - Item, copied into the ring
+*  @return - uint8_t ( SUCCESS(1), FAIL(0) if the ring is full )
+*/
+uint8_t worker_submit(worker_t * p_worker, const void * p_item);
+
+/* Function declaration to stop a worker, waits until all queued items are
+*  handled and the finish function returned
+*  @param[in] p_worker - Worker object
+*  @return - None
+*/
+void worker_stop(worker_t * p_worker);
+
+#endif /* WORKER_H */
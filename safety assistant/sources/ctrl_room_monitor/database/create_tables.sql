@@ -6,6 +6,26 @@ fl_name CHAR(32)                  NOT NULL,
 u_role  CHAR(32)                  NOT NULL,
 time    timestamp  default (strftime('%s', 'now'))
 );
+CREATE TABLE alarm_rules (
+sl         INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id     INTEGER                   NOT NULL,
+kind       CHAR(8)                   NOT NULL,
+threshold  REAL                      NOT NULL,
+hysteresis REAL                      NOT NULL DEFAULT 0,
+debounce   INTEGER                   NOT NULL DEFAULT 1,
+window_s   INTEGER                   NOT NULL DEFAULT 60,
+enabled    INTEGER                   NOT NULL DEFAULT 1,
+name       CHAR(32)
+);
+CREATE TABLE alarms (
+sl        INTEGER    PRIMARY KEY    AUTOINCREMENT,
+rule_id   INTEGER                   NOT NULL,
+sen_id    INTEGER                   NOT NULL,
+state     INTEGER                   NOT NULL,
+value     REAL                      NOT NULL,
+threshold REAL                      NOT NULL,
+time      timestamp  default (strftime('%s', 'now'))
+);
 CREATE TABLE loads (
 sl          INTEGER    PRIMARY KEY    AUTOINCREMENT,
 load_type   INTEGER                   NOT NULL,
@@ -18,6 +38,60 @@ sen_id  INTEGER                   NOT NULL,
 sen_val REAL                      NOT NULL,
 time    timestamp  default (strftime('%s', 'now'))
 );
+CREATE TABLE sensor_data_1m (
+sl        INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id    INTEGER                   NOT NULL,
+bucket    INTEGER                   NOT NULL,
+val_min   REAL                      NOT NULL,
+val_max   REAL                      NOT NULL,
+val_sum   REAL                      NOT NULL,
+val_count INTEGER                   NOT NULL,
+UNIQUE (sen_id, bucket)
+);
+CREATE TABLE sensor_data_1h (
+sl        INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id    INTEGER                   NOT NULL,
+bucket    INTEGER                   NOT NULL,
+val_min   REAL                      NOT NULL,
+val_max   REAL                      NOT NULL,
+val_sum   REAL                      NOT NULL,
+val_count INTEGER                   NOT NULL,
+UNIQUE (sen_id, bucket)
+);
+CREATE TABLE sensor_data_1d (
+sl        INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id    INTEGER                   NOT NULL,
+bucket    INTEGER                   NOT NULL,
+val_min   REAL                      NOT NULL,
+val_max   REAL                      NOT NULL,
+val_sum   REAL                      NOT NULL,
+val_count INTEGER                   NOT NULL,
+UNIQUE (sen_id, bucket)
+);
+CREATE TABLE sensor_health (
+sl        INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id    INTEGER                   NOT NULL,
+time      INTEGER                   NOT NULL,
+count     INTEGER                   NOT NULL,
+mean      REAL                      NOT NULL,
+stddev    REAL                      NOT NULL,
+win_min   REAL                      NOT NULL,
+win_max   REAL                      NOT NULL,
+p50       REAL                      NOT NULL,
+p95       REAL                      NOT NULL,
+p99       REAL                      NOT NULL,
+baseline  REAL,
+cusum_pos REAL                      NOT NULL,
+cusum_neg REAL                      NOT NULL,
+drift     INTEGER                   NOT NULL
+);
+CREATE TABLE sensors (
+sl       INTEGER    PRIMARY KEY    AUTOINCREMENT,
+sen_id   INTEGER                   NOT NULL UNIQUE,
+rom_code CHAR(16)                  NOT NULL UNIQUE,
+sen_type INTEGER                   NOT NULL,
+time    timestamp  default (strftime('%s', 'now'))
+);
 CREATE TABLE users (
 sl      INTEGER    PRIMARY KEY    AUTOINCREMENT,
 u_name  CHAR(32)                  NOT NULL,
@@ -26,4 +100,15 @@ fl_name CHAR(32)                  NOT NULL,
 u_role  CHAR(32)                  NOT NULL,
 time    timestamp  default (strftime('%s', 'now'))
 );
+CREATE INDEX sensor_data_latest ON sensor_data (sen_id, sl DESC, sen_val);
+CREATE INDEX sensor_data_range ON sensor_data (sen_id, time, sen_val);
+CREATE INDEX loads_latest ON loads (load_type, sl DESC, load_status);
+CREATE INDEX users_login ON users (u_name);
+-- Limits of the dashboard flow: temperature band 24.5 .. 27.5, dust 0.6.
+-- Sensor IDs 1, 2 are the DS18B20 found first, 3 the dust sensor.
+INSERT INTO alarm_rules (sen_id, kind, threshold, hysteresis, debounce, name) VALUES (1, 'high', 27.5, 3.0, 2, 'temp1_high');
+INSERT INTO alarm_rules (sen_id, kind, threshold, hysteresis, debounce, name) VALUES (2, 'high', 27.5, 3.0, 2, 'temp2_high');
+INSERT INTO alarm_rules (sen_id, kind, threshold, window_s, name) VALUES (1, 'rise', 2.0, 60, 'temp1_rise');
+INSERT INTO alarm_rules (sen_id, kind, threshold, window_s, name) VALUES (2, 'rise', 2.0, 60, 'temp2_rise');
+INSERT INTO alarm_rules (sen_id, kind, threshold, hysteresis, debounce, name) VALUES (3, 'high', 0.6, 0.1, 3, 'dust_high');
 COMMIT;